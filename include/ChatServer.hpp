@@ -19,6 +19,8 @@ extern "C" {
     #include "protocol.h"
 }
 
+#include "Frame.hpp"
+
 namespace chat {
 
 /**
@@ -0,0 +1,409 @@
+/**
+ * @file Frame.hpp
+ * @brief Compile-time frame schemas for the chat protocol
+ *
+ * Each frame layout from protocol.h is described once as a Schema: the
+ * message type followed by a list of field kinds. Encoders and read-only
+ * FrameView accessors are generated from that description, so C++ code
+ * never computes offsets by hand. Parsing is bounds-checked and allocation
+ * free: string fields are std::string_view into the caller's buffer.
+ */
+
+#ifndef CHAT_FRAME_HPP
+#define CHAT_FRAME_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+    #include "common.h"
+    #include "protocol.h"
+}
+
+namespace chat {
+namespace frame {
+
+/**
+ * @brief Single byte
+ */
+struct U8 {
+    using value_type = uint8_t;
+    static constexpr size_t min_size = 1;
+
+    static bool measure(const char *, size_t avail, size_t &len) {
+        len = 1;
+        return avail >= 1;
+    }
+    static value_type read(const char *p, size_t) {
+        return static_cast<uint8_t>(p[0]);
+    }
+    static bool valid(value_type) {
+        return true;
+    }
+    static size_t size(value_type) {
+        return 1;
+    }
+    static void write(char *p, value_type v) {
+        p[0] = static_cast<char>(v);
+    }
+};
+
+/**
+ * @brief Fixed-width integer copied as-is (addresses and ports already in
+ *        network order)
+ */
+template <class T>
+struct Raw {
+    using value_type = T;
+    static constexpr size_t min_size = sizeof(T);
+
+    static bool measure(const char *, size_t avail, size_t &len) {
+        len = sizeof(T);
+        return avail >= sizeof(T);
+    }
+    static value_type read(const char *p, size_t) {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        return v;
+    }
+    static bool valid(value_type) {
+        return true;
+    }
+    static size_t size(value_type) {
+        return sizeof(T);
+    }
+    static void write(char *p, value_type v) {
+        std::memcpy(p, &v, sizeof(T));
+    }
+};
+
+/**
+ * @brief 32-bit integer in network byte order, host order in the view
+ */
+struct Net32 {
+    using value_type = uint32_t;
+    static constexpr size_t min_size = 4;
+
+    static bool measure(const char *, size_t avail, size_t &len) {
+        len = 4;
+        return avail >= 4;
+    }
+    static value_type read(const char *p, size_t) {
+        const auto *b = reinterpret_cast<const uint8_t *>(p);
+        return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+    }
+    static bool valid(value_type) {
+        return true;
+    }
+    static size_t size(value_type) {
+        return 4;
+    }
+    static void write(char *p, value_type v) {
+        p[0] = static_cast<char>(v >> 24);
+        p[1] = static_cast<char>(v >> 16);
+        p[2] = static_cast<char>(v >> 8);
+        p[3] = static_cast<char>(v);
+    }
+};
+
+/**
+ * @brief Fixed-width lowercase hex number, used where a value must never
+ *        contain the '\n' terminator
+ */
+template <size_t Digits>
+struct Hex {
+    static_assert(Digits > 0 && Digits <= 16, "at most 64 bits");
+    using value_type = uint64_t;
+    static constexpr size_t min_size = Digits;
+
+    static bool measure(const char *p, size_t avail, size_t &len) {
+        len = Digits;
+        uint64_t unused;
+        return avail >= Digits && hex_to_u64(p, Digits, &unused) == 0;
+    }
+    static value_type read(const char *p, size_t) {
+        uint64_t v = 0;
+        hex_to_u64(p, Digits, &v);
+        return v;
+    }
+    static bool valid(value_type v) {
+        return Digits == 16 || v >> (4 * (Digits % 16)) == 0;
+    }
+    static size_t size(value_type) {
+        return Digits;
+    }
+    static void write(char *p, value_type v) {
+        static constexpr char digits[] = "0123456789abcdef";
+        for (size_t i = 0; i < Digits; i++) {
+            p[Digits - 1 - i] = digits[v & 0xf];
+            v >>= 4;
+        }
+    }
+};
+
+/**
+ * @brief String prefixed by a one-byte length
+ */
+struct Str8 {
+    using value_type = std::string_view;
+    static constexpr size_t min_size = 1;
+
+    static bool measure(const char *p, size_t avail, size_t &len) {
+        if (avail < 1) {
+            return false;
+        }
+        len = 1 + static_cast<uint8_t>(p[0]);
+        return avail >= len;
+    }
+    static value_type read(const char *p, size_t len) {
+        return value_type(p + 1, len - 1);
+    }
+    static bool valid(value_type v) {
+        return v.size() <= 255;
+    }
+    static size_t size(value_type v) {
+        return 1 + v.size();
+    }
+    static void write(char *p, value_type v) {
+        p[0] = static_cast<char>(v.size());
+        std::memcpy(p + 1, v.data(), v.size());
+    }
+};
+
+/**
+ * @brief Everything up to the terminating '\n'; only valid as the last field
+ */
+struct Text {
+    using value_type = std::string_view;
+    static constexpr size_t min_size = 0;
+
+    static bool measure(const char *, size_t avail, size_t &len) {
+        len = avail;
+        return true;
+    }
+    static value_type read(const char *p, size_t len) {
+        return value_type(p, len);
+    }
+    static bool valid(value_type v) {
+        /* An embedded newline would end the frame early */
+        return std::memchr(v.data(), '\n', v.size()) == nullptr;
+    }
+    static size_t size(value_type v) {
+        return v.size();
+    }
+    static void write(char *p, value_type v) {
+        std::memcpy(p, v.data(), v.size());
+    }
+};
+
+/**
+ * @brief Layout of one frame: [Type][Fields...]\n
+ */
+template <uint8_t Type, class... Fields>
+struct Schema {
+    static constexpr uint8_t type = Type;
+    static constexpr size_t num_fields = sizeof...(Fields);
+    static constexpr size_t min_size = 1 + (Fields::min_size + ... + 0) + 1;
+
+    template <size_t I>
+    using field = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+private:
+    static constexpr bool text_last() {
+        bool is_text[] = {std::is_same_v<Fields, Text>..., false};
+        for (size_t i = 0; i + 1 < num_fields; i++) {
+            if (is_text[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(text_last(), "Text must be the last field of a frame");
+};
+
+/**
+ * @brief Non-owning, bounds-checked view of one received frame
+ *
+ * The viewed buffer must outlive the view.
+ */
+template <class S>
+class FrameView {
+public:
+    /**
+     * @brief Validate a complete frame, including its trailing '\n'
+     * @return The view, or std::nullopt if the frame does not match S
+     */
+    static std::optional<FrameView> parse(std::string_view frame) {
+        if (frame.size() < S::min_size || static_cast<uint8_t>(frame.front()) != S::type ||
+            frame.back() != '\n') {
+            return std::nullopt;
+        }
+
+        FrameView view(frame);
+        size_t pos = 1;
+        size_t end = frame.size() - 1;
+        if (!view.measureFields(pos, end, std::make_index_sequence<S::num_fields>{}) ||
+            pos != end) {
+            return std::nullopt;
+        }
+        return view;
+    }
+
+    /**
+     * @brief Value of field I
+     */
+    template <size_t I>
+    typename S::template field<I>::value_type get() const {
+        return S::template field<I>::read(frame_.data() + offsets_[I],
+                                          offsets_[I + 1] - offsets_[I]);
+    }
+
+    /**
+     * @brief Whole frame, including type byte and terminator
+     */
+    std::string_view bytes() const {
+        return frame_;
+    }
+
+private:
+    explicit FrameView(std::string_view frame) : frame_(frame), offsets_{} {}
+
+    template <size_t... I>
+    bool measureFields(size_t &pos, size_t end, std::index_sequence<I...>) {
+        return (measureField<I>(pos, end) && ...);
+    }
+
+    template <size_t I>
+    bool measureField(size_t &pos, size_t end) {
+        size_t len = 0;
+        offsets_[I] = pos;
+        if (!S::template field<I>::measure(frame_.data() + pos, end - pos, len)) {
+            return false;
+        }
+        pos += len;
+        offsets_[I + 1] = pos;
+        return true;
+    }
+
+    std::string_view frame_;
+    std::array<size_t, S::num_fields + 1> offsets_;
+};
+
+namespace detail {
+
+template <class S, size_t... I>
+auto typedValues(std::index_sequence<I...>,
+                 const typename S::template field<I>::value_type &...values) {
+    return std::make_tuple(values...);
+}
+
+template <class S, size_t... I, class Tuple>
+bool validValues(std::index_sequence<I...>, const Tuple &values) {
+    return (S::template field<I>::valid(std::get<I>(values)) && ...);
+}
+
+template <class S, size_t... I, class Tuple>
+size_t encodedSize(std::index_sequence<I...>, const Tuple &values) {
+    return 1 + (S::template field<I>::size(std::get<I>(values)) + ... + 0) + 1;
+}
+
+template <class S, size_t... I, class Tuple>
+void writeFields(char *p, std::index_sequence<I...>, const Tuple &values) {
+    ((S::template field<I>::write(p, std::get<I>(values)),
+      p += S::template field<I>::size(std::get<I>(values))),
+     ...);
+    (void)p; /* Unused for frames without fields */
+}
+
+} // namespace detail
+
+/**
+ * @brief Encode a frame of schema S
+ * @param buf Output buffer
+ * @param cap Capacity of buf
+ * @param values One value per field, in schema order
+ * @return Frame length, or 0 if it does not fit or a value is invalid
+ */
+template <class S, class... Values>
+size_t encode(char *buf, size_t cap, const Values &...values) {
+    static_assert(sizeof...(Values) == S::num_fields, "one value per field");
+    using Seq = std::make_index_sequence<S::num_fields>;
+
+    auto typed = detail::typedValues<S>(Seq{}, values...);
+    if (!detail::validValues<S>(Seq{}, typed)) {
+        return 0;
+    }
+
+    size_t total = detail::encodedSize<S>(Seq{}, typed);
+    if (total > cap) {
+        return 0;
+    }
+
+    buf[0] = static_cast<char>(S::type);
+    detail::writeFields<S>(buf + 1, Seq{}, typed);
+    buf[total - 1] = '\n';
+    return total;
+}
+
+} // namespace frame
+
+/* Frame layouts (see protocol.h). Address and port stay in network order. */
+namespace frames {
+using namespace frame;
+
+using Chat = Schema<MSG_TYPE_CHAT, Raw<uint32_t>, Raw<uint16_t>, Str8, Text>;
+using Join = Schema<MSG_TYPE_JOIN, Raw<uint32_t>, Raw<uint16_t>, Str8>;
+using Disconnect = Schema<MSG_TYPE_DISCONNECT, Raw<uint32_t>, Raw<uint16_t>, Str8>;
+using SearchResult = Schema<MSG_TYPE_SEARCH_RESULT, Raw<uint32_t>, Raw<uint16_t>, Str8, Text>;
+using SearchEnd = Schema<MSG_TYPE_SEARCH_END, Net32>;
+using RegisterAck = Schema<MSG_TYPE_REGISTER_ACK, U8>;
+using ServerHello = Schema<MSG_TYPE_HELLO, U8, Net32>;
+using SessionAck = Schema<MSG_TYPE_SESSION_ACK, Hex<SESSION_ID_HEX_LEN>, U8>;
+using RelayRedirect = Schema<MSG_TYPE_RELAY_REDIRECT, Raw<uint32_t>, Raw<uint16_t>>;
+using MuteAck = Schema<MSG_TYPE_MUTE_ACK, U8>;
+using SubscribeAck = Schema<MSG_TYPE_SUBSCRIBE_ACK, U8>;
+using TopicChat = Schema<MSG_TYPE_TOPIC_CHAT, Raw<uint32_t>, Raw<uint16_t>, Str8, Str8, Text>;
+using Signal = Schema<MSG_TYPE_SIGNAL, Raw<uint32_t>, Raw<uint16_t>, Str8, U8>;
+using ChatSeq = Schema<MSG_TYPE_CHAT_SEQ, Raw<uint64_t>>;
+using ReactionCount = Schema<MSG_TYPE_REACTION_COUNT, Raw<uint64_t>, Net32, Str8>;
+using TransferInfo = Schema<MSG_TYPE_TRANSFER_INFO, Raw<uint16_t>>;
+using ChatFailed = Schema<MSG_TYPE_CHAT_FAILED, Hex<MSG_ID_HEX_LEN>>;
+using SessionFailed = Schema<MSG_TYPE_SESSION_FAILED, Hex<SESSION_ID_HEX_LEN>, Hex<MSG_ID_HEX_LEN>>;
+
+using Username = Schema<MSG_TYPE_USERNAME, Str8>;
+using ChatId = Schema<MSG_TYPE_CHAT_ID, Hex<MSG_ID_HEX_LEN>, Text>;
+using Search = Schema<MSG_TYPE_SEARCH, Text>;
+using ClientHello = Schema<MSG_TYPE_HELLO, U8, Hex<8>>;
+using Leave = Schema<MSG_TYPE_DISCONNECT>;
+using SessionOpen = Schema<MSG_TYPE_SESSION_OPEN, Hex<SESSION_ID_HEX_LEN>, Str8>;
+using SessionChat = Schema<MSG_TYPE_SESSION_CHAT, Hex<SESSION_ID_HEX_LEN>, Hex<MSG_ID_HEX_LEN>, Text>;
+using SessionClose = Schema<MSG_TYPE_SESSION_CLOSE, Hex<SESSION_ID_HEX_LEN>>;
+using RelayAttach = Schema<MSG_TYPE_RELAY_ATTACH, Hex<4>>;
+using Mute = Schema<MSG_TYPE_MUTE, U8, Str8>;
+using Subscribe = Schema<MSG_TYPE_SUBSCRIBE, U8, Str8>;
+using Publish = Schema<MSG_TYPE_PUBLISH, Str8, Text>;
+using SendSignal = Schema<MSG_TYPE_SIGNAL, U8>;
+using React = Schema<MSG_TYPE_REACT, U8, Hex<16>, Str8>;
+
+static_assert(ClientHello::min_size == HELLO_CLIENT_LEN);
+static_assert(ServerHello::min_size == HELLO_SERVER_LEN);
+static_assert(Join::min_size == PEER_FRAME_HEADER + 1);
+static_assert(RelayAttach::min_size == RELAY_ATTACH_LEN);
+static_assert(RelayRedirect::min_size == RELAY_REDIRECT_LEN);
+static_assert(ChatSeq::min_size == CHAT_SEQ_LEN);
+static_assert(React::min_size == REACT_HEADER + 1);
+static_assert(TransferInfo::min_size == TRANSFER_INFO_LEN);
+static_assert(ChatFailed::min_size == CHAT_FAILED_LEN);
+static_assert(SessionFailed::min_size == SESSION_FAILED_LEN);
+} // namespace frames
+
+} // namespace chat
+
+#endif // CHAT_FRAME_HPP
@@ -0,0 +1,105 @@
+/**
+ * @file admin.h
+ * @brief Plain-text HTTP admin endpoint
+ *
+ * Operators and scrapers fetch GET /metrics from the admin port and receive
+ * the server's counters in the Prometheus text format. The server renders
+ * the body through a callback when a request is complete; the response is
+ * written as the socket accepts it and the connection is then closed.
+ * Connections are few and short-lived, so they use a small fixed table; one
+ * that has not sent its whole request within ADMIN_TIMEOUT_MS, or whose
+ * response stops moving for that long, is closed so that idle connections
+ * cannot hold every slot.
+ */
+
+#ifndef ADMIN_H
+#define ADMIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Concurrent admin connections */
+#define ADMIN_MAX_CONNS 8
+
+/* Largest request accepted */
+#define ADMIN_MAX_REQUEST 2048
+
+/* Largest response body */
+#define ADMIN_MAX_RESPONSE 65536
+
+/* A connection is closed this long after it was accepted, or after its
+ * response last moved */
+#define ADMIN_TIMEOUT_MS 5000
+
+/* Path served with the metrics */
+#define ADMIN_METRICS_PATH "/metrics"
+
+/**
+ * @brief Render the metrics body
+ * @return Bytes written to out, or -1 if they do not fit in cap
+ */
+typedef int (*admin_render_fn)(char *out, size_t cap, void *arg);
+
+/**
+ * @brief One admin connection
+ */
+typedef struct {
+    int fd;                         /* -1 if the slot is free */
+    size_t request_len;
+    char request[ADMIN_MAX_REQUEST];
+    char *response;                 /* Response being written, or NULL */
+    size_t response_len;
+    size_t response_sent;
+    int64_t active_ms;              /* When accepted, then when the response last moved */
+} admin_conn_t;
+
+/**
+ * @brief Admin listener and its connections
+ */
+typedef struct {
+    int listen_fd;
+    admin_conn_t conns[ADMIN_MAX_CONNS];
+    admin_render_fn render;
+    void *arg;
+} admin_t;
+
+/**
+ * @brief Take over a listening socket
+ */
+void admin_init(admin_t *admin, int listen_fd, admin_render_fn render, void *arg);
+
+/**
+ * @brief Accept a connection; rejected if all slots are in use
+ */
+void admin_accept(admin_t *admin, int64_t now_ms);
+
+/**
+ * @brief Poll events to wait for on a connection: POLLIN until the request
+ *        is complete, then POLLOUT until the response is written
+ */
+short admin_poll_events(const admin_t *admin, int index);
+
+/**
+ * @brief Handle readiness of a connection
+ */
+void admin_handle_events(admin_t *admin, int index, short revents, int64_t now_ms);
+
+/**
+ * @brief Close connections that have not finished their request, or whose
+ *        response has not moved, within ADMIN_TIMEOUT_MS
+ */
+void admin_sweep(admin_t *admin, int64_t now_ms);
+
+/**
+ * @brief Find the path of a complete GET request
+ * @return 1 with *path and *path_len set, 0 if the headers are not complete
+ *         yet, -1 if the request is not a GET
+ */
+int admin_parse_request(const char *request, size_t len, const char **path, size_t *path_len);
+
+/**
+ * @brief Close every connection and the listener
+ */
+void admin_close(admin_t *admin);
+
+#endif /* ADMIN_H */
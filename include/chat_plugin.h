@@ -0,0 +1,88 @@
+/**
+ * @file chat_plugin.h
+ * @brief C ABI for server plugins
+ *
+ * A plugin is a shared object that defines
+ *
+ *     const chat_plugin_t chat_plugin = {CHAT_PLUGIN_ABI_VERSION, "name", ...};
+ *
+ * and is loaded with `server -P plugin.so[:arg]`. Its on_message hook runs on
+ * the event loop for every chat and topic message that passed validation,
+ * before the message is stored or broadcast. The message is passed as a view
+ * of the server's receive buffer, so nothing is copied; the hook must not
+ * keep the pointers after it returns. It answers with a verdict, and for
+ * CHAT_PLUGIN_REWRITE writes the replacement text into a buffer owned by the
+ * server.
+ *
+ * Hooks run inline and are timed against a per-call budget (-T). A plugin
+ * that overruns it too many times in a row is disabled.
+ */
+
+#ifndef CHAT_PLUGIN_H
+#define CHAT_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bumped whenever the structures below change incompatibly */
+#define CHAT_PLUGIN_ABI_VERSION 1
+
+/* Name of the chat_plugin_t a plugin exports */
+#define CHAT_PLUGIN_SYMBOL "chat_plugin"
+
+/**
+ * @brief What to do with a message
+ */
+typedef enum {
+    CHAT_PLUGIN_ACCEPT = 0,  /* Deliver unchanged */
+    CHAT_PLUGIN_DROP = 1,    /* Deliver to nobody */
+    CHAT_PLUGIN_REWRITE = 2  /* Deliver the text written to the rewrite buffer */
+} chat_plugin_verdict_t;
+
+/**
+ * @brief Read-only view of an inbound message
+ *
+ * Strings are not NUL-terminated.
+ */
+typedef struct {
+    const char *sender;
+    size_t sender_len;
+    const char *room;         /* Topic of a published message; empty for the main chat */
+    size_t room_len;
+    const char *payload;      /* Message text without the frame terminator */
+    size_t payload_len;
+    uint32_t sender_ip;       /* Network byte order */
+    uint16_t sender_port;     /* Network byte order */
+} chat_plugin_message_t;
+
+/**
+ * @brief Plugin descriptor
+ */
+typedef struct {
+    uint32_t abi_version;     /* CHAT_PLUGIN_ABI_VERSION */
+    const char *name;
+
+    /**
+     * @brief Optional: set up plugin state
+     * @param arg Text after ':' in the -P argument, or NULL
+     * @param state Receives the state passed to the other hooks
+     * @return 0 on success; anything else refuses the load
+     */
+    int (*init)(const char *arg, void **state);
+
+    /**
+     * @brief Judge one message
+     * @param rewrite Buffer for replacement text
+     * @param rewrite_len In: capacity of rewrite. Out, for CHAT_PLUGIN_REWRITE:
+     *        length of the replacement, which must be valid UTF-8 without '\n'
+     */
+    chat_plugin_verdict_t (*on_message)(void *state, const chat_plugin_message_t *msg,
+                                        char *rewrite, size_t *rewrite_len);
+
+    /**
+     * @brief Optional: release plugin state at shutdown
+     */
+    void (*fini)(void *state);
+} chat_plugin_t;
+
+#endif /* CHAT_PLUGIN_H */
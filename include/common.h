@@ -72,6 +72,22 @@ ssize_t send_exact(int sock, const uint8_t *buf, size_t len);
  */
 int bytes_to_hex(const uint8_t *buf, ssize_t buf_size, char *str, ssize_t str_size);
 
+/**
+ * @brief Parse a fixed-width hexadecimal string into an integer
+ * @param str Input characters (not necessarily NUL-terminated)
+ * @param len Number of characters to parse (at most 16)
+ * @param out Parsed value
+ * @return 0 on success, -1 on error
+ */
+int hex_to_u64(const char *str, size_t len, uint64_t *out);
+
+/**
+ * @brief Fill a value with random bytes from /dev/urandom
+ * @param out Output value
+ * @return 0 on success, -1 on error
+ */
+int random_u64(uint64_t *out);
+
 /**
  * @brief Set socket to non-blocking mode
  * @param fd Socket file descriptor
@@ -0,0 +1,90 @@
+/**
+ * @file compactor.h
+ * @brief Background retention and index rebuild for the history log
+ *
+ * A compactor thread periodically checkpoints the history log and applies
+ * the retention policy to it. Right after startup, and whenever segments
+ * are deleted, it rebuilds the search index from the log (with throttled
+ * reads, except for the first build), catches the new index up with what
+ * was delivered meanwhile, then hands it to the event loop, which only has
+ * to index the last few messages before swapping it in. Records not yet delivered (history_delivered_offset) are
+ * left out; the event loop indexes them once they are.
+ */
+
+#ifndef COMPACTOR_H
+#define COMPACTOR_H
+
+#include "history.h"
+#include "search_index.h"
+#include <pthread.h>
+
+/* Seconds between retention passes */
+#define COMPACT_INTERVAL_SEC 30
+
+/* Read throughput allowed for index rebuilds after the first */
+#define COMPACT_IO_BYTES_PER_SEC (8ULL * 1024 * 1024)
+
+/* The compactor catches a rebuilt index up until this much log is left */
+#define COMPACT_CATCH_UP_BYTES (64 * 1024)
+
+/**
+ * @brief Compactor thread state
+ */
+typedef struct {
+    history_t *history;
+    history_retention_t retention;
+    unsigned interval_sec;
+    uint64_t io_bytes_per_sec;
+    pthread_t thread;
+    pthread_mutex_t lock;          /* Held by the thread for a whole pass */
+    pthread_cond_t wake;
+    volatile int stopping;
+    int needs_rebuild;             /* Rebuild the index on the next pass */
+    int built;                     /* An index has been rebuilt since start */
+    search_index_t *ready_index;   /* Rebuilt index waiting to be installed */
+    uint64_t ready_end;            /* Log offset the rebuilt index covers */
+} compactor_t;
+
+/**
+ * @brief Callback that installs a rebuilt index on the event loop thread
+ * @param index Rebuilt index (ownership passes to the callee)
+ * @param indexed_end Log offset up to which index is complete
+ * @param arg User argument
+ */
+typedef void (*compactor_install_fn)(search_index_t *index, uint64_t indexed_end, void *arg);
+
+/**
+ * @brief Start the compactor thread
+ *
+ * The first pass runs immediately and builds the search index over the
+ * existing log.
+ *
+ * @param compactor Compactor to initialize
+ * @param history History log to compact
+ * @param retention Retention policy (both limits 0 to keep everything)
+ * @param interval_sec Seconds between passes
+ * @param io_bytes_per_sec Read throughput limit for index rebuilds after the
+ *                         first one
+ * @return 0 on success, -1 on error
+ */
+int compactor_start(compactor_t *compactor, history_t *history,
+                    const history_retention_t *retention, unsigned interval_sec,
+                    uint64_t io_bytes_per_sec);
+
+/**
+ * @brief Install a rebuilt index if one is ready
+ *
+ * Called from the event loop on every iteration. Never blocks: if a pass is
+ * running the call returns immediately. install runs while the compactor is
+ * paused, so it may safely scan the log.
+ *
+ * @return 1 if an index was installed, 0 otherwise
+ */
+int compactor_poll(compactor_t *compactor, compactor_install_fn install, void *arg);
+
+/**
+ * @brief Stop the compactor thread and free any index not yet installed
+ */
+void compactor_stop(compactor_t *compactor);
+
+#endif /* COMPACTOR_H */
@@ -0,0 +1,120 @@
+/**
+ * @file content_filter.h
+ * @brief Banned-term filter for chat messages
+ *
+ * The banned terms are compiled into an Aho-Corasick automaton, stored as a
+ * dense transition table over the byte classes that occur in the terms, so
+ * matching a message costs one table lookup per byte whatever the number of
+ * terms. Matching is ASCII case-insensitive and finds terms anywhere in the
+ * message. While the automaton is in its start state, bytes that cannot
+ * begin a term are skipped 16 at a time with SSSE3 where available.
+ *
+ * Reloading the term list compiles a new automaton on a background thread.
+ * The event loop swaps it in between messages, so filtering never waits for
+ * a reload and a list that fails to load leaves the current one in place.
+ */
+
+#ifndef CONTENT_FILTER_H
+#define CONTENT_FILTER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Set in a transition when the target state completes a term */
+#define AC_ACCEPT 0x80000000u
+
+/**
+ * @brief Compiled automaton
+ */
+typedef struct {
+    uint8_t classes[256];     /* Byte class of each byte; 0 for bytes in no term */
+    uint32_t num_classes;
+    uint32_t num_states;
+    uint32_t *delta;          /* [row + class] -> next row | AC_ACCEPT, where a
+                               * state's row is state * num_classes */
+    uint8_t starts[256];      /* Whether a byte leaves the start state */
+    uint8_t start_rows[2][16]; /* starts as nibble bit rows, for SSSE3 */
+    int prefilter;            /* 0 off, 1 scalar, 2 SSSE3 start-state skipping */
+    size_t num_terms;
+} ac_automaton_t;
+
+/**
+ * @brief Compile an automaton from a list of terms
+ * @param terms Terms; empty ones are ignored
+ * @param lens Length of each term
+ * @param num_terms Number of terms
+ * @return The automaton, or NULL on allocation failure or if the table
+ *         would need more than 2^31 entries
+ */
+ac_automaton_t *ac_build(const char *const *terms, const size_t *lens, size_t num_terms);
+
+/**
+ * @brief Compile an automaton from a file with one term per line
+ *
+ * Empty lines and lines starting with '#' are skipped.
+ *
+ * @return The automaton, or NULL if the file cannot be read
+ */
+ac_automaton_t *ac_load(const char *path);
+
+/**
+ * @brief Release an automaton
+ */
+void ac_free(ac_automaton_t *ac);
+
+/**
+ * @brief Whether any term occurs in a text
+ */
+int ac_match(const ac_automaton_t *ac, const char *text, size_t len);
+
+/**
+ * @brief Filter state shared with the rebuild thread
+ */
+typedef struct {
+    const char *path;
+    ac_automaton_t *active;   /* Used by the event loop only */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int stopping;
+    int reload_requested;
+    ac_automaton_t *ready;    /* Rebuilt automaton waiting to be swapped in */
+    uint64_t checked;
+    uint64_t blocked;
+} content_filter_t;
+
+/**
+ * @brief Load the term list and start the rebuild thread
+ * @return 0 on success, -1 if the list cannot be loaded or the thread fails
+ */
+int content_filter_start(content_filter_t *filter, const char *path);
+
+/**
+ * @brief Ask the rebuild thread to load the term list again
+ *
+ * Not async-signal-safe; call it from the event loop.
+ */
+void content_filter_reload(content_filter_t *filter);
+
+/**
+ * @brief Swap in a rebuilt automaton if one is ready
+ *
+ * Called from the event loop on every iteration. Never blocks.
+ *
+ * @return 1 if a new automaton was installed, 0 otherwise
+ */
+int content_filter_poll(content_filter_t *filter);
+
+/**
+ * @brief Check a message against the active automaton and count it
+ * @return 1 if the message contains a banned term, 0 otherwise
+ */
+int content_filter_check(content_filter_t *filter, const char *text, size_t len);
+
+/**
+ * @brief Stop the rebuild thread and free both automata
+ */
+void content_filter_stop(content_filter_t *filter);
+
+#endif /* CONTENT_FILTER_H */
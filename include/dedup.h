@@ -0,0 +1,84 @@
+/**
+ * @file dedup.h
+ * @brief Per-sender duplicate detection for client message IDs
+ *
+ * Clients that resend after a reconnect attach a message ID to every chat
+ * message. The server remembers the most recent IDs of each sender in a
+ * fixed-size ring of 32-bit fingerprints so a retried message is not
+ * broadcast twice. Memory use is bounded by the table capacity chosen at
+ * startup; the least recently active sender is evicted when it fills up.
+ */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of recent message IDs remembered per sender */
+#define DEDUP_WINDOW 64
+
+/* Number of table slots probed when looking up a sender */
+#define DEDUP_PROBE 8
+
+/**
+ * @brief Ring of recent message ID fingerprints for one sender
+ */
+typedef struct {
+    uint32_t fingerprints[DEDUP_WINDOW];
+    uint32_t next;     /* Slot that receives the next fingerprint */
+    uint32_t count;    /* Number of valid fingerprints */
+} dedup_ring_t;
+
+/**
+ * @brief Table slot binding a sender to its ring
+ */
+typedef struct {
+    uint64_t sender_hash;  /* Hash of the sender name, 0 if slot is free */
+    uint64_t last_used;    /* Table clock value of the last lookup */
+    dedup_ring_t ring;
+} dedup_entry_t;
+
+/**
+ * @brief Fixed-capacity table of per-sender rings
+ */
+typedef struct {
+    dedup_entry_t *entries;
+    size_t capacity;
+    uint64_t clock;
+} dedup_table_t;
+
+/**
+ * @brief Allocate a deduplication table
+ * @param table Table to initialize
+ * @param capacity Maximum number of senders tracked at once
+ * @return 0 on success, -1 on error
+ */
+int dedup_table_init(dedup_table_t *table, size_t capacity);
+
+/**
+ * @brief Release memory held by a deduplication table
+ */
+void dedup_table_free(dedup_table_t *table);
+
+/**
+ * @brief Check a message ID and remember it if it is new
+ * @param table Deduplication table
+ * @param sender Sender username (NUL-terminated)
+ * @param msg_id Client-assigned message ID
+ * @return 1 if the ID was seen recently for this sender, 0 otherwise
+ */
+int dedup_check(dedup_table_t *table, const char *sender, uint64_t msg_id);
+
+/**
+ * @brief Forget a message ID so that a retry of it is accepted again
+ *
+ * Used when a message that passed dedup_check could not be delivered.
+ *
+ * @param table Deduplication table
+ * @param sender Sender username (NUL-terminated)
+ * @param msg_id Client-assigned message ID
+ */
+void dedup_forget(dedup_table_t *table, const char *sender, uint64_t msg_id);
+
+#endif /* DEDUP_H */
@@ -0,0 +1,108 @@
+/**
+ * @file ephemeral.h
+ * @brief Coalescing of ephemeral signals (typing, presence)
+ *
+ * Signals describe a user's current state rather than an event, so only the
+ * latest one matters. Each sender keeps just that latest signal; signals
+ * arriving within one EPHEMERAL_INTERVAL_MS are announced once, at the next
+ * flush, and an unchanged signal is announced again only every
+ * EPHEMERAL_REFRESH_MS, however often the client repeats it.
+ *
+ * Signals never queue behind chat. A recipient whose socket still holds
+ * unsent data at a flush is skipped and only remembers which senders it is
+ * owed; once it has caught up it gets their latest signals, one each, and
+ * signals older than EPHEMERAL_TTL_MS are dropped. Newer signals replace
+ * stale ones instead of being appended.
+ */
+
+#ifndef EPHEMERAL_H
+#define EPHEMERAL_H
+
+#include "slotset.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Milliseconds between flushes: the coalescing window */
+#define EPHEMERAL_INTERVAL_MS 200
+
+/* An unchanged signal is announced again after this long */
+#define EPHEMERAL_REFRESH_MS 3000
+
+/* Signals older than this are not delivered; clients expire them too */
+#define EPHEMERAL_TTL_MS 6000
+
+/**
+ * @brief Signal state of one slot, as sender and as recipient
+ */
+typedef struct {
+    uint8_t kind;           /* Latest signal, 0 if none */
+    uint8_t sent_kind;      /* Signal last announced */
+    int64_t at_ms;          /* When kind was set */
+    int64_t sent_ms;        /* When sent_kind was announced */
+    slotset_t owed;         /* Senders whose latest signal this recipient missed */
+} ephemeral_slot_t;
+
+/**
+ * @brief Where a flush sends its signals
+ */
+typedef struct {
+    /* Recipients of a sender's signals */
+    const slotset_t *(*audience)(size_t sender, void *arg);
+    /* Whether a recipient still has data waiting to be sent */
+    int (*busy)(size_t recipient, void *arg);
+    /* Send a sender's signal to one recipient */
+    void (*deliver)(size_t recipient, size_t sender, uint8_t kind, void *arg);
+    void *arg;
+} ephemeral_sink_t;
+
+/**
+ * @brief Signals of all slots
+ */
+typedef struct {
+    ephemeral_slot_t *slots;
+    size_t num_slots;
+    slotset_t dirty;        /* Senders with a signal to announce */
+    slotset_t backlogged;   /* Recipients that are owed signals */
+    int64_t next_flush_ms;
+    uint64_t coalesced;     /* Signals absorbed without a frame of their own */
+    uint64_t deferred;      /* Deliveries held back from busy recipients */
+    uint64_t expired;       /* Held-back deliveries dropped as stale */
+} ephemeral_t;
+
+/**
+ * @brief Create empty state for num_slots slots
+ * @return 0 on success, -1 if out of memory
+ */
+int ephemeral_init(ephemeral_t *eph, size_t num_slots);
+
+/**
+ * @brief Record a sender's latest signal
+ * @return 1 if it will be announced at the next flush, 0 if it repeats
+ *         the signal announced last
+ */
+int ephemeral_set(ephemeral_t *eph, size_t sender, uint8_t kind, int64_t now_ms);
+
+/**
+ * @brief Announce pending signals and pay off caught-up recipients
+ *
+ * Does nothing before the flush is due.
+ */
+void ephemeral_flush(ephemeral_t *eph, int64_t now_ms, const ephemeral_sink_t *sink);
+
+/**
+ * @brief Milliseconds until the next flush is due
+ * @return -1 if nothing is waiting
+ */
+int64_t ephemeral_wait_ms(const ephemeral_t *eph, int64_t now_ms);
+
+/**
+ * @brief Drop everything about a slot whose connection closed
+ */
+void ephemeral_forget(ephemeral_t *eph, size_t slot);
+
+/**
+ * @brief Release all memory
+ */
+void ephemeral_free(ephemeral_t *eph);
+
+#endif /* EPHEMERAL_H */
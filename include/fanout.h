@@ -0,0 +1,86 @@
+/**
+ * @file fanout.h
+ * @brief Strategies for writing one broadcast to many sockets
+ *
+ * send:   the frame is copied from userspace into every recipient's socket
+ *         with send(), once per recipient.
+ * splice: the frame is written once into a pipe. For each recipient, tee()
+ *         duplicates the pipe's page references into a second pipe and
+ *         splice() moves them into the socket, so the bytes are not copied
+ *         through userspace again. Linux only.
+ *
+ * A broadcast is bracketed by fanout_begin() and fanout_end(). Anything the
+ * splice path cannot take (frames larger than the pipe, or a socket that
+ * only accepts part of a frame) falls back to send() for the remainder, so
+ * both strategies put the same bytes on the wire.
+ */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Pipe size requested for the splice strategy */
+#define FANOUT_PIPE_SIZE (1024 * 1024)
+
+typedef enum {
+    FANOUT_SEND = 0,
+    FANOUT_SPLICE
+} fanout_mode_t;
+
+/**
+ * @brief Broadcast fan-out state
+ */
+typedef struct {
+    fanout_mode_t mode;
+    int source[2];        /* Holds the frame being broadcast */
+    int copy[2];          /* Per-recipient duplicate, emptied into the socket */
+    int devnull;          /* Drains the source pipe at the end of a broadcast */
+    size_t capacity;      /* Bytes either pipe can hold */
+    size_t staged;        /* Bytes in the source pipe, 0 when falling back */
+    uint64_t spliced;     /* Recipients served entirely by splice() */
+    uint64_t fallbacks;   /* Recipients that needed send() */
+} fanout_t;
+
+/**
+ * @brief Parse a fan-out strategy name ("send" or "splice")
+ * @return 0 on success, -1 if the name is unknown
+ */
+int fanout_mode_parse(const char *name, fanout_mode_t *mode);
+
+/**
+ * @brief Name of a fan-out strategy
+ */
+const char *fanout_mode_name(fanout_mode_t mode);
+
+/**
+ * @brief Set up a strategy
+ * @return 0 on success, -1 on error (errno ENOSYS if splice is unavailable)
+ */
+int fanout_init(fanout_t *fanout, fanout_mode_t mode);
+
+/**
+ * @brief Release pipes
+ */
+void fanout_free(fanout_t *fanout);
+
+/**
+ * @brief Stage a broadcast before sending it to its recipients
+ */
+void fanout_begin(fanout_t *fanout, const uint8_t *data, size_t len);
+
+/**
+ * @brief Send the staged broadcast to one socket
+ * @param data The same bytes passed to fanout_begin()
+ * @return len on success, -1 on error
+ */
+ssize_t fanout_send(fanout_t *fanout, int fd, const uint8_t *data, size_t len);
+
+/**
+ * @brief Discard the staged broadcast
+ */
+void fanout_end(fanout_t *fanout);
+
+#endif /* FANOUT_H */
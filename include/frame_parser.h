@@ -0,0 +1,73 @@
+/**
+ * @file frame_parser.h
+ * @brief Push-style incremental frame parser
+ *
+ * Bytes are fed in chunks of any size, straight from whatever read them
+ * (blocking recv, a non-blocking read, or a completion-based ring), and
+ * each frame is handed to a callback as soon as its last byte arrives.
+ * Frames that lie entirely within a chunk are passed as pointers into that
+ * chunk; only a frame split across chunks is assembled in the parser's own
+ * buffer. State is kept between calls, so nothing is rescanned.
+ *
+ * Frame boundaries follow each type's layout rather than the first '\n',
+ * since addresses, ports and length bytes may contain that value.
+ */
+
+#ifndef FRAME_PARSER_H
+#define FRAME_PARSER_H
+
+#include "protocol.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest frame accepted in either direction */
+#define FRAME_MAX_LEN (BUF_SIZE + 16)
+
+/**
+ * @brief Which side's frames are being parsed
+ */
+typedef enum {
+    FRAME_TO_SERVER,   /* Frames sent by clients */
+    FRAME_TO_CLIENT    /* Frames sent by the server */
+} frame_direction_t;
+
+/**
+ * @brief Parser state
+ */
+typedef struct {
+    frame_direction_t direction;
+    uint8_t buf[FRAME_MAX_LEN];  /* Partial frame carried over between chunks */
+    size_t len;
+} frame_parser_t;
+
+/**
+ * @brief Called for every complete frame
+ * @param frame Frame bytes, from the type byte to the terminating '\n'
+ * @param len Length of frame
+ * @param arg User argument
+ * @return 0 to continue, non-zero to stop parsing
+ */
+typedef int (*frame_handler_fn)(const uint8_t *frame, size_t len, void *arg);
+
+/**
+ * @brief Initialize a parser
+ */
+void frame_parser_init(frame_parser_t *parser, frame_direction_t direction);
+
+/**
+ * @brief Feed a chunk of received bytes
+ *
+ * If the handler stops parsing, the rest of the chunk is discarded.
+ *
+ * @param parser Parser
+ * @param data Received bytes
+ * @param len Number of bytes
+ * @param handler Callback for complete frames
+ * @param arg Argument passed to handler
+ * @return 0 when the chunk was consumed, 1 if the handler stopped parsing,
+ *         -1 on a malformed or oversized frame
+ */
+int frame_parser_feed(frame_parser_t *parser, const uint8_t *data, size_t len,
+                      frame_handler_fn handler, void *arg);
+
+#endif /* FRAME_PARSER_H */
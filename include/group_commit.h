@@ -0,0 +1,106 @@
+/**
+ * @file group_commit.h
+ * @brief Durability modes for the history log
+ *
+ * none:         appends go to the page cache and are never synced explicitly.
+ * write-behind: a background thread syncs the log at a fixed interval;
+ *               messages are broadcast as soon as they are appended.
+ * sync:         messages are only broadcast once they are on stable storage.
+ *               The event loop collects everything that arrives within a
+ *               short window and asks the sync thread for a single
+ *               fdatasync covering the whole batch, so the cost is one sync
+ *               per batch rather than one per message.
+ *
+ * The sync thread reports completed syncs by writing to a pipe that the
+ * event loop polls alongside the client sockets.
+ */
+
+#ifndef GROUP_COMMIT_H
+#define GROUP_COMMIT_H
+
+#include "history.h"
+#include <pthread.h>
+
+/* How long the first message of a batch waits for others to join it */
+#define GROUP_COMMIT_WINDOW_MS 2
+
+/* A batch holding this many bytes of frames is committed without waiting */
+#define GROUP_COMMIT_MAX_BATCH (256 * 1024)
+
+/* Sync interval in write-behind mode */
+#define WRITE_BEHIND_INTERVAL_MS 1000
+
+typedef enum {
+    DURABILITY_NONE = 0,
+    DURABILITY_WRITE_BEHIND,
+    DURABILITY_SYNC
+} durability_mode_t;
+
+/**
+ * @brief Sync thread state
+ */
+typedef struct {
+    history_t *history;
+    durability_mode_t mode;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int stopping;
+    int requested;        /* The event loop is waiting for a sync */
+    int notify_fds[2];    /* Sync thread -> event loop */
+    int last_result;      /* Result of the last requested sync */
+    uint64_t syncs;       /* fdatasync rounds performed */
+} group_commit_t;
+
+/**
+ * @brief Parse a durability mode name ("none", "write-behind" or "sync")
+ * @return 0 on success, -1 if the name is unknown
+ */
+int durability_mode_parse(const char *name, durability_mode_t *mode);
+
+/**
+ * @brief Name of a durability mode
+ */
+const char *durability_mode_name(durability_mode_t mode);
+
+/**
+ * @brief Start the sync thread
+ *
+ * Nothing is started in DURABILITY_NONE mode.
+ *
+ * @param gc Group commit state to initialize
+ * @param history History log to sync
+ * @param mode Durability mode
+ * @return 0 on success, -1 on error
+ */
+int group_commit_start(group_commit_t *gc, history_t *history, durability_mode_t mode);
+
+/**
+ * @brief Ask for everything appended so far to be synced
+ *
+ * Completion is signalled through group_commit_fd(). Only one request may be
+ * outstanding at a time.
+ */
+void group_commit_request(group_commit_t *gc);
+
+/**
+ * @brief File descriptor that becomes readable when a requested sync is done
+ * @return Descriptor to poll, or -1 if no sync thread is running
+ */
+int group_commit_fd(const group_commit_t *gc);
+
+/**
+ * @brief Consume a completion notification
+ *
+ * Call once group_commit_fd() is readable.
+ *
+ * @return 0 if the requested sync succeeded, -1 if it failed
+ */
+int group_commit_complete(group_commit_t *gc);
+
+/**
+ * @brief Perform a final sync and stop the sync thread
+ */
+void group_commit_stop(group_commit_t *gc);
+
+#endif /* GROUP_COMMIT_H */
@@ -0,0 +1,255 @@
+/**
+ * @file history.h
+ * @brief Append-only on-disk chat history log
+ *
+ * Broadcast chat messages are appended to a log split into segment files.
+ * Each segment is named after the global log offset of its first byte, so
+ * a message is identified by a single 64-bit offset that stays valid for
+ * the lifetime of the log.
+ *
+ * Record format (host byte order):
+ * [record_len:4][seq:8][timestamp:8][ip:4][port:2][username_len:1][username][text]
+ * where record_len counts the bytes following the length field.
+ *
+ * Opening the log does not read it. When a segment is sealed its metadata
+ * (sequence range, newest timestamp) is written next to it (<base>.idx) and
+ * only read when retention needs it. The state of the segment being
+ * appended to, including a sparse sequence index that lets a rollback find
+ * the last record it keeps, is saved in a checkpoint file, so after a clean
+ * shutdown nothing is scanned at all and after a crash only the bytes
+ * written since the last checkpoint are.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "protocol.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Segments are rolled once they grow past this size */
+#define HISTORY_SEGMENT_BYTES (64ULL * 1024 * 1024)
+
+/* Fixed part of a record following the length field */
+#define HISTORY_RECORD_HEADER (8 + 8 + 4 + 2 + 1)
+
+/* One active segment index entry is kept for every this many records */
+#define HISTORY_INDEX_STRIDE 64
+
+/**
+ * @brief One message stored in the history log
+ */
+typedef struct {
+    uint64_t seq;                    /* Sequence number, starting at 1 */
+    int64_t timestamp;               /* Seconds since the epoch */
+    uint32_t ip;                     /* Sender IP (network order) */
+    uint16_t port;                   /* Sender port (network order) */
+    char username[MAX_USERNAME_LEN];
+    char text[MAX_MESSAGE_LEN];      /* Not NUL-terminated */
+    size_t text_len;
+} history_record_t;
+
+/**
+ * @brief Sequence index entry: where a given record starts in its segment
+ */
+typedef struct {
+    uint64_t seq;
+    uint64_t offset;  /* Relative to the segment base */
+} history_index_entry_t;
+
+/**
+ * @brief One segment file
+ */
+typedef struct {
+    uint64_t base;           /* Global offset of the first byte */
+    uint64_t size;           /* Bytes currently in the file */
+    int fd;
+    int meta_loaded;         /* Whether the fields below are valid */
+    uint64_t first_seq;      /* 0 if the segment is empty */
+    uint64_t last_seq;
+    int64_t max_timestamp;   /* Timestamp of the newest record */
+} history_segment_t;
+
+/**
+ * @brief Open history log
+ *
+ * The segment list is guarded by lock so a background compactor can drop
+ * expired segments while the event loop appends and reads.
+ */
+typedef struct {
+    char dir[PATH_MAX];
+    history_segment_t *segments;     /* Sorted by base offset; the last one is active */
+    size_t num_segments;
+    size_t cap_segments;
+    uint64_t next_seq;
+    uint64_t segment_bytes;          /* Roll size, HISTORY_SEGMENT_BYTES by default */
+    history_index_entry_t *active_entries; /* Sequence index of the active segment */
+    size_t num_active_entries;
+    size_t cap_active_entries;
+    uint64_t active_count;           /* Records in the active segment */
+    uint64_t synced_end;             /* Log offset known to be on stable storage */
+    int hold_delivery;               /* delivered_end only moves through history_deliver */
+    uint64_t delivered_end;          /* Records below this reached their recipients */
+    uint64_t rollbacks;              /* Calls to history_rollback that dropped records */
+    pthread_mutex_t lock;
+} history_t;
+
+/**
+ * @brief Retention policy applied by history_expire
+ */
+typedef struct {
+    int64_t max_age;       /* Seconds a message is kept, 0 for no limit */
+    uint64_t max_bytes;    /* Total log size, 0 for no limit */
+} history_retention_t;
+
+/**
+ * @brief Callback invoked for every record of a scanned range
+ * @param offset Global offset of the record
+ * @param rec Decoded record
+ * @param arg User argument
+ */
+typedef void (*history_scan_fn)(uint64_t offset, const history_record_t *rec, void *arg);
+
+/**
+ * @brief Open (or create) a history log directory
+ *
+ * Only the checkpoint and the tail of the active segment written after it
+ * are read; a torn record at the end is truncated away.
+ *
+ * @param history History log to initialize
+ * @param dir Directory holding the segment files
+ * @return 0 on success, -1 on error
+ */
+int history_open(history_t *history, const char *dir);
+
+/**
+ * @brief Append a record to the log
+ *
+ * The record's seq field is assigned by the log.
+ *
+ * @param history History log
+ * @param rec Record to append
+ * @param offset_out Global offset of the appended record (may be NULL)
+ * @return 0 on success, -1 on error
+ */
+int history_append(history_t *history, history_record_t *rec, uint64_t *offset_out);
+
+/**
+ * @brief Drop every record appended at or after offset
+ *
+ * Used when records could not be made durable and were never delivered.
+ * The sequence numbers of the dropped records are handed out again, and
+ * the checkpoint is rewritten so recovery never starts past the new end.
+ *
+ * @param history History log
+ * @param offset Offset returned by history_append
+ * @return 0 on success, -1 if offset is not in the segment being appended to
+ *         or the file could not be truncated
+ */
+int history_rollback(history_t *history, uint64_t offset);
+
+/**
+ * @brief Read the record stored at a global offset
+ * @param history History log
+ * @param offset Offset returned by history_append or a scan
+ * @param rec Decoded record
+ * @return 0 on success, -1 on error
+ */
+int history_read(history_t *history, uint64_t offset, history_record_t *rec);
+
+/**
+ * @brief Pass every record in a range of the log to a callback
+ *
+ * Reads happen without holding the log lock, so this may run on a
+ * background thread while messages are appended. Only one thread may call
+ * history_scan_range or history_expire at a time.
+ *
+ * @param history History log
+ * @param from First global offset to scan (rounded up to a segment start
+ *             if it falls inside a deleted segment)
+ * @param to End of the range (exclusive), typically history_end_offset()
+ * @param scan Callback for each record
+ * @param arg Argument passed to scan
+ * @param bytes_per_sec Read throughput limit, 0 for unlimited
+ * @return 0 on success, -1 on error
+ */
+int history_scan_range(history_t *history, uint64_t from, uint64_t to, history_scan_fn scan,
+                       void *arg, uint64_t bytes_per_sec);
+
+/**
+ * @brief Delete sealed segments that fall outside the retention policy
+ *
+ * The segment currently being appended to is never deleted.
+ *
+ * @param history History log
+ * @param retention Retention policy
+ * @param now Current time in seconds since the epoch
+ * @return Number of segments deleted, or -1 on error
+ */
+ssize_t history_expire(history_t *history, const history_retention_t *retention, int64_t now);
+
+/**
+ * @brief Flush everything appended so far to stable storage
+ *
+ * Issues one fdatasync per segment written since the previous call (almost
+ * always just the active one). The lock is not held while syncing, so this
+ * is meant to run on a background thread.
+ *
+ * @param history History log
+ * @param synced_out Log offset covered by the sync (may be NULL)
+ * @return 0 on success, -1 on error
+ */
+int history_sync(history_t *history, uint64_t *synced_out);
+
+/**
+ * @brief Persist the state of the active segment
+ *
+ * Called on segment roll, on close, and periodically by the compactor so a
+ * restart after a crash only rescans recent appends.
+ *
+ * @return 0 on success, -1 on error
+ */
+int history_checkpoint(history_t *history);
+
+/**
+ * @brief Stop treating appended records as delivered straight away
+ *
+ * In sync durability mode a record only reaches its recipients once its
+ * batch is synced, and a failed sync rolls it back. After this call,
+ * history_delivered_offset stays where history_deliver last put it, so the
+ * search index is never built from records that may still disappear.
+ *
+ * @param history History log (before any thread scans it)
+ */
+void history_hold_delivery(history_t *history);
+
+/**
+ * @brief Mark every record before offset as delivered
+ */
+void history_deliver(history_t *history, uint64_t offset);
+
+/**
+ * @brief Global offset up to which records were delivered and may be indexed
+ *
+ * The same as history_end_offset unless history_hold_delivery was called.
+ */
+uint64_t history_delivered_offset(history_t *history);
+
+/**
+ * @brief Global offset of the oldest byte still in the log
+ */
+uint64_t history_start_offset(history_t *history);
+
+/**
+ * @brief Global offset at which the next record will be appended
+ */
+uint64_t history_end_offset(history_t *history);
+
+/**
+ * @brief Write a checkpoint and close all segment files
+ */
+void history_close(history_t *history);
+
+#endif /* HISTORY_H */
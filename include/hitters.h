@@ -0,0 +1,95 @@
+/**
+ * @file hitters.h
+ * @brief Heavy-hitter detection with a count-min sketch and a top-K heap
+ *
+ * Counts are kept per key (a sender or a room) in fixed memory, however
+ * many distinct keys there are. A count-min sketch of HITTERS_DEPTH rows of
+ * HITTERS_WIDTH counters estimates each key's weight; estimates never fall
+ * below the true weight and, with conservative updates, rarely exceed it by
+ * much. The HITTERS_TOP_K keys with the highest estimates are kept in a
+ * min-heap, so a new key enters it by beating the smallest entry.
+ *
+ * Halving every counter from time to time makes the counts an exponentially
+ * decaying sum, so a bot that starts flooding rises to the top within a few
+ * periods and old traffic fades out.
+ */
+
+#ifndef HITTERS_H
+#define HITTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sketch rows; each row is indexed by a different hash of the key */
+#define HITTERS_DEPTH 4
+
+/* Counters per row, a power of two */
+#define HITTERS_WIDTH 2048
+
+/* Keys tracked in the top-K heap */
+#define HITTERS_TOP_K 10
+
+/* Longest key stored in the heap; longer keys are truncated */
+#define HITTERS_MAX_KEY 255
+
+/* Seconds between halvings, the half-life of old traffic */
+#define HITTERS_HALF_LIFE_SEC 60
+
+/**
+ * @brief A top-K entry
+ */
+typedef struct {
+    uint64_t estimate;
+    uint8_t key_len;
+    char key[HITTERS_MAX_KEY];
+} hitter_t;
+
+/**
+ * @brief Sketch and heap
+ */
+typedef struct {
+    uint32_t counters[HITTERS_DEPTH][HITTERS_WIDTH];
+    hitter_t top[HITTERS_TOP_K];  /* Min-heap on estimate */
+    int num_top;
+    uint64_t total;               /* Decayed sum of all weights */
+} hitters_t;
+
+/**
+ * @brief Reset to no counts
+ */
+void hitters_init(hitters_t *hitters);
+
+/**
+ * @brief Add weight to a key
+ * @return The key's new estimate
+ */
+uint64_t hitters_add(hitters_t *hitters, const char *key, size_t key_len, uint32_t weight);
+
+/**
+ * @brief Estimated weight of a key
+ */
+uint64_t hitters_estimate(const hitters_t *hitters, const char *key, size_t key_len);
+
+/**
+ * @brief Halve every count
+ */
+void hitters_decay(hitters_t *hitters);
+
+/**
+ * @brief Copy the top-K entries, heaviest first
+ * @return Number of entries written, at most HITTERS_TOP_K
+ */
+int hitters_top(const hitters_t *hitters, hitter_t *out);
+
+/**
+ * @brief Append the top-K entries as Prometheus text
+ *
+ * Writes one line per entry, metric{rank="1",label="key"} estimate, with
+ * the key escaped as a label value.
+ *
+ * @return Bytes written, or -1 if they do not fit
+ */
+int hitters_render(const hitters_t *hitters, const char *metric, const char *label, char *out,
+                   size_t cap);
+
+#endif /* HITTERS_H */
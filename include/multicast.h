@@ -0,0 +1,150 @@
+/**
+ * @file multicast.h
+ * @brief Sequenced UDP multicast of broadcasts with NAK-based repair
+ *
+ * The server can publish every broadcast once to a multicast group instead
+ * of writing it to each read-only subscriber. A packet is an 8-byte
+ * sequence number (network order) followed by whole server-to-client
+ * frames. Subscribers keep their TCP connection only to ask for packets
+ * they missed (NAK) and receive them back over it (REPAIR), so the server
+ * keeps the most recent packets in a ring. When idle, the publisher sends a
+ * header-only heartbeat carrying the next sequence number so that the loss
+ * of the last packet is noticed too.
+ */
+
+#ifndef MULTICAST_H
+#define MULTICAST_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sequence number in front of every packet */
+#define MCAST_HEADER_LEN 8
+
+/* Largest packet, so one fits an Ethernet MTU after IP and UDP headers */
+#define MCAST_MAX_PACKET 1400
+
+/* Packets kept by the publisher for repairs */
+#define MCAST_RING_PACKETS 4096
+
+/* Packets a subscriber holds while waiting for a gap to be repaired */
+#define MCAST_HOLD_PACKETS 512
+
+/* Packets requested by one NAK at most */
+#define MCAST_MAX_NAK 256
+
+/* Idle time after which the publisher sends a heartbeat */
+#define MCAST_HEARTBEAT_MS 1000
+
+/* Time before an unanswered NAK is sent again */
+#define MCAST_NAK_RETRY_MS 200
+
+/**
+ * @brief Sending side, owned by the server
+ */
+typedef struct {
+    int fd;
+    struct sockaddr_in group;
+    uint64_t next_seq;          /* Sequence number of the next packet (from 1) */
+    uint8_t *ring;              /* MCAST_RING_PACKETS slots of MCAST_MAX_PACKET */
+    uint16_t *ring_len;         /* Packet length per slot */
+    size_t packet_len;          /* Bytes in the packet being filled */
+    int64_t last_send_ms;       /* For heartbeats */
+} mcast_publisher_t;
+
+/**
+ * @brief Receiving side, owned by a subscriber
+ */
+typedef struct {
+    int fd;                     /* UDP socket joined to the group */
+    uint64_t next_seq;          /* Next packet to deliver */
+    uint64_t horizon;           /* One past the highest sequence number known */
+    uint8_t *held;              /* MCAST_HOLD_PACKETS packets waiting behind a gap */
+    uint16_t *held_len;         /* 0 if the slot is empty */
+    uint64_t *held_seq;
+    uint64_t nak_end;           /* One past the last packet requested */
+    int64_t nak_ms;             /* When the last NAK was sent */
+    unsigned drop_every;        /* Testing: discard every Nth datagram (0 = none) */
+    unsigned received;          /* Datagrams read, for drop_every */
+} mcast_subscriber_t;
+
+/**
+ * @brief Callback receiving the frames of one packet, in sequence order
+ * @return 0 to continue, non-zero to stop
+ */
+typedef int (*mcast_deliver_fn)(const uint8_t *frames, size_t len, void *arg);
+
+/**
+ * @brief Open a publisher sending to a group
+ * @param iface Address of the interface to send on, or INADDR_ANY
+ * @return 0 on success, -1 on error
+ */
+int mcast_publisher_open(mcast_publisher_t *pub, const struct sockaddr_in *group,
+                         struct in_addr iface);
+
+/**
+ * @brief Close the publisher and free its ring
+ */
+void mcast_publisher_close(mcast_publisher_t *pub);
+
+/**
+ * @brief Publish complete frames, packing as many whole frames per packet as fit
+ * @return 0 on success, -1 if a frame is malformed
+ */
+int mcast_publish(mcast_publisher_t *pub, const uint8_t *frames, size_t len, int64_t now_ms);
+
+/**
+ * @brief Send a heartbeat if nothing was sent for MCAST_HEARTBEAT_MS
+ */
+void mcast_heartbeat(mcast_publisher_t *pub, int64_t now_ms);
+
+/**
+ * @brief Find a packet for a repair
+ * @param len Receives the length of its frames
+ * @return Frames of the packet, or NULL if it has left the ring or was never sent
+ */
+const uint8_t *mcast_lookup(const mcast_publisher_t *pub, uint64_t seq, size_t *len);
+
+/**
+ * @brief Join a group
+ * @param group Group address and port; port 0 binds an ephemeral port
+ * @param iface Address of the interface to receive on, or INADDR_ANY
+ * @param next_seq First packet to deliver
+ * @return 0 on success, -1 on error
+ */
+int mcast_subscriber_open(mcast_subscriber_t *sub, const struct sockaddr_in *group,
+                          struct in_addr iface, uint64_t next_seq);
+
+/**
+ * @brief Leave the group and free held packets
+ */
+void mcast_subscriber_close(mcast_subscriber_t *sub);
+
+/**
+ * @brief Accept one packet from the group or from a repair
+ *
+ * Packets are delivered strictly in order; ones that arrive early are held
+ * until the gap before them is filled. A NULL packet marks seq as lost for
+ * good, and delivery moves past it.
+ *
+ * @return Non-zero if the deliver callback asked to stop
+ */
+int mcast_accept(mcast_subscriber_t *sub, uint64_t seq, const uint8_t *frames, size_t len,
+                 mcast_deliver_fn deliver, void *arg);
+
+/**
+ * @brief Read and accept every datagram waiting on the socket
+ * @return 0 on success, -1 on a socket error, or the callback's stop value
+ */
+int mcast_receive(mcast_subscriber_t *sub, mcast_deliver_fn deliver, void *arg);
+
+/**
+ * @brief Decide whether to ask for missing packets now
+ * @param first Receives the first missing sequence number
+ * @param count Receives the number of packets to request
+ * @return 1 if a NAK should be sent, 0 otherwise
+ */
+int mcast_next_nak(mcast_subscriber_t *sub, int64_t now_ms, uint64_t *first, uint32_t *count);
+
+#endif /* MULTICAST_H */
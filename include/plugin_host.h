@@ -0,0 +1,101 @@
+/**
+ * @file plugin_host.h
+ * @brief Loading and running message plugins (see chat_plugin.h)
+ *
+ * Plugins run in load order. A rewrite replaces the text seen by the
+ * plugins after it, and a drop ends the chain. Each call is timed with the
+ * monotonic clock; a call that takes longer than the budget still has its
+ * verdict applied but counts as an overrun, and a plugin that overruns
+ * PLUGIN_MAX_OVERRUNS calls in a row is disabled for the rest of the run.
+ */
+
+#ifndef PLUGIN_HOST_H
+#define PLUGIN_HOST_H
+
+#include "chat_plugin.h"
+#include "protocol.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most plugins that can be loaded */
+#define PLUGIN_MAX 8
+
+/* Default time budget of one on_message call */
+#define PLUGIN_DEFAULT_BUDGET_US 100
+
+/* Consecutive overruns after which a plugin is disabled */
+#define PLUGIN_MAX_OVERRUNS 8
+
+/**
+ * @brief A loaded plugin and its counters
+ */
+typedef struct {
+    const chat_plugin_t *api;
+    void *handle;                 /* dlopen handle, NULL if added in-process */
+    void *state;                  /* From init */
+    int disabled;
+    uint32_t consecutive_overruns;
+    uint64_t calls;
+    uint64_t drops;
+    uint64_t rewrites;
+    uint64_t errors;              /* Invalid verdicts or rewrites, ignored */
+    uint64_t overruns;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} plugin_t;
+
+/**
+ * @brief All loaded plugins
+ */
+typedef struct {
+    plugin_t plugins[PLUGIN_MAX];
+    int num_plugins;
+    uint64_t budget_ns;
+    char rewrite[2][MAX_MESSAGE_LEN]; /* Alternate between plugins in a chain */
+} plugin_host_t;
+
+/**
+ * @brief Set up an empty host
+ */
+void plugin_host_init(plugin_host_t *host, uint64_t budget_ns);
+
+/**
+ * @brief Register a plugin descriptor and run its init hook
+ * @param handle dlopen handle to close at shutdown, or NULL
+ * @param arg Passed to init
+ * @return 0 on success, -1 if the host is full, the ABI version differs,
+ *         on_message is missing or init fails
+ */
+int plugin_host_add(plugin_host_t *host, const chat_plugin_t *api, void *handle,
+                    const char *arg);
+
+/**
+ * @brief Load a plugin from a shared object
+ * @param spec "path" or "path:arg"
+ * @return 0 on success, -1 on failure (logged)
+ */
+int plugin_host_load(plugin_host_t *host, const char *spec);
+
+/**
+ * @brief Run a message through every enabled plugin
+ *
+ * If a plugin rewrites the payload, msg->payload and msg->payload_len are
+ * updated to point into the host's buffers, which remain valid until the
+ * next call.
+ *
+ * @return 1 if a plugin dropped the message, 0 otherwise
+ */
+int plugin_host_run(plugin_host_t *host, chat_plugin_message_t *msg);
+
+/**
+ * @brief Append the plugin counters as Prometheus text
+ * @return Bytes written, or -1 if they do not fit
+ */
+int plugin_host_render_metrics(const plugin_host_t *host, char *out, size_t cap);
+
+/**
+ * @brief Run fini hooks and unload every plugin
+ */
+void plugin_host_free(plugin_host_t *host);
+
+#endif /* PLUGIN_HOST_H */
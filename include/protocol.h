@@ -10,6 +10,8 @@
 #define PROTOCOL_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 
 /* Protocol Constants */
@@ -22,9 +24,194 @@
 #define MSG_TYPE_DISCONNECT 1 /* Client disconnect notification */
 #define MSG_TYPE_JOIN 2       /* Client join notification */
 #define MSG_TYPE_USERNAME 3   /* Username registration */
+#define MSG_TYPE_CHAT_ID 4    /* Chat message carrying a client message ID */
+#define MSG_TYPE_SEARCH 5     /* History search request */
+#define MSG_TYPE_SEARCH_RESULT 6 /* One search hit (same layout as CHAT) */
+#define MSG_TYPE_SEARCH_END 7 /* End of search results */
+#define MSG_TYPE_REGISTER_ACK 8 /* Result of a username registration */
+#define MSG_TYPE_HELLO 9      /* Capability handshake (both directions) */
+#define MSG_TYPE_SESSION_OPEN 10  /* Register a user on a multiplexed connection */
+#define MSG_TYPE_SESSION_ACK 11   /* Result of a session registration */
+#define MSG_TYPE_SESSION_CHAT 12  /* Chat message from one session */
+#define MSG_TYPE_SESSION_CLOSE 13 /* Session left the chat */
+#define MSG_TYPE_RELAY_ATTACH 14  /* Relay node asks to join the fan-out tree */
+#define MSG_TYPE_RELAY_REDIRECT 15 /* Answer to RELAY_ATTACH: stay or move */
+#define MSG_TYPE_MCAST_INFO 16    /* Multicast group of a subscriber */
+#define MSG_TYPE_NAK 17           /* Subscriber asks for missed packets */
+#define MSG_TYPE_REPAIR 18        /* One missed packet, sent over TCP */
+#define MSG_TYPE_MUTE 19          /* Stop or resume receiving a user's chat */
+#define MSG_TYPE_MUTE_ACK 20      /* Result of a MUTE request */
+#define MSG_TYPE_SUBSCRIBE 21     /* Subscribe to or unsubscribe from a topic pattern */
+#define MSG_TYPE_SUBSCRIBE_ACK 22 /* Result of a SUBSCRIBE request */
+#define MSG_TYPE_PUBLISH 23       /* Chat message sent to a topic */
+#define MSG_TYPE_TOPIC_CHAT 24    /* Topic message delivered to a subscriber */
+#define MSG_TYPE_SIGNAL 25        /* Ephemeral signal such as typing (both directions) */
+#define MSG_TYPE_REACT 26         /* Add or remove a reaction to a chat message */
+#define MSG_TYPE_CHAT_SEQ 27      /* Number of the chat message just delivered */
+#define MSG_TYPE_REACTION_COUNT 28 /* New total of one reaction on one message */
+#define MSG_TYPE_TRANSFER_INFO 29 /* Port for file transfers */
+#define MSG_TYPE_CHAT_FAILED 30   /* A chat message was not delivered */
+#define MSG_TYPE_SESSION_FAILED 31 /* A session's chat message was not delivered */
 
-/* Protocol Version */
-#define PROTOCOL_VERSION 1
+/* Registration status carried by MSG_TYPE_REGISTER_ACK */
+#define REGISTER_OK 0         /* Username accepted, chat frames may follow */
+#define REGISTER_INVALID 1    /* Empty or too long */
+#define REGISTER_TAKEN 2      /* Another connected client uses this name */
+#define REGISTER_FULL 3       /* Session ID in use or session limit reached */
+
+/* Fixed part of frames that name a peer (CHAT, JOIN, DISCONNECT,
+ * SEARCH_RESULT): [type][ip:4][port:2][username_len:1] */
+#define PEER_FRAME_HEADER (1 + 4 + 2 + 1)
+
+/* Client message IDs are sent as fixed-width hex so they never contain '\n' */
+#define MSG_ID_HEX_LEN 16
+
+/* A chat message that could not be stored (-d sync) reaches nobody. Its
+ * sender is told, if it negotiated FEATURE_MSG_IDS, and may send it again
+ * with the same ID:
+ *   CHAT_FAILED:    [type][16 hex message id]\n           (server -> client)
+ *   SESSION_FAILED: [type][session][16 hex message id]\n  (server -> client)
+ * SESSION_FAILED reports a SESSION_CHAT; relays hand it back to the user
+ * who sent the message. The ID is all zeros for a message sent without one. */
+#define CHAT_FAILED_LEN (1 + MSG_ID_HEX_LEN + 1)
+#define SESSION_FAILED_LEN (1 + SESSION_ID_HEX_LEN + MSG_ID_HEX_LEN + 1)
+
+/* Multiplexed sessions (FEATURE_SESSIONS)
+ *
+ * One connection may register many usernames, each under a session ID it
+ * picks, sent as fixed-width hex:
+ *   SESSION_OPEN:  [type][session][username_len][username]\n
+ *   SESSION_ACK:   [type][session][status]\n          (server -> client)
+ *   SESSION_CHAT:  [type][session][16 hex message id][message]\n
+ *   SESSION_CLOSE: [type][session]\n
+ * Broadcasts are not tagged: the connection gets each CHAT, JOIN and
+ * DISCONNECT frame once and hands it to all of its local users. */
+#define SESSION_ID_HEX_LEN 4
+#define MAX_SESSIONS_PER_CONN 4096
+
+/* Relay nodes (FEATURE_RELAY)
+ *
+ * A server started as a relay connects to a parent like a gateway and
+ * registers each of its users as a session, then repeats every broadcast
+ * it receives to its own clients, including relays attached below it:
+ *   RELAY_ATTACH:   [type][4 hex listening port]\n
+ *   RELAY_REDIRECT: [type][ip:4][port:2]\n    (server -> relay)
+ * A zero address accepts the relay; any other address names a relay deeper
+ * in the tree to attach to instead. A relay connection carries the
+ * sessions of its whole subtree, so every session ID may be in use. */
+#define RELAY_ATTACH_LEN (1 + 4 + 1)
+#define RELAY_REDIRECT_LEN (1 + 4 + 2 + 1)
+#define MAX_SESSIONS_PER_RELAY 65536
+
+/* Multicast subscribers (FEATURE_MULTICAST, see multicast.h)
+ *
+ * A read-only subscriber negotiates FEATURE_MULTICAST and never registers.
+ * The server follows its HELLO reply with the group to join, then the
+ * subscriber uses the connection only to repair gaps:
+ *   MCAST_INFO: [type][group ip:4][port:2][next seq:8]\n     (server -> client)
+ *   NAK:        [type][16 hex first seq][4 hex count]\n
+ *   REPAIR:     [type][seq:8][len:2]\n + len bytes of frames  (server -> client)
+ * A REPAIR with len 0 means the packet is no longer available. */
+#define MCAST_INFO_LEN (1 + 4 + 2 + 8 + 1)
+#define NAK_LEN (1 + 16 + 4 + 1)
+#define REPAIR_HEADER_LEN (1 + 8 + 2 + 1)
+
+/* Mute lists (FEATURE_MUTE)
+ *
+ * A registered user can stop receiving the chat messages of another user
+ * connected directly to the same server:
+ *   MUTE:     [type][1 mute / 0 unmute][username_len][username]\n
+ *   MUTE_ACK: [type][status]\n                   (server -> client)
+ * A mute lasts as long as both connections do. */
+#define MUTE_OK 0             /* Mute list updated */
+#define MUTE_UNKNOWN 1        /* No such user on this server, or yourself */
+
+/* Topics (FEATURE_TOPICS, see topic_trie.h)
+ *
+ * Topics are dot-separated names such as team.backend.deploys. A pattern
+ * may use '*' for exactly one segment and a final '#' for any number of
+ * trailing segments, including none:
+ *   SUBSCRIBE:     [type][1 subscribe / 0 unsubscribe][pattern_len][pattern]\n
+ *   SUBSCRIBE_ACK: [type][status]\n                              (server -> client)
+ *   PUBLISH:       [type][topic_len][topic][message]\n
+ *   TOPIC_CHAT:    [type][ip][port][username_len][username][topic_len][topic][message]\n
+ * Topic messages go to every subscriber with a matching pattern, once, and
+ * are not kept in the history. Subscriptions end with the connection. */
+#define TOPIC_OK 0            /* Subscription list updated */
+#define TOPIC_INVALID 1       /* Malformed pattern, or not subscribed */
+#define TOPIC_LIMIT 2         /* MAX_TOPICS_PER_CLIENT reached */
+#define MAX_TOPICS_PER_CLIENT 64
+
+/* Ephemeral signals (FEATURE_SIGNALS, see ephemeral.h)
+ *
+ * A registered user tells the others what it is doing; the server keeps
+ * only the latest signal per user and may drop or merge signals, but never
+ * delays chat behind them:
+ *   SIGNAL: [type][kind]\n
+ *   SIGNAL: [type][ip][port][username_len][username][kind]\n   (server -> client)
+ * Signals are not kept in the history and do not reach viewers or
+ * multicast subscribers. A TYPING that is not repeated within
+ * EPHEMERAL_TTL_MS should be treated as IDLE. */
+#define SIGNAL_TYPING 1       /* Composing a message */
+#define SIGNAL_IDLE 2         /* Stopped composing */
+#define SIGNAL_PRESENCE 3     /* Still here */
+#define SIGNAL_KIND_MAX SIGNAL_PRESENCE
+
+/* Reactions (FEATURE_REACTIONS, see reactions.h)
+ *
+ * Each chat message is followed, for clients that negotiated reactions, by
+ * its number; users react to recent messages by number, and the server
+ * sends the changed totals in batches:
+ *   CHAT_SEQ:       [type][seq:8]\n                     (server -> client)
+ *   REACT:          [type][1 add / 0 remove][16 hex seq][len][reaction]\n
+ *   REACTION_COUNT: [type][seq:8][count:4 net order][len][reaction]\n
+ *                                                       (server -> client)
+ * A reaction is at most REACTIONS_MAX_LEN bytes of UTF-8. Topic messages
+ * are not numbered. */
+#define CHAT_SEQ_LEN (1 + 8 + 1)
+#define REACT_HEADER (1 + 1 + 16 + 1)
+
+/* File transfers (FEATURE_TRANSFERS, see transfer.h)
+ *
+ * Files go over a second connection to the transfer port so that chat on
+ * this one is never stuck behind them. The server follows its HELLO reply
+ * with the port:
+ *   TRANSFER_INFO: [type][port:2 net order]\n              (server -> client)
+ * The id of an uploaded file is shared in chat as text. */
+#define TRANSFER_INFO_LEN (1 + 2 + 1)
+
+/* Maximum number of hits returned for one search request */
+#define SEARCH_MAX_RESULTS 20
+
+/* Protocol Version
+ *
+ * Version 1 clients never send HELLO. From version 2 on the client opens
+ * with [HELLO][version][8 hex feature bits]\n and the server answers with
+ * [HELLO][version][features:4 net order]\n carrying the features both sides
+ * support. The version byte must never equal '\n'.
+ */
+#define PROTOCOL_VERSION 2
+
+/* Feature bits negotiated by HELLO */
+#define FEATURE_ACKS        (1u << 0) /* Server sends REGISTER_ACK */
+#define FEATURE_MSG_IDS     (1u << 1) /* Server accepts CHAT_ID frames */
+#define FEATURE_BATCHING    (1u << 2) /* Several frames per write (reserved) */
+#define FEATURE_COMPRESSION (1u << 3) /* Compressed payloads (reserved) */
+#define FEATURE_SENDER_IDS  (1u << 4) /* Numeric sender IDs (reserved) */
+#define FEATURE_SESSIONS    (1u << 5) /* Several users per connection */
+#define FEATURE_RELAY       (1u << 6) /* Relay nodes may attach (RELAY_ATTACH) */
+#define FEATURE_MULTICAST   (1u << 7) /* Broadcasts via multicast, repairs via NAK */
+#define FEATURE_MUTE        (1u << 8) /* Server honours MUTE requests */
+#define FEATURE_TOPICS      (1u << 9) /* Topic subscriptions and PUBLISH */
+#define FEATURE_SIGNALS     (1u << 10) /* Typing and presence signals */
+#define FEATURE_REACTIONS   (1u << 11) /* Message numbers and reaction counts */
+#define FEATURE_TRANSFERS   (1u << 12) /* File transfers on a separate port */
+
+/* Length of the client HELLO frame */
+#define HELLO_CLIENT_LEN (1 + 1 + 8 + 1)
+
+/* Length of the server HELLO frame */
+#define HELLO_SERVER_LEN (1 + 1 + 4 + 1)
 
 /**
  * @brief Message header structure
@@ -74,4 +261,110 @@ static inline void init_msg_header(msg_header_t *header, uint8_t type, uint16_t
     header->length = length;
 }
 
+/**
+ * @brief Decoded frame naming a peer; pointers refer into the frame buffer
+ */
+typedef struct {
+    uint8_t type;
+    uint32_t ip;             /* Network order */
+    uint16_t port;           /* Network order */
+    const char *username;    /* Not NUL-terminated */
+    uint8_t username_len;
+    const char *payload;     /* Message text for CHAT and SEARCH_RESULT; TOPIC_CHAT
+                              * prefixes it with [topic_len][topic]; the kind
+                              * byte for SIGNAL */
+    size_t payload_len;
+} peer_frame_t;
+
+/**
+ * @brief Encode [type][ip][port][username_len][username][payload]\n
+ * @param buf Output buffer
+ * @param cap Capacity of buf
+ * @param type MSG_TYPE_CHAT, JOIN, DISCONNECT, SEARCH_RESULT, TOPIC_CHAT or SIGNAL
+ * @param ip Peer address (network order)
+ * @param port Peer port (network order)
+ * @param username NUL-terminated username
+ * @param payload Message text without the terminator (may be NULL)
+ * @param payload_len Length of payload
+ * @return Frame length, or -1 if it does not fit
+ */
+static inline int encode_peer_frame(uint8_t *buf, size_t cap, uint8_t type, uint32_t ip,
+                                    uint16_t port, const char *username, const char *payload,
+                                    size_t payload_len) {
+    size_t username_len = strlen(username);
+    if (username_len > 255 || PEER_FRAME_HEADER + username_len + payload_len + 1 > cap) {
+        return -1;
+    }
+
+    uint8_t *p = buf;
+    *p++ = type;
+    memcpy(p, &ip, 4);
+    p += 4;
+    memcpy(p, &port, 2);
+    p += 2;
+    *p++ = (uint8_t)username_len;
+    memcpy(p, username, username_len);
+    p += username_len;
+    if (payload_len > 0) {
+        memcpy(p, payload, payload_len);
+        p += payload_len;
+    }
+    *p++ = '\n';
+    return (int)(p - buf);
+}
+
+/**
+ * @brief Decode a complete peer frame (including its trailing '\n')
+ * @return 0 on success, -1 if the frame is truncated or malformed
+ */
+static inline int decode_peer_frame(const uint8_t *frame, size_t len, peer_frame_t *out) {
+    if (len < PEER_FRAME_HEADER + 1 || frame[len - 1] != '\n') {
+        return -1;
+    }
+
+    out->type = frame[0];
+    memcpy(&out->ip, frame + 1, 4);
+    memcpy(&out->port, frame + 5, 2);
+    out->username_len = frame[7];
+    if ((size_t)PEER_FRAME_HEADER + out->username_len + 1 > len) {
+        return -1;
+    }
+    out->username = (const char *)frame + PEER_FRAME_HEADER;
+    out->payload = out->username + out->username_len;
+    out->payload_len = len - PEER_FRAME_HEADER - out->username_len - 1;
+    return 0;
+}
+
+/**
+ * @brief Encode a client HELLO frame
+ * @param buf Output buffer of at least HELLO_CLIENT_LEN + 1 bytes
+ * @param features FEATURE_* bits the client supports
+ * @return Frame length
+ */
+static inline int encode_client_hello(uint8_t *buf, uint32_t features) {
+    buf[0] = MSG_TYPE_HELLO;
+    buf[1] = PROTOCOL_VERSION;
+    snprintf((char *)buf + 2, 9, "%08x", (unsigned)features);
+    buf[10] = '\n';
+    return HELLO_CLIENT_LEN;
+}
+
+/**
+ * @brief Human-readable description of a registration status
+ */
+static inline const char *register_status_str(uint8_t status) {
+    switch (status) {
+    case REGISTER_OK:
+        return "accepted";
+    case REGISTER_INVALID:
+        return "invalid username";
+    case REGISTER_TAKEN:
+        return "username already in use";
+    case REGISTER_FULL:
+        return "no free session";
+    default:
+        return "rejected";
+    }
+}
+
 #endif /* PROTOCOL_H */
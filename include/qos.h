@@ -0,0 +1,175 @@
+/**
+ * @file qos.h
+ * @brief QoS classes for rooms, scheduled by deficit round robin
+ *
+ * Every room (topic) belongs to a class. Interactive rooms, and the main
+ * chat, are written as soon as a message arrives. Bulk and bot rooms are
+ * queued per class, and a deficit-round-robin scheduler drains the queues
+ * between passes of the event loop: each turn a class is credited its
+ * quantum of bytes and sends queued frames while its credit lasts. Bulk
+ * therefore gets QOS_BULK_SHARE and bots QOS_BOT_SHARE parts of what the
+ * queues send, an idle class leaves its share to the other, and no pass of
+ * the loop writes more than its budget of queued bytes before going back to
+ * people's chat.
+ *
+ * A queued frame is not written to a recipient whose socket is already
+ * holding data, so a bot room can never fill the socket that a person's next
+ * message needs; the frame stays queued for that recipient until its socket
+ * drains, and a class is charged only for the copies it actually writes. A
+ * class whose queue fills up with frames still waiting on busy recipients
+ * drops its oldest frames for them. Rooms are assigned by topic
+ * pattern, first matching rule first; rooms that match no rule are
+ * interactive.
+ */
+
+#ifndef QOS_H
+#define QOS_H
+
+#include "slotset.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Class rules (-Q) */
+#define QOS_MAX_RULES 32
+
+/* Bytes credited to a class per turn, times its share */
+#define QOS_QUANTUM 4096
+#define QOS_BULK_SHARE 3
+#define QOS_BOT_SHARE 1
+
+/* Queued bytes written per pass of the event loop */
+#define QOS_PASS_BYTES (256 * 1024)
+
+/* Bytes of frames a class may hold; the oldest give way to new ones */
+#define QOS_MAX_QUEUED (1024 * 1024)
+
+/* How soon the event loop tries again when every queued frame is waiting
+ * on a busy recipient */
+#define QOS_RETRY_MS 10
+
+/**
+ * @brief Class of a room
+ */
+typedef enum {
+    QOS_INTERACTIVE,                /* Sent at once */
+    QOS_BULK,
+    QOS_BOT,
+    QOS_NUM_CLASSES
+} qos_class_t;
+
+/**
+ * @brief Rooms matching a topic pattern belong to a class
+ */
+typedef struct {
+    char pattern[256];
+    size_t len;
+    qos_class_t cls;
+} qos_rule_t;
+
+/**
+ * @brief A queued frame and the slots still to receive it
+ */
+typedef struct qos_frame {
+    struct qos_frame *next;
+    size_t len;
+    size_t cost;                    /* len times the recipients still to get it */
+    slotset_t recipients;
+    uint8_t data[];
+} qos_frame_t;
+
+/**
+ * @brief Frames of one class, oldest first
+ */
+typedef struct {
+    qos_frame_t *head;
+    qos_frame_t *tail;
+    size_t queued;                  /* Bytes of frames held */
+    size_t deficit;                 /* Credit left from earlier turns */
+    uint64_t sent;                  /* Bytes written, counted per recipient */
+    uint64_t dropped;               /* Deliveries lost: queue full or write failed */
+} qos_queue_t;
+
+/**
+ * @brief Class rules and queues
+ */
+typedef struct {
+    qos_rule_t rules[QOS_MAX_RULES];
+    int num_rules;
+    qos_queue_t queues[QOS_NUM_CLASSES];
+    size_t num_slots;
+    int turn;                       /* Class whose turn comes next */
+    slotset_t waiting;              /* Busy recipients found during a turn */
+} qos_t;
+
+/**
+ * @brief Where queued frames go
+ */
+typedef struct {
+    int (*busy)(size_t recipient, void *arg);   /* Socket still holding data */
+    int (*deliver)(size_t recipient, const uint8_t *frame, size_t len, void *arg);
+                                                /* 0 on success, -1 on failure */
+    void *arg;
+} qos_sink_t;
+
+/**
+ * @brief Start with no rules and empty queues for num_slots slots
+ */
+void qos_init(qos_t *qos, size_t num_slots);
+
+/**
+ * @brief Add a rule given as class:pattern, such as bot:bots.#
+ * @return 0 on success, -1 if the class or pattern is invalid or there are
+ *         QOS_MAX_RULES rules
+ */
+int qos_add_rule(qos_t *qos, const char *spec);
+
+/**
+ * @brief Class of a room
+ */
+qos_class_t qos_classify(const qos_t *qos, const char *topic, size_t len);
+
+/**
+ * @brief Name of a class, as used in rules
+ */
+const char *qos_class_name(qos_class_t cls);
+
+/**
+ * @brief Queue a frame of a bulk or bot room for some recipients
+ *
+ * If the class's queue is full its oldest frames are dropped to make room.
+ * @return 0 if queued, -1 if the frame is larger than a queue or memory ran
+ *         out
+ */
+int qos_enqueue(qos_t *qos, qos_class_t cls, const uint8_t *frame, size_t len,
+                const slotset_t *recipients);
+
+/**
+ * @brief Whether any frame is queued
+ */
+int qos_pending(const qos_t *qos);
+
+/**
+ * @brief Send queued frames, taking classes in deficit-round-robin turns,
+ *        until about budget bytes are written or nothing more can be
+ * @return Bytes written, counted per recipient; 0 while every queued frame
+ *         waits on a busy recipient
+ */
+size_t qos_flush(qos_t *qos, size_t budget, const qos_sink_t *sink);
+
+/**
+ * @brief Stop queued frames from reaching a slot whose connection closed
+ */
+void qos_forget(qos_t *qos, size_t slot);
+
+/**
+ * @brief Render the per-class counters as Prometheus metrics
+ * @return Bytes written, or -1 if they do not fit in cap
+ */
+int qos_render(const qos_t *qos, char *out, size_t cap);
+
+/**
+ * @brief Drop every queued frame
+ */
+void qos_free(qos_t *qos);
+
+#endif /* QOS_H */
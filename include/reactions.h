@@ -0,0 +1,118 @@
+/**
+ * @file reactions.h
+ * @brief Aggregated reactions on recent chat messages
+ *
+ * Every chat message gets a number, and users react to the last
+ * REACTIONS_MAX_MESSAGES messages by number. Reactions are not relayed one
+ * by one: each message keeps a counter per distinct reaction, and every
+ * REACTIONS_INTERVAL_MS the counters that changed are sent as one batch of
+ * small frames carrying their new totals. A burst of clicks on a popular
+ * message therefore costs the room a few frames per second, and a client
+ * that missed a batch is corrected by the next one.
+ *
+ * Each user may add a given reaction to a message once. Messages are kept
+ * in a ring indexed by number, so a new message reuses the slot of the one
+ * REACTIONS_MAX_MESSAGES before it.
+ */
+
+#ifndef REACTIONS_H
+#define REACTIONS_H
+
+#include "slotset.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Recent messages that can be reacted to, a power of two */
+#define REACTIONS_MAX_MESSAGES 256
+
+/* Distinct reactions per message */
+#define REACTIONS_MAX_KINDS 8
+
+/* Longest reaction, in bytes (an emoji or a short word) */
+#define REACTIONS_MAX_LEN 16
+
+/* Milliseconds between batches of updated counters */
+#define REACTIONS_INTERVAL_MS 250
+
+/* Encoded REACTION_COUNT frame without its reaction text */
+#define REACTION_COUNT_HEADER (1 + 8 + 4 + 1)
+
+/**
+ * @brief One reaction on one message
+ */
+typedef struct {
+    uint8_t len;
+    char text[REACTIONS_MAX_LEN];
+    uint32_t count;
+    uint32_t reported;      /* Count in the last batch sent */
+    slotset_t reactors;     /* Slots that added this reaction */
+} reaction_t;
+
+/**
+ * @brief Reactions on one message
+ */
+typedef struct {
+    uint64_t seq;
+    int num_kinds;
+    reaction_t kinds[REACTIONS_MAX_KINDS];
+} reaction_entry_t;
+
+/**
+ * @brief Reaction counters of recent messages
+ */
+typedef struct {
+    reaction_entry_t entries[REACTIONS_MAX_MESSAGES];  /* Indexed by seq */
+    slotset_t dirty;        /* Entries with counters not yet sent */
+    uint64_t next_seq;      /* Number of the next message */
+    int64_t next_flush_ms;
+    uint64_t applied;       /* Reactions that changed a counter */
+    uint64_t updates;       /* Counter updates sent */
+} reactions_t;
+
+/**
+ * @brief Create an empty table for reactions from num_slots slots
+ */
+void reactions_init(reactions_t *reactions, size_t num_slots);
+
+/**
+ * @brief Number the next chat message, forgetting the oldest one
+ * @return The message's number
+ */
+uint64_t reactions_next_message(reactions_t *reactions);
+
+/**
+ * @brief Add or remove a slot's reaction to a message
+ * @return 1 if a counter changed, 0 if the slot had already added (or had
+ *         not added) the reaction, -1 if the message is not recent, the
+ *         message has REACTIONS_MAX_KINDS reactions or memory ran out
+ */
+int reactions_apply(reactions_t *reactions, size_t slot, uint64_t seq, int add,
+                    const char *text, size_t len);
+
+/**
+ * @brief Encode the changed counters once the batch is due
+ *
+ * Writes one [REACTION_COUNT][seq:8][count:4][len][reaction]\n frame per
+ * changed counter. Counters that do not fit stay pending.
+ *
+ * @return Bytes written, 0 if nothing is due
+ */
+size_t reactions_flush(reactions_t *reactions, int64_t now_ms, uint8_t *out, size_t cap);
+
+/**
+ * @brief Milliseconds until the next batch is due
+ * @return -1 if no counter changed
+ */
+int64_t reactions_wait_ms(const reactions_t *reactions, int64_t now_ms);
+
+/**
+ * @brief Let a new connection in a slot react afresh; counts are kept
+ */
+void reactions_forget(reactions_t *reactions, size_t slot);
+
+/**
+ * @brief Release all memory
+ */
+void reactions_free(reactions_t *reactions);
+
+#endif /* REACTIONS_H */
@@ -0,0 +1,144 @@
+/**
+ * @file relay.h
+ * @brief Upstream link of a relay node in the broadcast fan-out tree
+ *
+ * A relay is a server that takes its broadcasts from a parent instead of
+ * producing them. Its users are registered upstream as sessions on one
+ * connection, so the parent sends each broadcast to the relay once and the
+ * relay repeats it to its own clients. Relays accept relays of their own,
+ * which lets the origin spread a large room over a tree: a node with its
+ * quota of direct relays redirects newcomers to the child that has received
+ * the fewest so far.
+ *
+ * Every downstream user owns one upstream session ID (a route). Routes are
+ * created on registration and stay reserved until the parent has answered
+ * them, so a late SESSION_ACK never reaches a user who took over the ID.
+ */
+
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "frame_parser.h"
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Relays attached directly to one node before it starts redirecting */
+#define RELAY_DEFAULT_FANOUT 8
+
+/* Redirects followed before a relay gives up attaching */
+#define RELAY_MAX_HOPS 16
+
+/* Seconds to wait for the parent's answers while attaching */
+#define RELAY_ATTACH_TIMEOUT_SEC 5
+
+/* Features a relay requires from its parent */
+#define RELAY_FEATURES (FEATURE_ACKS | FEATURE_MSG_IDS | FEATURE_SESSIONS | FEATURE_RELAY)
+
+/* Number of upstream session IDs */
+#define RELAY_MAX_ROUTES 65536
+
+/* Route states */
+#define RELAY_ROUTE_FREE 0
+#define RELAY_ROUTE_PENDING 1   /* SESSION_OPEN sent, no answer yet */
+#define RELAY_ROUTE_OPEN 2
+#define RELAY_ROUTE_ABANDONED 3 /* User left before the answer arrived */
+
+/**
+ * @brief Downstream owner of one upstream session
+ */
+typedef struct {
+    int client;         /* Client slot on this relay */
+    uint16_t session;   /* Session ID on that client, if is_session */
+    uint8_t is_session; /* 0 for the client's own username */
+    uint8_t state;      /* RELAY_ROUTE_* */
+} relay_route_t;
+
+/**
+ * @brief Connection to the parent node
+ */
+typedef struct {
+    int fd;                    /* -1 until attached */
+    frame_parser_t parser;     /* Frames from the parent */
+    struct sockaddr_in parent; /* Node the relay ended up attached to */
+    relay_route_t *routes;     /* Indexed by upstream session ID */
+    uint32_t next_id;          /* Where the search for a free ID starts */
+    uint64_t next_msg_id;      /* ID for chat frames that arrive without one */
+} relay_link_t;
+
+/**
+ * @brief Allocate the route table
+ * @return 0 on success, -1 on failure
+ */
+int relay_link_init(relay_link_t *link);
+
+/**
+ * @brief Close the connection and free the route table
+ */
+void relay_link_free(relay_link_t *link);
+
+/**
+ * @brief Attach to a parent, following redirects down the tree
+ * @param link Initialized link
+ * @param origin Node to ask first
+ * @param listen_port Port this relay accepts clients and relays on
+ * @return 0 once attached (link->fd is non-blocking), -1 on failure
+ */
+int relay_attach(relay_link_t *link, const struct sockaddr_in *origin, int listen_port);
+
+/**
+ * @brief Encode [RELAY_ATTACH][4 hex port]\n
+ * @param buf Output buffer of at least RELAY_ATTACH_LEN + 1 bytes
+ * @return Frame length
+ */
+int relay_encode_attach(uint8_t *buf, int port);
+
+/**
+ * @brief Encode [RELAY_REDIRECT][ip][port]\n
+ * @param buf Output buffer of at least RELAY_REDIRECT_LEN bytes
+ * @param ip Address in network order, 0 to accept the relay
+ * @param port Port in network order, 0 to accept the relay
+ * @return Frame length
+ */
+int relay_encode_redirect(uint8_t *buf, uint32_t ip, uint16_t port);
+
+/**
+ * @brief Reserve an upstream session for a user and send SESSION_OPEN
+ * @param id Receives the upstream session ID
+ * @return 0 on success, -1 if no ID is free or the parent is unreachable
+ */
+int relay_open(relay_link_t *link, const relay_route_t *owner, const char *username,
+               uint16_t *id);
+
+/**
+ * @brief Send SESSION_CLOSE for a user who left
+ *
+ * An open route is released at once; a pending one stays reserved until
+ * its SESSION_ACK arrives.
+ */
+void relay_close(relay_link_t *link, uint16_t id);
+
+/**
+ * @brief Apply the parent's answer to a SESSION_OPEN
+ * @param route Receives the route's owner
+ * @return 1 if the owner is still waiting for the answer, 0 if the answer
+ *         is stale and was absorbed here
+ */
+int relay_settle(relay_link_t *link, uint16_t id, uint8_t status, relay_route_t *route);
+
+/**
+ * @brief Look up the owner of an open upstream session
+ * @param route Receives the route's owner
+ * @return 1 if the session is open, 0 otherwise
+ */
+int relay_route(const relay_link_t *link, uint16_t id, relay_route_t *route);
+
+/**
+ * @brief Forward a chat message: [SESSION_CHAT][session][16 hex id][message]\n
+ * @param text Message text without the trailing newline
+ * @return 0 on success, -1 on error
+ */
+int relay_chat(relay_link_t *link, uint16_t id, uint64_t msg_id, const char *text,
+               size_t text_len);
+
+#endif /* RELAY_H */
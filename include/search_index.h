@@ -0,0 +1,88 @@
+/**
+ * @file search_index.h
+ * @brief Incremental inverted index over chat history
+ *
+ * Maps each token of a message to the history log offsets of the messages
+ * containing it. Offsets are appended in increasing order, so posting lists
+ * are stored as varint-encoded deltas and typically cost one or two bytes
+ * per entry. Queries intersect the posting lists of all query tokens and
+ * never touch the log itself.
+ */
+
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Longer tokens are truncated to this many bytes */
+#define SEARCH_MAX_TOKEN 32
+
+/* Maximum number of tokens considered in one query */
+#define SEARCH_MAX_QUERY_TOKENS 8
+
+/**
+ * @brief Delta-encoded list of message offsets for one token
+ */
+typedef struct {
+    uint8_t *data;       /* Varint-encoded deltas */
+    size_t len;
+    size_t cap;
+    uint64_t last;       /* Last offset appended */
+    uint32_t count;      /* Number of offsets */
+} posting_list_t;
+
+/**
+ * @brief Hash table slot for one token
+ */
+typedef struct {
+    uint64_t hash;       /* 0 if slot is free */
+    char term[SEARCH_MAX_TOKEN + 1];
+    posting_list_t postings;
+} search_term_t;
+
+/**
+ * @brief Inverted index
+ */
+typedef struct {
+    search_term_t *terms;
+    size_t capacity;     /* Always a power of two */
+    size_t num_terms;
+    uint64_t num_docs;
+} search_index_t;
+
+/**
+ * @brief Initialize an empty index
+ * @return 0 on success, -1 on error
+ */
+int search_index_init(search_index_t *index);
+
+/**
+ * @brief Release all memory held by an index
+ */
+void search_index_free(search_index_t *index);
+
+/**
+ * @brief Add a message to the index
+ * @param index Inverted index
+ * @param offset Log offset of the message, greater than any offset added before
+ * @param text Message text
+ * @param len Length of text
+ * @return 0 on success, -1 on error
+ */
+int search_index_add(search_index_t *index, uint64_t offset, const char *text, size_t len);
+
+/**
+ * @brief Find messages containing every token of a query
+ * @param index Inverted index
+ * @param query Query text
+ * @param len Length of query
+ * @param out Matching offsets, most recent first
+ * @param max_out Capacity of out
+ * @return Number of offsets written to out, or -1 on error
+ */
+ssize_t search_index_query(const search_index_t *index, const char *query, size_t len,
+                           uint64_t *out, size_t max_out);
+
+#endif /* SEARCH_INDEX_H */
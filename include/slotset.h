@@ -0,0 +1,102 @@
+/**
+ * @file slotset.h
+ * @brief Bitmap sets of client slot indices
+ *
+ * Broadcast recipients are computed as set operations instead of per-client
+ * checks: the registered connections form one set, each client keeps the set
+ * of slots that muted it, and the recipients of a chat message are
+ * "registered AND NOT muted-by-sender". Sets are plain 64-bit words, which
+ * the compiler vectorizes, so an operation over 1024 slots touches only 16
+ * words. A set that has never held a slot owns no memory, so per-client mute
+ * sets cost nothing until they are used.
+ */
+
+#ifndef SLOTSET_H
+#define SLOTSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Set of slots in [0, num_slots)
+ */
+typedef struct {
+    uint64_t *words;      /* NULL while empty and never used */
+    size_t num_words;
+    size_t num_slots;
+} slotset_t;
+
+/**
+ * @brief Create an empty set able to hold slots below num_slots
+ *
+ * No memory is allocated until the first slotset_add().
+ */
+void slotset_init(slotset_t *set, size_t num_slots);
+
+/**
+ * @brief Release the set's words; it stays usable and empty
+ */
+void slotset_free(slotset_t *set);
+
+/**
+ * @brief Allocate the set's words now, so that adding slots cannot fail
+ * @return 0 on success, -1 on allocation failure
+ */
+int slotset_reserve(slotset_t *set);
+
+/**
+ * @brief Add a slot
+ * @return 0 on success, -1 if the words could not be allocated
+ */
+int slotset_add(slotset_t *set, size_t slot);
+
+/**
+ * @brief Remove a slot
+ */
+void slotset_remove(slotset_t *set, size_t slot);
+
+/**
+ * @brief Whether a slot is in the set
+ */
+static inline int slotset_contains(const slotset_t *set, size_t slot) {
+    return set->words && slot < set->num_slots &&
+           (set->words[slot / 64] >> (slot % 64)) & 1u;
+}
+
+/**
+ * @brief Whether the set holds no slot
+ */
+int slotset_empty(const slotset_t *set);
+
+/**
+ * @brief Number of slots in the set
+ */
+size_t slotset_count(const slotset_t *set);
+
+/**
+ * @brief Remove every slot
+ */
+void slotset_clear(slotset_t *set);
+
+/**
+ * @brief out = a AND NOT b
+ *
+ * All three sets must have the same num_slots; out may be a.
+ *
+ * @return 0 on success, -1 if out's words could not be allocated
+ */
+int slotset_andnot(slotset_t *out, const slotset_t *a, const slotset_t *b);
+
+/**
+ * @brief out = out OR a
+ * @return 0 on success, -1 if out's words could not be allocated
+ */
+int slotset_or(slotset_t *out, const slotset_t *a);
+
+/**
+ * @brief Find the first slot at or after from
+ * @return The slot, or -1 if there is none
+ */
+long slotset_next(const slotset_t *set, size_t from);
+
+#endif /* SLOTSET_H */
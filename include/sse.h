@@ -0,0 +1,125 @@
+/**
+ * @file sse.h
+ * @brief Read-only Server-Sent Events stream of the chat
+ *
+ * Viewers open GET /events on the SSE port and receive every chat, join and
+ * leave broadcast as an event whose data is a JSON object. They never
+ * register and never send frames, so a viewer costs a few bytes of request
+ * matching state and a poll slot rather than a client slot with a frame
+ * parser. Each broadcast is rendered once into a shared buffer that is
+ * written to all viewers; a viewer that cannot keep up is dropped, and one
+ * that has not sent its whole request within SSE_REQUEST_TIMEOUT_SEC is
+ * closed so that half-open requests cannot hold the viewer slots.
+ */
+
+#ifndef SSE_H
+#define SSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Default number of viewer slots */
+#define SSE_MAX_VIEWERS 4096
+
+/* Largest request accepted from a viewer */
+#define SSE_MAX_REQUEST 8192
+
+/* Seconds a viewer has to send its whole request */
+#define SSE_REQUEST_TIMEOUT_SEC 5
+
+/* Seconds between keepalive comments on idle streams */
+#define SSE_KEEPALIVE_SEC 15
+
+/* Request line prefix served as the event stream */
+#define SSE_REQUEST_PREFIX "GET /events"
+
+/**
+ * @brief One viewer connection
+ */
+typedef struct {
+    int fd;               /* -1 if the slot is free */
+    int streaming;        /* Response headers sent, events follow */
+    uint8_t path_match;   /* Bytes of SSE_REQUEST_PREFIX matched */
+    uint8_t path_ok;      /* Request line names the event stream */
+    uint8_t end_match;    /* Bytes of the closing "\r\n\r\n" matched */
+    uint16_t request_len; /* Request bytes received */
+    time_t accepted;      /* When the connection was accepted */
+} sse_viewer_t;
+
+/**
+ * @brief All viewers and the shared event buffer
+ */
+typedef struct {
+    sse_viewer_t *viewers;
+    int max_viewers;
+    int num_viewers;
+    int num_pending;       /* Viewers still sending their request */
+    char *events;          /* Rendered events of the current broadcast */
+    size_t events_cap;
+    time_t last_write;     /* Last time anything was written to viewers */
+} sse_hub_t;
+
+/**
+ * @brief Allocate viewer slots
+ * @return 0 on success, -1 on failure
+ */
+int sse_hub_init(sse_hub_t *hub, int max_viewers);
+
+/**
+ * @brief Close all viewers and free the hub
+ */
+void sse_hub_free(sse_hub_t *hub);
+
+/**
+ * @brief Take over an accepted, non-blocking connection
+ * @param now Current time, from which the request timeout runs
+ * @return Slot index, or -1 if all slots are in use (fd is closed)
+ */
+int sse_add_viewer(sse_hub_t *hub, int fd, time_t now);
+
+/**
+ * @brief Read from a viewer whose socket is readable
+ *
+ * Until the request is complete its bytes are matched; afterwards input is
+ * discarded. The viewer is closed on EOF, error or an invalid request.
+ */
+void sse_handle_input(sse_hub_t *hub, int index);
+
+/**
+ * @brief Match request bytes
+ * @return 1 once a complete GET /events request was seen, 0 if more bytes
+ *         are needed, -1 for any other or oversized request
+ */
+int sse_request_feed(sse_viewer_t *viewer, const uint8_t *data, size_t len);
+
+/**
+ * @brief Render one peer frame (CHAT, JOIN or DISCONNECT) as an SSE event
+ * @param frame Complete frame including its trailing '\n'
+ * @param len Length of frame
+ * @param out Output buffer
+ * @param cap Capacity of out
+ * @return Event length, 0 if the frame type is not streamed, -1 if the
+ *         frame is malformed or the event does not fit
+ */
+int sse_render_frame(const uint8_t *frame, size_t len, char *out, size_t cap);
+
+/**
+ * @brief Render broadcast frames once and write them to every viewer
+ * @param frames One or more complete server-to-client frames
+ * @param len Length of frames
+ */
+void sse_broadcast(sse_hub_t *hub, const uint8_t *frames, size_t len);
+
+/**
+ * @brief Send a comment to idle streams so proxies keep them open
+ */
+void sse_keepalive(sse_hub_t *hub, time_t now);
+
+/**
+ * @brief Close viewers that have not sent a complete request within
+ *        SSE_REQUEST_TIMEOUT_SEC of being accepted
+ */
+void sse_sweep(sse_hub_t *hub, time_t now);
+
+#endif /* SSE_H */
@@ -0,0 +1,127 @@
+/**
+ * @file topic_trie.h
+ * @brief Wildcard topic subscriptions
+ *
+ * Subscription patterns are stored in a trie with one node per dot-separated
+ * segment. Each node holds the set of client slots subscribed to the pattern
+ * ending there. '*' matches exactly one segment and a final '#' matches any
+ * number of trailing segments, including none, so a published topic is
+ * matched by walking the trie once per wildcard branch.
+ *
+ * The resolved subscriber set of each recently published topic is cached.
+ * A publish to a cached topic costs one hash lookup, however many patterns
+ * exist. Subscribing adds the slot to the cached topics the pattern matches;
+ * unsubscribing drops only those entries, because the slot may still match
+ * them through another pattern. Both touch at most the cache, never the
+ * other subscriptions.
+ */
+
+#ifndef TOPIC_TRIE_H
+#define TOPIC_TRIE_H
+
+#include "slotset.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longest topic or pattern, limited by its length byte */
+#define TOPIC_MAX_LEN 255
+
+/* Number of cached topics */
+#define TOPIC_CACHE_SIZE 256
+
+/* Number of cache slots probed when looking up a topic */
+#define TOPIC_CACHE_PROBE 4
+
+/**
+ * @brief Trie node for one pattern segment
+ */
+typedef struct topic_node {
+    char *segment;                 /* NULL for the root */
+    size_t segment_len;
+    struct topic_node **children;
+    size_t num_children;
+    size_t children_cap;
+    slotset_t subscribers;         /* Slots subscribed to the pattern ending here */
+} topic_node_t;
+
+/**
+ * @brief Cached subscriber set of one concrete topic
+ */
+typedef struct {
+    uint64_t hash;                 /* 0 if the entry is free */
+    uint64_t last_used;            /* Cache clock value of the last lookup */
+    size_t topic_len;
+    char topic[TOPIC_MAX_LEN];
+    slotset_t subscribers;
+} topic_cache_entry_t;
+
+/**
+ * @brief Subscription trie with its per-topic cache
+ */
+typedef struct {
+    topic_node_t root;
+    topic_cache_entry_t *cache;
+    size_t num_slots;
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+} topic_trie_t;
+
+/**
+ * @brief Check a concrete topic: non-empty segments without wildcards
+ * @return 1 if valid, 0 otherwise
+ */
+int topic_name_valid(const char *topic, size_t len);
+
+/**
+ * @brief Check a pattern: non-empty segments, '*' and '#' only as whole
+ *        segments, '#' only last
+ * @return 1 if valid, 0 otherwise
+ */
+int topic_pattern_valid(const char *pattern, size_t len);
+
+/**
+ * @brief Whether a pattern matches a concrete topic
+ */
+int topic_pattern_matches(const char *pattern, size_t pattern_len, const char *topic,
+                          size_t topic_len);
+
+/**
+ * @brief Create an empty trie for slots below num_slots
+ * @return 0 on success, -1 on error
+ */
+int topic_trie_init(topic_trie_t *trie, size_t num_slots);
+
+/**
+ * @brief Release all memory held by a trie
+ */
+void topic_trie_free(topic_trie_t *trie);
+
+/**
+ * @brief Subscribe a slot to a valid pattern
+ * @return 1 if added, 0 if already subscribed, -1 on allocation failure
+ */
+int topic_trie_subscribe(topic_trie_t *trie, const char *pattern, size_t len, size_t slot);
+
+/**
+ * @brief Unsubscribe a slot from a pattern
+ * @return 1 if removed, 0 if it was not subscribed
+ */
+int topic_trie_unsubscribe(topic_trie_t *trie, const char *pattern, size_t len, size_t slot);
+
+/**
+ * @brief Remove a slot from every pattern, e.g. when its client leaves
+ */
+void topic_trie_remove_slot(topic_trie_t *trie, size_t slot);
+
+/**
+ * @brief Find the subscribers of a valid concrete topic
+ *
+ * The returned set belongs to the cache and stays valid until the next call
+ * that changes the trie or looks up another topic.
+ *
+ * @return The set of subscribed slots, or NULL on allocation failure
+ */
+const slotset_t *topic_trie_match(topic_trie_t *trie, const char *topic, size_t len);
+
+#endif /* TOPIC_TRIE_H */
@@ -0,0 +1,141 @@
+/**
+ * @file transfer.h
+ * @brief File transfers on a port of their own
+ *
+ * Attachments never travel over chat connections, where one large upload
+ * would hold up every frame queued behind it. A client opens a second
+ * connection to the transfer port and moves one file on it:
+ *   PUT <size>\n followed by size bytes     ->  OK <16 hex id>\n
+ *   GET <16 hex id>\n                       ->  OK <size>\n followed by the file
+ * Anything else, or a failure, is answered with ERR <reason>\n. Either way
+ * the server closes the connection afterwards. The id is then shared in
+ * chat like any other text.
+ *
+ * Files are stored in one directory, named by id. Uploads move from the
+ * socket to the file with splice() and downloads with sendfile(), so the
+ * bytes do not pass through the event loop's buffers. Each readiness event
+ * moves at most TRANSFER_CHUNK bytes: a transfer is paced by its own socket
+ * and the loop goes back to chat between chunks.
+ *
+ * A connection that makes no progress for TRANSFER_IDLE_MS is closed and
+ * its partial upload deleted, so stalled clients cannot hold every slot.
+ * Stored files are never deleted by the server. Once they add up to
+ * max_stored bytes, uploads are refused with ERR full until an operator
+ * removes some; the directory is rescanned before refusing, so space freed
+ * that way is found without a restart.
+ */
+
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Concurrent transfer connections */
+#define TRANSFER_MAX_CONNS 16
+
+/* Bytes moved per readiness event */
+#define TRANSFER_CHUNK (256 * 1024)
+
+/* Largest file accepted */
+#define TRANSFER_MAX_SIZE (64ull * 1024 * 1024)
+
+/* Longest request line, including '\n' */
+#define TRANSFER_MAX_REQUEST 64
+
+/* A connection idle for this long is closed */
+#define TRANSFER_IDLE_MS 30000
+
+/* Total size of stored files, by default */
+#define TRANSFER_MAX_STORED (1024ull * 1024 * 1024)
+
+/**
+ * @brief Where a connection is in its exchange
+ */
+typedef enum {
+    TRANSFER_REQUEST,               /* Reading the request line */
+    TRANSFER_UPLOAD,                /* Storing the file */
+    TRANSFER_REPLY,                 /* Writing the reply line */
+    TRANSFER_DOWNLOAD               /* Writing the file after the reply */
+} transfer_state_t;
+
+/**
+ * @brief One transfer connection
+ */
+typedef struct {
+    int fd;                         /* -1 if the slot is free */
+    transfer_state_t state;
+    size_t request_len;
+    char request[TRANSFER_MAX_REQUEST];
+    int file_fd;                    /* File being stored or sent, or -1 */
+    int pipe[2];                    /* splice() staging for uploads, or -1 */
+    uint64_t id;
+    uint64_t size;
+    uint64_t done;                  /* Bytes of the file moved so far */
+    int then_download;              /* The reply is followed by the file */
+    size_t reply_len;
+    size_t reply_sent;
+    char reply[48];
+    int64_t active_ms;              /* When the connection last did anything */
+} transfer_conn_t;
+
+/**
+ * @brief Transfer listener, storage directory and connections
+ */
+typedef struct {
+    int listen_fd;
+    int dir_fd;
+    transfer_conn_t conns[TRANSFER_MAX_CONNS];
+    uint64_t uploads;               /* Files stored */
+    uint64_t downloads;             /* Files sent in full */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t stored_bytes;          /* Size of the files in the directory */
+    uint64_t max_stored;            /* TRANSFER_MAX_STORED unless changed */
+} transfer_t;
+
+/**
+ * @brief Take over a listening socket and store files in dir
+ *
+ * Partial uploads left behind by an earlier run are deleted.
+ *
+ * @return 0 on success, -1 if dir cannot be opened
+ */
+int transfer_init(transfer_t *transfer, int listen_fd, const char *dir);
+
+/**
+ * @brief Accept a connection; rejected if all slots are in use
+ */
+void transfer_accept(transfer_t *transfer, int64_t now_ms);
+
+/**
+ * @brief Poll events to wait for on a connection: POLLIN while reading the
+ *        request or an upload, POLLOUT while replying or sending a file
+ */
+short transfer_poll_events(const transfer_t *transfer, int index);
+
+/**
+ * @brief Handle readiness of a connection
+ */
+void transfer_handle_events(transfer_t *transfer, int index, short revents, int64_t now_ms);
+
+/**
+ * @brief Close connections idle for TRANSFER_IDLE_MS, deleting their
+ *        partial uploads
+ */
+void transfer_sweep(transfer_t *transfer, int64_t now_ms);
+
+/**
+ * @brief Parse a request line without its '\n'
+ * @return 1 for PUT with *value set to the size, 2 for GET with *value set
+ *         to the id, -1 if the line is malformed
+ */
+int transfer_parse_request(const char *line, size_t len, uint64_t *value);
+
+/**
+ * @brief Close every connection, the listener and the directory; partial
+ *        uploads are removed
+ */
+void transfer_close(transfer_t *transfer);
+
+#endif /* TRANSFER_H */
@@ -0,0 +1,34 @@
+/**
+ * @file utf8.h
+ * @brief UTF-8 validation of chat payloads
+ *
+ * Every chat message, topic and username is checked once on arrival, so
+ * clients never receive malformed UTF-8 and need not check it themselves.
+ * On x86-64 with SSSE3 the check runs 16 bytes at a time with the lookup
+ * algorithm of Keiser and Lemire: three nibble table lookups per block
+ * classify each pair of adjacent bytes, and a block of plain ASCII costs a
+ * single comparison. Elsewhere a scalar validator skips ASCII eight bytes
+ * at a time.
+ */
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+
+/**
+ * @brief Whether data is well-formed UTF-8
+ *
+ * Rejects overlong encodings, surrogates, code points above U+10FFFF and
+ * truncated sequences.
+ *
+ * @return 1 if valid, 0 otherwise
+ */
+int utf8_valid(const char *data, size_t len);
+
+/**
+ * @brief Scalar implementation of utf8_valid(), used where SSSE3 is missing
+ */
+int utf8_valid_scalar(const char *data, size_t len);
+
+#endif /* UTF8_H */
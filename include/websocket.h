@@ -0,0 +1,133 @@
+/**
+ * @file websocket.h
+ * @brief Minimal RFC 6455 WebSocket server side
+ *
+ * Covers what the chat server needs to let browsers in: the HTTP upgrade
+ * handshake, decoding of masked client frames (fragmented messages and
+ * interleaved control frames included) and encoding of unmasked server
+ * frame headers. Like the frame parser, decoding is push-style and keeps
+ * its state between reads, so it runs inside the non-blocking event loop.
+ * Extensions and subprotocols are not negotiated.
+ */
+
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include "protocol.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Opcodes */
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+
+/* Largest frame header: 2 bytes, 8-byte extended length, 4-byte mask */
+#define WS_MAX_HEADER 14
+
+/* Largest control frame payload */
+#define WS_MAX_CONTROL 125
+
+/* Largest reassembled message accepted from a client */
+#define WS_MAX_MESSAGE (4 * BUF_SIZE)
+
+/* Largest HTTP upgrade request accepted */
+#define WS_MAX_REQUEST 4096
+
+/* Length of Sec-WebSocket-Accept (base64 of a SHA-1 digest) */
+#define WS_ACCEPT_LEN 28
+
+/**
+ * @brief Per-connection state
+ */
+typedef struct {
+    int open;                           /* Handshake completed */
+    char request[WS_MAX_REQUEST];       /* Upgrade request received so far */
+    size_t request_len;
+
+    uint8_t header[WS_MAX_HEADER];      /* Frame header received so far */
+    size_t header_len;
+    int in_payload;                     /* Header complete, payload pending */
+    uint8_t opcode;                     /* Opcode of the current frame */
+    int fin;                            /* Current frame ends its message */
+    uint8_t mask[4];
+    uint64_t payload_left;              /* Payload bytes still to come */
+    size_t payload_pos;                 /* Payload bytes received */
+
+    uint8_t message_opcode;             /* TEXT or BINARY, 0 between messages */
+    uint8_t message[WS_MAX_MESSAGE];    /* Data message being reassembled */
+    size_t message_len;
+    uint8_t control[WS_MAX_CONTROL];    /* Control frame payload */
+    size_t control_len;
+} ws_conn_t;
+
+/**
+ * @brief Called for every complete data message and control frame
+ * @param opcode WS_OPCODE_TEXT, BINARY, CLOSE, PING or PONG
+ * @param payload Unmasked payload (valid until the next decode call)
+ * @param len Length of payload
+ * @param arg User argument
+ * @return 0 to continue, non-zero to stop decoding
+ */
+typedef int (*ws_message_fn)(uint8_t opcode, const uint8_t *payload, size_t len, void *arg);
+
+/**
+ * @brief Reset connection state for a new connection
+ */
+void ws_conn_init(ws_conn_t *ws);
+
+/**
+ * @brief Compute Sec-WebSocket-Accept for a client key
+ * @param key Value of Sec-WebSocket-Key
+ * @param key_len Length of key
+ * @param out Output buffer of at least WS_ACCEPT_LEN + 1 bytes
+ */
+void ws_accept_key(const char *key, size_t key_len, char *out);
+
+/**
+ * @brief Feed bytes of the HTTP upgrade request
+ * @param ws Connection
+ * @param data Received bytes
+ * @param len Number of bytes
+ * @param consumed Set to the number of bytes that belonged to the request;
+ *                 anything after them is already WebSocket framing
+ * @param response Buffer for the 101 response
+ * @param cap Capacity of response
+ * @return Response length once the request is complete, 0 if more bytes
+ *         are needed, -1 if it is not a valid upgrade request
+ */
+int ws_handshake_feed(ws_conn_t *ws, const uint8_t *data, size_t len, size_t *consumed,
+                      char *response, size_t cap);
+
+/**
+ * @brief Feed received frame bytes
+ *
+ * If the handler stops decoding, the rest of the chunk is discarded.
+ *
+ * @return 0 when the chunk was consumed, 1 if the handler stopped decoding,
+ *         -1 on a protocol violation (unmasked or oversized frame, bad
+ *         fragmentation, reserved bits or opcodes)
+ */
+int ws_decode(ws_conn_t *ws, const uint8_t *data, size_t len, ws_message_fn handler, void *arg);
+
+/**
+ * @brief Encode the header of an unfragmented, unmasked server frame
+ * @param out Buffer of at least WS_MAX_HEADER bytes
+ * @param opcode Frame opcode
+ * @param payload_len Payload length
+ * @return Header length
+ */
+size_t ws_frame_header(uint8_t *out, uint8_t opcode, uint64_t payload_len);
+
+/**
+ * @brief Send a frame header and payload with one system call where possible
+ * @return payload_len on success, -1 on error
+ */
+ssize_t ws_send(int fd, const uint8_t *header, size_t header_len, const uint8_t *payload,
+                size_t payload_len);
+
+#endif /* WEBSOCKET_H */
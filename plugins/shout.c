@@ -0,0 +1,48 @@
+/**
+ * @file shout.c
+ * @brief Example plugin: lowercase messages written in capitals
+ *
+ * Build with `make plugins` and load with
+ *
+ *     ./server -P build/shout.so[:min_letters] 8080 100
+ *
+ * A message with at least min_letters letters (default 8), four fifths of
+ * them capitals, is rewritten in lowercase. Other messages are accepted.
+ */
+
+#include "chat_plugin.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int shout_init(const char *arg, void **state) {
+    long min_letters = arg ? strtol(arg, NULL, 10) : 8;
+    if (min_letters <= 0) {
+        return -1;
+    }
+    *state = (void *)(size_t)min_letters;
+    return 0;
+}
+
+static chat_plugin_verdict_t shout_on_message(void *state, const chat_plugin_message_t *msg,
+                                              char *rewrite, size_t *rewrite_len) {
+    size_t letters = 0;
+    size_t capitals = 0;
+    for (size_t i = 0; i < msg->payload_len; i++) {
+        char c = msg->payload[i];
+        letters += (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        capitals += c >= 'A' && c <= 'Z';
+    }
+    if (letters < (size_t)state || capitals * 5 < letters * 4 || msg->payload_len > *rewrite_len) {
+        return CHAT_PLUGIN_ACCEPT;
+    }
+
+    for (size_t i = 0; i < msg->payload_len; i++) {
+        char c = msg->payload[i];
+        rewrite[i] = c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+    }
+    *rewrite_len = msg->payload_len;
+    return CHAT_PLUGIN_REWRITE;
+}
+
+const chat_plugin_t chat_plugin = {CHAT_PLUGIN_ABI_VERSION, "shout", shout_init,
+                                   shout_on_message, NULL};
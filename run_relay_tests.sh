@@ -0,0 +1,108 @@
+#!/bin/bash
+
+# run_relay_tests.sh - End-to-end test of a relay fan-out tree
+#
+# Starts an origin that takes two relays directly, attaches five relays to
+# it (the last three are redirected one level down), puts a client on the
+# origin and on relays at both depths, and checks that every client saw
+# the same messages in the same order.
+
+set -e
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+YELLOW='\033[1;33m'
+NC='\033[0m' # No Color
+
+BASE_PORT=9500
+NUM_RELAYS=5
+MESSAGES=10
+CLIENTS="alice:0 bob:3 carol:4 dave:5"
+PIDS=""
+
+cleanup() {
+    kill $PIDS 2>/dev/null || true
+}
+trap cleanup EXIT
+
+echo -e "${GREEN}╔════════════════════════════════════════╗${NC}"
+echo -e "${GREEN}║  TCP Group Chat - Relay Tree Tests    ║${NC}"
+echo -e "${GREEN}╚════════════════════════════════════════╝${NC}"
+echo ""
+
+echo -e "${YELLOW}[1/4]${NC} Building project..."
+rm -f relay_*.log client_*.log
+make > /dev/null 2>&1
+echo -e "${GREEN}✓${NC} Build successful"
+
+echo -e "${YELLOW}[2/4]${NC} Starting origin and $NUM_RELAYS relays..."
+./server -f 2 $BASE_PORT 10 > relay_0.log 2>&1 &
+PIDS="$PIDS $!"
+sleep 0.5
+for i in $(seq 1 $NUM_RELAYS); do
+    ./server -f 2 -u 127.0.0.1:$BASE_PORT $((BASE_PORT + i)) 10 > relay_$i.log 2>&1 &
+    PIDS="$PIDS $!"
+    sleep 0.3
+    if ! grep -q "Attached as relay" relay_$i.log; then
+        echo -e "${RED}✗${NC} Relay $i failed to attach"
+        cat relay_$i.log
+        exit 1
+    fi
+done
+REDIRECTED=$(grep -l "Redirected to relay" relay_*.log | wc -l)
+echo -e "${GREEN}✓${NC} Tree built ($REDIRECTED relays redirected below the origin)"
+
+echo -e "${YELLOW}[3/4]${NC} Running clients..."
+CLIENT_PIDS=""
+for entry in $CLIENTS; do
+    name=${entry%%:*}
+    node=${entry##*:}
+    ./client 127.0.0.1 $((BASE_PORT + node)) $name $MESSAGES client_$name.log > /dev/null 2>&1 &
+    CLIENT_PIDS="$CLIENT_PIDS $!"
+done
+for pid in $CLIENT_PIDS; do
+    wait $pid 2>/dev/null || true
+done
+sleep 1
+
+echo -e "${YELLOW}[4/4]${NC} Verifying delivery..."
+# Clients start together, so one may miss messages sent before it joined.
+# After joining, every client must see the same messages in the same order:
+# its log must be a suffix of the fullest log, with nothing missing.
+FAIL_COUNT=0
+NUM_CLIENTS=$(echo $CLIENTS | wc -w)
+EXPECTED=$((NUM_CLIENTS * MESSAGES))
+REFERENCE=""
+for entry in $CLIENTS; do
+    name=${entry%%:*}
+    grep '^\[' client_$name.log > client_$name.chat || true
+    if [ -z "$REFERENCE" ] || [ $(wc -l < client_$name.chat) -gt $(wc -l < "$REFERENCE") ]; then
+        REFERENCE=client_$name.chat
+    fi
+done
+for entry in $CLIENTS; do
+    name=${entry%%:*}
+    node=${entry##*:}
+    count=$(wc -l < client_$name.chat)
+    own=$(grep -c "^\[$name@" client_$name.chat || true)
+    if [ "$own" -ne "$MESSAGES" ] || [ "$count" -lt $((EXPECTED - NUM_CLIENTS + 1)) ]; then
+        echo -e "${RED}✗${NC} $name (node $node): $count of $EXPECTED messages ($own own)"
+        FAIL_COUNT=$((FAIL_COUNT + 1))
+    elif ! tail -n "$count" "$REFERENCE" | cmp -s - client_$name.chat; then
+        echo -e "${RED}✗${NC} $name (node $node): messages missing or out of order"
+        FAIL_COUNT=$((FAIL_COUNT + 1))
+    else
+        echo -e "${GREEN}✓${NC} $name (node $node): $count messages"
+    fi
+done
+rm -f client_*.chat
+
+echo ""
+echo "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━"
+if [ $FAIL_COUNT -eq 0 ]; then
+    echo -e "${GREEN}✓ ALL RELAY TESTS PASSED${NC}"
+    exit 0
+else
+    echo -e "${RED}✗ SOME RELAY TESTS FAILED${NC} (see relay_*.log)"
+    exit 1
+fi
@@ -0,0 +1,209 @@
+/**
+ * @file admin.c
+ * @brief Implementation of the admin endpoint
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "admin.h"
+#include "common.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const char admin_not_found[] = "HTTP/1.1 404 Not Found\r\n"
+                                      "Content-Length: 0\r\n"
+                                      "Connection: close\r\n"
+                                      "\r\n";
+
+static const char admin_bad_request[] = "HTTP/1.1 400 Bad Request\r\n"
+                                        "Content-Length: 0\r\n"
+                                        "Connection: close\r\n"
+                                        "\r\n";
+
+static const char admin_unavailable[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                        "Content-Length: 0\r\n"
+                                        "Connection: close\r\n"
+                                        "\r\n";
+
+void admin_init(admin_t *admin, int listen_fd, admin_render_fn render, void *arg) {
+    memset(admin, 0, sizeof(*admin));
+    admin->listen_fd = listen_fd;
+    admin->render = render;
+    admin->arg = arg;
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        admin->conns[i].fd = -1;
+    }
+}
+
+static void close_conn(admin_conn_t *conn) {
+    close(conn->fd);
+    free(conn->response);
+    conn->fd = -1;
+    conn->request_len = 0;
+    conn->response = NULL;
+    conn->response_len = 0;
+    conn->response_sent = 0;
+}
+
+void admin_accept(admin_t *admin, int64_t now_ms) {
+    int fd = accept(admin->listen_fd, NULL, NULL);
+    if (fd == -1) {
+        log_message(LOG_ERROR, "Failed to accept admin connection: %s", strerror(errno));
+        return;
+    }
+    if (set_nonblocking(fd) == -1) {
+        close(fd);
+        return;
+    }
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        if (admin->conns[i].fd == -1) {
+            admin->conns[i].fd = fd;
+            admin->conns[i].active_ms = now_ms;
+            return;
+        }
+    }
+    log_message(LOG_WARN, "Admin connection limit reached, rejecting connection");
+    close(fd);
+}
+
+short admin_poll_events(const admin_t *admin, int index) {
+    return admin->conns[index].response ? POLLOUT : POLLIN;
+}
+
+int admin_parse_request(const char *request, size_t len, const char **path, size_t *path_len) {
+    int complete = 0;
+    for (size_t i = 0; i + 4 <= len; i++) {
+        if (memcmp(request + i, "\r\n\r\n", 4) == 0) {
+            complete = 1;
+            break;
+        }
+    }
+    if (len >= 4 && memcmp(request, "GET ", 4) != 0) {
+        return -1;
+    }
+    if (!complete) {
+        return 0;
+    }
+
+    const char *start = request + 4;
+    const char *end = memchr(start, ' ', len - 4);
+    const char *line_end = memchr(start, '\r', len - 4);
+    if (!end || end > line_end) {
+        end = line_end;
+    }
+    *path = start;
+    *path_len = (size_t)(end - start);
+    return 1;
+}
+
+/* Build the response to a request that is complete, invalid or too long */
+static void respond(admin_t *admin, admin_conn_t *conn, int parsed, const char *path,
+                    size_t path_len) {
+    const char *fixed = NULL;
+    if (parsed != 1) {
+        fixed = admin_bad_request;
+    } else if (path_len != strlen(ADMIN_METRICS_PATH) ||
+               memcmp(path, ADMIN_METRICS_PATH, path_len) != 0) {
+        fixed = admin_not_found;
+    }
+
+    const size_t header_cap = 128;
+    conn->response = malloc(header_cap + ADMIN_MAX_RESPONSE);
+    if (!conn->response) {
+        close_conn(conn);
+        return;
+    }
+
+    int body_len = fixed ? -1 : admin->render(conn->response + header_cap, ADMIN_MAX_RESPONSE,
+                                              admin->arg);
+    if (!fixed && body_len < 0) {
+        fixed = admin_unavailable;
+    }
+    if (fixed) {
+        conn->response_len = strlen(fixed);
+        memcpy(conn->response, fixed, conn->response_len);
+        return;
+    }
+
+    /* The headers go right in front of the body, and sending starts there */
+    char header[128];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 200 OK\r\n"
+                              "Content-Type: text/plain; version=0.0.4\r\n"
+                              "Content-Length: %d\r\n"
+                              "Connection: close\r\n"
+                              "\r\n",
+                              body_len);
+    conn->response_sent = header_cap - (size_t)header_len;
+    memcpy(conn->response + conn->response_sent, header, (size_t)header_len);
+    conn->response_len = header_cap + (size_t)body_len;
+}
+
+void admin_handle_events(admin_t *admin, int index, short revents, int64_t now_ms) {
+    admin_conn_t *conn = &admin->conns[index];
+
+    if (conn->response && (revents & (POLLOUT | POLLERR | POLLHUP))) {
+        ssize_t sent = send(conn->fd, conn->response + conn->response_sent,
+                            conn->response_len - conn->response_sent, MSG_NOSIGNAL);
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (sent > 0) {
+            conn->response_sent += (size_t)sent;
+            conn->active_ms = now_ms;
+        }
+        if (sent <= 0 || conn->response_sent == conn->response_len) {
+            close_conn(conn);
+        }
+        return;
+    }
+    if (conn->response || !(revents & (POLLIN | POLLERR | POLLHUP))) {
+        return;
+    }
+
+    ssize_t received = recv(conn->fd, conn->request + conn->request_len,
+                            sizeof(conn->request) - conn->request_len, 0);
+    if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (received <= 0) {
+        close_conn(conn);
+        return;
+    }
+    conn->request_len += (size_t)received;
+
+    const char *path = NULL;
+    size_t path_len = 0;
+    int parsed = admin_parse_request(conn->request, conn->request_len, &path, &path_len);
+    if (parsed == 0 && conn->request_len < sizeof(conn->request)) {
+        return;
+    }
+    respond(admin, conn, parsed, path, path_len);
+    conn->active_ms = now_ms;
+}
+
+void admin_sweep(admin_t *admin, int64_t now_ms) {
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        admin_conn_t *conn = &admin->conns[i];
+        if (conn->fd != -1 && now_ms - conn->active_ms >= ADMIN_TIMEOUT_MS) {
+            log_message(LOG_INFO, "Closing stalled admin connection");
+            close_conn(conn);
+        }
+    }
+}
+
+void admin_close(admin_t *admin) {
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        if (admin->conns[i].fd != -1) {
+            close_conn(&admin->conns[i]);
+        }
+    }
+    close(admin->listen_fd);
+    admin->listen_fd = -1;
+}
@@ -13,6 +13,7 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "common.h"
+#include "frame_parser.h"
 #include "protocol.h"
 #include <arpa/inet.h>
 #include <errno.h>
@@ -26,6 +27,12 @@
 
 #define RAND_BYTES 10
 
+/* Features offered in HELLO */
+#define CLIENT_FEATURES (FEATURE_ACKS | FEATURE_MSG_IDS)
+
+/* Bytes requested from the socket per recv() call */
+#define RECV_CHUNK_SIZE 4096
+
 /* Shared data between threads */
 typedef struct {
     int socket_fd;
@@ -33,17 +40,96 @@ typedef struct {
     FILE *log_file;
     volatile int should_stop;
     char username[MAX_USERNAME_LEN];
+    uint64_t next_msg_id;      /* ID attached to the next chat message */
+    pthread_mutex_t lock;
+    pthread_cond_t registered;  /* Signalled when register_status changes */
+    int register_status;        /* REGISTER_*, or -1 while waiting for the server */
+    int negotiated;             /* Whether the server's first frame has been seen */
+    uint32_t features;          /* FEATURE_* bits agreed with the server */
 } thread_data_t;
 
+/**
+ * @brief Block until the server has answered the username registration
+ * @return REGISTER_OK on success, the rejection status otherwise (-1 if the
+ *         connection closed first)
+ */
+static int wait_for_registration(thread_data_t *data) {
+    pthread_mutex_lock(&data->lock);
+    while (data->register_status == -1 && !data->should_stop) {
+        pthread_cond_wait(&data->registered, &data->lock);
+    }
+    int status = data->register_status;
+    pthread_mutex_unlock(&data->lock);
+    return status;
+}
+
+/**
+ * @brief Record the registration result and wake the sender thread
+ */
+static void set_register_status(thread_data_t *data, int status) {
+    pthread_mutex_lock(&data->lock);
+    data->register_status = status;
+    pthread_cond_broadcast(&data->registered);
+    pthread_mutex_unlock(&data->lock);
+}
+
+/**
+ * @brief Handle the first frame received from the server
+ *
+ * A server that supports the handshake always answers HELLO first. Any
+ * other frame means it predates HELLO, so no features are available and
+ * registration is assumed to have succeeded.
+ *
+ * @return 1 if the frame was a HELLO and has been consumed, 0 if it still
+ *         needs to be processed
+ */
+static int handle_handshake(thread_data_t *data, const uint8_t *frame, size_t len) {
+    data->negotiated = 1;
+    if (frame[0] != MSG_TYPE_HELLO || len != HELLO_SERVER_LEN) {
+        set_register_status(data, REGISTER_OK);
+        return 0;
+    }
+    
+    /* Server HELLO: [type][version][features:4]\n */
+    uint32_t features_net;
+    memcpy(&features_net, frame + 2, 4);
+    
+    pthread_mutex_lock(&data->lock);
+    data->features = ntohl(features_net);
+    pthread_mutex_unlock(&data->lock);
+    
+    /* Without acks there is nothing more to wait for */
+    if (!(data->features & FEATURE_ACKS)) {
+        set_register_status(data, REGISTER_OK);
+    }
+    return 1;
+}
+
+/**
+ * @brief Extract printable username and address from a peer frame
+ */
+static void peer_names(const peer_frame_t *peer, char *username, char *ip_str) {
+    if (peer->username_len > 0 && peer->username_len < MAX_USERNAME_LEN) {
+        memcpy(username, peer->username, peer->username_len);
+        username[peer->username_len] = '\0';
+    } else {
+        strcpy(username, "unknown");
+    }
+    
+    struct in_addr addr;
+    addr.s_addr = peer->ip;
+    inet_ntop(AF_INET, &addr, ip_str, INET_ADDRSTRLEN);
+}
+
 /**
  * @brief Sender thread - sends messages to the server
  */
 void *sender_thread(void *arg) {
     thread_data_t *data = (thread_data_t *)arg;
     
-    /* First, send username registration */
+    /* Open with HELLO and pipeline the username registration behind it */
     uint8_t username_msg[BUF_SIZE];
-    int offset = 0;
+    int offset = encode_client_hello(username_msg, CLIENT_FEATURES);
     username_msg[offset++] = MSG_TYPE_USERNAME;
     
     uint8_t username_len = (uint8_t)strlen(data->username);
@@ -57,8 +143,17 @@ void *sender_thread(void *arg) {
         return NULL;
     }
     
+    /* Chat frames are only accepted once the server has confirmed the name */
+    int status = wait_for_registration(data);
+    if (status != REGISTER_OK) {
+        if (status != -1) {
+            log_message(LOG_ERROR, "Registration failed: %s", register_status_str((uint8_t)status));
+        }
+        data->should_stop = 1;
+        shutdown(data->socket_fd, SHUT_RDWR);
+        return NULL;
+    }
     log_message(LOG_INFO, "Registered username: %s", data->username);
-    usleep(100000); /* Small delay to let username propagate */
     
     /* Send random messages */
     for (int i = 0; i < data->num_messages && !data->should_stop; i++) {
@@ -79,14 +174,25 @@ void *sender_thread(void *arg) {
             break;
         }
         
+        /* Chat message with ID: [type][16 hex id][message]\n, or a plain
+         * [type][message]\n if the server does not take IDs */
         uint8_t send_buf[BUF_SIZE];
-        send_buf[0] = MSG_TYPE_CHAT;
+        int send_len = 0;
+        if (data->features & FEATURE_MSG_IDS) {
+            send_buf[send_len++] = MSG_TYPE_CHAT_ID;
+            snprintf((char *)&send_buf[send_len], MSG_ID_HEX_LEN + 1, "%016llx",
+                     (unsigned long long)data->next_msg_id++);
+            send_len += MSG_ID_HEX_LEN;
+        } else {
+            send_buf[send_len++] = MSG_TYPE_CHAT;
+        }
         
         int msg_len = (int)strlen(hex_str);
-        memcpy(&send_buf[1], hex_str, msg_len);
-        send_buf[1 + msg_len] = '\n';
+        memcpy(&send_buf[send_len], hex_str, msg_len);
+        send_len += msg_len;
+        send_buf[send_len++] = '\n';
         
-        if (send(data->socket_fd, send_buf, 1 + msg_len + 1, 0) < 0) {
+        if (send(data->socket_fd, send_buf, send_len, 0) < 0) {
             log_message(LOG_ERROR, "Failed to send message");
             break;
         }
@@ -110,183 +216,105 @@ void *sender_thread(void *arg) {
     return NULL;
 }
 
+/**
+ * @brief Frame parser callback - logs one frame from the server
+ * @return 0 to keep reading, 1 to stop
+ */
+static int handle_frame(const uint8_t *frame, size_t len, void *arg) {
+    thread_data_t *data = (thread_data_t *)arg;
+    uint8_t type = frame[0];
+    
+    /* The server's first frame tells whether it understood HELLO */
+    if (!data->negotiated && handle_handshake(data, frame, len)) {
+        return 0;
+    }
+    
+    if (type == MSG_TYPE_CHAT || type == MSG_TYPE_JOIN || type == MSG_TYPE_DISCONNECT) {
+        /* [type][ip][port][username_len][username][message]\n */
+        peer_frame_t peer;
+        if (decode_peer_frame(frame, len, &peer) != 0) {
+            return 1;
+        }
+        
+        char username[MAX_USERNAME_LEN];
+        char ip_str[INET_ADDRSTRLEN];
+        peer_names(&peer, username, ip_str);
+        uint16_t port_host = ntohs(peer.port);
+        
+        /* Log formatted message */
+        if (type == MSG_TYPE_CHAT) {
+            fprintf(data->log_file, "[%s@%s:%u] %.*s\n",
+                    username, ip_str, port_host, (int)peer.payload_len, peer.payload);
+        } else if (type == MSG_TYPE_JOIN) {
+            fprintf(data->log_file, "*** %s joined the chat from %s:%u ***\n", 
+                    username, ip_str, port_host);
+        } else {
+            fprintf(data->log_file, "*** %s left the chat from %s:%u ***\n", 
+                    username, ip_str, port_host);
+        }
+        fflush(data->log_file);
+        
+    } else if (type == MSG_TYPE_REGISTER_ACK) {
+        /* Registration result: [type][status]\n */
+        set_register_status(data, frame[1]);
+        
+    } else if (type == MSG_TYPE_CHAT_FAILED) {
+        /* Message not stored: [type][16 hex id]\n */
+        log_message(LOG_WARN, "Message %.*s was not delivered", MSG_ID_HEX_LEN,
+                    (const char *)frame + 1);
+        fprintf(data->log_file, "*** Message %.*s was not delivered ***\n", MSG_ID_HEX_LEN,
+                (const char *)frame + 1);
+        fflush(data->log_file);
+        
+    } else {
+        log_message(LOG_WARN, "Unknown message type: %u", type);
+        return 1;
+    }
+    return 0;
+}
+
 /**
  * @brief Receiver thread - receives and logs messages from server
+ *
+ * Whatever recv returns is pushed through the frame parser, so one call
+ * may deliver several frames and a frame may span several calls.
  */
 void *receiver_thread(void *arg) {
     thread_data_t *data = (thread_data_t *)arg;
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    uint8_t chunk[RECV_CHUNK_SIZE];
     
     while (!data->should_stop) {
-        uint8_t type;
-        ssize_t r = recv_exact(data->socket_fd, &type, 1);
+        ssize_t r = recv(data->socket_fd, chunk, sizeof(chunk), 0);
         
         if (r <= 0) {
+            if (r == -1 && errno == EINTR) {
+                continue;
+            }
             if (r == 0) {
                 log_message(LOG_INFO, "Server closed connection");
             } else {
-                log_message(LOG_ERROR, "recv_exact failed");
+                log_message(LOG_ERROR, "recv failed");
             }
             break;
         }
         
-        if (type == MSG_TYPE_CHAT) {
-            /* Chat message: [type][ip][port][username_len][username][message]\n */
-            uint32_t ip_net;
-            uint16_t port_net;
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&ip_net, sizeof(ip_net)) <= 0) {
-                break;
-            }
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&port_net, sizeof(port_net)) <= 0) {
-                break;
-            }
-            
-            uint8_t username_len;
-            if (recv_exact(data->socket_fd, &username_len, 1) <= 0) {
-                break;
-            }
-            
-            char username[MAX_USERNAME_LEN];
-            if (username_len > 0 && username_len < MAX_USERNAME_LEN) {
-                if (recv_exact(data->socket_fd, (uint8_t *)username, username_len) <= 0) {
-                    break;
-                }
-                username[username_len] = '\0';
-            } else {
-                strcpy(username, "unknown");
-            }
-            
-            /* Read message until newline */
-            char msg_buf[BUF_SIZE];
-            int idx = 0;
-            while (1) {
-                uint8_t ch;
-                r = recv(data->socket_fd, &ch, 1, 0);
-                if (r <= 0) {
-                    data->should_stop = 1;
-                    break;
-                }
-                if (ch == '\n') {
-                    break;
-                }
-                if (idx < (int)sizeof(msg_buf) - 1) {
-                    msg_buf[idx++] = (char)ch;
-                }
-            }
-            
-            if (data->should_stop) {
-                break;
-            }
-            
-            msg_buf[idx] = '\0';
-            
-            /* Convert IP to string */
-            struct in_addr addr;
-            addr.s_addr = ip_net;
-            char ip_str[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &addr, ip_str, sizeof(ip_str));
-            
-            uint16_t port_host = ntohs(port_net);
-            
-            /* Log formatted message */
-            fprintf(data->log_file, "[%s@%s:%u] %s\n", 
-                    username, ip_str, port_host, msg_buf);
-            fflush(data->log_file);
-            
-        } else if (type == MSG_TYPE_JOIN) {
-            /* Join notification: [type][ip][port][username_len][username]\n */
-            uint32_t ip_net;
-            uint16_t port_net;
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&ip_net, sizeof(ip_net)) <= 0) {
-                break;
-            }
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&port_net, sizeof(port_net)) <= 0) {
-                break;
-            }
-            
-            uint8_t username_len;
-            if (recv_exact(data->socket_fd, &username_len, 1) <= 0) {
-                break;
-            }
-            
-            char username[MAX_USERNAME_LEN];
-            if (username_len > 0 && username_len < MAX_USERNAME_LEN) {
-                if (recv_exact(data->socket_fd, (uint8_t *)username, username_len) <= 0) {
-                    break;
-                }
-                username[username_len] = '\0';
-            } else {
-                strcpy(username, "unknown");
-            }
-            
-            /* Read newline */
-            uint8_t newline;
-            if (recv(data->socket_fd, &newline, 1, 0) <= 0) {
-                break;
-            }
-            
-            struct in_addr addr;
-            addr.s_addr = ip_net;
-            char ip_str[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &addr, ip_str, sizeof(ip_str));
-            
-            fprintf(data->log_file, "*** %s joined the chat from %s:%u ***\n", 
-                    username, ip_str, ntohs(port_net));
-            fflush(data->log_file);
-            
-        } else if (type == MSG_TYPE_DISCONNECT) {
-            /* Disconnect notification */
-            uint32_t ip_net;
-            uint16_t port_net;
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&ip_net, sizeof(ip_net)) <= 0) {
-                break;
-            }
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&port_net, sizeof(port_net)) <= 0) {
-                break;
-            }
-            
-            uint8_t username_len;
-            if (recv_exact(data->socket_fd, &username_len, 1) <= 0) {
-                break;
-            }
-            
-            char username[MAX_USERNAME_LEN];
-            if (username_len > 0 && username_len < MAX_USERNAME_LEN) {
-                if (recv_exact(data->socket_fd, (uint8_t *)username, username_len) <= 0) {
-                    break;
-                }
-                username[username_len] = '\0';
-            } else {
-                strcpy(username, "unknown");
-            }
-            
-            /* Read newline */
-            uint8_t newline;
-            if (recv(data->socket_fd, &newline, 1, 0) <= 0) {
-                break;
-            }
-            
-            struct in_addr addr;
-            addr.s_addr = ip_net;
-            char ip_str[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &addr, ip_str, sizeof(ip_str));
-            
-            fprintf(data->log_file, "*** %s left the chat from %s:%u ***\n", 
-                    username, ip_str, ntohs(port_net));
-            fflush(data->log_file);
-            
-        } else {
-            log_message(LOG_WARN, "Unknown message type: %u", type);
-            data->should_stop = 1;
+        int rc = frame_parser_feed(&parser, chunk, (size_t)r, handle_frame, data);
+        if (rc == -1) {
+            log_message(LOG_WARN, "Malformed frame from server");
+        }
+        if (rc != 0) {
             break;
         }
     }
     
+    /* Unblock a sender still waiting for its registration */
+    pthread_mutex_lock(&data->lock);
+    data->should_stop = 1;
+    pthread_cond_broadcast(&data->registered);
+    pthread_mutex_unlock(&data->lock);
+    
     log_message(LOG_INFO, "Receiver thread completed");
     return NULL;
 }
@@ -355,10 +383,20 @@ int main(int argc, char *argv[]) {
         .num_messages = num_messages,
         .log_file = log_file,
         .should_stop = 0,
+        .register_status = -1,
     };
+    pthread_mutex_init(&thread_data.lock, NULL);
+    pthread_cond_init(&thread_data.registered, NULL);
     strncpy(thread_data.username, username, MAX_USERNAME_LEN - 1);
     thread_data.username[MAX_USERNAME_LEN - 1] = '\0';
     
+    /* Random starting ID keeps IDs unique across sessions of one user */
+    if (random_u64(&thread_data.next_msg_id) != 0) {
+        close(sfd);
+        fclose(log_file);
+        handle_error("random_u64");
+    }
+    
     /* Create threads */
     pthread_t sender_tid, receiver_tid;
     
@@ -381,6 +419,8 @@ int main(int argc, char *argv[]) {
     log_message(LOG_INFO, "Disconnected from server");
     
     /* Cleanup */
+    pthread_cond_destroy(&thread_data.registered);
+    pthread_mutex_destroy(&thread_data.lock);
     close(sfd);
     fclose(log_file);
     log_close();
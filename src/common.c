@@ -98,6 +98,45 @@ int bytes_to_hex(const uint8_t *buf, ssize_t buf_size, char *str, ssize_t str_si
     return 0;
 }
 
+int hex_to_u64(const char *str, size_t len, uint64_t *out) {
+    if (str == NULL || out == NULL || len == 0 || len > 16) {
+        return -1;
+    }
+
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = str[i];
+        uint64_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = (uint64_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = (uint64_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            digit = (uint64_t)(c - 'A' + 10);
+        } else {
+            return -1;
+        }
+        value = (value << 4) | digit;
+    }
+
+    *out = value;
+    return 0;
+}
+
+int random_u64(uint64_t *out) {
+    if (out == NULL) {
+        return -1;
+    }
+
+    FILE *urandom = fopen("/dev/urandom", "r");
+    if (!urandom) {
+        return -1;
+    }
+    size_t n = fread(out, 1, sizeof(*out), urandom);
+    fclose(urandom);
+    return n == sizeof(*out) ? 0 : -1;
+}
+
 int set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) {
@@ -0,0 +1,165 @@
+/**
+ * @file compactor.c
+ * @brief Implementation of the background history compactor
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "compactor.h"
+#include "common.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Scan callback adding each record to the index being rebuilt */
+static void rebuild_record(uint64_t offset, const history_record_t *rec, void *arg) {
+    search_index_t *index = arg;
+    search_index_add(index, offset, rec->text, rec->text_len);
+}
+
+/**
+ * @brief Checkpoint, apply retention and rebuild the index if needed
+ *
+ * Runs with compactor->lock held.
+ */
+static void compact_pass(compactor_t *compactor) {
+    if (history_checkpoint(compactor->history) == -1) {
+        log_message(LOG_WARN, "Compactor failed to write history checkpoint");
+    }
+
+    if (compactor->retention.max_age > 0 || compactor->retention.max_bytes > 0) {
+        ssize_t expired = history_expire(compactor->history, &compactor->retention,
+                                         (int64_t)time(NULL));
+        if (expired > 0) {
+            log_message(LOG_INFO, "Compactor deleted %zd expired history segment(s)", expired);
+            compactor->needs_rebuild = 1;
+        }
+    }
+
+    if (!compactor->needs_rebuild) {
+        return;
+    }
+
+    search_index_t *index = malloc(sizeof(search_index_t));
+    if (!index || search_index_init(index) == -1) {
+        free(index);
+        log_message(LOG_ERROR, "Compactor failed to allocate index");
+        return;
+    }
+
+    /* Searches only see recent messages until the first build is in, so
+     * that one is not throttled */
+    uint64_t start = history_start_offset(compactor->history);
+    uint64_t end = history_delivered_offset(compactor->history);
+    uint64_t bytes_per_sec = compactor->built ? compactor->io_bytes_per_sec : 0;
+    int rc = history_scan_range(compactor->history, start, end, rebuild_record, index,
+                                bytes_per_sec);
+
+    /* Catch up at full speed with what was delivered during the scan, so
+     * the event loop is left with little to index */
+    uint64_t delivered = history_delivered_offset(compactor->history);
+    while (rc == 0 && delivered > end && delivered - end > COMPACT_CATCH_UP_BYTES) {
+        rc = history_scan_range(compactor->history, end, delivered, rebuild_record, index, 0);
+        end = delivered;
+        delivered = history_delivered_offset(compactor->history);
+    }
+
+    if (rc == -1) {
+        log_message(LOG_ERROR, "Compactor failed to rebuild index");
+        search_index_free(index);
+        free(index);
+        return;
+    }
+
+    compactor->ready_index = index;
+    compactor->ready_end = end;
+    compactor->needs_rebuild = 0;
+    compactor->built = 1;
+    log_message(LOG_INFO, "Compactor rebuilt index (%llu messages)",
+                (unsigned long long)index->num_docs);
+}
+
+static void *compactor_thread(void *arg) {
+    compactor_t *compactor = arg;
+
+    pthread_mutex_lock(&compactor->lock);
+    compact_pass(compactor);
+    while (!compactor->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += compactor->interval_sec;
+
+        int rc = 0;
+        while (!compactor->stopping && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&compactor->wake, &compactor->lock, &deadline);
+        }
+
+        /* Skip the pass until the event loop has taken the last index */
+        if (!compactor->stopping && compactor->ready_index == NULL) {
+            compact_pass(compactor);
+        }
+    }
+    pthread_mutex_unlock(&compactor->lock);
+
+    return NULL;
+}
+
+int compactor_start(compactor_t *compactor, history_t *history,
+                    const history_retention_t *retention, unsigned interval_sec,
+                    uint64_t io_bytes_per_sec) {
+    if (!compactor || !history || !retention || interval_sec == 0) {
+        return -1;
+    }
+
+    compactor->history = history;
+    compactor->retention = *retention;
+    compactor->interval_sec = interval_sec;
+    compactor->io_bytes_per_sec = io_bytes_per_sec;
+    compactor->stopping = 0;
+    compactor->ready_index = NULL;
+    compactor->ready_end = 0;
+    compactor->needs_rebuild = 1;
+    compactor->built = 0;
+    pthread_mutex_init(&compactor->lock, NULL);
+    pthread_cond_init(&compactor->wake, NULL);
+
+    if (pthread_create(&compactor->thread, NULL, compactor_thread, compactor) != 0) {
+        pthread_cond_destroy(&compactor->wake);
+        pthread_mutex_destroy(&compactor->lock);
+        return -1;
+    }
+    return 0;
+}
+
+int compactor_poll(compactor_t *compactor, compactor_install_fn install, void *arg) {
+    if (pthread_mutex_trylock(&compactor->lock) != 0) {
+        return 0; /* Pass in progress */
+    }
+
+    int installed = 0;
+    if (compactor->ready_index) {
+        install(compactor->ready_index, compactor->ready_end, arg);
+        compactor->ready_index = NULL;
+        installed = 1;
+    }
+
+    pthread_mutex_unlock(&compactor->lock);
+    return installed;
+}
+
+void compactor_stop(compactor_t *compactor) {
+    pthread_mutex_lock(&compactor->lock);
+    compactor->stopping = 1;
+    pthread_cond_signal(&compactor->wake);
+    pthread_mutex_unlock(&compactor->lock);
+    pthread_join(compactor->thread, NULL);
+
+    if (compactor->ready_index) {
+        search_index_free(compactor->ready_index);
+        free(compactor->ready_index);
+        compactor->ready_index = NULL;
+    }
+    pthread_cond_destroy(&compactor->wake);
+    pthread_mutex_destroy(&compactor->lock);
+}
@@ -0,0 +1,370 @@
+/**
+ * @file content_filter.c
+ * @brief Implementation of the banned-term filter
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "content_filter.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define AC_HAVE_SSSE3 1
+#endif
+
+/* The start-state prefilter only pays off if most bytes cannot start a term */
+#define AC_PREFILTER_MAX_STARTS 32
+
+static uint8_t fold(uint8_t byte) {
+    return byte >= 'A' && byte <= 'Z' ? (uint8_t)(byte - 'A' + 'a') : byte;
+}
+
+#ifdef AC_HAVE_SSSE3
+/**
+ * @brief Skip to the first byte in the start set, 16 bytes at a time
+ *
+ * Looks each byte up in a 16x16 bit table split by nibbles: the low nibble
+ * selects a row of eight high-nibble bits from one of two shuffle tables,
+ * and the high nibble selects the bit.
+ */
+__attribute__((target("ssse3")))
+static const uint8_t *skip_ssse3(const ac_automaton_t *ac, const uint8_t *p,
+                                 const uint8_t *end) {
+    const __m128i rows_low = _mm_loadu_si128((const __m128i *)ac->start_rows[0]);
+    const __m128i rows_high = _mm_loadu_si128((const __m128i *)ac->start_rows[1]);
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i seven = _mm_set1_epi8(7);
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i lo = _mm_and_si128(v, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+        __m128i high_half = _mm_cmpgt_epi8(hi, seven);
+        __m128i row = _mm_or_si128(_mm_andnot_si128(high_half, _mm_shuffle_epi8(rows_low, lo)),
+                                   _mm_and_si128(high_half, _mm_shuffle_epi8(rows_high, lo)));
+        __m128i hit = _mm_and_si128(row, _mm_shuffle_epi8(bits, hi));
+        int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())) & 0xffff;
+        if (mask) {
+            return p + __builtin_ctz((unsigned)mask);
+        }
+        p += 16;
+    }
+    return p;
+}
+#endif
+
+/* Advance p to the next byte that can start a term, or to end */
+static const uint8_t *skip_to_start(const ac_automaton_t *ac, const uint8_t *p,
+                                    const uint8_t *end) {
+#ifdef AC_HAVE_SSSE3
+    if (ac->prefilter == 2) {
+        p = skip_ssse3(ac, p, end);
+    }
+#endif
+    while (p < end && !ac->starts[*p]) {
+        p++;
+    }
+    return p;
+}
+
+ac_automaton_t *ac_build(const char *const *terms, const size_t *lens, size_t num_terms) {
+    ac_automaton_t *ac = calloc(1, sizeof(*ac));
+    if (!ac) {
+        return NULL;
+    }
+
+    /* Byte classes: one per distinct (folded) byte used by the terms */
+    size_t max_states = 1;
+    int used[256] = {0};
+    for (size_t t = 0; t < num_terms; t++) {
+        for (size_t i = 0; i < lens[t]; i++) {
+            used[fold((uint8_t)terms[t][i])] = 1;
+        }
+        max_states += lens[t];
+    }
+    ac->num_classes = 1;
+    for (int b = 0; b < 256; b++) {
+        if (used[b]) {
+            ac->classes[b] = (uint8_t)ac->num_classes++;
+        }
+    }
+    for (int b = 'A'; b <= 'Z'; b++) {
+        ac->classes[b] = ac->classes[fold((uint8_t)b)];
+    }
+
+    /* Trie in the dense table; 0 means "no child" until failure links fill it */
+    size_t nc = ac->num_classes;
+    if (max_states * nc >= AC_ACCEPT) {
+        ac_free(ac);
+        return NULL;
+    }
+    ac->delta = calloc(max_states * nc, sizeof(uint32_t));
+    uint32_t *fail = calloc(max_states, sizeof(uint32_t));
+    uint32_t *queue = calloc(max_states, sizeof(uint32_t));
+    uint8_t *accept = calloc(max_states, 1);
+    if (!ac->delta || !fail || !queue || !accept) {
+        free(fail);
+        free(queue);
+        free(accept);
+        ac_free(ac);
+        return NULL;
+    }
+
+    ac->num_states = 1;
+    for (size_t t = 0; t < num_terms; t++) {
+        if (lens[t] == 0) {
+            continue;
+        }
+        uint32_t state = 0;
+        for (size_t i = 0; i < lens[t]; i++) {
+            uint32_t *next = &ac->delta[state * nc + ac->classes[(uint8_t)terms[t][i]]];
+            if (*next == 0) {
+                *next = ac->num_states++;
+            }
+            state = *next;
+        }
+        accept[state] = 1;
+        ac->num_terms++;
+    }
+
+    /* Breadth-first: a state's failure target is shallower, so its row is
+     * already complete when the state's missing transitions copy from it */
+    size_t head = 0;
+    size_t tail = 0;
+    for (size_t c = 0; c < nc; c++) {
+        if (ac->delta[c]) {
+            queue[tail++] = ac->delta[c];
+        }
+    }
+    while (head < tail) {
+        uint32_t state = queue[head++];
+        accept[state] |= accept[fail[state]];
+        uint32_t *row = &ac->delta[state * nc];
+        const uint32_t *fail_row = &ac->delta[fail[state] * nc];
+        for (size_t c = 0; c < nc; c++) {
+            if (row[c]) {
+                fail[row[c]] = fail_row[c];
+                queue[tail++] = row[c];
+            } else {
+                row[c] = fail_row[c];
+            }
+        }
+    }
+
+    /* Store targets as row offsets, which saves a multiply per byte, and flag
+     * transitions into accepting states so matching needs one load */
+    for (size_t i = 0; i < ac->num_states * nc; i++) {
+        uint32_t target = ac->delta[i];
+        ac->delta[i] = (uint32_t)(target * nc) | (accept[target] ? AC_ACCEPT : 0);
+    }
+    free(fail);
+    free(queue);
+    free(accept);
+
+    uint32_t *shrunk = realloc(ac->delta, ac->num_states * nc * sizeof(uint32_t));
+    if (shrunk) {
+        ac->delta = shrunk;
+    }
+
+    /* Bytes that leave the start state, also as the SSSE3 nibble table */
+    size_t num_starts = 0;
+    for (int b = 0; b < 256; b++) {
+        ac->starts[b] = ac->delta[ac->classes[b]] != 0;
+        if (ac->starts[b]) {
+            ac->start_rows[b >> 7][b & 0x0f] |= (uint8_t)(1u << ((b >> 4) & 7));
+            num_starts++;
+        }
+    }
+    if (num_starts <= AC_PREFILTER_MAX_STARTS) {
+        ac->prefilter = 1;
+#ifdef AC_HAVE_SSSE3
+        if (__builtin_cpu_supports("ssse3")) {
+            ac->prefilter = 2;
+        }
+#endif
+    }
+    return ac;
+}
+
+ac_automaton_t *ac_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return NULL;
+    }
+
+    char **terms = NULL;
+    size_t *lens = NULL;
+    size_t num_terms = 0;
+    size_t cap = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    int failed = 0;
+    while ((line_len = getline(&line, &line_cap, file)) != -1) {
+        while (line_len > 0 && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) {
+            line_len--;
+        }
+        if (line_len == 0 || line[0] == '#') {
+            continue;
+        }
+        if (num_terms == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **grown_terms = realloc(terms, cap * sizeof(*terms));
+            size_t *grown_lens = grown_terms ? realloc(lens, cap * sizeof(*lens)) : NULL;
+            if (grown_terms) {
+                terms = grown_terms;
+            }
+            if (!grown_lens) {
+                failed = 1;
+                break;
+            }
+            lens = grown_lens;
+        }
+        if (!(terms[num_terms] = malloc((size_t)line_len))) {
+            failed = 1;
+            break;
+        }
+        memcpy(terms[num_terms], line, (size_t)line_len);
+        lens[num_terms++] = (size_t)line_len;
+    }
+    free(line);
+    fclose(file);
+
+    ac_automaton_t *ac = failed ? NULL : ac_build((const char *const *)terms, lens, num_terms);
+    for (size_t i = 0; i < num_terms; i++) {
+        free(terms[i]);
+    }
+    free(terms);
+    free(lens);
+    return ac;
+}
+
+void ac_free(ac_automaton_t *ac) {
+    if (ac) {
+        free(ac->delta);
+        free(ac);
+    }
+}
+
+int ac_match(const ac_automaton_t *ac, const char *text, size_t len) {
+    const uint8_t *p = (const uint8_t *)text;
+    const uint8_t *end = p + len;
+    const uint32_t *delta = ac->delta;
+    uint32_t row = 0;
+
+    while (p < end) {
+        if (row == 0 && ac->prefilter && (p = skip_to_start(ac, p, end)) == end) {
+            break;
+        }
+        uint32_t next = delta[row + ac->classes[*p++]];
+        if (next & AC_ACCEPT) {
+            return 1;
+        }
+        row = next;
+    }
+    return 0;
+}
+
+static void *content_filter_thread(void *arg) {
+    content_filter_t *filter = arg;
+
+    pthread_mutex_lock(&filter->lock);
+    while (!filter->stopping) {
+        if (!filter->reload_requested) {
+            pthread_cond_wait(&filter->wake, &filter->lock);
+            continue;
+        }
+        filter->reload_requested = 0;
+
+        /* Compile without the lock so the event loop can keep swapping */
+        pthread_mutex_unlock(&filter->lock);
+        ac_automaton_t *ac = ac_load(filter->path);
+        pthread_mutex_lock(&filter->lock);
+
+        if (!ac) {
+            log_message(LOG_WARN, "Failed to reload banned terms from %s; keeping the old list",
+                        filter->path);
+            continue;
+        }
+        ac_free(filter->ready);
+        filter->ready = ac;
+        log_message(LOG_INFO, "Reloaded %zu banned terms (%u states)", ac->num_terms,
+                    ac->num_states);
+    }
+    pthread_mutex_unlock(&filter->lock);
+
+    return NULL;
+}
+
+int content_filter_start(content_filter_t *filter, const char *path) {
+    memset(filter, 0, sizeof(*filter));
+    filter->path = path;
+    filter->active = ac_load(path);
+    if (!filter->active) {
+        return -1;
+    }
+
+    pthread_mutex_init(&filter->lock, NULL);
+    pthread_cond_init(&filter->wake, NULL);
+    if (pthread_create(&filter->thread, NULL, content_filter_thread, filter) != 0) {
+        pthread_cond_destroy(&filter->wake);
+        pthread_mutex_destroy(&filter->lock);
+        ac_free(filter->active);
+        return -1;
+    }
+    return 0;
+}
+
+void content_filter_reload(content_filter_t *filter) {
+    pthread_mutex_lock(&filter->lock);
+    filter->reload_requested = 1;
+    pthread_cond_signal(&filter->wake);
+    pthread_mutex_unlock(&filter->lock);
+}
+
+int content_filter_poll(content_filter_t *filter) {
+    if (pthread_mutex_trylock(&filter->lock) != 0) {
+        return 0;
+    }
+
+    int installed = 0;
+    if (filter->ready) {
+        ac_free(filter->active);
+        filter->active = filter->ready;
+        filter->ready = NULL;
+        installed = 1;
+    }
+
+    pthread_mutex_unlock(&filter->lock);
+    return installed;
+}
+
+int content_filter_check(content_filter_t *filter, const char *text, size_t len) {
+    filter->checked++;
+    if (ac_match(filter->active, text, len)) {
+        filter->blocked++;
+        return 1;
+    }
+    return 0;
+}
+
+void content_filter_stop(content_filter_t *filter) {
+    pthread_mutex_lock(&filter->lock);
+    filter->stopping = 1;
+    pthread_cond_signal(&filter->wake);
+    pthread_mutex_unlock(&filter->lock);
+    pthread_join(filter->thread, NULL);
+
+    ac_free(filter->ready);
+    ac_free(filter->active);
+    filter->ready = NULL;
+    filter->active = NULL;
+    pthread_cond_destroy(&filter->wake);
+    pthread_mutex_destroy(&filter->lock);
+}
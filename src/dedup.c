@@ -0,0 +1,141 @@
+/**
+ * @file dedup.c
+ * @brief Implementation of per-sender message ID deduplication
+ */
+
+#include "dedup.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* FNV-1a 64-bit hash of a NUL-terminated string */
+static uint64_t hash_string(const char *str) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1; /* 0 marks a free slot */
+}
+
+/* Fold a 64-bit message ID into a well-mixed 32-bit fingerprint */
+static uint32_t fingerprint(uint64_t msg_id) {
+    msg_id ^= msg_id >> 33;
+    msg_id *= 0xff51afd7ed558ccdULL;
+    msg_id ^= msg_id >> 33;
+    return (uint32_t)msg_id;
+}
+
+int dedup_table_init(dedup_table_t *table, size_t capacity) {
+    if (!table || capacity == 0) {
+        return -1;
+    }
+
+    table->entries = calloc(capacity, sizeof(dedup_entry_t));
+    if (!table->entries) {
+        return -1;
+    }
+    table->capacity = capacity;
+    table->clock = 0;
+    return 0;
+}
+
+void dedup_table_free(dedup_table_t *table) {
+    if (!table) {
+        return;
+    }
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+}
+
+/**
+ * @brief Find the ring for a sender, claiming or evicting a slot if needed
+ */
+static dedup_ring_t *lookup_ring(dedup_table_t *table, uint64_t sender_hash) {
+    size_t start = (size_t)(sender_hash % table->capacity);
+    size_t probes = table->capacity < DEDUP_PROBE ? table->capacity : DEDUP_PROBE;
+    dedup_entry_t *victim = NULL;
+
+    for (size_t i = 0; i < probes; i++) {
+        dedup_entry_t *entry = &table->entries[(start + i) % table->capacity];
+        if (entry->sender_hash == sender_hash) {
+            entry->last_used = ++table->clock;
+            return &entry->ring;
+        }
+        if (entry->sender_hash == 0) {
+            if (!victim || victim->sender_hash != 0) {
+                victim = entry;
+            }
+        } else if (!victim || (victim->sender_hash != 0 && entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+
+    /* Unknown sender: reuse a free slot or evict the least recently used one */
+    memset(victim, 0, sizeof(*victim));
+    victim->sender_hash = sender_hash;
+    victim->last_used = ++table->clock;
+    return &victim->ring;
+}
+
+/* Slot of the i-th oldest fingerprint in a ring */
+static uint32_t ring_slot(const dedup_ring_t *ring, uint32_t i) {
+    return (ring->next + DEDUP_WINDOW - ring->count + i) % DEDUP_WINDOW;
+}
+
+int dedup_check(dedup_table_t *table, const char *sender, uint64_t msg_id) {
+    if (!table || !table->entries || !sender) {
+        return 0;
+    }
+
+    dedup_ring_t *ring = lookup_ring(table, hash_string(sender));
+    uint32_t fp = fingerprint(msg_id);
+
+    for (uint32_t i = 0; i < ring->count; i++) {
+        if (ring->fingerprints[ring_slot(ring, i)] == fp) {
+            return 1;
+        }
+    }
+
+    ring->fingerprints[ring->next] = fp;
+    ring->next = (ring->next + 1) % DEDUP_WINDOW;
+    if (ring->count < DEDUP_WINDOW) {
+        ring->count++;
+    }
+    return 0;
+}
+
+void dedup_forget(dedup_table_t *table, const char *sender, uint64_t msg_id) {
+    if (!table || !table->entries || !sender) {
+        return;
+    }
+
+    /* Look the sender up without claiming a slot */
+    uint64_t sender_hash = hash_string(sender);
+    size_t start = (size_t)(sender_hash % table->capacity);
+    size_t probes = table->capacity < DEDUP_PROBE ? table->capacity : DEDUP_PROBE;
+    dedup_ring_t *ring = NULL;
+    for (size_t i = 0; i < probes && !ring; i++) {
+        dedup_entry_t *entry = &table->entries[(start + i) % table->capacity];
+        if (entry->sender_hash == sender_hash) {
+            ring = &entry->ring;
+        }
+    }
+    if (!ring) {
+        return;
+    }
+
+    /* Close the gap by moving the newer fingerprints back one place */
+    uint32_t fp = fingerprint(msg_id);
+    for (uint32_t i = 0; i < ring->count; i++) {
+        if (ring->fingerprints[ring_slot(ring, i)] != fp) {
+            continue;
+        }
+        for (uint32_t j = i; j + 1 < ring->count; j++) {
+            ring->fingerprints[ring_slot(ring, j)] = ring->fingerprints[ring_slot(ring, j + 1)];
+        }
+        ring->next = (ring->next + DEDUP_WINDOW - 1) % DEDUP_WINDOW;
+        ring->count--;
+        return;
+    }
+}
@@ -0,0 +1,138 @@
+/**
+ * @file ephemeral.c
+ * @brief Implementation of ephemeral signal coalescing
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "ephemeral.h"
+#include <stdlib.h>
+#include <string.h>
+
+int ephemeral_init(ephemeral_t *eph, size_t num_slots) {
+    memset(eph, 0, sizeof(*eph));
+    eph->slots = calloc(num_slots, sizeof(ephemeral_slot_t));
+    if (!eph->slots) {
+        return -1;
+    }
+    eph->num_slots = num_slots;
+    for (size_t i = 0; i < num_slots; i++) {
+        slotset_init(&eph->slots[i].owed, num_slots);
+    }
+    slotset_init(&eph->dirty, num_slots);
+    slotset_init(&eph->backlogged, num_slots);
+    return 0;
+}
+
+int ephemeral_set(ephemeral_t *eph, size_t sender, uint8_t kind, int64_t now_ms) {
+    ephemeral_slot_t *slot = &eph->slots[sender];
+    slot->kind = kind;
+    slot->at_ms = now_ms;
+
+    if (slotset_contains(&eph->dirty, sender)) {
+        eph->coalesced++;
+        return 1;
+    }
+    if (kind == slot->sent_kind && now_ms - slot->sent_ms < EPHEMERAL_REFRESH_MS) {
+        eph->coalesced++;
+        return 0;
+    }
+    return slotset_add(&eph->dirty, sender) == 0;
+}
+
+static int fresh(const ephemeral_slot_t *slot, int64_t now_ms) {
+    return slot->kind != 0 && now_ms - slot->at_ms < EPHEMERAL_TTL_MS;
+}
+
+/* Remember that a recipient missed a sender's signal; a later signal from
+ * the same sender replaces it, since only the latest is ever delivered */
+static void defer(ephemeral_t *eph, size_t recipient, size_t sender) {
+    if (slotset_add(&eph->slots[recipient].owed, sender) == 0 &&
+        slotset_add(&eph->backlogged, recipient) == 0) {
+        eph->deferred++;
+    }
+}
+
+void ephemeral_flush(ephemeral_t *eph, int64_t now_ms, const ephemeral_sink_t *sink) {
+    if (now_ms < eph->next_flush_ms) {
+        return;
+    }
+    eph->next_flush_ms = now_ms + EPHEMERAL_INTERVAL_MS;
+
+    /* Recipients that caught up get what they missed, unless it is stale
+     * or about to be announced anyway */
+    for (long r = slotset_next(&eph->backlogged, 0); r != -1;
+         r = slotset_next(&eph->backlogged, (size_t)r + 1)) {
+        if (sink->busy((size_t)r, sink->arg)) {
+            continue;
+        }
+        slotset_t *owed = &eph->slots[r].owed;
+        for (long s = slotset_next(owed, 0); s != -1; s = slotset_next(owed, (size_t)s + 1)) {
+            if (slotset_contains(&eph->dirty, (size_t)s)) {
+                continue;
+            }
+            if (fresh(&eph->slots[s], now_ms)) {
+                sink->deliver((size_t)r, (size_t)s, eph->slots[s].kind, sink->arg);
+            } else {
+                eph->expired++;
+            }
+        }
+        slotset_clear(owed);
+        slotset_remove(&eph->backlogged, (size_t)r);
+    }
+
+    for (long s = slotset_next(&eph->dirty, 0); s != -1;
+         s = slotset_next(&eph->dirty, (size_t)s + 1)) {
+        ephemeral_slot_t *slot = &eph->slots[s];
+        const slotset_t *audience = sink->audience((size_t)s, sink->arg);
+        for (long r = slotset_next(audience, 0); r != -1;
+             r = slotset_next(audience, (size_t)r + 1)) {
+            if (r == s) {
+                continue;
+            }
+            if (slotset_contains(&eph->backlogged, (size_t)r) ||
+                sink->busy((size_t)r, sink->arg)) {
+                defer(eph, (size_t)r, (size_t)s);
+            } else {
+                sink->deliver((size_t)r, (size_t)s, slot->kind, sink->arg);
+            }
+        }
+        slot->sent_kind = slot->kind;
+        slot->sent_ms = now_ms;
+    }
+    slotset_clear(&eph->dirty);
+}
+
+int64_t ephemeral_wait_ms(const ephemeral_t *eph, int64_t now_ms) {
+    if (slotset_empty(&eph->dirty) && slotset_empty(&eph->backlogged)) {
+        return -1;
+    }
+    return eph->next_flush_ms > now_ms ? eph->next_flush_ms - now_ms : 0;
+}
+
+void ephemeral_forget(ephemeral_t *eph, size_t slot) {
+    for (long r = slotset_next(&eph->backlogged, 0); r != -1;
+         r = slotset_next(&eph->backlogged, (size_t)r + 1)) {
+        slotset_remove(&eph->slots[r].owed, slot);
+    }
+    slotset_remove(&eph->dirty, slot);
+    slotset_remove(&eph->backlogged, slot);
+    ephemeral_slot_t *state = &eph->slots[slot];
+    slotset_clear(&state->owed);
+    state->kind = 0;
+    state->sent_kind = 0;
+    state->at_ms = 0;
+    state->sent_ms = 0;
+}
+
+void ephemeral_free(ephemeral_t *eph) {
+    for (size_t i = 0; i < eph->num_slots; i++) {
+        slotset_free(&eph->slots[i].owed);
+    }
+    free(eph->slots);
+    eph->slots = NULL;
+    eph->num_slots = 0;
+    slotset_free(&eph->dirty);
+    slotset_free(&eph->backlogged);
+}
@@ -0,0 +1,166 @@
+/**
+ * @file fanout.c
+ * @brief Implementation of the broadcast fan-out strategies
+ */
+
+/* tee(), splice() and F_SETPIPE_SZ are Linux extensions */
+#define _GNU_SOURCE
+
+#include "fanout.h"
+#include "common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *mode_names[] = {"send", "splice"};
+
+int fanout_mode_parse(const char *name, fanout_mode_t *mode) {
+    if (!name || !mode) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(mode_names) / sizeof(mode_names[0]); i++) {
+        if (strcmp(name, mode_names[i]) == 0) {
+            *mode = (fanout_mode_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *fanout_mode_name(fanout_mode_t mode) {
+    if ((size_t)mode >= sizeof(mode_names) / sizeof(mode_names[0])) {
+        return "unknown";
+    }
+    return mode_names[mode];
+}
+
+int fanout_init(fanout_t *fanout, fanout_mode_t mode) {
+    memset(fanout, 0, sizeof(*fanout));
+    fanout->mode = mode;
+    fanout->source[0] = fanout->source[1] = -1;
+    fanout->copy[0] = fanout->copy[1] = -1;
+    fanout->devnull = -1;
+    if (mode == FANOUT_SEND) {
+        return 0;
+    }
+
+#ifdef __linux__
+    /* Non-blocking pipes: a short tee() or splice() falls back to send()
+     * instead of stalling the event loop */
+    if (pipe2(fanout->source, O_NONBLOCK) == -1 || pipe2(fanout->copy, O_NONBLOCK) == -1 ||
+        (fanout->devnull = open("/dev/null", O_WRONLY)) == -1) {
+        fanout_free(fanout);
+        return -1;
+    }
+
+    /* Both pipes must hold the same amount, or tee() could come up short */
+    fcntl(fanout->source[1], F_SETPIPE_SZ, FANOUT_PIPE_SIZE);
+    fcntl(fanout->copy[1], F_SETPIPE_SZ, FANOUT_PIPE_SIZE);
+    int source_size = fcntl(fanout->source[1], F_GETPIPE_SZ);
+    int copy_size = fcntl(fanout->copy[1], F_GETPIPE_SZ);
+    if (source_size <= 0 || copy_size <= 0) {
+        fanout_free(fanout);
+        return -1;
+    }
+    fanout->capacity = (size_t)(source_size < copy_size ? source_size : copy_size);
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void fanout_free(fanout_t *fanout) {
+    int *fds[] = {&fanout->source[0], &fanout->source[1], &fanout->copy[0],
+                  &fanout->copy[1], &fanout->devnull};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] != -1) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
+
+#ifdef __linux__
+/* Empty a pipe without reading it into userspace */
+static void drain_pipe(fanout_t *fanout, int fd, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(fd, NULL, fanout->devnull, NULL, len, SPLICE_F_NONBLOCK);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        len -= (size_t)n;
+    }
+}
+#endif
+
+void fanout_begin(fanout_t *fanout, const uint8_t *data, size_t len) {
+    fanout->staged = 0;
+#ifdef __linux__
+    if (fanout->mode != FANOUT_SPLICE || len == 0 || len > fanout->capacity) {
+        return;
+    }
+    ssize_t n = write(fanout->source[1], data, len);
+    if (n == (ssize_t)len) {
+        fanout->staged = len;
+    } else if (n > 0) {
+        drain_pipe(fanout, fanout->source[0], (size_t)n);
+    }
+#else
+    (void)data;
+    (void)len;
+#endif
+}
+
+ssize_t fanout_send(fanout_t *fanout, int fd, const uint8_t *data, size_t len) {
+    size_t done = 0;
+
+#ifdef __linux__
+    if (fanout->staged == len && len > 0) {
+        /* Duplicate the staged pages, then move them into the socket */
+        ssize_t copied = tee(fanout->source[0], fanout->copy[1], len, SPLICE_F_NONBLOCK);
+        if (copied == (ssize_t)len) {
+            while (done < len) {
+                ssize_t n = splice(fanout->copy[0], NULL, fd, NULL, len - done,
+                                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (n <= 0) {
+                    if (n == -1 && errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                done += (size_t)n;
+            }
+            if (done == len) {
+                fanout->spliced++;
+                return (ssize_t)len;
+            }
+        }
+        /* Whatever the socket did not take is sent from the caller's copy */
+        if (copied > 0) {
+            drain_pipe(fanout, fanout->copy[0], (size_t)copied - done);
+        }
+    }
+#endif
+
+    if (fanout->mode == FANOUT_SPLICE) {
+        fanout->fallbacks++;
+    }
+    if (send_exact(fd, data + done, len - done) != (ssize_t)(len - done)) {
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+void fanout_end(fanout_t *fanout) {
+#ifdef __linux__
+    if (fanout->staged > 0) {
+        drain_pipe(fanout, fanout->source[0], fanout->staged);
+    }
+#endif
+    fanout->staged = 0;
+}
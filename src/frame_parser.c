@@ -0,0 +1,229 @@
+/**
+ * @file frame_parser.c
+ * @brief Implementation of the incremental frame parser
+ */
+
+#include "frame_parser.h"
+#include <string.h>
+
+/**
+ * @brief Shape of one frame type
+ *
+ * A frame is a fixed prefix (starting with the type byte), optionally
+ * extended by a length byte inside it and, after that field, by one more
+ * length-prefixed field, followed either by the terminator or by free text
+ * running up to the terminator.
+ */
+typedef struct {
+    uint16_t prefix;   /* Bytes before the variable part, including the type */
+    int8_t len_at;     /* Offset of a length byte extending the prefix, or -1 */
+    uint8_t text;      /* Whether free text follows the prefix */
+    uint8_t chained;   /* Whether a second length byte follows the first field */
+} frame_layout_t;
+
+enum { MEASURE_COMPLETE, MEASURE_NEED, MEASURE_SCAN, MEASURE_ERROR };
+
+static frame_layout_t layout_of(frame_direction_t direction, uint8_t type) {
+    frame_layout_t text_frame = {1, -1, 1, 0};
+
+    if (direction == FRAME_TO_SERVER) {
+        switch (type) {
+        case MSG_TYPE_USERNAME:
+            return (frame_layout_t){2, 1, 0, 0};
+        case MSG_TYPE_HELLO:
+            return (frame_layout_t){HELLO_CLIENT_LEN - 1, -1, 0, 0};
+        case MSG_TYPE_SESSION_OPEN:
+            return (frame_layout_t){1 + SESSION_ID_HEX_LEN + 1, SESSION_ID_HEX_LEN + 1, 0, 0};
+        case MSG_TYPE_RELAY_ATTACH:
+            return (frame_layout_t){RELAY_ATTACH_LEN - 1, -1, 0, 0};
+        case MSG_TYPE_NAK:
+            return (frame_layout_t){NAK_LEN - 1, -1, 0, 0};
+        case MSG_TYPE_MUTE:
+        case MSG_TYPE_SUBSCRIBE:
+            return (frame_layout_t){3, 2, 0, 0};
+        case MSG_TYPE_PUBLISH:
+            return (frame_layout_t){2, 1, 1, 0};
+        case MSG_TYPE_SIGNAL:
+            return (frame_layout_t){2, -1, 0, 0};
+        case MSG_TYPE_REACT:
+            return (frame_layout_t){REACT_HEADER, REACT_HEADER - 1, 0, 0};
+        default:
+            return text_frame;
+        }
+    }
+
+    switch (type) {
+    case MSG_TYPE_CHAT:
+    case MSG_TYPE_SEARCH_RESULT:
+    case MSG_TYPE_SIGNAL:
+        return (frame_layout_t){PEER_FRAME_HEADER, PEER_FRAME_HEADER - 1, 1, 0};
+    case MSG_TYPE_TOPIC_CHAT:
+        return (frame_layout_t){PEER_FRAME_HEADER, PEER_FRAME_HEADER - 1, 1, 1};
+    case MSG_TYPE_JOIN:
+    case MSG_TYPE_DISCONNECT:
+        return (frame_layout_t){PEER_FRAME_HEADER, PEER_FRAME_HEADER - 1, 0, 0};
+    case MSG_TYPE_SEARCH_END:
+        return (frame_layout_t){1 + 4, -1, 0, 0};
+    case MSG_TYPE_REGISTER_ACK:
+    case MSG_TYPE_MUTE_ACK:
+    case MSG_TYPE_SUBSCRIBE_ACK:
+        return (frame_layout_t){1 + 1, -1, 0, 0};
+    case MSG_TYPE_HELLO:
+        return (frame_layout_t){HELLO_SERVER_LEN - 1, -1, 0, 0};
+    case MSG_TYPE_SESSION_ACK:
+        return (frame_layout_t){1 + SESSION_ID_HEX_LEN + 1, -1, 0, 0};
+    case MSG_TYPE_RELAY_REDIRECT:
+        return (frame_layout_t){RELAY_REDIRECT_LEN - 1, -1, 0, 0};
+    case MSG_TYPE_MCAST_INFO:
+        return (frame_layout_t){MCAST_INFO_LEN - 1, -1, 0, 0};
+    case MSG_TYPE_REPAIR:
+        return (frame_layout_t){REPAIR_HEADER_LEN - 1, -1, 0, 0};
+    case MSG_TYPE_CHAT_SEQ:
+        return (frame_layout_t){CHAT_SEQ_LEN - 1, -1, 0, 0};
+    case MSG_TYPE_REACTION_COUNT:
+        return (frame_layout_t){1 + 8 + 4 + 1, 1 + 8 + 4, 0, 0};
+    case MSG_TYPE_TRANSFER_INFO:
+        return (frame_layout_t){TRANSFER_INFO_LEN - 1, -1, 0, 0};
+    case MSG_TYPE_CHAT_FAILED:
+        return (frame_layout_t){CHAT_FAILED_LEN - 1, -1, 0, 0};
+    case MSG_TYPE_SESSION_FAILED:
+        return (frame_layout_t){SESSION_FAILED_LEN - 1, -1, 0, 0};
+    default:
+        return text_frame;
+    }
+}
+
+/**
+ * @brief Work out how far the frame starting at buf extends
+ *
+ * With scan set, free text is searched for the terminator. Without it the
+ * caller guarantees the text holds no terminator except possibly in the last
+ * byte, so the check is O(1).
+ *
+ * @param n Frame length (COMPLETE) or number of bytes still missing (NEED)
+ */
+static int measure(frame_direction_t direction, const uint8_t *buf, size_t avail, size_t *n,
+                   int scan) {
+    if (avail == 0) {
+        *n = 1;
+        return MEASURE_NEED;
+    }
+
+    frame_layout_t layout = layout_of(direction, buf[0]);
+    size_t prefix = layout.prefix;
+    if (avail < prefix) {
+        *n = prefix - avail;
+        return MEASURE_NEED;
+    }
+    if (layout.len_at >= 0) {
+        prefix += buf[layout.len_at] + layout.chained;
+        if (avail < prefix) {
+            *n = prefix - avail;
+            return MEASURE_NEED;
+        }
+        if (layout.chained) {
+            prefix += buf[prefix - 1];
+            if (avail < prefix) {
+                *n = prefix - avail;
+                return MEASURE_NEED;
+            }
+        }
+    }
+
+    if (!layout.text) {
+        if (avail == prefix) {
+            *n = 1;
+            return MEASURE_NEED;
+        }
+        if (buf[prefix] != '\n') {
+            return MEASURE_ERROR;
+        }
+        *n = prefix + 1;
+        return MEASURE_COMPLETE;
+    }
+
+    if (scan) {
+        const uint8_t *newline = memchr(buf + prefix, '\n', avail - prefix);
+        if (newline) {
+            *n = (size_t)(newline - buf) + 1;
+            return MEASURE_COMPLETE;
+        }
+    } else if (avail > prefix && buf[avail - 1] == '\n') {
+        *n = avail;
+        return MEASURE_COMPLETE;
+    }
+
+    if (avail >= FRAME_MAX_LEN) {
+        return MEASURE_ERROR;
+    }
+    return MEASURE_SCAN;
+}
+
+void frame_parser_init(frame_parser_t *parser, frame_direction_t direction) {
+    parser->direction = direction;
+    parser->len = 0;
+}
+
+int frame_parser_feed(frame_parser_t *parser, const uint8_t *data, size_t len,
+                      frame_handler_fn handler, void *arg) {
+    size_t pos = 0;
+
+    /* Complete a frame carried over from earlier chunks, copying only the
+     * bytes it still needs */
+    while (parser->len > 0) {
+        size_t n;
+        int status = measure(parser->direction, parser->buf, parser->len, &n, 0);
+        if (status == MEASURE_ERROR) {
+            return -1;
+        }
+        if (status == MEASURE_COMPLETE) {
+            parser->len = 0;
+            if (handler(parser->buf, n, arg) != 0) {
+                return 1;
+            }
+            break;
+        }
+        if (pos == len) {
+            return 0;
+        }
+
+        size_t take = len - pos;
+        if (status == MEASURE_NEED) {
+            take = n < take ? n : take;
+        } else {
+            const uint8_t *newline = memchr(data + pos, '\n', len - pos);
+            if (newline) {
+                take = (size_t)(newline - (data + pos)) + 1;
+            }
+        }
+        if (parser->len + take > FRAME_MAX_LEN) {
+            return -1;
+        }
+        memcpy(parser->buf + parser->len, data + pos, take);
+        parser->len += take;
+        pos += take;
+    }
+
+    /* Frames wholly inside the chunk are handed out in place */
+    while (pos < len) {
+        size_t n;
+        int status = measure(parser->direction, data + pos, len - pos, &n, 1);
+        if (status == MEASURE_ERROR) {
+            return -1;
+        }
+        if (status == MEASURE_COMPLETE) {
+            const uint8_t *frame = data + pos;
+            pos += n;
+            if (handler(frame, n, arg) != 0) {
+                return 1;
+            }
+            continue;
+        }
+
+        /* Keep the incomplete tail for the next chunk */
+        memcpy(parser->buf, data + pos, len - pos);
+        parser->len = len - pos;
+        return 0;
+    }
+    return 0;
+}
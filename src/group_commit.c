@@ -0,0 +1,172 @@
+/**
+ * @file group_commit.c
+ * @brief Implementation of the history sync thread
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "group_commit.h"
+#include "common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *mode_names[] = {"none", "write-behind", "sync"};
+
+int durability_mode_parse(const char *name, durability_mode_t *mode) {
+    if (!name || !mode) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(mode_names) / sizeof(mode_names[0]); i++) {
+        if (strcmp(name, mode_names[i]) == 0) {
+            *mode = (durability_mode_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *durability_mode_name(durability_mode_t mode) {
+    if ((size_t)mode >= sizeof(mode_names) / sizeof(mode_names[0])) {
+        return "unknown";
+    }
+    return mode_names[mode];
+}
+
+static void *sync_thread(void *arg) {
+    group_commit_t *gc = arg;
+
+    pthread_mutex_lock(&gc->lock);
+    while (!gc->stopping) {
+        if (gc->mode == DURABILITY_WRITE_BEHIND) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += WRITE_BEHIND_INTERVAL_MS / 1000;
+            deadline.tv_nsec += (long)(WRITE_BEHIND_INTERVAL_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            int rc = 0;
+            while (!gc->stopping && rc != ETIMEDOUT) {
+                rc = pthread_cond_timedwait(&gc->wake, &gc->lock, &deadline);
+            }
+        } else {
+            while (!gc->stopping && !gc->requested) {
+                pthread_cond_wait(&gc->wake, &gc->lock);
+            }
+        }
+        if (gc->stopping) {
+            break;
+        }
+
+        int requested = gc->requested;
+        gc->requested = 0;
+        pthread_mutex_unlock(&gc->lock);
+
+        /* Everything appended before the request is covered by this sync */
+        int result = history_sync(gc->history, NULL);
+        if (result == -1) {
+            log_message(LOG_ERROR, "Failed to sync history log: %s", strerror(errno));
+        }
+
+        pthread_mutex_lock(&gc->lock);
+        gc->syncs++;
+        if (requested) {
+            gc->last_result = result;
+            char byte = 1;
+            while (write(gc->notify_fds[1], &byte, 1) == -1 && errno == EINTR) {
+            }
+        }
+    }
+    pthread_mutex_unlock(&gc->lock);
+
+    return NULL;
+}
+
+int group_commit_start(group_commit_t *gc, history_t *history, durability_mode_t mode) {
+    if (!gc || !history) {
+        return -1;
+    }
+
+    memset(gc, 0, sizeof(*gc));
+    gc->history = history;
+    gc->mode = mode;
+    gc->notify_fds[0] = -1;
+    gc->notify_fds[1] = -1;
+    if (mode == DURABILITY_NONE) {
+        return 0;
+    }
+
+    if (pipe(gc->notify_fds) == -1) {
+        return -1;
+    }
+    fcntl(gc->notify_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(gc->notify_fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(gc->notify_fds[1], F_SETFD, FD_CLOEXEC);
+    pthread_mutex_init(&gc->lock, NULL);
+    pthread_cond_init(&gc->wake, NULL);
+
+    if (pthread_create(&gc->thread, NULL, sync_thread, gc) != 0) {
+        pthread_cond_destroy(&gc->wake);
+        pthread_mutex_destroy(&gc->lock);
+        close(gc->notify_fds[0]);
+        close(gc->notify_fds[1]);
+        gc->notify_fds[0] = -1;
+        gc->notify_fds[1] = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void group_commit_request(group_commit_t *gc) {
+    if (gc->notify_fds[0] == -1) {
+        return;
+    }
+    pthread_mutex_lock(&gc->lock);
+    gc->requested = 1;
+    pthread_cond_signal(&gc->wake);
+    pthread_mutex_unlock(&gc->lock);
+}
+
+int group_commit_fd(const group_commit_t *gc) {
+    return gc->notify_fds[0];
+}
+
+int group_commit_complete(group_commit_t *gc) {
+    char byte;
+    while (read(gc->notify_fds[0], &byte, 1) == -1 && errno == EINTR) {
+    }
+
+    pthread_mutex_lock(&gc->lock);
+    int result = gc->last_result;
+    pthread_mutex_unlock(&gc->lock);
+    return result;
+}
+
+void group_commit_stop(group_commit_t *gc) {
+    if (gc->notify_fds[0] == -1) {
+        return;
+    }
+
+    pthread_mutex_lock(&gc->lock);
+    gc->stopping = 1;
+    pthread_cond_signal(&gc->wake);
+    pthread_mutex_unlock(&gc->lock);
+    pthread_join(gc->thread, NULL);
+
+    if (history_sync(gc->history, NULL) == -1) {
+        log_message(LOG_ERROR, "Failed to sync history log: %s", strerror(errno));
+    }
+
+    pthread_cond_destroy(&gc->wake);
+    pthread_mutex_destroy(&gc->lock);
+    close(gc->notify_fds[0]);
+    close(gc->notify_fds[1]);
+    gc->notify_fds[0] = -1;
+    gc->notify_fds[1] = -1;
+}
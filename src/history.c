@@ -0,0 +1,1096 @@
+/**
+ * @file history.c
+ * @brief Implementation of the segmented chat history log
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "history.h"
+#include "common.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SEGMENT_NAME_DIGITS 20
+#define MAX_RECORD_LEN (HISTORY_RECORD_HEADER + MAX_USERNAME_LEN + MAX_MESSAGE_LEN)
+#define SCAN_CHUNK (64 * 1024)
+
+#define INDEX_MAGIC 0x48494458U      /* "HIDX" */
+#define CHECKPOINT_MAGIC 0x4843484bU /* "HCHK" */
+#define CHECKPOINT_NAME "checkpoint"
+
+/**
+ * @brief Contents of a sealed segment's metadata file
+ *
+ * Files written by older versions are followed by sparse index entries
+ * (num_entries of them); nothing reads those anymore.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t num_entries;
+    uint64_t size;           /* Size of the segment the file describes */
+    uint64_t first_seq;
+    uint64_t last_seq;
+    int64_t max_timestamp;
+} index_header_t;
+
+/**
+ * @brief Header of the checkpoint file
+ *
+ * Followed by num_entries history_index_entry_t for the active segment.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t num_entries;
+    uint64_t next_seq;
+    uint64_t active_base;
+    uint64_t active_size;
+    uint64_t active_count;
+    uint64_t first_seq;
+    uint64_t last_seq;
+    int64_t max_timestamp;
+} checkpoint_header_t;
+
+/**
+ * @brief Segment metadata accumulated while scanning records
+ */
+typedef struct {
+    uint64_t base;
+    uint64_t count;
+    uint64_t first_seq;
+    uint64_t last_seq;
+    int64_t max_timestamp;
+    int collect_entries;     /* Build the sparse index (active segment only) */
+    history_index_entry_t *entries;
+    size_t num_entries;
+    size_t cap_entries;
+    int failed;
+} meta_builder_t;
+
+static void segment_path(const history_t *history, uint64_t base, char *path, size_t size) {
+    snprintf(path, size, "%s/%020llu.log", history->dir, (unsigned long long)base);
+}
+
+static void index_path(const history_t *history, uint64_t base, char *path, size_t size) {
+    snprintf(path, size, "%s/%020llu.idx", history->dir, (unsigned long long)base);
+}
+
+static void checkpoint_path(const history_t *history, char *path, size_t size) {
+    snprintf(path, size, "%s/%s", history->dir, CHECKPOINT_NAME);
+}
+
+/**
+ * @brief Decode a record body (the bytes following the length field)
+ * @return 0 on success, -1 if the record is malformed
+ */
+static int decode_record(const uint8_t *buf, uint32_t len, history_record_t *rec) {
+    if (len < HISTORY_RECORD_HEADER || len > MAX_RECORD_LEN) {
+        return -1;
+    }
+
+    size_t offset = 0;
+    memcpy(&rec->seq, buf + offset, 8);
+    offset += 8;
+    memcpy(&rec->timestamp, buf + offset, 8);
+    offset += 8;
+    memcpy(&rec->ip, buf + offset, 4);
+    offset += 4;
+    memcpy(&rec->port, buf + offset, 2);
+    offset += 2;
+
+    uint8_t username_len = buf[offset++];
+    if (username_len >= MAX_USERNAME_LEN || offset + username_len > len) {
+        return -1;
+    }
+    memcpy(rec->username, buf + offset, username_len);
+    rec->username[username_len] = '\0';
+    offset += username_len;
+
+    rec->text_len = len - offset;
+    if (rec->text_len > MAX_MESSAGE_LEN) {
+        return -1;
+    }
+    memcpy(rec->text, buf + offset, rec->text_len);
+    return 0;
+}
+
+/**
+ * @brief Encode a record including its length field
+ * @return Encoded size
+ */
+static size_t encode_record(const history_record_t *rec, uint8_t *buf) {
+    uint8_t username_len = (uint8_t)strlen(rec->username);
+    uint32_t len = HISTORY_RECORD_HEADER + username_len + (uint32_t)rec->text_len;
+    size_t offset = 0;
+
+    memcpy(buf + offset, &len, 4);
+    offset += 4;
+    memcpy(buf + offset, &rec->seq, 8);
+    offset += 8;
+    memcpy(buf + offset, &rec->timestamp, 8);
+    offset += 8;
+    memcpy(buf + offset, &rec->ip, 4);
+    offset += 4;
+    memcpy(buf + offset, &rec->port, 2);
+    offset += 2;
+    buf[offset++] = username_len;
+    memcpy(buf + offset, rec->username, username_len);
+    offset += username_len;
+    memcpy(buf + offset, rec->text, rec->text_len);
+    offset += rec->text_len;
+
+    return offset;
+}
+
+static int push_entry(history_index_entry_t **entries, size_t *num, size_t *cap, uint64_t seq,
+                      uint64_t offset) {
+    if (*num == *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 64;
+        history_index_entry_t *grown = realloc(*entries, new_cap * sizeof(**entries));
+        if (!grown) {
+            return -1;
+        }
+        *entries = grown;
+        *cap = new_cap;
+    }
+    (*entries)[*num].seq = seq;
+    (*entries)[*num].offset = offset;
+    (*num)++;
+    return 0;
+}
+
+/* Scan callback collecting segment metadata and, if asked, its sparse index */
+static void meta_builder_add(uint64_t offset, const history_record_t *rec, void *arg) {
+    meta_builder_t *builder = arg;
+
+    if (builder->collect_entries && builder->count % HISTORY_INDEX_STRIDE == 0 &&
+        push_entry(&builder->entries, &builder->num_entries, &builder->cap_entries, rec->seq,
+                   offset - builder->base) == -1) {
+        builder->failed = 1;
+    }
+    if (builder->count == 0) {
+        builder->first_seq = rec->seq;
+    }
+    builder->last_seq = rec->seq;
+    builder->max_timestamp = rec->timestamp;
+    builder->count++;
+}
+
+/**
+ * @brief Write a file under a temporary name and rename it into place
+ */
+static int write_file_atomic(const char *path, const void *head, size_t head_len,
+                             const void *body, size_t body_len) {
+    char tmp_path[PATH_MAX + 48];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+
+    int ok = write(fd, head, head_len) == (ssize_t)head_len &&
+             (body_len == 0 || write(fd, body, body_len) == (ssize_t)body_len);
+    close(fd);
+
+    if (!ok || rename(tmp_path, path) == -1) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Load a sealed segment's metadata from its index file
+ * @return 0 on success, -1 if the file is missing or stale
+ */
+static int read_segment_index(const history_t *history, history_segment_t *seg) {
+    char path[PATH_MAX + 32];
+    index_path(history, seg->base, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    index_header_t header;
+    ssize_t n = pread(fd, &header, sizeof(header), 0);
+    close(fd);
+    if (n != (ssize_t)sizeof(header) || header.magic != INDEX_MAGIC || header.size != seg->size) {
+        return -1;
+    }
+
+    seg->first_seq = header.first_seq;
+    seg->last_seq = header.last_seq;
+    seg->max_timestamp = header.max_timestamp;
+    seg->meta_loaded = 1;
+    return 0;
+}
+
+/**
+ * @brief Write the index file of a sealed segment
+ */
+static int write_segment_index(const history_t *history, const history_segment_t *seg) {
+    index_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEX_MAGIC;
+    header.size = seg->size;
+    header.first_seq = seg->first_seq;
+    header.last_seq = seg->last_seq;
+    header.max_timestamp = seg->max_timestamp;
+
+    char path[PATH_MAX + 32];
+    index_path(history, seg->base, path, sizeof(path));
+    return write_file_atomic(path, &header, sizeof(header), NULL, 0);
+}
+
+static int add_segment(history_t *history, uint64_t base, int fd, uint64_t size) {
+    if (history->num_segments == history->cap_segments) {
+        size_t new_cap = history->cap_segments ? history->cap_segments * 2 : 8;
+        history_segment_t *segments = realloc(history->segments, new_cap * sizeof(*segments));
+        if (!segments) {
+            return -1;
+        }
+        history->segments = segments;
+        history->cap_segments = new_cap;
+    }
+
+    history_segment_t *seg = &history->segments[history->num_segments++];
+    memset(seg, 0, sizeof(*seg));
+    seg->base = base;
+    seg->size = size;
+    seg->fd = fd;
+    return 0;
+}
+
+static int create_segment(history_t *history, uint64_t base) {
+    char path[PATH_MAX + 32];
+    segment_path(history, base, path, sizeof(path));
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    if (add_segment(history, base, fd, 0) == -1) {
+        close(fd);
+        return -1;
+    }
+    history->segments[history->num_segments - 1].meta_loaded = 1;
+    return 0;
+}
+
+static int compare_segments(const void *a, const void *b) {
+    const history_segment_t *sa = a;
+    const history_segment_t *sb = b;
+    return (sa->base > sb->base) - (sa->base < sb->base);
+}
+
+/* Index of the last segment whose base is <= offset (caller holds the lock) */
+static size_t find_segment(const history_t *history, uint64_t offset) {
+    size_t lo = 0;
+    size_t hi = history->num_segments;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (history->segments[mid].base <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Token-bucket style pacing for background reads
+ */
+typedef struct {
+    uint64_t bytes_per_sec;
+    uint64_t bytes;
+    struct timespec start;
+} io_throttle_t;
+
+static void throttle_init(io_throttle_t *throttle, uint64_t bytes_per_sec) {
+    throttle->bytes_per_sec = bytes_per_sec;
+    throttle->bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &throttle->start);
+}
+
+/* Sleep until the bytes read so far fit within the configured rate */
+static void throttle_account(io_throttle_t *throttle, size_t bytes) {
+    if (throttle->bytes_per_sec == 0) {
+        return;
+    }
+
+    throttle->bytes += bytes;
+    uint64_t due_ns = throttle->bytes * 1000000000ULL / throttle->bytes_per_sec;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t elapsed_ns = (uint64_t)(now.tv_sec - throttle->start.tv_sec) * 1000000000ULL +
+                          (uint64_t)(now.tv_nsec - throttle->start.tv_nsec);
+    if (due_ns > elapsed_ns) {
+        uint64_t wait_ns = due_ns - elapsed_ns;
+        struct timespec delay = {(time_t)(wait_ns / 1000000000ULL), (long)(wait_ns % 1000000000ULL)};
+        nanosleep(&delay, NULL);
+    }
+}
+
+/**
+ * @brief Decode records of one segment between two segment-relative offsets
+ * @param seg Copy of the segment to scan
+ * @param start First byte to scan (must be a record boundary)
+ * @param end End of the scanned range
+ * @param scan Callback for each record (may be NULL)
+ * @param arg Argument passed to scan
+ * @param throttle Read pacing (may be NULL)
+ * @return Segment offset just past the last valid record, or -1 on read error
+ */
+static int64_t scan_segment(const history_segment_t *seg, uint64_t start, uint64_t end,
+                            history_scan_fn scan, void *arg, io_throttle_t *throttle) {
+    uint8_t *buf = malloc(SCAN_CHUNK);
+    if (!buf) {
+        return -1;
+    }
+
+    history_record_t rec;
+    uint64_t pos = start;      /* Segment offset of buf[0] */
+    size_t filled = 0;
+    size_t parsed = 0;
+    int corrupt = 0;
+
+    while (1) {
+        /* Parse every complete record in the buffer */
+        while (filled - parsed >= 4) {
+            uint32_t len;
+            memcpy(&len, buf + parsed, 4);
+            if (len < HISTORY_RECORD_HEADER || len > MAX_RECORD_LEN) {
+                corrupt = 1;
+                break;
+            }
+            if (filled - parsed < 4 + (size_t)len) {
+                break;
+            }
+            if (decode_record(buf + parsed + 4, len, &rec) == -1) {
+                corrupt = 1;
+                break;
+            }
+            if (scan) {
+                scan(seg->base + pos + parsed, &rec, arg);
+            }
+            parsed += 4 + len;
+        }
+
+        if (corrupt) {
+            break;
+        }
+
+        /* Keep the partial record and refill */
+        memmove(buf, buf + parsed, filled - parsed);
+        pos += parsed;
+        filled -= parsed;
+        parsed = 0;
+
+        if (pos + filled >= end) {
+            break;
+        }
+        size_t want = SCAN_CHUNK - filled;
+        if (want > end - pos - filled) {
+            want = (size_t)(end - pos - filled);
+        }
+        ssize_t n = pread(seg->fd, buf + filled, want, (off_t)(pos + filled));
+        if (n < 0) {
+            free(buf);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        filled += (size_t)n;
+        if (throttle) {
+            throttle_account(throttle, (size_t)n);
+        }
+    }
+
+    free(buf);
+    return (int64_t)(pos + parsed);
+}
+
+/**
+ * @brief Load metadata of a sealed segment, building its index file if needed
+ *
+ * Operates on a segment the caller owns (a copy or one accessed under the
+ * lock); may scan the whole segment if no valid index file exists.
+ */
+static int load_segment_meta(const history_t *history, history_segment_t *seg) {
+    if (read_segment_index(history, seg) == 0) {
+        return 0;
+    }
+
+    meta_builder_t builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.base = seg->base;
+    if (scan_segment(seg, 0, seg->size, meta_builder_add, &builder, NULL) < 0) {
+        return -1;
+    }
+
+    seg->first_seq = builder.first_seq;
+    seg->last_seq = builder.last_seq;
+    seg->max_timestamp = builder.max_timestamp;
+    seg->meta_loaded = 1;
+
+    /* Persist the metadata so the next load only reads the index file */
+    write_segment_index(history, seg);
+    return 0;
+}
+
+/**
+ * @brief Read the checkpoint file
+ * @return Malloc'd checkpoint (header followed by entries), or NULL
+ */
+static checkpoint_header_t *read_checkpoint(const history_t *history) {
+    char path[PATH_MAX + 32];
+    checkpoint_path(history, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    checkpoint_header_t *checkpoint = NULL;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(checkpoint_header_t)) {
+        checkpoint = malloc((size_t)st.st_size);
+        if (checkpoint && (pread(fd, checkpoint, (size_t)st.st_size, 0) != st.st_size ||
+                           checkpoint->magic != CHECKPOINT_MAGIC ||
+                           (size_t)st.st_size != sizeof(checkpoint_header_t) +
+                                                     checkpoint->num_entries *
+                                                         sizeof(history_index_entry_t))) {
+            free(checkpoint);
+            checkpoint = NULL;
+        }
+    }
+
+    close(fd);
+    return checkpoint;
+}
+
+/**
+ * @brief Copy the active segment state (caller holds the lock)
+ * @return Malloc'd checkpoint (header followed by entries), or NULL
+ */
+static checkpoint_header_t *snapshot_checkpoint(const history_t *history) {
+    size_t entries_len = history->num_active_entries * sizeof(history_index_entry_t);
+    checkpoint_header_t *checkpoint = malloc(sizeof(checkpoint_header_t) + entries_len);
+    if (!checkpoint) {
+        return NULL;
+    }
+
+    const history_segment_t *active = &history->segments[history->num_segments - 1];
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    checkpoint->magic = CHECKPOINT_MAGIC;
+    checkpoint->num_entries = (uint32_t)history->num_active_entries;
+    checkpoint->next_seq = history->next_seq;
+    checkpoint->active_base = active->base;
+    checkpoint->active_size = active->size;
+    checkpoint->active_count = history->active_count;
+    checkpoint->first_seq = active->first_seq;
+    checkpoint->last_seq = active->last_seq;
+    checkpoint->max_timestamp = active->max_timestamp;
+    memcpy(checkpoint + 1, history->active_entries, entries_len);
+    return checkpoint;
+}
+
+static int write_checkpoint(const history_t *history, const checkpoint_header_t *checkpoint) {
+    char path[PATH_MAX + 32];
+    checkpoint_path(history, path, sizeof(path));
+    return write_file_atomic(path, checkpoint, sizeof(*checkpoint), checkpoint + 1,
+                             checkpoint->num_entries * sizeof(history_index_entry_t));
+}
+
+/**
+ * @brief Restore the active segment from the checkpoint and scan what follows it
+ */
+static int recover_active_segment(history_t *history, const checkpoint_header_t *checkpoint) {
+    history_segment_t *active = &history->segments[history->num_segments - 1];
+    meta_builder_t builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.base = active->base;
+    builder.collect_entries = 1;
+
+    uint64_t start = 0;
+    if (checkpoint && checkpoint->active_base == active->base &&
+        checkpoint->active_size <= active->size) {
+        const history_index_entry_t *entries = (const history_index_entry_t *)(checkpoint + 1);
+        for (uint32_t i = 0; i < checkpoint->num_entries; i++) {
+            if (push_entry(&builder.entries, &builder.num_entries, &builder.cap_entries,
+                           entries[i].seq, entries[i].offset) == -1) {
+                free(builder.entries);
+                return -1;
+            }
+        }
+        builder.count = checkpoint->active_count;
+        builder.first_seq = checkpoint->first_seq;
+        builder.last_seq = checkpoint->last_seq;
+        builder.max_timestamp = checkpoint->max_timestamp;
+        start = checkpoint->active_size;
+    }
+
+    int64_t valid = scan_segment(active, start, active->size, meta_builder_add, &builder, NULL);
+    if (valid < 0 || builder.failed) {
+        free(builder.entries);
+        return -1;
+    }
+    if ((uint64_t)valid < active->size) {
+        log_message(LOG_WARN, "History segment %llu: truncating %llu trailing bytes",
+                    (unsigned long long)active->base,
+                    (unsigned long long)(active->size - (uint64_t)valid));
+        if (ftruncate(active->fd, (off_t)valid) == -1) {
+            free(builder.entries);
+            return -1;
+        }
+        active->size = (uint64_t)valid;
+    }
+    if (start > 0 || valid > 0) {
+        log_message(LOG_DEBUG, "History recovery scanned %llu bytes",
+                    (unsigned long long)((uint64_t)valid - start));
+    }
+
+    active->first_seq = builder.first_seq;
+    active->last_seq = builder.last_seq;
+    active->max_timestamp = builder.max_timestamp;
+    active->meta_loaded = 1;
+    history->active_entries = builder.entries;
+    history->num_active_entries = builder.num_entries;
+    history->cap_active_entries = builder.cap_entries;
+    history->active_count = builder.count;
+
+    /* Continue the sequence from the newest record we know of */
+    if (builder.last_seq != 0) {
+        history->next_seq = builder.last_seq + 1;
+    } else if (checkpoint) {
+        history->next_seq = checkpoint->next_seq;
+    } else if (history->num_segments > 1) {
+        history_segment_t *prev = &history->segments[history->num_segments - 2];
+        if (load_segment_meta(history, prev) == 0 && prev->last_seq != 0) {
+            history->next_seq = prev->last_seq + 1;
+        }
+    }
+    return 0;
+}
+
+int history_open(history_t *history, const char *dir) {
+    if (!history || !dir || strlen(dir) >= sizeof(history->dir)) {
+        return -1;
+    }
+
+    memset(history, 0, sizeof(*history));
+    strcpy(history->dir, dir);
+    history->next_seq = 1;
+    history->segment_bytes = HISTORY_SEGMENT_BYTES;
+    pthread_mutex_init(&history->lock, NULL);
+
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        return -1;
+    }
+
+    DIR *dirp = opendir(dir);
+    if (!dirp) {
+        return -1;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dirp)) != NULL) {
+        const char *name = entry->d_name;
+        if (strlen(name) != SEGMENT_NAME_DIGITS + 4 ||
+            strcmp(name + SEGMENT_NAME_DIGITS, ".log") != 0) {
+            continue;
+        }
+
+        char *end;
+        unsigned long long base = strtoull(name, &end, 10);
+        if (end != name + SEGMENT_NAME_DIGITS) {
+            continue;
+        }
+
+        char path[PATH_MAX + 32];
+        segment_path(history, base, path, sizeof(path));
+        int fd = open(path, O_RDWR);
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) == -1 || add_segment(history, base, fd, st.st_size) == -1) {
+            if (fd != -1) {
+                close(fd);
+            }
+            closedir(dirp);
+            history_close(history);
+            return -1;
+        }
+    }
+    closedir(dirp);
+
+    if (history->num_segments > 1) {
+        qsort(history->segments, history->num_segments, sizeof(history_segment_t),
+              compare_segments);
+    }
+
+    checkpoint_header_t *checkpoint = read_checkpoint(history);
+
+    if (history->num_segments == 0) {
+        if (create_segment(history, 0) == -1) {
+            free(checkpoint);
+            history_close(history);
+            return -1;
+        }
+        if (checkpoint) {
+            history->next_seq = checkpoint->next_seq;
+        }
+        free(checkpoint);
+        return 0;
+    }
+
+    /* Sealed segments are left untouched until their metadata is needed */
+    int rc = recover_active_segment(history, checkpoint);
+    free(checkpoint);
+    if (rc == -1) {
+        history_close(history);
+        return -1;
+    }
+
+    /* Whatever survived the restart is treated as already synced and delivered */
+    const history_segment_t *active = &history->segments[history->num_segments - 1];
+    history->synced_end = active->base + active->size;
+    history->delivered_end = history->synced_end;
+    return 0;
+}
+
+/**
+ * @brief Seal the active segment and start a new one (caller holds the lock)
+ */
+static int roll_segment(history_t *history) {
+    history_segment_t *active = &history->segments[history->num_segments - 1];
+    if (write_segment_index(history, active) == -1) {
+        log_message(LOG_WARN, "Failed to write index for history segment %llu",
+                    (unsigned long long)active->base);
+    }
+
+    if (create_segment(history, active->base + active->size) == -1) {
+        return -1;
+    }
+    history->num_active_entries = 0;
+    history->active_count = 0;
+
+    checkpoint_header_t *checkpoint = snapshot_checkpoint(history);
+    if (checkpoint) {
+        write_checkpoint(history, checkpoint);
+        free(checkpoint);
+    }
+    return 0;
+}
+
+int history_append(history_t *history, history_record_t *rec, uint64_t *offset_out) {
+    if (!history || !rec || rec->text_len > MAX_MESSAGE_LEN) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&history->lock);
+
+    rec->seq = history->next_seq;
+
+    uint8_t buf[4 + MAX_RECORD_LEN];
+    size_t len = encode_record(rec, buf);
+
+    history_segment_t *seg = &history->segments[history->num_segments - 1];
+    if (seg->size > 0 && seg->size + len > history->segment_bytes) {
+        if (roll_segment(history) == -1) {
+            pthread_mutex_unlock(&history->lock);
+            return -1;
+        }
+        seg = &history->segments[history->num_segments - 1];
+    }
+
+    if (history->active_count % HISTORY_INDEX_STRIDE == 0 &&
+        push_entry(&history->active_entries, &history->num_active_entries,
+                   &history->cap_active_entries, rec->seq, seg->size) == -1) {
+        pthread_mutex_unlock(&history->lock);
+        return -1;
+    }
+
+    ssize_t written = pwrite(seg->fd, buf, len, (off_t)seg->size);
+    if (written != (ssize_t)len) {
+        if (history->active_count % HISTORY_INDEX_STRIDE == 0) {
+            history->num_active_entries--;
+        }
+        pthread_mutex_unlock(&history->lock);
+        return -1;
+    }
+
+    if (offset_out) {
+        *offset_out = seg->base + seg->size;
+    }
+    if (history->active_count == 0) {
+        seg->first_seq = rec->seq;
+    }
+    seg->last_seq = rec->seq;
+    seg->max_timestamp = rec->timestamp;
+    seg->size += len;
+    history->active_count++;
+    history->next_seq++;
+
+    pthread_mutex_unlock(&history->lock);
+    return 0;
+}
+
+/* Scan callback keeping the timestamp of the last record seen */
+static void last_timestamp(uint64_t offset, const history_record_t *rec, void *arg) {
+    (void)offset;
+    *(int64_t *)arg = rec->timestamp;
+}
+
+int history_rollback(history_t *history, uint64_t offset) {
+    if (!history) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&history->lock);
+
+    history_segment_t *seg = &history->segments[history->num_segments - 1];
+    if (offset < seg->base || offset > seg->base + seg->size) {
+        pthread_mutex_unlock(&history->lock);
+        return -1; /* Not in the active segment */
+    }
+    uint64_t size = offset - seg->base;
+    if (size == seg->size) {
+        pthread_mutex_unlock(&history->lock);
+        return 0;
+    }
+
+    /* The first record dropped tells how far the sequence goes back */
+    uint8_t header[4 + 8];
+    uint64_t seq;
+    if (pread(seg->fd, header, sizeof(header), (off_t)size) != (ssize_t)sizeof(header)) {
+        pthread_mutex_unlock(&history->lock);
+        return -1;
+    }
+    memcpy(&seq, header + 4, 8);
+
+    while (history->num_active_entries > 0 &&
+           history->active_entries[history->num_active_entries - 1].offset >= size) {
+        history->num_active_entries--;
+    }
+
+    /* Rescan from the last index entry kept to find the newest remaining
+     * timestamp; entry 0 always marks the start of the segment */
+    int64_t max_timestamp = 0;
+    if (history->num_active_entries > 0) {
+        uint64_t from = history->active_entries[history->num_active_entries - 1].offset;
+        if (scan_segment(seg, from, size, last_timestamp, &max_timestamp, NULL) !=
+            (int64_t)size) {
+            pthread_mutex_unlock(&history->lock);
+            return -1;
+        }
+    }
+    if (ftruncate(seg->fd, (off_t)size) == -1) {
+        pthread_mutex_unlock(&history->lock);
+        return -1;
+    }
+
+    history->active_count -= history->next_seq - seq;
+    history->next_seq = seq;
+    seg->size = size;
+    seg->first_seq = history->active_count > 0 ? seg->first_seq : 0;
+    seg->last_seq = history->active_count > 0 ? seq - 1 : 0;
+    seg->max_timestamp = max_timestamp;
+    if (history->synced_end > offset) {
+        history->synced_end = offset;
+    }
+    if (history->delivered_end > offset) {
+        history->delivered_end = offset;
+    }
+    history->rollbacks++;
+
+    /* A checkpoint past the new end would make recovery start mid-record
+     * once the segment grows again; drop it if it cannot be replaced */
+    checkpoint_header_t *checkpoint = snapshot_checkpoint(history);
+    if (!checkpoint || write_checkpoint(history, checkpoint) == -1) {
+        char path[PATH_MAX + 32];
+        checkpoint_path(history, path, sizeof(path));
+        unlink(path);
+    }
+    free(checkpoint);
+
+    pthread_mutex_unlock(&history->lock);
+    return 0;
+}
+
+int history_read(history_t *history, uint64_t offset, history_record_t *rec) {
+    if (!history || !rec) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&history->lock);
+
+    const history_segment_t *seg = &history->segments[find_segment(history, offset)];
+    if (offset < seg->base || offset - seg->base + 4 > seg->size) {
+        pthread_mutex_unlock(&history->lock);
+        return -1; /* Expired or never written */
+    }
+
+    uint8_t buf[4 + MAX_RECORD_LEN];
+    ssize_t n = pread(seg->fd, buf, sizeof(buf), (off_t)(offset - seg->base));
+    pthread_mutex_unlock(&history->lock);
+    if (n < 4) {
+        return -1;
+    }
+
+    uint32_t len;
+    memcpy(&len, buf, 4);
+    if ((size_t)n < 4 + (size_t)len) {
+        return -1;
+    }
+    return decode_record(buf + 4, len, rec);
+}
+
+int history_scan_range(history_t *history, uint64_t from, uint64_t to, history_scan_fn scan,
+                       void *arg, uint64_t bytes_per_sec) {
+    if (!history || !scan) {
+        return -1;
+    }
+
+    io_throttle_t throttle;
+    throttle_init(&throttle, bytes_per_sec);
+
+    uint64_t pos = from;
+    while (pos < to) {
+        /* Copy the segment so the lock is not held while reading */
+        pthread_mutex_lock(&history->lock);
+        size_t i = find_segment(history, pos);
+        history_segment_t seg = history->segments[i];
+        if (pos < seg.base) {
+            pos = seg.base; /* Start of the range was expired */
+        }
+        pthread_mutex_unlock(&history->lock);
+
+        if (pos >= seg.base + seg.size) {
+            break; /* Nothing more has been written */
+        }
+
+        uint64_t seg_end = seg.size < to - seg.base ? seg.size : to - seg.base;
+        if (scan_segment(&seg, pos - seg.base, seg_end, scan, arg, &throttle) < 0) {
+            return -1;
+        }
+        pos = seg.base + seg_end;
+    }
+
+    return 0;
+}
+
+ssize_t history_expire(history_t *history, const history_retention_t *retention, int64_t now) {
+    if (!history || !retention) {
+        return -1;
+    }
+
+    /* Load metadata of sealed segments outside the lock; only this thread
+     * removes segments, so their positions in the array stay valid */
+    pthread_mutex_lock(&history->lock);
+    size_t num_sealed = history->num_segments - 1;
+    history_segment_t *sealed = NULL;
+    if (num_sealed > 0) {
+        sealed = malloc(num_sealed * sizeof(history_segment_t));
+        if (!sealed) {
+            pthread_mutex_unlock(&history->lock);
+            return -1;
+        }
+        memcpy(sealed, history->segments, num_sealed * sizeof(history_segment_t));
+    }
+    pthread_mutex_unlock(&history->lock);
+
+    for (size_t i = 0; i < num_sealed; i++) {
+        if (!sealed[i].meta_loaded) {
+            load_segment_meta(history, &sealed[i]);
+        }
+    }
+
+    pthread_mutex_lock(&history->lock);
+
+    for (size_t i = 0; i < num_sealed; i++) {
+        history_segment_t *seg = &history->segments[i];
+        if (!seg->meta_loaded && sealed[i].meta_loaded) {
+            *seg = sealed[i];
+        }
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < history->num_segments; i++) {
+        total += history->segments[i].size;
+    }
+
+    size_t expired = 0;
+    while (expired < num_sealed) {
+        const history_segment_t *seg = &history->segments[expired];
+        int too_old = retention->max_age > 0 && seg->meta_loaded &&
+                      seg->max_timestamp < now - retention->max_age;
+        int too_big = retention->max_bytes > 0 && total > retention->max_bytes;
+        if (!too_old && !too_big) {
+            break;
+        }
+        total -= seg->size;
+        expired++;
+    }
+
+    /* Detach expired segments; close and unlink them after unlocking */
+    if (expired > 0) {
+        memcpy(sealed, history->segments, expired * sizeof(history_segment_t));
+        memmove(history->segments, history->segments + expired,
+                (history->num_segments - expired) * sizeof(history_segment_t));
+        history->num_segments -= expired;
+    }
+
+    pthread_mutex_unlock(&history->lock);
+
+    for (size_t i = 0; i < expired; i++) {
+        char path[PATH_MAX + 32];
+        close(sealed[i].fd);
+        index_path(history, sealed[i].base, path, sizeof(path));
+        unlink(path);
+        segment_path(history, sealed[i].base, path, sizeof(path));
+        if (unlink(path) == -1) {
+            log_message(LOG_WARN, "Failed to delete history segment %s", path);
+        }
+    }
+
+    free(sealed);
+    return (ssize_t)expired;
+}
+
+int history_sync(history_t *history, uint64_t *synced_out) {
+    if (!history) {
+        return -1;
+    }
+
+    /* Collect the segments holding unsynced bytes. Retention may close a
+     * sealed segment as soon as the lock is released, so sync duplicates */
+    pthread_mutex_lock(&history->lock);
+    const history_segment_t *active = &history->segments[history->num_segments - 1];
+    uint64_t end = active->base + active->size;
+    uint64_t synced = history->synced_end;
+    uint64_t rollbacks = history->rollbacks;
+    size_t first = find_segment(history, synced);
+    size_t count = history->num_segments - first;
+    int *fds = end != synced ? malloc(count * sizeof(int)) : NULL;
+    size_t num_fds = 0;
+    while (fds && num_fds < count) {
+        fds[num_fds] = dup(history->segments[first + num_fds].fd);
+        if (fds[num_fds] == -1) {
+            break;
+        }
+        num_fds++;
+    }
+    pthread_mutex_unlock(&history->lock);
+
+    if (end != synced) {
+        int result = fds && num_fds == count ? 0 : -1;
+        for (size_t i = 0; i < num_fds; i++) {
+            if (result == 0 && fdatasync(fds[i]) == -1) {
+                result = -1;
+            }
+            close(fds[i]);
+        }
+        free(fds);
+        if (result == -1) {
+            return -1;
+        }
+
+        /* Bytes rolled back meanwhile may have been rewritten since the sync */
+        pthread_mutex_lock(&history->lock);
+        if (history->rollbacks == rollbacks) {
+            history->synced_end = end;
+        }
+        pthread_mutex_unlock(&history->lock);
+    }
+
+    if (synced_out) {
+        *synced_out = end;
+    }
+    return 0;
+}
+
+int history_checkpoint(history_t *history) {
+    if (!history) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&history->lock);
+    checkpoint_header_t *checkpoint = snapshot_checkpoint(history);
+    pthread_mutex_unlock(&history->lock);
+
+    if (!checkpoint) {
+        return -1;
+    }
+    int rc = write_checkpoint(history, checkpoint);
+    free(checkpoint);
+    return rc;
+}
+
+void history_hold_delivery(history_t *history) {
+    pthread_mutex_lock(&history->lock);
+    history->hold_delivery = 1;
+    pthread_mutex_unlock(&history->lock);
+}
+
+void history_deliver(history_t *history, uint64_t offset) {
+    pthread_mutex_lock(&history->lock);
+    if (offset > history->delivered_end) {
+        history->delivered_end = offset;
+    }
+    pthread_mutex_unlock(&history->lock);
+}
+
+uint64_t history_delivered_offset(history_t *history) {
+    pthread_mutex_lock(&history->lock);
+    const history_segment_t *seg = &history->segments[history->num_segments - 1];
+    uint64_t end = history->hold_delivery ? history->delivered_end : seg->base + seg->size;
+    pthread_mutex_unlock(&history->lock);
+    return end;
+}
+
+uint64_t history_start_offset(history_t *history) {
+    pthread_mutex_lock(&history->lock);
+    uint64_t start = history->segments[0].base;
+    pthread_mutex_unlock(&history->lock);
+    return start;
+}
+
+uint64_t history_end_offset(history_t *history) {
+    pthread_mutex_lock(&history->lock);
+    const history_segment_t *seg = &history->segments[history->num_segments - 1];
+    uint64_t end = seg->base + seg->size;
+    pthread_mutex_unlock(&history->lock);
+    return end;
+}
+
+void history_close(history_t *history) {
+    if (!history) {
+        return;
+    }
+
+    if (history->num_segments > 0 && history->segments[history->num_segments - 1].meta_loaded) {
+        history_checkpoint(history);
+    }
+
+    for (size_t i = 0; i < history->num_segments; i++) {
+        close(history->segments[i].fd);
+    }
+    free(history->segments);
+    free(history->active_entries);
+    history->segments = NULL;
+    history->active_entries = NULL;
+    history->num_segments = 0;
+    history->cap_segments = 0;
+    pthread_mutex_destroy(&history->lock);
+}
@@ -0,0 +1,207 @@
+/**
+ * @file hitters.c
+ * @brief Implementation of heavy-hitter detection
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "hitters.h"
+#include <stdio.h>
+#include <string.h>
+
+/* FNV-1a over the key; the two halves seed the row hashes */
+static uint64_t hash_key(const char *key, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Column of a key in each row, by double hashing */
+static void columns(const char *key, size_t len, uint32_t cols[HITTERS_DEPTH]) {
+    uint64_t hash = hash_key(key, len);
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (int row = 0; row < HITTERS_DEPTH; row++) {
+        cols[row] = (h1 + (uint32_t)row * h2) & (HITTERS_WIDTH - 1);
+    }
+}
+
+static void swap(hitter_t *a, hitter_t *b) {
+    hitter_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void sift_up(hitters_t *hitters, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (hitters->top[parent].estimate <= hitters->top[i].estimate) {
+            break;
+        }
+        swap(&hitters->top[parent], &hitters->top[i]);
+        i = parent;
+    }
+}
+
+static void sift_down(hitters_t *hitters, int i) {
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < hitters->num_top &&
+            hitters->top[left].estimate < hitters->top[smallest].estimate) {
+            smallest = left;
+        }
+        if (right < hitters->num_top &&
+            hitters->top[right].estimate < hitters->top[smallest].estimate) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        swap(&hitters->top[smallest], &hitters->top[i]);
+        i = smallest;
+    }
+}
+
+void hitters_init(hitters_t *hitters) {
+    memset(hitters, 0, sizeof(*hitters));
+}
+
+uint64_t hitters_add(hitters_t *hitters, const char *key, size_t key_len, uint32_t weight) {
+    if (key_len > HITTERS_MAX_KEY) {
+        key_len = HITTERS_MAX_KEY;
+    }
+
+    /* Conservative update: raise each counter only as far as the new
+     * estimate, which keeps collisions from inflating the other rows */
+    uint32_t cols[HITTERS_DEPTH];
+    columns(key, key_len, cols);
+    uint32_t min = UINT32_MAX;
+    for (int row = 0; row < HITTERS_DEPTH; row++) {
+        uint32_t count = hitters->counters[row][cols[row]];
+        min = count < min ? count : min;
+    }
+    uint32_t estimate = min > UINT32_MAX - weight ? UINT32_MAX : min + weight;
+    for (int row = 0; row < HITTERS_DEPTH; row++) {
+        uint32_t *count = &hitters->counters[row][cols[row]];
+        if (*count < estimate) {
+            *count = estimate;
+        }
+    }
+    hitters->total += weight;
+
+    /* Estimates only grow, so an entry already in the heap moves down */
+    for (int i = 0; i < hitters->num_top; i++) {
+        hitter_t *entry = &hitters->top[i];
+        if (entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+            entry->estimate = estimate;
+            sift_down(hitters, i);
+            return estimate;
+        }
+    }
+
+    hitter_t *slot;
+    if (hitters->num_top < HITTERS_TOP_K) {
+        slot = &hitters->top[hitters->num_top++];
+    } else if (estimate > hitters->top[0].estimate) {
+        slot = &hitters->top[0];
+    } else {
+        return estimate;
+    }
+    slot->estimate = estimate;
+    slot->key_len = (uint8_t)key_len;
+    memcpy(slot->key, key, key_len);
+    if (slot == &hitters->top[0]) {
+        sift_down(hitters, 0);
+    } else {
+        sift_up(hitters, (int)(slot - hitters->top));
+    }
+    return estimate;
+}
+
+uint64_t hitters_estimate(const hitters_t *hitters, const char *key, size_t key_len) {
+    if (key_len > HITTERS_MAX_KEY) {
+        key_len = HITTERS_MAX_KEY;
+    }
+    uint32_t cols[HITTERS_DEPTH];
+    columns(key, key_len, cols);
+    uint32_t min = UINT32_MAX;
+    for (int row = 0; row < HITTERS_DEPTH; row++) {
+        uint32_t count = hitters->counters[row][cols[row]];
+        min = count < min ? count : min;
+    }
+    return min;
+}
+
+void hitters_decay(hitters_t *hitters) {
+    for (int row = 0; row < HITTERS_DEPTH; row++) {
+        for (int col = 0; col < HITTERS_WIDTH; col++) {
+            hitters->counters[row][col] >>= 1;
+        }
+    }
+    /* Halving keeps the heap order */
+    for (int i = 0; i < hitters->num_top; i++) {
+        hitters->top[i].estimate >>= 1;
+    }
+    hitters->total >>= 1;
+}
+
+int hitters_top(const hitters_t *hitters, hitter_t *out) {
+    int n = hitters->num_top;
+    memcpy(out, hitters->top, (size_t)n * sizeof(hitter_t));
+
+    /* Insertion sort, heaviest first; K is small */
+    for (int i = 1; i < n; i++) {
+        hitter_t entry = out[i];
+        int j = i;
+        while (j > 0 && out[j - 1].estimate < entry.estimate) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = entry;
+    }
+    return n;
+}
+
+/* Append a key as a label value: backslash, quote and newline are escaped */
+static size_t escape_label(char *out, size_t cap, const char *key, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = key[i];
+        int escaped = c == '\\' || c == '"' || c == '\n';
+        if (n + 1 + (size_t)escaped >= cap) {
+            return cap;
+        }
+        if (escaped) {
+            out[n++] = '\\';
+            c = c == '\n' ? 'n' : c;
+        }
+        out[n++] = c;
+    }
+    return n;
+}
+
+int hitters_render(const hitters_t *hitters, const char *metric, const char *label, char *out,
+                   size_t cap) {
+    hitter_t top[HITTERS_TOP_K];
+    int n = hitters_top(hitters, top);
+
+    size_t len = 0;
+    for (int i = 0; i < n; i++) {
+        char key[2 * HITTERS_MAX_KEY + 1];
+        size_t key_len = escape_label(key, sizeof(key), top[i].key, top[i].key_len);
+        int written = snprintf(out + len, cap - len, "%s{rank=\"%d\",%s=\"%.*s\"} %llu\n",
+                               metric, i + 1, label, (int)key_len, key,
+                               (unsigned long long)top[i].estimate);
+        if (written < 0 || (size_t)written >= cap - len) {
+            return -1;
+        }
+        len += (size_t)written;
+    }
+    return (int)len;
+}
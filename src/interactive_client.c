@@ -12,6 +12,7 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "common.h"
+#include "frame_parser.h"
 #include "protocol.h"
 #include <arpa/inet.h>
 #include <errno.h>
@@ -23,22 +24,107 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+/* Features offered in HELLO */
+#define CLIENT_FEATURES (FEATURE_ACKS | FEATURE_MSG_IDS | FEATURE_MUTE | FEATURE_TOPICS)
+
+/* Bytes requested from the socket per recv() call */
+#define RECV_CHUNK_SIZE 4096
+
 /* Shared data between threads */
 typedef struct {
     int socket_fd;
     volatile int should_stop;
     char username[MAX_USERNAME_LEN];
+    uint64_t next_msg_id;      /* ID attached to the next chat message */
+    pthread_mutex_t lock;
+    pthread_cond_t registered;  /* Signalled when register_status changes */
+    int register_status;        /* REGISTER_*, or -1 while waiting for the server */
+    int negotiated;             /* Whether the server's first frame has been seen */
+    uint32_t features;          /* FEATURE_* bits agreed with the server */
 } thread_data_t;
 
+/**
+ * @brief Block until the server has answered the username registration
+ * @return REGISTER_OK on success, the rejection status otherwise (-1 if the
+ *         connection closed first)
+ */
+static int wait_for_registration(thread_data_t *data) {
+    pthread_mutex_lock(&data->lock);
+    while (data->register_status == -1 && !data->should_stop) {
+        pthread_cond_wait(&data->registered, &data->lock);
+    }
+    int status = data->register_status;
+    pthread_mutex_unlock(&data->lock);
+    return status;
+}
+
+/**
+ * @brief Record the registration result and wake the sender thread
+ */
+static void set_register_status(thread_data_t *data, int status) {
+    pthread_mutex_lock(&data->lock);
+    data->register_status = status;
+    pthread_cond_broadcast(&data->registered);
+    pthread_mutex_unlock(&data->lock);
+}
+
+/**
+ * @brief Handle the first frame received from the server
+ *
+ * A server that supports the handshake always answers HELLO first. Any
+ * other frame means it predates HELLO, so no features are available and
+ * registration is assumed to have succeeded.
+ *
+ * @return 1 if the frame was a HELLO and has been consumed, 0 if it still
+ *         needs to be processed
+ */
+static int handle_handshake(thread_data_t *data, const uint8_t *frame, size_t len) {
+    data->negotiated = 1;
+    if (frame[0] != MSG_TYPE_HELLO || len != HELLO_SERVER_LEN) {
+        set_register_status(data, REGISTER_OK);
+        return 0;
+    }
+    
+    /* Server HELLO: [type][version][features:4]\n */
+    uint32_t features_net;
+    memcpy(&features_net, frame + 2, 4);
+    
+    pthread_mutex_lock(&data->lock);
+    data->features = ntohl(features_net);
+    pthread_mutex_unlock(&data->lock);
+    
+    /* Without acks there is nothing more to wait for */
+    if (!(data->features & FEATURE_ACKS)) {
+        set_register_status(data, REGISTER_OK);
+    }
+    return 1;
+}
+
+/**
+ * @brief Extract printable username and address from a peer frame
+ */
+static void peer_names(const peer_frame_t *peer, char *username, char *ip_str) {
+    if (peer->username_len > 0 && peer->username_len < MAX_USERNAME_LEN) {
+        memcpy(username, peer->username, peer->username_len);
+        username[peer->username_len] = '\0';
+    } else {
+        strcpy(username, "unknown");
+    }
+    
+    struct in_addr addr;
+    addr.s_addr = peer->ip;
+    inet_ntop(AF_INET, &addr, ip_str, INET_ADDRSTRLEN);
+}
+
 /**
  * @brief Sender thread - reads from stdin and sends to server
  */
 void *sender_thread(void *arg) {
     thread_data_t *data = (thread_data_t *)arg;
     
-    /* First, send username registration */
+    /* Open with HELLO and pipeline the username registration behind it */
     uint8_t username_msg[BUF_SIZE];
-    int offset = 0;
+    int offset = encode_client_hello(username_msg, CLIENT_FEATURES);
     username_msg[offset++] = MSG_TYPE_USERNAME;
     
     uint8_t username_len = (uint8_t)strlen(data->username);
@@ -52,12 +138,22 @@ void *sender_thread(void *arg) {
         return NULL;
     }
     
+    int status = wait_for_registration(data);
+    if (status != REGISTER_OK) {
+        if (status != -1) {
+            fprintf(stderr, "\n✗ Registration failed: %s\n", register_status_str((uint8_t)status));
+        }
+        data->should_stop = 1;
+        shutdown(data->socket_fd, SHUT_RDWR);
+        return NULL;
+    }
+    
     printf("\n✓ Connected as '%s'\n", data->username);
-    printf("Type your messages (or 'quit' to exit):\n");
+    printf("Type your messages ('/search <words>' to search history, '/mute <name>' or\n"
+           "'/unmute <name>' to hide or show someone's messages, '/sub <pattern>',\n"
+           "'/unsub <pattern>' and '/pub <topic> <message>' for topics, 'quit' to exit):\n");
     printf("─────────────────────────────────────────\n");
     
-    usleep(100000); /* Small delay to let username propagate */
-    
     char input_line[MAX_MESSAGE_LEN];
     
     while (!data->should_stop) {
@@ -87,13 +183,109 @@ void *sender_thread(void *arg) {
             continue;
         }
         
+        /* History search: /search <words> */
+        if (strncmp(input_line, "/search ", 8) == 0) {
+            uint8_t search_buf[BUF_SIZE];
+            size_t query_len = len - 8;
+            search_buf[0] = MSG_TYPE_SEARCH;
+            memcpy(&search_buf[1], input_line + 8, query_len);
+            search_buf[1 + query_len] = '\n';
+            
+            if (send(data->socket_fd, search_buf, 1 + query_len + 1, 0) < 0) {
+                fprintf(stderr, "\nFailed to send search\n");
+                break;
+            }
+            continue;
+        }
+        
+        /* Mute list: /mute <name>, /unmute <name> */
+        int mute = strncmp(input_line, "/mute ", 6) == 0;
+        if (mute || strncmp(input_line, "/unmute ", 8) == 0) {
+            const char *name = input_line + (mute ? 6 : 8);
+            size_t name_len = strlen(name);
+            if (!(data->features & FEATURE_MUTE)) {
+                printf("This server does not support muting\n");
+                continue;
+            }
+            if (name_len == 0 || name_len >= MAX_USERNAME_LEN) {
+                printf("Usage: /mute <name> or /unmute <name>\n");
+                continue;
+            }
+            
+            /* [MUTE][1 mute / 0 unmute][username_len][username]\n */
+            uint8_t mute_buf[4 + MAX_USERNAME_LEN];
+            mute_buf[0] = MSG_TYPE_MUTE;
+            mute_buf[1] = (uint8_t)mute;
+            mute_buf[2] = (uint8_t)name_len;
+            memcpy(&mute_buf[3], name, name_len);
+            mute_buf[3 + name_len] = '\n';
+            
+            if (send(data->socket_fd, mute_buf, 4 + name_len, 0) < 0) {
+                fprintf(stderr, "\nFailed to send mute request\n");
+                break;
+            }
+            continue;
+        }
+        
+        /* Topics: /sub <pattern>, /unsub <pattern>, /pub <topic> <message> */
+        int sub = strncmp(input_line, "/sub ", 5) == 0;
+        int pub = strncmp(input_line, "/pub ", 5) == 0;
+        if (sub || pub || strncmp(input_line, "/unsub ", 7) == 0) {
+            const char *topic = input_line + (sub || pub ? 5 : 7);
+            const char *space = pub ? strchr(topic, ' ') : NULL;
+            size_t topic_len = space ? (size_t)(space - topic) : strlen(topic);
+            if (!(data->features & FEATURE_TOPICS)) {
+                printf("This server does not support topics\n");
+                continue;
+            }
+            if (topic_len == 0 || topic_len > 255 || (pub && !space)) {
+                printf("Usage: /sub <pattern>, /unsub <pattern> or /pub <topic> <message>\n");
+                continue;
+            }
+            
+            /* [SUBSCRIBE][1 / 0][pattern_len][pattern]\n or
+             * [PUBLISH][topic_len][topic][message]\n */
+            uint8_t topic_buf[BUF_SIZE];
+            size_t topic_frame_len = 0;
+            topic_buf[topic_frame_len++] = pub ? MSG_TYPE_PUBLISH : MSG_TYPE_SUBSCRIBE;
+            if (!pub) {
+                topic_buf[topic_frame_len++] = (uint8_t)sub;
+            }
+            topic_buf[topic_frame_len++] = (uint8_t)topic_len;
+            memcpy(&topic_buf[topic_frame_len], topic, topic_len);
+            topic_frame_len += topic_len;
+            if (pub) {
+                size_t text_len = strlen(space + 1);
+                memcpy(&topic_buf[topic_frame_len], space + 1, text_len);
+                topic_frame_len += text_len;
+            }
+            topic_buf[topic_frame_len++] = '\n';
+            
+            if (send(data->socket_fd, topic_buf, topic_frame_len, 0) < 0) {
+                fprintf(stderr, "\nFailed to send topic request\n");
+                break;
+            }
+            continue;
+        }
+        
         /* Send message */
+        /* Chat message with ID: [type][16 hex id][message]\n, or a plain
+         * [type][message]\n if the server does not take IDs */
         uint8_t send_buf[BUF_SIZE];
-        send_buf[0] = MSG_TYPE_CHAT;
-        memcpy(&send_buf[1], input_line, len);
-        send_buf[1 + len] = '\n';
+        size_t send_len = 0;
+        if (data->features & FEATURE_MSG_IDS) {
+            send_buf[send_len++] = MSG_TYPE_CHAT_ID;
+            snprintf((char *)&send_buf[send_len], MSG_ID_HEX_LEN + 1, "%016llx",
+                     (unsigned long long)data->next_msg_id++);
+            send_len += MSG_ID_HEX_LEN;
+        } else {
+            send_buf[send_len++] = MSG_TYPE_CHAT;
+        }
+        memcpy(&send_buf[send_len], input_line, len);
+        send_len += len;
+        send_buf[send_len++] = '\n';
         
-        if (send(data->socket_fd, send_buf, 1 + len + 1, 0) < 0) {
+        if (send(data->socket_fd, send_buf, send_len, 0) < 0) {
             fprintf(stderr, "\nFailed to send message\n");
             break;
         }
@@ -109,162 +301,128 @@ void *sender_thread(void *arg) {
     return NULL;
 }
 
+/**
+ * @brief Frame parser callback - displays one frame from the server
+ * @return 0 to keep reading, 1 to stop
+ */
+static int handle_frame(const uint8_t *frame, size_t len, void *arg) {
+    thread_data_t *data = (thread_data_t *)arg;
+    uint8_t type = frame[0];
+    
+    /* The server's first frame tells whether it understood HELLO */
+    if (!data->negotiated && handle_handshake(data, frame, len)) {
+        return 0;
+    }
+    
+    if (type == MSG_TYPE_CHAT || type == MSG_TYPE_SEARCH_RESULT || type == MSG_TYPE_JOIN ||
+        type == MSG_TYPE_DISCONNECT || type == MSG_TYPE_TOPIC_CHAT) {
+        /* [type][ip][port][username_len][username][message]\n */
+        peer_frame_t peer;
+        if (decode_peer_frame(frame, len, &peer) != 0) {
+            return 1;
+        }
+        
+        char username[MAX_USERNAME_LEN];
+        char ip_str[INET_ADDRSTRLEN];
+        peer_names(&peer, username, ip_str);
+        
+        /* Display formatted message */
+        printf("\r\033[K");  /* Clear current line */
+        if (type == MSG_TYPE_SEARCH_RESULT) {
+            printf("[search] <%s> %.*s\n", username, (int)peer.payload_len, peer.payload);
+        } else if (type == MSG_TYPE_CHAT) {
+            printf("<%s> %.*s\n", username, (int)peer.payload_len, peer.payload);
+        } else if (type == MSG_TYPE_TOPIC_CHAT) {
+            /* Payload: [topic_len][topic][message] */
+            uint8_t topic_len = (uint8_t)peer.payload[0];
+            printf("[%.*s] <%s> %.*s\n", (int)topic_len, peer.payload + 1, username,
+                   (int)(peer.payload_len - 1 - topic_len), peer.payload + 1 + topic_len);
+        } else if (type == MSG_TYPE_JOIN) {
+            printf("*** %s joined the chat ***\n", username);
+        } else {
+            printf("*** %s left the chat ***\n", username);
+        }
+        printf("> ");
+        fflush(stdout);
+        
+    } else if (type == MSG_TYPE_SEARCH_END) {
+        /* End of search results: [type][count]\n */
+        uint32_t count_net;
+        memcpy(&count_net, frame + 1, 4);
+        
+        printf("\r\033[K");
+        printf("*** %u search result(s) ***\n", ntohl(count_net));
+        printf("> ");
+        fflush(stdout);
+        
+    } else if (type == MSG_TYPE_MUTE_ACK) {
+        /* Mute result: [type][status]\n */
+        printf("\r\033[K");
+        printf(frame[1] == MUTE_OK ? "*** Mute list updated ***\n"
+                                   : "*** No such user on this server ***\n");
+        printf("> ");
+        fflush(stdout);
+        
+    } else if (type == MSG_TYPE_SUBSCRIBE_ACK) {
+        /* Subscription result: [type][status]\n */
+        printf("\r\033[K");
+        printf(frame[1] == TOPIC_OK      ? "*** Subscriptions updated ***\n"
+               : frame[1] == TOPIC_LIMIT ? "*** Too many subscriptions ***\n"
+                                         : "*** Invalid pattern or not subscribed ***\n");
+        printf("> ");
+        fflush(stdout);
+        
+    } else if (type == MSG_TYPE_CHAT_FAILED) {
+        /* Message not stored: [type][16 hex id]\n */
+        printf("\r\033[K");
+        printf("*** Your message %.*s was not delivered; send it again ***\n", MSG_ID_HEX_LEN,
+               (const char *)frame + 1);
+        printf("> ");
+        fflush(stdout);
+        
+    } else if (type == MSG_TYPE_REGISTER_ACK) {
+        /* Registration result: [type][status]\n */
+        set_register_status(data, frame[1]);
+    }
+    return 0;
+}
+
 /**
  * @brief Receiver thread - receives and displays messages from server
+ *
+ * Whatever recv returns is pushed through the frame parser, so one call
+ * may deliver several frames and a frame may span several calls.
  */
 void *receiver_thread(void *arg) {
     thread_data_t *data = (thread_data_t *)arg;
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    uint8_t chunk[RECV_CHUNK_SIZE];
     
     while (!data->should_stop) {
-        uint8_t type;
-        ssize_t r = recv_exact(data->socket_fd, &type, 1);
+        ssize_t r = recv(data->socket_fd, chunk, sizeof(chunk), 0);
         
         if (r <= 0) {
+            if (r == -1 && errno == EINTR) {
+                continue;
+            }
             if (!data->should_stop) {
                 printf("\n✗ Connection closed by server\n");
             }
             break;
         }
         
-        if (type == MSG_TYPE_CHAT) {
-            /* Chat message: [type][ip][port][username_len][username][message]\n */
-            uint32_t ip_net;
-            uint16_t port_net;
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&ip_net, sizeof(ip_net)) <= 0) {
-                break;
-            }
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&port_net, sizeof(port_net)) <= 0) {
-                break;
-            }
-            
-            uint8_t username_len;
-            if (recv_exact(data->socket_fd, &username_len, 1) <= 0) {
-                break;
-            }
-            
-            char username[MAX_USERNAME_LEN];
-            if (username_len > 0 && username_len < MAX_USERNAME_LEN) {
-                if (recv_exact(data->socket_fd, (uint8_t *)username, username_len) <= 0) {
-                    break;
-                }
-                username[username_len] = '\0';
-            } else {
-                strcpy(username, "unknown");
-            }
-            
-            /* Read message until newline */
-            char msg_buf[BUF_SIZE];
-            int idx = 0;
-            while (1) {
-                uint8_t ch;
-                r = recv(data->socket_fd, &ch, 1, 0);
-                if (r <= 0) {
-                    data->should_stop = 1;
-                    break;
-                }
-                if (ch == '\n') {
-                    break;
-                }
-                if (idx < (int)sizeof(msg_buf) - 1) {
-                    msg_buf[idx++] = (char)ch;
-                }
-            }
-            
-            if (data->should_stop) {
-                break;
-            }
-            
-            msg_buf[idx] = '\0';
-            
-            /* Display formatted message */
-            printf("\r\033[K");  /* Clear current line */
-            printf("<%s> %s\n", username, msg_buf);
-            printf("> ");
-            fflush(stdout);
-            
-        } else if (type == MSG_TYPE_JOIN) {
-            /* Join notification */
-            uint32_t ip_net;
-            uint16_t port_net;
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&ip_net, sizeof(ip_net)) <= 0) {
-                break;
-            }
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&port_net, sizeof(port_net)) <= 0) {
-                break;
-            }
-            
-            uint8_t username_len;
-            if (recv_exact(data->socket_fd, &username_len, 1) <= 0) {
-                break;
-            }
-            
-            char username[MAX_USERNAME_LEN];
-            if (username_len > 0 && username_len < MAX_USERNAME_LEN) {
-                if (recv_exact(data->socket_fd, (uint8_t *)username, username_len) <= 0) {
-                    break;
-                }
-                username[username_len] = '\0';
-            } else {
-                strcpy(username, "unknown");
-            }
-            
-            /* Read newline */
-            uint8_t newline;
-            if (recv(data->socket_fd, &newline, 1, 0) <= 0) {
-                break;
-            }
-            
-            printf("\r\033[K");
-            printf("*** %s joined the chat ***\n", username);
-            printf("> ");
-            fflush(stdout);
-            
-        } else if (type == MSG_TYPE_DISCONNECT) {
-            /* Disconnect notification */
-            uint32_t ip_net;
-            uint16_t port_net;
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&ip_net, sizeof(ip_net)) <= 0) {
-                break;
-            }
-            
-            if (recv_exact(data->socket_fd, (uint8_t *)&port_net, sizeof(port_net)) <= 0) {
-                break;
-            }
-            
-            uint8_t username_len;
-            if (recv_exact(data->socket_fd, &username_len, 1) <= 0) {
-                break;
-            }
-            
-            char username[MAX_USERNAME_LEN];
-            if (username_len > 0 && username_len < MAX_USERNAME_LEN) {
-                if (recv_exact(data->socket_fd, (uint8_t *)username, username_len) <= 0) {
-                    break;
-                }
-                username[username_len] = '\0';
-            } else {
-                strcpy(username, "unknown");
-            }
-            
-            /* Read newline */
-            uint8_t newline;
-            if (recv(data->socket_fd, &newline, 1, 0) <= 0) {
-                break;
-            }
-            
-            printf("\r\033[K");
-            printf("*** %s left the chat ***\n", username);
-            printf("> ");
-            fflush(stdout);
+        if (frame_parser_feed(&parser, chunk, (size_t)r, handle_frame, data) != 0) {
+            printf("\n✗ Malformed frame from server\n");
+            break;
         }
     }
     
+    /* Unblock a sender still waiting for its registration */
+    pthread_mutex_lock(&data->lock);
     data->should_stop = 1;
+    pthread_cond_broadcast(&data->registered);
+    pthread_mutex_unlock(&data->lock);
     return NULL;
 }
 
@@ -319,10 +477,20 @@ int main(int argc, char *argv[]) {
     thread_data_t thread_data = {
         .socket_fd = sfd,
         .should_stop = 0,
+        .register_status = -1,
     };
+    pthread_mutex_init(&thread_data.lock, NULL);
+    pthread_cond_init(&thread_data.registered, NULL);
     strncpy(thread_data.username, username, MAX_USERNAME_LEN - 1);
     thread_data.username[MAX_USERNAME_LEN - 1] = '\0';
     
+    /* Random starting ID keeps IDs unique across sessions of one user */
+    if (random_u64(&thread_data.next_msg_id) != 0) {
+        perror("random_u64");
+        close(sfd);
+        return EXIT_FAILURE;
+    }
+    
     /* Create threads */
     pthread_t sender_tid, receiver_tid;
     
@@ -345,6 +513,8 @@ int main(int argc, char *argv[]) {
     printf("\nDisconnected.\n");
     
     /* Cleanup */
+    pthread_cond_destroy(&thread_data.registered);
+    pthread_mutex_destroy(&thread_data.lock);
     close(sfd);
     
     return EXIT_SUCCESS;
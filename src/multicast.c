@@ -0,0 +1,293 @@
+/**
+ * @file multicast.c
+ * @brief Implementation of sequenced multicast with NAK-based repair
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "multicast.h"
+#include "common.h"
+#include "frame_parser.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Frames that fit in one packet after the header */
+#define MCAST_MAX_FRAMES (MCAST_MAX_PACKET - MCAST_HEADER_LEN)
+
+static void put_seq(uint8_t *buf, uint64_t seq) {
+    for (int i = 7; i >= 0; i--) {
+        buf[i] = (uint8_t)seq;
+        seq >>= 8;
+    }
+}
+
+static uint64_t get_seq(const uint8_t *buf) {
+    uint64_t seq = 0;
+    for (int i = 0; i < 8; i++) {
+        seq = (seq << 8) | buf[i];
+    }
+    return seq;
+}
+
+int mcast_publisher_open(mcast_publisher_t *pub, const struct sockaddr_in *group,
+                         struct in_addr iface) {
+    memset(pub, 0, sizeof(*pub));
+    pub->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (pub->fd == -1) {
+        return -1;
+    }
+
+    /* Stay on the local segment, and reach subscribers on this host too */
+    unsigned char ttl = 1;
+    unsigned char loop = 1;
+    if (setsockopt(pub->fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) == -1 ||
+        setsockopt(pub->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == -1 ||
+        setsockopt(pub->fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == -1 ||
+        set_nonblocking(pub->fd) == -1) {
+        close(pub->fd);
+        return -1;
+    }
+
+    pub->ring = malloc((size_t)MCAST_RING_PACKETS * MCAST_MAX_PACKET);
+    pub->ring_len = calloc(MCAST_RING_PACKETS, sizeof(uint16_t));
+    if (!pub->ring || !pub->ring_len) {
+        free(pub->ring);
+        free(pub->ring_len);
+        close(pub->fd);
+        return -1;
+    }
+    pub->group = *group;
+    pub->next_seq = 1;
+    return 0;
+}
+
+void mcast_publisher_close(mcast_publisher_t *pub) {
+    close(pub->fd);
+    free(pub->ring);
+    free(pub->ring_len);
+    pub->fd = -1;
+    pub->ring = NULL;
+    pub->ring_len = NULL;
+}
+
+static uint8_t *ring_slot(const mcast_publisher_t *pub, uint64_t seq) {
+    return pub->ring + (seq % MCAST_RING_PACKETS) * MCAST_MAX_PACKET;
+}
+
+/* Seal the packet being filled and send it; a failed send is left to NAKs */
+static void flush_packet(mcast_publisher_t *pub, int64_t now_ms) {
+    if (pub->packet_len == 0) {
+        return;
+    }
+
+    uint8_t *slot = ring_slot(pub, pub->next_seq);
+    size_t len = MCAST_HEADER_LEN + pub->packet_len;
+    put_seq(slot, pub->next_seq);
+    pub->ring_len[pub->next_seq % MCAST_RING_PACKETS] = (uint16_t)len;
+    sendto(pub->fd, slot, len, 0, (const struct sockaddr *)&pub->group, sizeof(pub->group));
+
+    pub->next_seq++;
+    pub->packet_len = 0;
+    pub->last_send_ms = now_ms;
+}
+
+/* Publishing state for one call */
+typedef struct {
+    mcast_publisher_t *pub;
+    int64_t now_ms;
+} publish_ctx_t;
+
+static int pack_frame(const uint8_t *frame, size_t len, void *arg) {
+    publish_ctx_t *ctx = arg;
+    mcast_publisher_t *pub = ctx->pub;
+
+    if (len > MCAST_MAX_FRAMES) {
+        return 0;
+    }
+    if (pub->packet_len + len > MCAST_MAX_FRAMES) {
+        flush_packet(pub, ctx->now_ms);
+    }
+    memcpy(ring_slot(pub, pub->next_seq) + MCAST_HEADER_LEN + pub->packet_len, frame, len);
+    pub->packet_len += len;
+    return 0;
+}
+
+int mcast_publish(mcast_publisher_t *pub, const uint8_t *frames, size_t len, int64_t now_ms) {
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    publish_ctx_t ctx = {pub, now_ms};
+    int rc = frame_parser_feed(&parser, frames, len, pack_frame, &ctx);
+    flush_packet(pub, now_ms);
+    return rc == -1 ? -1 : 0;
+}
+
+void mcast_heartbeat(mcast_publisher_t *pub, int64_t now_ms) {
+    if (now_ms - pub->last_send_ms < MCAST_HEARTBEAT_MS) {
+        return;
+    }
+
+    uint8_t header[MCAST_HEADER_LEN];
+    put_seq(header, pub->next_seq);
+    sendto(pub->fd, header, sizeof(header), 0, (const struct sockaddr *)&pub->group,
+           sizeof(pub->group));
+    pub->last_send_ms = now_ms;
+}
+
+const uint8_t *mcast_lookup(const mcast_publisher_t *pub, uint64_t seq, size_t *len) {
+    if (seq == 0 || seq >= pub->next_seq || pub->next_seq - seq > MCAST_RING_PACKETS) {
+        return NULL;
+    }
+    *len = pub->ring_len[seq % MCAST_RING_PACKETS] - MCAST_HEADER_LEN;
+    return ring_slot(pub, seq) + MCAST_HEADER_LEN;
+}
+
+int mcast_subscriber_open(mcast_subscriber_t *sub, const struct sockaddr_in *group,
+                          struct in_addr iface, uint64_t next_seq) {
+    memset(sub, 0, sizeof(*sub));
+    sub->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sub->fd == -1) {
+        return -1;
+    }
+
+    /* Several subscribers on one host share the group port */
+    int reuse = 1;
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr = group->sin_addr;
+    mreq.imr_interface = iface;
+    if (setsockopt(sub->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1 ||
+        bind(sub->fd, (const struct sockaddr *)group, sizeof(*group)) == -1 ||
+        setsockopt(sub->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1 ||
+        set_nonblocking(sub->fd) == -1) {
+        close(sub->fd);
+        return -1;
+    }
+
+    sub->held = malloc((size_t)MCAST_HOLD_PACKETS * MCAST_MAX_FRAMES);
+    sub->held_len = calloc(MCAST_HOLD_PACKETS, sizeof(uint16_t));
+    sub->held_seq = calloc(MCAST_HOLD_PACKETS, sizeof(uint64_t));
+    if (!sub->held || !sub->held_len || !sub->held_seq) {
+        mcast_subscriber_close(sub);
+        return -1;
+    }
+    sub->next_seq = next_seq;
+    sub->horizon = next_seq;
+    return 0;
+}
+
+void mcast_subscriber_close(mcast_subscriber_t *sub) {
+    if (sub->fd != -1) {
+        close(sub->fd);
+    }
+    free(sub->held);
+    free(sub->held_len);
+    free(sub->held_seq);
+    sub->fd = -1;
+    sub->held = NULL;
+    sub->held_len = NULL;
+    sub->held_seq = NULL;
+}
+
+/* Held slots store len + 1 so that a packet marked lost (0 bytes) is distinct
+ * from an empty slot */
+static int is_held(const mcast_subscriber_t *sub, uint64_t seq) {
+    size_t slot = seq % MCAST_HOLD_PACKETS;
+    return sub->held_len[slot] != 0 && sub->held_seq[slot] == seq;
+}
+
+int mcast_accept(mcast_subscriber_t *sub, uint64_t seq, const uint8_t *frames, size_t len,
+                 mcast_deliver_fn deliver, void *arg) {
+    if (seq < sub->next_seq || len > MCAST_MAX_FRAMES) {
+        return 0;
+    }
+    if (seq >= sub->horizon) {
+        sub->horizon = seq + 1;
+    }
+
+    if (seq > sub->next_seq) {
+        /* Packets too far ahead are dropped and requested again later */
+        if (seq - sub->next_seq < MCAST_HOLD_PACKETS && !is_held(sub, seq)) {
+            size_t slot = seq % MCAST_HOLD_PACKETS;
+            if (frames) {
+                memcpy(sub->held + slot * MCAST_MAX_FRAMES, frames, len);
+            }
+            sub->held_len[slot] = (uint16_t)(frames ? len + 1 : 1);
+            sub->held_seq[slot] = seq;
+        }
+        return 0;
+    }
+
+    int stop = frames && len > 0 ? deliver(frames, len, arg) : 0;
+    sub->next_seq++;
+
+    /* Release packets that were waiting for this one */
+    while (!stop && is_held(sub, sub->next_seq)) {
+        size_t slot = sub->next_seq % MCAST_HOLD_PACKETS;
+        size_t held_len = sub->held_len[slot] - 1u;
+        sub->held_len[slot] = 0;
+        sub->next_seq++;
+        if (held_len > 0) {
+            stop = deliver(sub->held + slot * MCAST_MAX_FRAMES, held_len, arg);
+        }
+    }
+    return stop;
+}
+
+int mcast_receive(mcast_subscriber_t *sub, mcast_deliver_fn deliver, void *arg) {
+    uint8_t packet[MCAST_MAX_PACKET];
+
+    for (;;) {
+        ssize_t n = recv(sub->fd, packet, sizeof(packet), 0);
+        if (n == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        if (n < MCAST_HEADER_LEN) {
+            continue;
+        }
+        if (sub->drop_every && ++sub->received % sub->drop_every == 0) {
+            continue;
+        }
+
+        uint64_t seq = get_seq(packet);
+        if (n == MCAST_HEADER_LEN) {
+            /* Heartbeat: seq is the number of the next packet */
+            if (seq > sub->horizon) {
+                sub->horizon = seq;
+            }
+            continue;
+        }
+
+        int stop = mcast_accept(sub, seq, packet + MCAST_HEADER_LEN,
+                                (size_t)n - MCAST_HEADER_LEN, deliver, arg);
+        if (stop) {
+            return stop;
+        }
+    }
+}
+
+int mcast_next_nak(mcast_subscriber_t *sub, int64_t now_ms, uint64_t *first, uint32_t *count) {
+    if (sub->next_seq >= sub->horizon) {
+        return 0;
+    }
+
+    /* Give the previous request time to be answered */
+    if (sub->nak_end > sub->next_seq && now_ms - sub->nak_ms < MCAST_NAK_RETRY_MS) {
+        return 0;
+    }
+
+    /* Ask for the run of missing packets up to the first one held */
+    uint64_t end = sub->next_seq + 1;
+    while (end < sub->horizon && end - sub->next_seq < MCAST_MAX_NAK && !is_held(sub, end)) {
+        end++;
+    }
+
+    *first = sub->next_seq;
+    *count = (uint32_t)(end - sub->next_seq);
+    sub->nak_end = end;
+    sub->nak_ms = now_ms;
+    return 1;
+}
@@ -0,0 +1,196 @@
+/**
+ * @file plugin_host.c
+ * @brief Implementation of message plugins
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "plugin_host.h"
+#include "common.h"
+#include "utf8.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void plugin_host_init(plugin_host_t *host, uint64_t budget_ns) {
+    memset(host, 0, sizeof(*host));
+    host->budget_ns = budget_ns;
+}
+
+int plugin_host_add(plugin_host_t *host, const chat_plugin_t *api, void *handle,
+                    const char *arg) {
+    if (host->num_plugins == PLUGIN_MAX || api->abi_version != CHAT_PLUGIN_ABI_VERSION ||
+        !api->on_message) {
+        return -1;
+    }
+
+    plugin_t *plugin = &host->plugins[host->num_plugins];
+    memset(plugin, 0, sizeof(*plugin));
+    plugin->api = api;
+    plugin->handle = handle;
+    if (api->init && api->init(arg, &plugin->state) != 0) {
+        return -1;
+    }
+    host->num_plugins++;
+    return 0;
+}
+
+int plugin_host_load(plugin_host_t *host, const char *spec) {
+    /* The argument starts at the first ':' in the file name */
+    char path[4096];
+    const char *arg = NULL;
+    const char *base = strrchr(spec, '/');
+    const char *colon = strchr(base ? base : spec, ':');
+    size_t path_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    if (path_len >= sizeof(path)) {
+        log_message(LOG_ERROR, "Plugin path too long: %s", spec);
+        return -1;
+    }
+    memcpy(path, spec, path_len);
+    path[path_len] = '\0';
+    if (colon) {
+        arg = colon + 1;
+    }
+
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        log_message(LOG_ERROR, "Failed to load plugin %s: %s", path, dlerror());
+        return -1;
+    }
+    const chat_plugin_t *api = dlsym(handle, CHAT_PLUGIN_SYMBOL);
+    if (!api) {
+        log_message(LOG_ERROR, "Plugin %s does not export %s", path, CHAT_PLUGIN_SYMBOL);
+        dlclose(handle);
+        return -1;
+    }
+    if (plugin_host_add(host, api, handle, arg) == -1) {
+        log_message(LOG_ERROR, "Plugin %s failed to initialise (ABI %u, server ABI %u)", path,
+                    api->abi_version, CHAT_PLUGIN_ABI_VERSION);
+        dlclose(handle);
+        return -1;
+    }
+    log_message(LOG_INFO, "Loaded plugin %s from %s", api->name ? api->name : "?", path);
+    return 0;
+}
+
+int plugin_host_run(plugin_host_t *host, chat_plugin_message_t *msg) {
+    int next_buf = 0;
+
+    for (int i = 0; i < host->num_plugins; i++) {
+        plugin_t *plugin = &host->plugins[i];
+        if (plugin->disabled) {
+            continue;
+        }
+
+        char *rewrite = host->rewrite[next_buf];
+        size_t rewrite_len = sizeof(host->rewrite[next_buf]);
+        uint64_t start = monotonic_ns();
+        chat_plugin_verdict_t verdict = plugin->api->on_message(plugin->state, msg, rewrite,
+                                                                &rewrite_len);
+        uint64_t elapsed = monotonic_ns() - start;
+
+        plugin->calls++;
+        plugin->total_ns += elapsed;
+        if (elapsed > plugin->max_ns) {
+            plugin->max_ns = elapsed;
+        }
+        if (elapsed > host->budget_ns) {
+            plugin->overruns++;
+            if (++plugin->consecutive_overruns == PLUGIN_MAX_OVERRUNS) {
+                plugin->disabled = 1;
+                log_message(LOG_WARN, "Disabled plugin %s after %d calls over the %llu us budget",
+                            plugin->api->name ? plugin->api->name : "?", PLUGIN_MAX_OVERRUNS,
+                            (unsigned long long)(host->budget_ns / 1000));
+            }
+        } else {
+            plugin->consecutive_overruns = 0;
+        }
+
+        if (verdict == CHAT_PLUGIN_DROP) {
+            plugin->drops++;
+            return 1;
+        }
+        if (verdict == CHAT_PLUGIN_REWRITE) {
+            /* The replacement goes out in a text frame like any message */
+            if (rewrite_len > sizeof(host->rewrite[next_buf]) ||
+                memchr(rewrite, '\n', rewrite_len) || !utf8_valid(rewrite, rewrite_len)) {
+                plugin->errors++;
+                continue;
+            }
+            plugin->rewrites++;
+            msg->payload = rewrite;
+            msg->payload_len = rewrite_len;
+            next_buf ^= 1;
+        } else if (verdict != CHAT_PLUGIN_ACCEPT) {
+            plugin->errors++;
+        }
+    }
+    return 0;
+}
+
+int plugin_host_render_metrics(const plugin_host_t *host, char *out, size_t cap) {
+    static const struct {
+        const char *name;
+        size_t offset;
+    } counters[] = {
+        {"calls_total", offsetof(plugin_t, calls)},
+        {"drops_total", offsetof(plugin_t, drops)},
+        {"rewrites_total", offsetof(plugin_t, rewrites)},
+        {"errors_total", offsetof(plugin_t, errors)},
+        {"overruns_total", offsetof(plugin_t, overruns)},
+        {"call_ns_total", offsetof(plugin_t, total_ns)},
+        {"call_ns_max", offsetof(plugin_t, max_ns)},
+    };
+
+    size_t len = 0;
+    int n = snprintf(out, cap, "chat_plugin_budget_ns %llu\n",
+                     (unsigned long long)host->budget_ns);
+    if (n < 0 || (size_t)n >= cap) {
+        return -1;
+    }
+    len += (size_t)n;
+
+    for (int i = 0; i < host->num_plugins; i++) {
+        const plugin_t *plugin = &host->plugins[i];
+        const char *name = plugin->api->name ? plugin->api->name : "?";
+        for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+            uint64_t value;
+            memcpy(&value, (const char *)plugin + counters[c].offset, sizeof(value));
+            n = snprintf(out + len, cap - len, "chat_plugin_%s{plugin=\"%s\"} %llu\n",
+                         counters[c].name, name, (unsigned long long)value);
+            if (n < 0 || (size_t)n >= cap - len) {
+                return -1;
+            }
+            len += (size_t)n;
+        }
+        n = snprintf(out + len, cap - len, "chat_plugin_disabled{plugin=\"%s\"} %d\n", name,
+                     plugin->disabled);
+        if (n < 0 || (size_t)n >= cap - len) {
+            return -1;
+        }
+        len += (size_t)n;
+    }
+    return (int)len;
+}
+
+void plugin_host_free(plugin_host_t *host) {
+    for (int i = 0; i < host->num_plugins; i++) {
+        plugin_t *plugin = &host->plugins[i];
+        if (plugin->api->fini) {
+            plugin->api->fini(plugin->state);
+        }
+        if (plugin->handle) {
+            dlclose(plugin->handle);
+        }
+    }
+    host->num_plugins = 0;
+}
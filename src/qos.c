@@ -0,0 +1,255 @@
+/**
+ * @file qos.c
+ * @brief Implementation of room QoS classes
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "qos.h"
+#include "topic_trie.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *class_names[QOS_NUM_CLASSES] = {"interactive", "bulk", "bot"};
+
+/* Credit per turn; interactive rooms are never queued */
+static const size_t class_quantum[QOS_NUM_CLASSES] = {
+    0, QOS_QUANTUM * QOS_BULK_SHARE, QOS_QUANTUM * QOS_BOT_SHARE};
+
+void qos_init(qos_t *qos, size_t num_slots) {
+    memset(qos, 0, sizeof(*qos));
+    qos->num_slots = num_slots;
+    qos->turn = QOS_BULK;
+    slotset_init(&qos->waiting, num_slots);
+}
+
+const char *qos_class_name(qos_class_t cls) {
+    return cls < QOS_NUM_CLASSES ? class_names[cls] : "unknown";
+}
+
+int qos_add_rule(qos_t *qos, const char *spec) {
+    const char *colon = strchr(spec, ':');
+    if (!colon || qos->num_rules == QOS_MAX_RULES) {
+        return -1;
+    }
+    const char *pattern = colon + 1;
+    size_t len = strlen(pattern);
+    if (len >= sizeof(qos->rules[0].pattern) || !topic_pattern_valid(pattern, len)) {
+        return -1;
+    }
+    for (int c = 0; c < QOS_NUM_CLASSES; c++) {
+        if (strlen(class_names[c]) == (size_t)(colon - spec) &&
+            memcmp(class_names[c], spec, (size_t)(colon - spec)) == 0) {
+            qos_rule_t *rule = &qos->rules[qos->num_rules++];
+            memcpy(rule->pattern, pattern, len);
+            rule->len = len;
+            rule->cls = (qos_class_t)c;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+qos_class_t qos_classify(const qos_t *qos, const char *topic, size_t len) {
+    for (int i = 0; i < qos->num_rules; i++) {
+        const qos_rule_t *rule = &qos->rules[i];
+        if (topic_pattern_matches(rule->pattern, rule->len, topic, len)) {
+            return rule->cls;
+        }
+    }
+    return QOS_INTERACTIVE;
+}
+
+static qos_frame_t *pop(qos_queue_t *queue) {
+    qos_frame_t *qf = queue->head;
+    queue->head = qf->next;
+    if (!queue->head) {
+        queue->tail = NULL;
+    }
+    queue->queued -= qf->len;
+    return qf;
+}
+
+static void free_frame(qos_frame_t *qf) {
+    slotset_free(&qf->recipients);
+    free(qf);
+}
+
+int qos_enqueue(qos_t *qos, qos_class_t cls, const uint8_t *frame, size_t len,
+                const slotset_t *recipients) {
+    if (cls == QOS_INTERACTIVE || cls >= QOS_NUM_CLASSES) {
+        return -1;
+    }
+    qos_queue_t *queue = &qos->queues[cls];
+    size_t count = slotset_count(recipients);
+    if (len > QOS_MAX_QUEUED) {
+        queue->dropped += count;
+        return -1;
+    }
+
+    qos_frame_t *qf = malloc(sizeof(*qf) + len);
+    if (!qf) {
+        queue->dropped += count;
+        return -1;
+    }
+    qf->next = NULL;
+    qf->len = len;
+    qf->cost = len * count;
+    slotset_init(&qf->recipients, qos->num_slots);
+    if (slotset_or(&qf->recipients, recipients) == -1) {
+        free(qf);
+        queue->dropped += count;
+        return -1;
+    }
+    memcpy(qf->data, frame, len);
+
+    /* A full queue is held up by recipients that stay busy; its oldest
+     * frames give way, and only those recipients miss them */
+    while (queue->queued + len > QOS_MAX_QUEUED) {
+        qos_frame_t *oldest = pop(queue);
+        queue->dropped += oldest->cost / oldest->len;
+        free_frame(oldest);
+    }
+    if (queue->tail) {
+        queue->tail->next = qf;
+    } else {
+        queue->head = qf;
+    }
+    queue->tail = qf;
+    queue->queued += len;
+    return 0;
+}
+
+int qos_pending(const qos_t *qos) {
+    for (int c = QOS_BULK; c < QOS_NUM_CLASSES; c++) {
+        if (qos->queues[c].head) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Write a class's frames while its credit lasts, charging it for each copy
+ * written. A recipient whose socket is busy keeps the frame queued for it,
+ * and is skipped by later frames for the rest of the turn so that it still
+ * gets them in order. Returns the bytes written; the scan ends early only
+ * when the credit runs out. */
+static size_t drain(qos_t *qos, qos_queue_t *queue, const qos_sink_t *sink) {
+    if (slotset_reserve(&qos->waiting) == -1) {
+        return 0;
+    }
+    slotset_clear(&qos->waiting);
+    size_t written = 0;
+    qos_frame_t *prev = NULL;
+    qos_frame_t *qf = queue->head;
+    while (qf && qf->len <= queue->deficit) {
+        for (long r = slotset_next(&qf->recipients, 0); r != -1 && qf->len <= queue->deficit;
+             r = slotset_next(&qf->recipients, (size_t)r + 1)) {
+            if (slotset_contains(&qos->waiting, (size_t)r)) {
+                continue;
+            }
+            if (sink->busy((size_t)r, sink->arg)) {
+                slotset_add(&qos->waiting, (size_t)r);
+                continue;
+            }
+            slotset_remove(&qf->recipients, (size_t)r);
+            qf->cost -= qf->len;
+            if (sink->deliver((size_t)r, qf->data, qf->len, sink->arg) == -1) {
+                queue->dropped++;
+                continue;
+            }
+            queue->deficit -= qf->len;
+            written += qf->len;
+        }
+
+        qos_frame_t *next = qf->next;
+        if (qf->cost == 0) {
+            if (prev) {
+                prev->next = next;
+            } else {
+                queue->head = next;
+            }
+            if (queue->tail == qf) {
+                queue->tail = prev;
+            }
+            queue->queued -= qf->len;
+            free_frame(qf);
+        } else {
+            prev = qf;
+        }
+        qf = next;
+    }
+    queue->sent += written;
+
+    /* Every frame left waits on a busy recipient: credit the class cannot
+     * use now is not kept for a burst later */
+    if (!qf) {
+        queue->deficit = 0;
+    }
+    return written;
+}
+
+size_t qos_flush(qos_t *qos, size_t budget, const qos_sink_t *sink) {
+    size_t written = 0;
+    int idle_turns = 0;             /* Turns in a row that wrote nothing */
+    while (written < budget && idle_turns < QOS_NUM_CLASSES - QOS_BULK) {
+        qos_queue_t *queue = &qos->queues[qos->turn];
+        qos->turn = qos->turn + 1 < QOS_NUM_CLASSES ? qos->turn + 1 : QOS_BULK;
+
+        size_t turn_written = 0;
+        if (queue->head) {
+            queue->deficit += class_quantum[queue - qos->queues];
+            turn_written = drain(qos, queue, sink);
+        }
+        /* An empty class keeps no credit, so it cannot burst later */
+        if (!queue->head) {
+            queue->deficit = 0;
+        }
+        written += turn_written;
+        idle_turns = turn_written > 0 ? 0 : idle_turns + 1;
+    }
+    return written;
+}
+
+void qos_forget(qos_t *qos, size_t slot) {
+    for (int c = 0; c < QOS_NUM_CLASSES; c++) {
+        for (qos_frame_t *qf = qos->queues[c].head; qf; qf = qf->next) {
+            if (slotset_contains(&qf->recipients, slot)) {
+                slotset_remove(&qf->recipients, slot);
+                qf->cost -= qf->len;
+            }
+        }
+    }
+}
+
+int qos_render(const qos_t *qos, char *out, size_t cap) {
+    size_t len = 0;
+    for (int c = QOS_BULK; c < QOS_NUM_CLASSES; c++) {
+        const qos_queue_t *queue = &qos->queues[c];
+        int written = snprintf(out + len, cap - len,
+                               "chat_qos_queued_bytes{class=\"%s\"} %zu\n"
+                               "chat_qos_sent_bytes_total{class=\"%s\"} %llu\n"
+                               "chat_qos_dropped_total{class=\"%s\"} %llu\n",
+                               class_names[c], queue->queued, class_names[c],
+                               (unsigned long long)queue->sent, class_names[c],
+                               (unsigned long long)queue->dropped);
+        if (written < 0 || (size_t)written >= cap - len) {
+            return -1;
+        }
+        len += (size_t)written;
+    }
+    return (int)len;
+}
+
+void qos_free(qos_t *qos) {
+    for (int c = 0; c < QOS_NUM_CLASSES; c++) {
+        qos_queue_t *queue = &qos->queues[c];
+        while (queue->head) {
+            free_frame(pop(queue));
+        }
+        queue->deficit = 0;
+    }
+    slotset_free(&qos->waiting);
+}
@@ -0,0 +1,151 @@
+/**
+ * @file reactions.c
+ * @brief Implementation of aggregated reactions
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "reactions.h"
+#include "protocol.h"
+#include <string.h>
+
+void reactions_init(reactions_t *reactions, size_t num_slots) {
+    memset(reactions, 0, sizeof(*reactions));
+    for (int i = 0; i < REACTIONS_MAX_MESSAGES; i++) {
+        for (int k = 0; k < REACTIONS_MAX_KINDS; k++) {
+            slotset_init(&reactions->entries[i].kinds[k].reactors, num_slots);
+        }
+    }
+    slotset_init(&reactions->dirty, REACTIONS_MAX_MESSAGES);
+}
+
+uint64_t reactions_next_message(reactions_t *reactions) {
+    uint64_t seq = reactions->next_seq++;
+    size_t index = seq & (REACTIONS_MAX_MESSAGES - 1);
+
+    /* The oldest message leaves the window; unsent updates for it are lost */
+    reaction_entry_t *entry = &reactions->entries[index];
+    for (int k = 0; k < entry->num_kinds; k++) {
+        slotset_clear(&entry->kinds[k].reactors);
+    }
+    entry->num_kinds = 0;
+    entry->seq = seq;
+    slotset_remove(&reactions->dirty, index);
+    return seq;
+}
+
+int reactions_apply(reactions_t *reactions, size_t slot, uint64_t seq, int add,
+                    const char *text, size_t len) {
+    if (seq >= reactions->next_seq || reactions->next_seq - seq > REACTIONS_MAX_MESSAGES ||
+        len == 0 || len > REACTIONS_MAX_LEN) {
+        return -1;
+    }
+    size_t index = seq & (REACTIONS_MAX_MESSAGES - 1);
+    reaction_entry_t *entry = &reactions->entries[index];
+
+    reaction_t *kind = NULL;
+    for (int k = 0; k < entry->num_kinds; k++) {
+        if (entry->kinds[k].len == len && memcmp(entry->kinds[k].text, text, len) == 0) {
+            kind = &entry->kinds[k];
+            break;
+        }
+    }
+    if (!kind) {
+        if (!add) {
+            return 0;
+        }
+        if (entry->num_kinds == REACTIONS_MAX_KINDS) {
+            return -1;
+        }
+        kind = &entry->kinds[entry->num_kinds++];
+        kind->len = (uint8_t)len;
+        memcpy(kind->text, text, len);
+        kind->count = 0;
+        kind->reported = 0;
+    }
+
+    if (add) {
+        if (slotset_contains(&kind->reactors, slot)) {
+            return 0;
+        }
+        if (slotset_add(&kind->reactors, slot) == -1) {
+            return -1;
+        }
+        kind->count++;
+    } else {
+        if (!slotset_contains(&kind->reactors, slot)) {
+            return 0;
+        }
+        slotset_remove(&kind->reactors, slot);
+        kind->count--;
+    }
+    if (slotset_add(&reactions->dirty, index) == -1) {
+        return -1;
+    }
+    reactions->applied++;
+    return 1;
+}
+
+size_t reactions_flush(reactions_t *reactions, int64_t now_ms, uint8_t *out, size_t cap) {
+    if (now_ms < reactions->next_flush_ms || slotset_empty(&reactions->dirty)) {
+        return 0;
+    }
+    reactions->next_flush_ms = now_ms + REACTIONS_INTERVAL_MS;
+
+    size_t len = 0;
+    for (long i = slotset_next(&reactions->dirty, 0); i != -1;
+         i = slotset_next(&reactions->dirty, (size_t)i + 1)) {
+        reaction_entry_t *entry = &reactions->entries[i];
+        for (int k = 0; k < entry->num_kinds; k++) {
+            reaction_t *kind = &entry->kinds[k];
+            if (kind->count == kind->reported) {
+                continue;
+            }
+            if (len + REACTION_COUNT_HEADER + kind->len + 1 > cap) {
+                return len;
+            }
+            uint8_t *frame = out + len;
+            frame[0] = MSG_TYPE_REACTION_COUNT;
+            for (int b = 0; b < 8; b++) {
+                frame[1 + b] = (uint8_t)(entry->seq >> (56 - 8 * b));
+            }
+            for (int b = 0; b < 4; b++) {
+                frame[9 + b] = (uint8_t)(kind->count >> (24 - 8 * b));
+            }
+            frame[13] = kind->len;
+            memcpy(frame + REACTION_COUNT_HEADER, kind->text, kind->len);
+            frame[REACTION_COUNT_HEADER + kind->len] = '\n';
+            len += REACTION_COUNT_HEADER + kind->len + 1;
+            kind->reported = kind->count;
+            reactions->updates++;
+        }
+        slotset_remove(&reactions->dirty, (size_t)i);
+    }
+    return len;
+}
+
+int64_t reactions_wait_ms(const reactions_t *reactions, int64_t now_ms) {
+    if (slotset_empty(&reactions->dirty)) {
+        return -1;
+    }
+    return reactions->next_flush_ms > now_ms ? reactions->next_flush_ms - now_ms : 0;
+}
+
+void reactions_forget(reactions_t *reactions, size_t slot) {
+    for (int i = 0; i < REACTIONS_MAX_MESSAGES; i++) {
+        reaction_entry_t *entry = &reactions->entries[i];
+        for (int k = 0; k < entry->num_kinds; k++) {
+            slotset_remove(&entry->kinds[k].reactors, slot);
+        }
+    }
+}
+
+void reactions_free(reactions_t *reactions) {
+    for (int i = 0; i < REACTIONS_MAX_MESSAGES; i++) {
+        for (int k = 0; k < REACTIONS_MAX_KINDS; k++) {
+            slotset_free(&reactions->entries[i].kinds[k].reactors);
+        }
+    }
+    slotset_free(&reactions->dirty);
+}
@@ -0,0 +1,254 @@
+/**
+ * @file relay.c
+ * @brief Implementation of the relay node's upstream link
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "relay.h"
+#include "common.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+int relay_link_init(relay_link_t *link) {
+    if (!link) {
+        return -1;
+    }
+
+    memset(link, 0, sizeof(*link));
+    link->fd = -1;
+    frame_parser_init(&link->parser, FRAME_TO_CLIENT);
+    link->routes = calloc(RELAY_MAX_ROUTES, sizeof(relay_route_t));
+    if (!link->routes) {
+        return -1;
+    }
+
+    /* Keep generated message IDs apart from those of an earlier run, which
+     * the parent may still remember for the same usernames */
+    if (random_u64(&link->next_msg_id) == -1) {
+        link->next_msg_id = (uint64_t)time(NULL) << 32;
+    }
+    return 0;
+}
+
+void relay_link_free(relay_link_t *link) {
+    if (link->fd != -1) {
+        close(link->fd);
+        link->fd = -1;
+    }
+    free(link->routes);
+    link->routes = NULL;
+}
+
+int relay_encode_attach(uint8_t *buf, int port) {
+    buf[0] = MSG_TYPE_RELAY_ATTACH;
+    snprintf((char *)buf + 1, 5, "%04x", (unsigned)port & 0xffff);
+    buf[5] = '\n';
+    return RELAY_ATTACH_LEN;
+}
+
+int relay_encode_redirect(uint8_t *buf, uint32_t ip, uint16_t port) {
+    buf[0] = MSG_TYPE_RELAY_REDIRECT;
+    memcpy(buf + 1, &ip, 4);
+    memcpy(buf + 5, &port, 2);
+    buf[7] = '\n';
+    return RELAY_REDIRECT_LEN;
+}
+
+/**
+ * @brief Ask one node to take the relay
+ * @param fd Connected socket
+ * @param next Receives the redirect target; zero if the node accepted
+ * @return 0 on an answer, -1 on error
+ */
+static int ask_parent(int fd, int listen_port, struct sockaddr_in *next) {
+    uint8_t request[HELLO_CLIENT_LEN + RELAY_ATTACH_LEN + 1];
+    int len = encode_client_hello(request, RELAY_FEATURES);
+    len += relay_encode_attach(request + len, listen_port);
+    if (send_exact(fd, request, (size_t)len) != len) {
+        return -1;
+    }
+
+    /* Read exactly the two answers; broadcasts may follow right behind */
+    uint8_t hello[HELLO_SERVER_LEN];
+    if (recv_exact(fd, hello, sizeof(hello)) != (ssize_t)sizeof(hello) ||
+        hello[0] != MSG_TYPE_HELLO) {
+        log_message(LOG_ERROR, "Parent did not answer HELLO");
+        return -1;
+    }
+    uint32_t features_net;
+    memcpy(&features_net, hello + 2, 4);
+    if ((ntohl(features_net) & RELAY_FEATURES) != RELAY_FEATURES) {
+        log_message(LOG_ERROR, "Parent does not accept relays (features 0x%x)",
+                    ntohl(features_net));
+        return -1;
+    }
+
+    uint8_t redirect[RELAY_REDIRECT_LEN];
+    if (recv_exact(fd, redirect, sizeof(redirect)) != (ssize_t)sizeof(redirect) ||
+        redirect[0] != MSG_TYPE_RELAY_REDIRECT || redirect[7] != '\n') {
+        log_message(LOG_ERROR, "Parent did not answer RELAY_ATTACH");
+        return -1;
+    }
+    memset(next, 0, sizeof(*next));
+    next->sin_family = AF_INET;
+    memcpy(&next->sin_addr.s_addr, redirect + 1, 4);
+    memcpy(&next->sin_port, redirect + 5, 2);
+    return 0;
+}
+
+int relay_attach(relay_link_t *link, const struct sockaddr_in *origin, int listen_port) {
+    struct sockaddr_in target = *origin;
+
+    for (int hop = 0; hop < RELAY_MAX_HOPS; hop++) {
+        char ip_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &target.sin_addr, ip_str, sizeof(ip_str));
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1) {
+            return -1;
+        }
+        struct timeval timeout = {RELAY_ATTACH_TIMEOUT_SEC, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, (struct sockaddr *)&target, sizeof(target)) == -1) {
+            log_message(LOG_ERROR, "Failed to reach parent %s:%d: %s", ip_str,
+                        ntohs(target.sin_port), strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        struct sockaddr_in next;
+        if (ask_parent(fd, listen_port, &next) == -1) {
+            close(fd);
+            return -1;
+        }
+
+        if (next.sin_addr.s_addr == 0 && next.sin_port == 0) {
+            if (set_nonblocking(fd) == -1) {
+                close(fd);
+                return -1;
+            }
+            link->fd = fd;
+            link->parent = target;
+            frame_parser_init(&link->parser, FRAME_TO_CLIENT);
+            log_message(LOG_INFO, "Attached as relay under %s:%d", ip_str,
+                        ntohs(target.sin_port));
+            return 0;
+        }
+
+        close(fd);
+        target = next;
+        inet_ntop(AF_INET, &target.sin_addr, ip_str, sizeof(ip_str));
+        log_message(LOG_INFO, "Redirected to relay %s:%d", ip_str, ntohs(target.sin_port));
+    }
+
+    log_message(LOG_ERROR, "Gave up attaching after %d redirects", RELAY_MAX_HOPS);
+    return -1;
+}
+
+int relay_open(relay_link_t *link, const relay_route_t *owner, const char *username,
+               uint16_t *id) {
+    size_t username_len = strlen(username);
+    if (username_len == 0 || username_len >= MAX_USERNAME_LEN) {
+        return -1;
+    }
+
+    /* IDs are handed out round robin, so a released one is not reused soon */
+    uint32_t candidate = link->next_id;
+    int found = 0;
+    for (uint32_t i = 0; i < RELAY_MAX_ROUTES; i++, candidate++) {
+        if (link->routes[candidate % RELAY_MAX_ROUTES].state == RELAY_ROUTE_FREE) {
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        return -1;
+    }
+    uint16_t route_id = (uint16_t)(candidate % RELAY_MAX_ROUTES);
+
+    uint8_t frame[1 + SESSION_ID_HEX_LEN + 1 + MAX_USERNAME_LEN + 2];
+    size_t pos = 0;
+    frame[pos++] = MSG_TYPE_SESSION_OPEN;
+    snprintf((char *)frame + pos, SESSION_ID_HEX_LEN + 1, "%04x", route_id);
+    pos += SESSION_ID_HEX_LEN;
+    frame[pos++] = (uint8_t)username_len;
+    memcpy(frame + pos, username, username_len);
+    pos += username_len;
+    frame[pos++] = '\n';
+    if (send_exact(link->fd, frame, pos) != (ssize_t)pos) {
+        return -1;
+    }
+
+    link->routes[route_id] = *owner;
+    link->routes[route_id].state = RELAY_ROUTE_PENDING;
+    link->next_id = (uint32_t)route_id + 1;
+    *id = route_id;
+    return 0;
+}
+
+void relay_close(relay_link_t *link, uint16_t id) {
+    relay_route_t *route = &link->routes[id];
+    if (route->state != RELAY_ROUTE_PENDING && route->state != RELAY_ROUTE_OPEN) {
+        return;
+    }
+
+    uint8_t frame[1 + SESSION_ID_HEX_LEN + 2];
+    frame[0] = MSG_TYPE_SESSION_CLOSE;
+    snprintf((char *)frame + 1, SESSION_ID_HEX_LEN + 1, "%04x", id);
+    frame[1 + SESSION_ID_HEX_LEN] = '\n';
+    send_exact(link->fd, frame, 2 + SESSION_ID_HEX_LEN);
+
+    route->state = route->state == RELAY_ROUTE_PENDING ? RELAY_ROUTE_ABANDONED
+                                                       : RELAY_ROUTE_FREE;
+}
+
+int relay_settle(relay_link_t *link, uint16_t id, uint8_t status, relay_route_t *route) {
+    relay_route_t *entry = &link->routes[id];
+    if (entry->state == RELAY_ROUTE_ABANDONED) {
+        entry->state = RELAY_ROUTE_FREE;
+        return 0;
+    }
+    if (entry->state != RELAY_ROUTE_PENDING) {
+        return 0;
+    }
+
+    *route = *entry;
+    entry->state = status == REGISTER_OK ? RELAY_ROUTE_OPEN : RELAY_ROUTE_FREE;
+    return 1;
+}
+
+int relay_route(const relay_link_t *link, uint16_t id, relay_route_t *route) {
+    if (link->routes[id].state != RELAY_ROUTE_OPEN) {
+        return 0;
+    }
+    *route = link->routes[id];
+    return 1;
+}
+
+int relay_chat(relay_link_t *link, uint16_t id, uint64_t msg_id, const char *text,
+               size_t text_len) {
+    uint8_t frame[1 + SESSION_ID_HEX_LEN + MSG_ID_HEX_LEN + BUF_SIZE + 2];
+    if (text_len > BUF_SIZE) {
+        return -1;
+    }
+
+    size_t pos = 0;
+    frame[pos++] = MSG_TYPE_SESSION_CHAT;
+    snprintf((char *)frame + pos, SESSION_ID_HEX_LEN + MSG_ID_HEX_LEN + 1, "%04x%016llx", id,
+             (unsigned long long)msg_id);
+    pos += SESSION_ID_HEX_LEN + MSG_ID_HEX_LEN;
+    memcpy(frame + pos, text, text_len);
+    pos += text_len;
+    frame[pos++] = '\n';
+    return send_exact(link->fd, frame, pos) == (ssize_t)pos ? 0 : -1;
+}
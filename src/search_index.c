@@ -0,0 +1,258 @@
+/**
+ * @file search_index.c
+ * @brief Implementation of the chat history inverted index
+ */
+
+#include "search_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 1024
+
+/* Token characters: ASCII letters and digits plus any non-ASCII byte, so
+ * UTF-8 words are indexed as-is */
+static int is_token_char(uint8_t c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+static uint8_t fold_case(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+/**
+ * @brief Extract the next token starting at *pos
+ * @return Token length (0 when the text is exhausted)
+ */
+static size_t next_token(const char *text, size_t len, size_t *pos, char *token) {
+    size_t i = *pos;
+    while (i < len && !is_token_char((uint8_t)text[i])) {
+        i++;
+    }
+
+    size_t n = 0;
+    while (i < len && is_token_char((uint8_t)text[i])) {
+        if (n < SEARCH_MAX_TOKEN) {
+            token[n++] = (char)fold_case((uint8_t)text[i]);
+        }
+        i++;
+    }
+    token[n] = '\0';
+    *pos = i;
+    return n;
+}
+
+/* FNV-1a 64-bit hash of a token */
+static uint64_t hash_term(const char *term) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while (*term) {
+        hash ^= (uint8_t)*term++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1; /* 0 marks a free slot */
+}
+
+static search_term_t *find_slot(search_term_t *terms, size_t capacity, uint64_t hash,
+                                const char *term) {
+    size_t i = (size_t)hash & (capacity - 1);
+    while (terms[i].hash != 0) {
+        if (terms[i].hash == hash && strcmp(terms[i].term, term) == 0) {
+            return &terms[i];
+        }
+        i = (i + 1) & (capacity - 1);
+    }
+    return &terms[i];
+}
+
+static int grow_table(search_index_t *index) {
+    size_t new_capacity = index->capacity * 2;
+    search_term_t *new_terms = calloc(new_capacity, sizeof(search_term_t));
+    if (!new_terms) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        search_term_t *old = &index->terms[i];
+        if (old->hash != 0) {
+            *find_slot(new_terms, new_capacity, old->hash, old->term) = *old;
+        }
+    }
+
+    free(index->terms);
+    index->terms = new_terms;
+    index->capacity = new_capacity;
+    return 0;
+}
+
+/* Append an offset to a posting list as a varint delta */
+static int posting_append(posting_list_t *list, uint64_t offset) {
+    if (list->len + 10 > list->cap) {
+        size_t new_cap = list->cap ? list->cap * 2 : 16;
+        uint8_t *data = realloc(list->data, new_cap);
+        if (!data) {
+            return -1;
+        }
+        list->data = data;
+        list->cap = new_cap;
+    }
+
+    uint64_t delta = list->count ? offset - list->last : offset;
+    while (delta >= 0x80) {
+        list->data[list->len++] = (uint8_t)(delta | 0x80);
+        delta >>= 7;
+    }
+    list->data[list->len++] = (uint8_t)delta;
+
+    list->last = offset;
+    list->count++;
+    return 0;
+}
+
+/* Decode the next offset of a posting list; *pos and *value carry the cursor */
+static void posting_next(const posting_list_t *list, size_t *pos, uint64_t *value) {
+    uint64_t delta = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        byte = list->data[(*pos)++];
+        delta |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    *value += delta;
+}
+
+int search_index_init(search_index_t *index) {
+    if (!index) {
+        return -1;
+    }
+
+    index->terms = calloc(INITIAL_CAPACITY, sizeof(search_term_t));
+    if (!index->terms) {
+        return -1;
+    }
+    index->capacity = INITIAL_CAPACITY;
+    index->num_terms = 0;
+    index->num_docs = 0;
+    return 0;
+}
+
+void search_index_free(search_index_t *index) {
+    if (!index || !index->terms) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        free(index->terms[i].postings.data);
+    }
+    free(index->terms);
+    index->terms = NULL;
+    index->capacity = 0;
+    index->num_terms = 0;
+}
+
+int search_index_add(search_index_t *index, uint64_t offset, const char *text, size_t len) {
+    if (!index || !index->terms || !text) {
+        return -1;
+    }
+
+    char token[SEARCH_MAX_TOKEN + 1];
+    size_t pos = 0;
+    while (next_token(text, len, &pos, token) > 0) {
+        if ((index->num_terms + 1) * 10 > index->capacity * 7 && grow_table(index) == -1) {
+            return -1;
+        }
+
+        uint64_t hash = hash_term(token);
+        search_term_t *slot = find_slot(index->terms, index->capacity, hash, token);
+        if (slot->hash == 0) {
+            slot->hash = hash;
+            memcpy(slot->term, token, sizeof(slot->term));
+            memset(&slot->postings, 0, sizeof(slot->postings));
+            index->num_terms++;
+        } else if (slot->postings.count > 0 && slot->postings.last == offset) {
+            continue; /* Token repeated within this message */
+        }
+
+        if (posting_append(&slot->postings, offset) == -1) {
+            return -1;
+        }
+    }
+
+    index->num_docs++;
+    return 0;
+}
+
+ssize_t search_index_query(const search_index_t *index, const char *query, size_t len,
+                           uint64_t *out, size_t max_out) {
+    if (!index || !index->terms || !query || !out) {
+        return -1;
+    }
+
+    /* Look up every query token; any unknown token means no match */
+    const posting_list_t *lists[SEARCH_MAX_QUERY_TOKENS];
+    size_t num_lists = 0;
+    char token[SEARCH_MAX_TOKEN + 1];
+    size_t pos = 0;
+    while (num_lists < SEARCH_MAX_QUERY_TOKENS && next_token(query, len, &pos, token) > 0) {
+        search_term_t *slot = find_slot(index->terms, index->capacity, hash_term(token), token);
+        if (slot->hash == 0) {
+            return 0;
+        }
+        lists[num_lists++] = &slot->postings;
+    }
+    if (num_lists == 0 || max_out == 0) {
+        return 0;
+    }
+
+    /* Start from the shortest list so intersections only ever shrink it */
+    size_t shortest = 0;
+    for (size_t i = 1; i < num_lists; i++) {
+        if (lists[i]->count < lists[shortest]->count) {
+            shortest = i;
+        }
+    }
+
+    uint64_t *candidates = malloc(lists[shortest]->count * sizeof(uint64_t));
+    if (!candidates) {
+        return -1;
+    }
+
+    size_t num_candidates = 0;
+    uint64_t value = 0;
+    pos = 0;
+    while (pos < lists[shortest]->len) {
+        posting_next(lists[shortest], &pos, &value);
+        candidates[num_candidates++] = value;
+    }
+
+    /* Merge-intersect the candidates with each remaining list */
+    for (size_t i = 0; i < num_lists && num_candidates > 0; i++) {
+        if (i == shortest) {
+            continue;
+        }
+
+        size_t kept = 0;
+        size_t c = 0;
+        value = 0;
+        pos = 0;
+        while (pos < lists[i]->len && c < num_candidates) {
+            posting_next(lists[i], &pos, &value);
+            while (c < num_candidates && candidates[c] < value) {
+                c++;
+            }
+            if (c < num_candidates && candidates[c] == value) {
+                candidates[kept++] = value;
+                c++;
+            }
+        }
+        num_candidates = kept;
+    }
+
+    /* Return the most recent matches first */
+    size_t n = num_candidates < max_out ? num_candidates : max_out;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = candidates[num_candidates - 1 - i];
+    }
+
+    free(candidates);
+    return (ssize_t)n;
+}
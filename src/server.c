@@ -11,13 +11,56 @@
  * - Non-blocking sockets for all clients
  * - Supports graceful shutdown when all clients disconnect
  * - Logs all server events with timestamps
+ * - Optionally persists chat history and answers full-text searches over it
+ * - Applies history retention and builds the search index on a background
+ *   thread, off the event loop
+ * - In sync durability mode, holds chat broadcasts until a group commit has
+ *   flushed them to disk
+ * - Lets one connection carry many users (sessions), delivering each
+ *   broadcast to such a connection once
+ * - Optionally accepts browsers on a WebSocket listener served by the same
+ *   poll loop
+ * - Optionally streams broadcasts to read-only Server-Sent Events viewers
+ * - Can run as a relay that takes its broadcasts from a parent server and
+ *   repeats them to its own clients, so a large room becomes a fan-out tree
+ * - Optionally publishes broadcasts once to a UDP multicast group for
+ *   read-only subscribers, repairing their gaps over TCP
+ * - Coalesces typing and presence signals and sends them only to clients
+ *   that are not behind on chat
+ * - Numbers chat messages and sends their reaction counts in batches
+ * - Optionally stores and serves files on a port of their own, so large
+ *   transfers never queue up in front of chat
+ * - Queues bulk and bot rooms and shares their bandwidth by deficit round
+ *   robin, so they never hold up people's conversations
  */
 
 /* Feature test macros defined in Makefile */
 #define _POSIX_C_SOURCE 200809L
 
+#include "admin.h"
 #include "common.h"
+#include "compactor.h"
+#include "content_filter.h"
+#include "dedup.h"
+#include "ephemeral.h"
+#include "fanout.h"
+#include "frame_parser.h"
+#include "group_commit.h"
+#include "history.h"
+#include "hitters.h"
+#include "multicast.h"
+#include "plugin_host.h"
 #include "protocol.h"
+#include "qos.h"
+#include "reactions.h"
+#include "relay.h"
+#include "search_index.h"
+#include "slotset.h"
+#include "sse.h"
+#include "topic_trie.h"
+#include "transfer.h"
+#include "utf8.h"
+#include "websocket.h"
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -26,27 +69,184 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 #define LISTEN_BACKLOG 32
 
+/* Bytes read from a client socket per read() call */
+#define READ_CHUNK_SIZE (64 * 1024)
+
+/* A client with more unsent bytes than this is behind on chat and gets no
+ * signals until it catches up */
+#define SIGNAL_MAX_BACKLOG 4096
+
+/* A client with more unsent bytes than this gets no queued bulk or bot
+ * frames, keeping room in its socket for interactive chat */
+#define QOS_MAX_BACKLOG (16 * 1024)
+
+/* Features this server offers in its HELLO */
+#define SERVER_FEATURES (FEATURE_ACKS | FEATURE_MSG_IDS | FEATURE_SESSIONS | FEATURE_RELAY)
+
+/* One user registered on a multiplexed connection */
+typedef struct {
+    uint16_t id;                     /* Chosen by the client */
+    char username[MAX_USERNAME_LEN];
+    uint16_t upstream_id;            /* Session on the parent (relay only) */
+    uint8_t pending;                 /* Parent has not answered yet (relay only) */
+} session_t;
+
 /* Client state structure */
 typedef struct {
     int fd;                    /* Socket file descriptor */
-    char buf[BUF_SIZE];        /* Receive buffer */
-    ssize_t len;               /* Current buffer length */
+    frame_parser_t parser;     /* Holds a frame split across reads */
     struct sockaddr_in addr;   /* Client address */
     char username[MAX_USERNAME_LEN]; /* Client username */
     int has_username;          /* Whether username is set */
+    uint8_t version;           /* Protocol version agreed by HELLO (1 without) */
+    uint32_t features;         /* FEATURE_* bits agreed by HELLO */
+    session_t *sessions;       /* Sessions sorted by id (FEATURE_SESSIONS) */
+    int num_sessions;
+    int sessions_cap;
+    int is_websocket;          /* Accepted on the WebSocket listener */
+    ws_conn_t *ws;             /* WebSocket state, kept for reuse of the slot */
+    int registering;           /* Username sent to the parent (relay only) */
+    uint16_t upstream_id;      /* Parent session of the username (relay only) */
+    int is_relay;              /* A relay node attached below this server */
+    int relay_port;            /* Port that relay accepts connections on */
+    uint32_t relays_assigned;  /* Relays redirected to it so far */
+    slotset_t muted_by;        /* Slots that do not want this user's chat */
+    slotset_t mutes;           /* Slots this user has muted */
+    int num_topics;            /* Topic patterns subscribed to */
 } client_t;
 
 /* Global server state */
 static volatile int server_running = 1;
+static volatile int filter_reload_pending = 0;
 static int server_fd = -1;
+static int ws_server_fd = -1;
+
+/* Read-only event stream (enabled with -e) */
+static int sse_server_fd = -1;
+static int sse_enabled = 0;
+static sse_hub_t sse_hub;
 static client_t *clients = NULL;
 static int max_clients = 0;
 
+/* Broadcast recipients: the slots of registered connections, and room to
+ * compute a filtered copy of that set */
+static slotset_t registered_slots;
+static slotset_t filtered_slots;
+static dedup_table_t dedup_table;
+
+/* Topic subscriptions of registered clients */
+static topic_trie_t topic_trie;
+
+/* Typing and presence signals, and the registered clients that take them */
+static ephemeral_t ephemeral;
+static slotset_t signal_slots;
+
+/* Reaction counters of recent chat messages, and the registered clients
+ * that take message numbers and counts */
+static reactions_t reactions;
+static slotset_t reaction_slots;
+
+/* Room QoS classes (-Q): bulk and bot rooms wait in queues drained between
+ * passes of the event loop */
+static qos_t qos;
+static int qos_stalled;         /* Last flush found every frame waiting */
+
+/* Banned terms (enabled with -b, reloaded on SIGHUP) */
+static int filter_enabled = 0;
+static content_filter_t content_filter;
+
+/* Chat messages dropped for not being valid UTF-8 */
+static uint64_t invalid_utf8_dropped = 0;
+
+/* Message plugins (-P), run after the checks above */
+static plugin_host_t plugin_host;
+
+/* Metrics over HTTP (enabled with -a), including the heaviest senders by
+ * messages and rooms by deliveries */
+static int admin_enabled = 0;
+static admin_t admin;
+static hitters_t sender_hitters;
+static hitters_t room_hitters;
+static int64_t hitters_decay_ms = 0;
+
+/* File transfers on a separate port (enabled with -x) */
+static int transfer_enabled = 0;
+static transfer_t transfer;
+static uint16_t transfer_port = 0;
+
+/* Message history (enabled with -H) */
+static int history_enabled = 0;
+static history_t history;
+static search_index_t search_index;
+static int compactor_enabled = 0;
+static compactor_t compactor;
+
+/* A frame in a batch that some recipients must not get */
+typedef struct {
+    size_t offset;
+    size_t len;
+    slotset_t excluded;        /* Copy of the sender's muted_by when queued */
+    int reactions_only;        /* A CHAT_SEQ frame, only for clients taking reactions */
+} filtered_frame_t;
+
+/* A chat message in a batch, to be indexed and numbered once the batch is
+ * synced or reported back to its sender if the sync fails */
+typedef struct {
+    int slot;                  /* Sending connection, -1 once it has closed */
+    char username[MAX_USERNAME_LEN];
+    int has_id;
+    uint64_t msg_id;           /* Client message ID if has_id */
+    uint64_t offset;           /* Position in the history log */
+    size_t text_offset;        /* Message text within the batch */
+    size_t text_len;
+    int seq_frame;             /* Filtered frame holding its CHAT_SEQ, or -1 */
+    size_t recipients;         /* Connections it goes to, counted once delivered */
+} batch_sender_t;
+
+/* Durability of history appends (-d) */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    filtered_frame_t *filtered; /* In offset order */
+    int num_filtered;
+    int filtered_cap;
+    batch_sender_t *senders;   /* In log order */
+    int num_senders;
+    int senders_cap;
+} frame_batch_t;
+
+static durability_mode_t durability = DURABILITY_NONE;
+static group_commit_t group_commit;
+static frame_batch_t pending_batch;     /* Chat frames waiting for the next sync */
+static frame_batch_t committing_batch;  /* Chat frames covered by the sync in flight */
+static int commit_in_flight = 0;
+static int64_t commit_deadline_ms = 0;  /* When pending_batch is committed */
+
+/* Fan-out tree: the parent link when running as a relay (-u), and the
+ * number of relays attached here before newcomers are redirected (-f) */
+static int relay_enabled = 0;
+static relay_link_t relay_link;
+static frame_batch_t relay_batch;       /* Broadcasts from one read of the parent */
+static int relay_fanout = RELAY_DEFAULT_FANOUT;
+
+/* How a broadcast is written to its TCP recipients (-F) */
+static fanout_t fanout;
+
+/* Multicast publishing for read-only subscribers (-m) */
+static int mcast_enabled = 0;
+static mcast_publisher_t mcast_pub;
+
+/* Shared by all connections: frames are processed before the next read */
+static uint8_t read_buf[READ_CHUNK_SIZE];
+
 /**
  * @brief Signal handler for graceful shutdown
  */
@@ -57,52 +257,164 @@ void handle_shutdown(int signum) {
 }
 
 /**
- * @brief Broadcast a message to all connected clients
+ * @brief Signal handler asking the event loop to reload the banned terms
+ */
+void handle_reload(int signum) {
+    (void)signum;
+    filter_reload_pending = 1;
+}
+
+/**
+ * @brief Milliseconds on the monotonic clock
+ */
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Whether a connection has a username or at least one session
+ */
+static int client_registered(const client_t *cli) {
+    return cli->has_username || cli->num_sessions > 0 || cli->is_relay;
+}
+
+/**
+ * @brief Keep registered_slots in step with a connection's state
+ */
+static void update_recipient(const client_t *cli) {
+    size_t slot = (size_t)(cli - clients);
+    if (cli->fd != -1 && client_registered(cli)) {
+        slotset_add(&registered_slots, slot);
+    } else {
+        slotset_remove(&registered_slots, slot);
+    }
+    if (cli->fd != -1 && client_registered(cli) && (cli->features & FEATURE_SIGNALS)) {
+        slotset_add(&signal_slots, slot);
+    } else {
+        slotset_remove(&signal_slots, slot);
+    }
+    if (cli->fd != -1 && client_registered(cli) && (cli->features & FEATURE_REACTIONS)) {
+        slotset_add(&reaction_slots, slot);
+    } else {
+        slotset_remove(&reaction_slots, slot);
+    }
+}
+
+/**
+ * @brief Send frames to one client, wrapped in a binary WebSocket message for
+ *        WebSocket clients
+ * @return len on success, -1 on error
+ */
+static ssize_t send_to_client(client_t *cli, const uint8_t *data, size_t len) {
+    if (!cli->is_websocket) {
+        return send_exact(cli->fd, data, len);
+    }
+    uint8_t header[WS_MAX_HEADER];
+    size_t header_len = ws_frame_header(header, WS_OPCODE_BINARY, len);
+    return ws_send(cli->fd, header, header_len, data, len);
+}
+
+/**
+ * @brief Broadcast a message to all registered clients except some
  * @param clients Array of client structures
  * @param max_clients Maximum number of clients
  * @param msg Message buffer to broadcast
  * @param msg_len Length of message
+ * @param excluded Slots to skip, or NULL; viewers and subscribers get
+ *        every message
  */
-void broadcast_message(client_t *clients, int max_clients, const char *msg, ssize_t msg_len) {
+void broadcast_filtered(client_t *clients, int max_clients, const char *msg, ssize_t msg_len,
+                        const slotset_t *excluded) {
     if (!clients || !msg || msg_len <= 0) {
         return;
     }
     
-    for (int i = 0; i < max_clients; i++) {
-        if (clients[i].fd != -1 && clients[i].fd > 0) {
-            ssize_t sent = send_exact(clients[i].fd, (const uint8_t *)msg, msg_len);
+    const slotset_t *recipients = &registered_slots;
+    if (excluded && !slotset_empty(excluded)) {
+        slotset_andnot(&filtered_slots, &registered_slots, excluded);
+        recipients = &filtered_slots;
+    }
+    
+    /* The WebSocket header only depends on the length, so it is built once
+     * and shared by every WebSocket recipient */
+    uint8_t ws_header[WS_MAX_HEADER];
+    size_t ws_header_len = ws_frame_header(ws_header, WS_OPCODE_BINARY, (uint64_t)msg_len);
+    
+    /* Connections that have not registered yet are skipped, so a client's
+     * first frame is always the answer to its own HELLO or USERNAME. A
+     * multiplexed connection gets one copy for all of its sessions. */
+    fanout_begin(&fanout, (const uint8_t *)msg, (size_t)msg_len);
+    for (long i = slotset_next(recipients, 0); i != -1 && i < max_clients;
+         i = slotset_next(recipients, (size_t)i + 1)) {
+        if (clients[i].fd > 0) {
+            ssize_t sent = clients[i].is_websocket
+                ? ws_send(clients[i].fd, ws_header, ws_header_len, (const uint8_t *)msg, msg_len)
+                : fanout_send(&fanout, clients[i].fd, (const uint8_t *)msg, (size_t)msg_len);
             if (sent != msg_len) {
-                log_message(LOG_WARN, "Failed to send complete message to client %d", i);
+                log_message(LOG_WARN, "Failed to send complete message to client %ld", i);
             }
         }
     }
+    fanout_end(&fanout);
+    
+    if (sse_enabled) {
+        sse_broadcast(&sse_hub, (const uint8_t *)msg, (size_t)msg_len);
+    }
+    if (mcast_enabled) {
+        mcast_publish(&mcast_pub, (const uint8_t *)msg, (size_t)msg_len, monotonic_ms());
+    }
+}
+
+/**
+ * @brief Broadcast a message to all registered clients
+ */
+void broadcast_message(client_t *clients, int max_clients, const char *msg, ssize_t msg_len) {
+    broadcast_filtered(clients, max_clients, msg, msg_len, NULL);
 }
 
 /**
  * @brief Send a join notification to all clients
+ * @param username The client's username or one of its sessions'
  */
-void broadcast_join(client_t *clients, int max_clients, client_t *new_client) {
-    char msg[BUF_SIZE];
-    int offset = 0;
-    
-    msg[offset++] = MSG_TYPE_JOIN;
-    memcpy(msg + offset, &new_client->addr.sin_addr.s_addr, 4);
-    offset += 4;
-    memcpy(msg + offset, &new_client->addr.sin_port, 2);
-    offset += 2;
-    
-    uint8_t username_len = (uint8_t)strlen(new_client->username);
-    msg[offset++] = username_len;
-    memcpy(msg + offset, new_client->username, username_len);
-    offset += username_len;
-    msg[offset++] = '\n';
+void broadcast_join(client_t *clients, int max_clients, client_t *new_client,
+                    const char *username) {
+    uint8_t msg[BUF_SIZE];
+    int len = encode_peer_frame(msg, sizeof(msg), MSG_TYPE_JOIN,
+                                new_client->addr.sin_addr.s_addr, new_client->addr.sin_port,
+                                username, NULL, 0);
     
-    broadcast_message(clients, max_clients, msg, offset);
+    broadcast_message(clients, max_clients, (const char *)msg, len);
     
     char ip_str[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &new_client->addr.sin_addr, ip_str, sizeof(ip_str));
     log_message(LOG_INFO, "Broadcasted join: %s from %s:%d", 
-                new_client->username, ip_str, ntohs(new_client->addr.sin_port));
+                username, ip_str, ntohs(new_client->addr.sin_port));
+}
+
+/**
+ * @brief Send a disconnect notification to all clients
+ */
+void broadcast_leave(const struct sockaddr_in *addr, const char *username) {
+    uint8_t msg[BUF_SIZE];
+    int len = encode_peer_frame(msg, sizeof(msg), MSG_TYPE_DISCONNECT, addr->sin_addr.s_addr,
+                                addr->sin_port, username, NULL, 0);
+    broadcast_message(clients, max_clients, (const char *)msg, len);
+}
+
+/**
+ * @brief Stop reporting lost messages to a connection that has closed
+ */
+static void forget_batch_sender(size_t slot) {
+    frame_batch_t *batches[] = {&pending_batch, &committing_batch};
+    for (int b = 0; b < 2; b++) {
+        for (int i = 0; i < batches[b]->num_senders; i++) {
+            if (batches[b]->senders[i].slot == (int)slot) {
+                batches[b]->senders[i].slot = -1;
+            }
+        }
+    }
 }
 
 /**
@@ -120,86 +432,1620 @@ void remove_client(client_t *cli, int client_index) {
                 cli->has_username ? cli->username : "unknown",
                 ip_str, ntohs(cli->addr.sin_port));
     
-    /* Save client info before closing */
-    int had_username = cli->has_username;
-    char username_copy[MAX_USERNAME_LEN];
-    struct sockaddr_in addr_copy = cli->addr;
-    
-    if (had_username) {
-        strncpy(username_copy, cli->username, MAX_USERNAME_LEN);
-    }
-    
     /* Close and mark as disconnected BEFORE broadcasting */
     close(cli->fd);
     cli->fd = -1;
-    cli->len = 0;
+    update_recipient(cli);
+    
+    /* Mutes end with either connection */
+    size_t self = (size_t)(cli - clients);
+    for (long i = slotset_next(&cli->mutes, 0); i != -1; i = slotset_next(&cli->mutes, (size_t)i + 1)) {
+        slotset_remove(&clients[i].muted_by, self);
+    }
+    for (long i = slotset_next(&cli->muted_by, 0); i != -1;
+         i = slotset_next(&cli->muted_by, (size_t)i + 1)) {
+        slotset_remove(&clients[i].mutes, self);
+    }
+    slotset_free(&cli->mutes);
+    slotset_free(&cli->muted_by);
+    ephemeral_forget(&ephemeral, self);
+    reactions_forget(&reactions, self);
+    qos_forget(&qos, self);
+    forget_batch_sender(self);
+    if (cli->num_topics > 0) {
+        topic_trie_remove_slot(&topic_trie, self);
+        cli->num_topics = 0;
+    }
+    
+    /* Now send disconnect notifications to OTHER clients; broadcast will
+     * skip this client since fd is now -1. A relay leaves that to its
+     * parent, whose DISCONNECT frames come back down the tree. */
+    if (relay_enabled) {
+        if (cli->has_username || cli->registering) {
+            relay_close(&relay_link, cli->upstream_id);
+        }
+        for (int i = 0; i < cli->num_sessions; i++) {
+            relay_close(&relay_link, cli->sessions[i].upstream_id);
+        }
+    } else {
+        if (cli->has_username) {
+            broadcast_leave(&cli->addr, cli->username);
+        }
+        for (int i = 0; i < cli->num_sessions; i++) {
+            broadcast_leave(&cli->addr, cli->sessions[i].username);
+        }
+    }
+    
     cli->has_username = 0;
+    cli->registering = 0;
+    cli->is_relay = 0;
+    free(cli->sessions);
+    cli->sessions = NULL;
+    cli->num_sessions = 0;
+    cli->sessions_cap = 0;
+}
+
+/**
+ * @brief Append frames to a batch, growing it as needed
+ * @return 0 on success, -1 if out of memory
+ */
+static int batch_append(frame_batch_t *batch, const char *data, size_t len) {
+    if (batch->len + len > batch->cap) {
+        size_t new_cap = batch->cap ? batch->cap * 2 : 4096;
+        while (new_cap < batch->len + len) {
+            new_cap *= 2;
+        }
+        char *grown = realloc(batch->data, new_cap);
+        if (!grown) {
+            return -1;
+        }
+        batch->data = grown;
+        batch->cap = new_cap;
+    }
     
-    /* Now send disconnect notification to OTHER clients */
-    if (had_username) {
-        char msg[BUF_SIZE];
-        int offset = 0;
-        msg[offset++] = MSG_TYPE_DISCONNECT;
-        memcpy(msg + offset, &addr_copy.sin_addr.s_addr, 4);
-        offset += 4;
-        memcpy(msg + offset, &addr_copy.sin_port, 2);
-        offset += 2;
-        uint8_t username_len = (uint8_t)strlen(username_copy);
-        msg[offset++] = username_len;
-        memcpy(msg + offset, username_copy, username_len);
-        offset += username_len;
-        msg[offset++] = '\n';
-        
-        /* Broadcast will skip this client since fd is now -1 */
-        broadcast_message(clients, max_clients, msg, offset);
+    memcpy(batch->data + batch->len, data, len);
+    batch->len += len;
+    return 0;
+}
+
+/**
+ * @brief Hold a chat frame until the batch it joins has been synced
+ *
+ * The first frame of a batch opens a GROUP_COMMIT_WINDOW_MS window; frames
+ * arriving while a sync is in flight are committed as soon as it finishes.
+ *
+ * @param reactions_only Whether only clients taking reactions get the frame
+ * @param sender The chat message the frame carries, or NULL for a CHAT_SEQ
+ * @return 0 on success, -1 if out of memory
+ */
+int queue_for_commit(const char *msg, size_t msg_len, const slotset_t *excluded,
+                     int reactions_only, const batch_sender_t *sender) {
+    int opens_batch = pending_batch.len == 0;
+    
+    if (sender && pending_batch.num_senders == pending_batch.senders_cap) {
+        int new_cap = pending_batch.senders_cap ? pending_batch.senders_cap * 2 : 8;
+        batch_sender_t *grown = realloc(pending_batch.senders,
+                                        (size_t)new_cap * sizeof(batch_sender_t));
+        if (!grown) {
+            log_message(LOG_ERROR, "Failed to queue message for commit");
+            return -1;
+        }
+        pending_batch.senders = grown;
+        pending_batch.senders_cap = new_cap;
     }
+    
+    /* Remember who must not get this frame when the batch goes out */
+    int filtered = reactions_only || (excluded && !slotset_empty(excluded));
+    if (filtered) {
+        if (pending_batch.num_filtered == pending_batch.filtered_cap) {
+            int new_cap = pending_batch.filtered_cap ? pending_batch.filtered_cap * 2 : 8;
+            filtered_frame_t *grown = realloc(pending_batch.filtered,
+                                              (size_t)new_cap * sizeof(filtered_frame_t));
+            if (!grown) {
+                log_message(LOG_ERROR, "Failed to queue message for commit");
+                return -1;
+            }
+            pending_batch.filtered = grown;
+            pending_batch.filtered_cap = new_cap;
+        }
+        filtered_frame_t *frame = &pending_batch.filtered[pending_batch.num_filtered];
+        frame->offset = pending_batch.len;
+        frame->len = msg_len;
+        frame->reactions_only = reactions_only;
+        slotset_init(&frame->excluded, (size_t)max_clients);
+        if (excluded && slotset_or(&frame->excluded, excluded) == -1) {
+            slotset_free(&frame->excluded);
+            log_message(LOG_ERROR, "Failed to queue message for commit");
+            return -1;
+        }
+        pending_batch.num_filtered++;
+    }
+    
+    if (batch_append(&pending_batch, msg, msg_len) == -1) {
+        if (filtered) {
+            slotset_free(&pending_batch.filtered[--pending_batch.num_filtered].excluded);
+        }
+        log_message(LOG_ERROR, "Failed to queue message for commit");
+        return -1;
+    }
+    if (sender) {
+        pending_batch.senders[pending_batch.num_senders++] = *sender;
+    }
+    
+    if (opens_batch) {
+        commit_deadline_ms = monotonic_ms() + GROUP_COMMIT_WINDOW_MS;
+    }
+    
+    if (pending_batch.len >= GROUP_COMMIT_MAX_BATCH) {
+        commit_deadline_ms = 0;
+    }
+    return 0;
 }
 
 /**
- * @brief Process a complete message from a client
+ * @brief Hand the pending batch to the sync thread once its window closes
+ */
+void start_commit_if_due(void) {
+    if (commit_in_flight || pending_batch.len == 0 || monotonic_ms() < commit_deadline_ms) {
+        return;
+    }
+    
+    frame_batch_t swap = committing_batch;
+    committing_batch = pending_batch;
+    pending_batch = swap;
+    pending_batch.len = 0;
+    
+    commit_in_flight = 1;
+    group_commit_request(&group_commit);
+}
+
+/**
+ * @brief Broadcast a committed batch, leaving out frames from muted senders
+ *
+ * Recipients who muted none of the batch's senders get it in one write, as
+ * usual. Only the others get it piece by piece, around the frames they muted.
  */
-void process_message(client_t *cli, ssize_t msg_len) {
-    uint8_t msg_type = (uint8_t)cli->buf[0];
+static void broadcast_batch(frame_batch_t *batch) {
+    if (batch->num_filtered == 0) {
+        broadcast_message(clients, max_clients, batch->data, (ssize_t)batch->len);
+        return;
+    }
     
-    if (msg_type == MSG_TYPE_USERNAME && !cli->has_username) {
-        /* Username registration */
-        if (msg_len > 2) {
-            uint8_t username_len = (uint8_t)cli->buf[1];
-            if (username_len > 0 && username_len < MAX_USERNAME_LEN && msg_len >= 2 + username_len) {
-                memcpy(cli->username, cli->buf + 2, username_len);
-                cli->username[username_len] = '\0';
-                cli->has_username = 1;
-                
-                log_message(LOG_INFO, "Client registered username: %s", cli->username);
-                broadcast_join(clients, max_clients, cli);
+    /* Message numbers are hidden from whoever does not take reactions now,
+     * including clients that registered during the sync */
+    slotset_t excluded;
+    slotset_init(&excluded, (size_t)max_clients);
+    slotset_andnot(&excluded, &registered_slots, &reaction_slots);
+    for (int f = 0; f < batch->num_filtered; f++) {
+        if (batch->filtered[f].reactions_only) {
+            slotset_or(&batch->filtered[f].excluded, &excluded);
+        }
+    }
+    slotset_clear(&excluded);
+    for (int f = 0; f < batch->num_filtered; f++) {
+        slotset_or(&excluded, &batch->filtered[f].excluded);
+    }
+    broadcast_filtered(clients, max_clients, batch->data, (ssize_t)batch->len, &excluded);
+    
+    for (long i = slotset_next(&excluded, 0); i != -1; i = slotset_next(&excluded, (size_t)i + 1)) {
+        if (!slotset_contains(&registered_slots, (size_t)i)) {
+            continue;
+        }
+        size_t pos = 0;
+        for (int f = 0; f <= batch->num_filtered; f++) {
+            const filtered_frame_t *frame = f < batch->num_filtered ? &batch->filtered[f] : NULL;
+            if (frame && !slotset_contains(&frame->excluded, (size_t)i)) {
+                continue;
+            }
+            size_t end = frame ? frame->offset : batch->len;
+            if (end > pos &&
+                send_to_client(&clients[i], (const uint8_t *)batch->data + pos, end - pos) !=
+                    (ssize_t)(end - pos)) {
+                log_message(LOG_WARN, "Failed to send complete message to client %ld", i);
+                break;
             }
+            pos = frame ? frame->offset + frame->len : end;
+        }
+    }
+    slotset_free(&excluded);
+}
+
+/**
+ * @brief Tell the sender of a chat message that nobody got it, and let a
+ *        retry under the same ID through: [CHAT_FAILED][16 hex id]\n, or
+ *        [SESSION_FAILED][session][16 hex id]\n if a session sent it
+ */
+static void report_chat_failed(const batch_sender_t *sender) {
+    if (sender->has_id) {
+        dedup_forget(&dedup_table, sender->username, sender->msg_id);
+    }
+    if (sender->slot == -1 || !(clients[sender->slot].features & FEATURE_MSG_IDS)) {
+        return;
+    }
+    
+    client_t *cli = &clients[sender->slot];
+    unsigned long long msg_id = sender->has_id ? sender->msg_id : 0;
+    char frame[SESSION_FAILED_LEN + 1];
+    int len;
+    if (cli->has_username && strcmp(cli->username, sender->username) == 0) {
+        len = snprintf(frame, sizeof(frame), "%c%016llx\n", MSG_TYPE_CHAT_FAILED, msg_id);
+    } else {
+        /* Nobody to tell if the session has closed since */
+        int i = 0;
+        while (i < cli->num_sessions && strcmp(cli->sessions[i].username, sender->username) != 0) {
+            i++;
+        }
+        if (i == cli->num_sessions) {
+            return;
+        }
+        len = snprintf(frame, sizeof(frame), "%c%04x%016llx\n", MSG_TYPE_SESSION_FAILED,
+                       cli->sessions[i].id, msg_id);
+    }
+    if (send_to_client(cli, (const uint8_t *)frame, (size_t)len) != len) {
+        log_message(LOG_WARN, "Failed to report lost message to %s", sender->username);
+    }
+}
+
+/**
+ * @brief Empty a batch, reporting its chat messages as failed if asked to
+ */
+static void clear_batch(frame_batch_t *batch, int failed) {
+    for (int i = 0; failed && i < batch->num_senders; i++) {
+        report_chat_failed(&batch->senders[i]);
+    }
+    for (int i = 0; i < batch->num_filtered; i++) {
+        slotset_free(&batch->filtered[i].excluded);
+    }
+    batch->num_filtered = 0;
+    batch->num_senders = 0;
+    batch->len = 0;
+}
+
+/**
+ * @brief Encode [CHAT_SEQ][seq:8]\n into a CHAT_SEQ_LEN buffer
+ */
+static void encode_chat_seq(uint8_t *frame, uint64_t seq) {
+    frame[0] = MSG_TYPE_CHAT_SEQ;
+    for (int i = 0; i < 8; i++) {
+        frame[1 + i] = (uint8_t)(seq >> (56 - 8 * i));
+    }
+    frame[9] = '\n';
+}
+
+/**
+ * @brief Add a stored chat message to the search index
+ */
+static void index_message(uint64_t offset, const char *text, size_t text_len) {
+    if (search_index_add(&search_index, offset, text,
+                         text_len < MAX_MESSAGE_LEN ? text_len : MAX_MESSAGE_LEN) == -1) {
+        log_message(LOG_WARN, "Failed to index history record at %llu",
+                    (unsigned long long)offset);
+    }
+}
+
+/**
+ * @brief Count copies of a message written towards the heaviest rooms
+ * @param room Topic, or empty for the main chat
+ */
+static void count_room_traffic(const char *room, size_t room_len, size_t recipients) {
+    if (admin_enabled && recipients > 0) {
+        hitters_add(&room_hitters, room, room_len, (uint32_t)recipients);
+    }
+}
+
+/**
+ * @brief Count a delivered message towards the heaviest senders and rooms
+ * @param room Topic, or empty for the main chat
+ * @param recipients Connections the message was sent to
+ */
+static void count_traffic(const char *username, const char *room, size_t room_len,
+                          size_t recipients) {
+    if (!admin_enabled) {
+        return;
+    }
+    hitters_add(&sender_hitters, username, strlen(username), 1);
+    count_room_traffic(room, room_len, recipients);
+}
+
+/**
+ * @brief Broadcast a batch whose sync has completed
+ *
+ * If the sync failed, the batch's messages are removed from the log and
+ * their senders told. Messages queued during the sync were appended behind
+ * them and go too.
+ */
+void finish_commit(void) {
+    if (group_commit_complete(&group_commit) == 0) {
+        for (int i = 0; i < committing_batch.num_senders; i++) {
+            const batch_sender_t *sender = &committing_batch.senders[i];
+            index_message(sender->offset, committing_batch.data + sender->text_offset,
+                          sender->text_len);
+            count_traffic(sender->username, "", 0, sender->recipients);
+            
+            /* Only delivered messages are numbered, in broadcast order */
+            uint64_t seq = reactions_next_message(&reactions);
+            if (sender->seq_frame >= 0) {
+                size_t at = committing_batch.filtered[sender->seq_frame].offset;
+                encode_chat_seq((uint8_t *)committing_batch.data + at, seq);
+            }
+        }
+        /* Everything before the messages queued during the sync is out */
+        uint64_t delivered = pending_batch.num_senders > 0 ? pending_batch.senders[0].offset
+                                                           : history_end_offset(&history);
+        history_deliver(&history, delivered);
+        broadcast_batch(&committing_batch);
+        clear_batch(&committing_batch, 0);
+    } else if (committing_batch.num_senders > 0 &&
+               history_rollback(&history, committing_batch.senders[0].offset) == 0) {
+        log_message(LOG_ERROR, "History sync failed, %d messages not delivered",
+                    committing_batch.num_senders + pending_batch.num_senders);
+        clear_batch(&committing_batch, 1);
+        clear_batch(&pending_batch, 1);
+    } else {
+        log_message(LOG_ERROR,
+                    "History sync failed, %d messages not delivered but left in the log",
+                    committing_batch.num_senders);
+        clear_batch(&committing_batch, 1);
+    }
+    commit_in_flight = 0;
+    
+    /* Messages queued during the sync have already waited long enough */
+    commit_deadline_ms = 0;
+}
+
+/**
+ * @brief Deliver every queued chat message before shutting down
+ *
+ * Waits for the sync in flight and commits whatever was queued behind it,
+ * so each message in the log has been broadcast or reported as failed.
+ */
+static void drain_commits(void) {
+    while (commit_in_flight || pending_batch.len > 0) {
+        commit_deadline_ms = 0;
+        start_commit_if_due();
+        struct pollfd pfd = {group_commit_fd(&group_commit), POLLIN, 0};
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+            log_message(LOG_ERROR, "Failed to wait for history sync: %s", strerror(errno));
+            break;
+        }
+        if (pfd.revents & POLLIN) {
+            finish_commit();
+        }
+    }
+    clear_batch(&committing_batch, 0);
+    clear_batch(&pending_batch, 0);
+}
+
+/**
+ * @brief Append a chat message to the history log
+ * @param offset_out Where the message was stored
+ * @return 0 on success, -1 if the message could not be stored
+ */
+int record_history(client_t *cli, const char *username, const char *content,
+                   ssize_t content_len, uint64_t *offset_out) {
+    history_record_t rec;
+    rec.timestamp = (int64_t)time(NULL);
+    rec.ip = cli->addr.sin_addr.s_addr;
+    rec.port = cli->addr.sin_port;
+    strcpy(rec.username, username);
+    
+    /* Store the text without its trailing newline */
+    size_t text_len = content_len > 0 ? (size_t)content_len : 0;
+    if (text_len > 0 && content[text_len - 1] == '\n') {
+        text_len--;
+    }
+    if (text_len > MAX_MESSAGE_LEN) {
+        text_len = MAX_MESSAGE_LEN;
+    }
+    memcpy(rec.text, content, text_len);
+    rec.text_len = text_len;
+    
+    if (history_append(&history, &rec, offset_out) == -1) {
+        log_message(LOG_ERROR, "Failed to append history: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Scan callback adding records to an index being brought up to date
+ */
+void catch_up_record(uint64_t offset, const history_record_t *rec, void *arg) {
+    search_index_add((search_index_t *)arg, offset, rec->text, rec->text_len);
+}
+
+/**
+ * @brief Swap in an index rebuilt by the compactor
+ *
+ * The rebuilt index covers the log up to indexed_end; the compactor leaves
+ * at most COMPACT_CATCH_UP_BYTES or so of delivered messages past it, which
+ * are added here before the swap. Messages still waiting for their sync are
+ * indexed by finish_commit.
+ */
+void install_rebuilt_index(search_index_t *index, uint64_t indexed_end, void *arg) {
+    (void)arg;
+    history_scan_range(&history, indexed_end, history_delivered_offset(&history),
+                       catch_up_record, index, 0);
+    
+    search_index_free(&search_index);
+    search_index = *index;
+    free(index);
+    
+    log_message(LOG_INFO, "Installed rebuilt search index (%llu messages)",
+                (unsigned long long)search_index.num_docs);
+}
+
+/**
+ * @brief Answer a history search request
+ * @param cli Requesting client
+ * @param query Query text
+ * @param query_len Length of query
+ *
+ * Each hit is sent as [SEARCH_RESULT][ip][port][username_len][username][message]\n,
+ * most recent first, followed by [SEARCH_END][count:4]\n.
+ */
+void handle_search(client_t *cli, const char *query, size_t query_len) {
+    uint64_t offsets[SEARCH_MAX_RESULTS];
+    ssize_t num_hits = 0;
+    
+    if (history_enabled) {
+        num_hits = search_index_query(&search_index, query, query_len, offsets,
+                                      SEARCH_MAX_RESULTS);
+        if (num_hits < 0) {
+            num_hits = 0;
+        }
+    }
+    
+    uint32_t sent = 0;
+    for (ssize_t i = 0; i < num_hits; i++) {
+        history_record_t rec;
+        if (history_read(&history, offsets[i], &rec) == -1) {
+            continue;
+        }
+        
+        uint8_t msg[BUF_SIZE + 8];
+        int len = encode_peer_frame(msg, sizeof(msg), MSG_TYPE_SEARCH_RESULT, rec.ip, rec.port,
+                                    rec.username, rec.text, rec.text_len);
+        if (len < 0) {
+            continue;
+        }
+        
+        if (send_to_client(cli, msg, len) != len) {
+            log_message(LOG_WARN, "Failed to send search result to %s", cli->username);
+            return;
+        }
+        sent++;
+    }
+    
+    uint8_t end_msg[6];
+    uint32_t count_net = htonl(sent);
+    end_msg[0] = MSG_TYPE_SEARCH_END;
+    memcpy(end_msg + 1, &count_net, 4);
+    end_msg[5] = '\n';
+    send_to_client(cli, end_msg, sizeof(end_msg));
+    
+    log_message(LOG_DEBUG, "Search by %s returned %u hits", cli->username, sent);
+}
+
+/**
+ * @brief Check a chat message before it is delivered
+ *
+ * Messages must be valid UTF-8, so clients can display them unchecked, and
+ * with -b must not contain a banned term.
+ *
+ * @return 1 if the message must be dropped, 0 otherwise
+ */
+static int message_blocked(const char *username, const char *text, size_t text_len) {
+    if (!utf8_valid(text, text_len)) {
+        invalid_utf8_dropped++;
+        log_message(LOG_INFO, "Dropped message with invalid UTF-8 from %s", username);
+        return 1;
+    }
+    if (!filter_enabled || !content_filter_check(&content_filter, text, text_len)) {
+        return 0;
+    }
+    log_message(LOG_INFO, "Dropped message with a banned term from %s", username);
+    return 1;
+}
+
+/**
+ * @brief Run a chat message through the plugins (-P)
+ * @param room Topic of a published message, or NULL for the main chat
+ * @param text In: the message text. Out: the text to deliver, which points
+ *        into the plugin host if a plugin rewrote it
+ * @param text_len In and out: length of *text
+ * @return 1 if a plugin dropped the message, or rewrote it into one that
+ *         message_blocked() drops, 0 otherwise
+ */
+static int plugins_drop(client_t *cli, const char *username, const char *room, size_t room_len,
+                        const char **text, size_t *text_len) {
+    if (plugin_host.num_plugins == 0) {
+        return 0;
+    }
+    
+    chat_plugin_message_t view = {username, strlen(username), room ? room : "", room_len,
+                                  *text, *text_len, cli->addr.sin_addr.s_addr,
+                                  cli->addr.sin_port};
+    if (plugin_host_run(&plugin_host, &view)) {
+        log_message(LOG_DEBUG, "Plugin dropped message from %s", username);
+        return 1;
+    }
+    /* A rewrite is checked again, so plugins cannot add banned terms */
+    if (view.payload != *text && message_blocked(username, view.payload, view.payload_len)) {
+        return 1;
+    }
+    *text = view.payload;
+    *text_len = view.payload_len;
+    return 0;
+}
+
+/**
+ * @brief Number of connections a main chat message goes to
+ * @param excluded Slots that muted the sender, or NULL
+ */
+static size_t chat_recipients(const slotset_t *excluded) {
+    if (!excluded || slotset_empty(excluded) ||
+        slotset_andnot(&filtered_slots, &registered_slots, excluded) == -1) {
+        return slotset_count(&registered_slots);
+    }
+    return slotset_count(&filtered_slots);
+}
+
+/**
+ * @brief Follow a chat frame with its number, for clients taking reactions:
+ *        [CHAT_SEQ][seq:8]\n
+ * @param excluded Slots that do not get the chat frame, or NULL
+ */
+static void send_chat_seq(uint64_t seq, const slotset_t *excluded) {
+    if (slotset_empty(&reaction_slots)) {
+        return;
+    }
+    uint8_t frame[CHAT_SEQ_LEN];
+    encode_chat_seq(frame, seq);
+    
+    const slotset_t *recipients = &reaction_slots;
+    if (excluded && !slotset_empty(excluded)) {
+        if (slotset_andnot(&filtered_slots, &reaction_slots, excluded) == -1) {
+            return;
+        }
+        recipients = &filtered_slots;
+    }
+    for (long i = slotset_next(recipients, 0); i != -1;
+         i = slotset_next(recipients, (size_t)i + 1)) {
+        if (send_to_client(&clients[i], frame, sizeof(frame)) != (ssize_t)sizeof(frame)) {
+            log_message(LOG_WARN, "Failed to send message number to client %ld", i);
+        }
+    }
+}
+
+/**
+ * @brief Queue a CHAT_SEQ frame behind the chat message just queued
+ *
+ * Its number is filled in by finish_commit, so a message whose sync fails
+ * does not use one up.
+ */
+static void queue_chat_seq(const slotset_t *excluded) {
+    if (slotset_empty(&reaction_slots)) {
+        return;
+    }
+    uint8_t frame[CHAT_SEQ_LEN];
+    encode_chat_seq(frame, 0);
+    if (queue_for_commit((const char *)frame, sizeof(frame), excluded, 1, NULL) == 0) {
+        pending_batch.senders[pending_batch.num_senders - 1].seq_frame =
+            pending_batch.num_filtered - 1;
+    }
+}
+
+/**
+ * @brief Broadcast a chat payload on behalf of a registered client
+ * @param cli Sending client
+ * @param username The client's username or the sending session's
+ * @param content Message text including the trailing newline
+ * @param content_len Length of content
+ * @param msg_id Client message ID, or NULL if the message carried none
+ */
+void broadcast_chat(client_t *cli, const char *username, const char *content,
+                    ssize_t content_len, const uint64_t *msg_id) {
+    /* The frame terminator is added by the encoder */
+    size_t text_len = content_len > 0 ? (size_t)content_len : 0;
+    if (text_len > 0 && content[text_len - 1] == '\n') {
+        text_len--;
+    }
+    if (message_blocked(username, content, text_len) ||
+        plugins_drop(cli, username, NULL, 0, &content, &text_len)) {
+        return;
+    }
+    content_len = (ssize_t)text_len;
+    
+    char broadcast_msg[BUF_SIZE + 8];
+    int offset = encode_peer_frame((uint8_t *)broadcast_msg, sizeof(broadcast_msg), MSG_TYPE_CHAT,
+                                   cli->addr.sin_addr.s_addr, cli->addr.sin_port, username,
+                                   content, text_len);
+    if (offset < 0) {
+        return;
+    }
+    
+    /* Mutes apply to the connection's own username, not to its sessions */
+    const slotset_t *excluded = username == cli->username ? &cli->muted_by : NULL;
+    
+    /* In sync mode nobody sees the message before it is on disk */
+    if (durability == DURABILITY_SYNC) {
+        batch_sender_t sender = {(int)(cli - clients), "", msg_id != NULL, msg_id ? *msg_id : 0,
+                                 0, pending_batch.len + (size_t)offset - 1 - text_len, text_len,
+                                 -1, chat_recipients(excluded)};
+        strcpy(sender.username, username);
+        if (record_history(cli, username, content, content_len, &sender.offset) == -1) {
+            report_chat_failed(&sender);
+            return;
+        }
+        if (queue_for_commit(broadcast_msg, offset, excluded, 0, &sender) == -1) {
+            history_rollback(&history, sender.offset);
+            report_chat_failed(&sender);
+            return;
+        }
+        queue_chat_seq(excluded);
+        return;
+    }
+    
+    broadcast_filtered(clients, max_clients, broadcast_msg, offset, excluded);
+    count_traffic(username, "", 0, chat_recipients(excluded));
+    send_chat_seq(reactions_next_message(&reactions), excluded);
+    
+    log_message(LOG_DEBUG, "Broadcast message from %s", username);
+    
+    uint64_t log_offset;
+    if (history_enabled && record_history(cli, username, content, content_len, &log_offset) == 0) {
+        index_message(log_offset, content, text_len);
+    }
+}
+
+/**
+ * @brief Pass a chat message to the parent (relay only); it reaches local
+ *        clients, the sender included, when the parent broadcasts it
+ * @param upstream_id Parent session of the sender
+ * @param content Message text including the trailing newline
+ */
+void forward_chat(uint16_t upstream_id, uint64_t msg_id, const char *content,
+                  ssize_t content_len) {
+    size_t text_len = content_len > 0 ? (size_t)content_len : 0;
+    if (text_len > 0 && content[text_len - 1] == '\n') {
+        text_len--;
+    }
+    if (relay_chat(&relay_link, upstream_id, msg_id, content, text_len) == -1) {
+        log_message(LOG_WARN, "Failed to forward message to parent");
+    }
+}
+
+/**
+ * @brief Tell a client whether its username was accepted: [REGISTER_ACK][status]\n
+ *
+ * Clients that did not negotiate FEATURE_ACKS get no frame; if their name is
+ * rejected they are disconnected instead.
+ */
+void send_register_status(client_t *cli, uint8_t status) {
+    if (!(cli->features & FEATURE_ACKS)) {
+        if (status != REGISTER_OK) {
+            remove_client(cli, 0);
+        }
+        return;
+    }
+    
+    uint8_t msg[3] = {MSG_TYPE_REGISTER_ACK, status, '\n'};
+    if (send_to_client(cli, msg, sizeof(msg)) != (ssize_t)sizeof(msg)) {
+        log_message(LOG_WARN, "Failed to send registration status");
+    }
+}
+
+/**
+ * @brief Agree on a protocol version and feature set with a client
+ *
+ * Client sends [HELLO][version][8 hex feature bits]\n; the reply carries the
+ * server version and the intersection of both feature sets.
+ */
+void handle_hello(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint64_t client_features;
+    if (msg_len != HELLO_CLIENT_LEN || hex_to_u64(msg + 2, 8, &client_features) != 0) {
+        log_message(LOG_WARN, "Malformed HELLO, disconnecting client");
+        remove_client(cli, 0);
+        return;
+    }
+    
+    uint8_t client_version = (uint8_t)msg[1];
+    cli->version = client_version < PROTOCOL_VERSION ? client_version : PROTOCOL_VERSION;
+    /* A relay's chat comes back from its parent, past any mutes kept here,
+     * and topic messages are not passed up the tree */
+    uint32_t offered = SERVER_FEATURES | (mcast_enabled ? FEATURE_MULTICAST : 0) |
+                       (relay_enabled ? 0 : FEATURE_MUTE | FEATURE_TOPICS | FEATURE_SIGNALS |
+                                       FEATURE_REACTIONS) |
+                       (transfer_enabled ? FEATURE_TRANSFERS : 0);
+    cli->features = (uint32_t)client_features & offered;
+    
+    uint8_t reply[HELLO_SERVER_LEN];
+    uint32_t features_net = htonl(cli->features);
+    reply[0] = MSG_TYPE_HELLO;
+    reply[1] = PROTOCOL_VERSION;
+    memcpy(reply + 2, &features_net, 4);
+    reply[6] = '\n';
+    if (send_to_client(cli, reply, sizeof(reply)) != (ssize_t)sizeof(reply)) {
+        log_message(LOG_WARN, "Failed to send HELLO");
+        return;
+    }
+    
+    /* Subscribers learn where to listen:
+     * [MCAST_INFO][group ip:4][port:2][next seq:8]\n */
+    if (cli->features & FEATURE_MULTICAST) {
+        uint8_t info[MCAST_INFO_LEN];
+        info[0] = MSG_TYPE_MCAST_INFO;
+        memcpy(info + 1, &mcast_pub.group.sin_addr.s_addr, 4);
+        memcpy(info + 5, &mcast_pub.group.sin_port, 2);
+        for (int i = 0; i < 8; i++) {
+            info[7 + i] = (uint8_t)(mcast_pub.next_seq >> (56 - 8 * i));
+        }
+        info[15] = '\n';
+        send_to_client(cli, info, sizeof(info));
+        log_message(LOG_INFO, "Multicast subscriber joined at packet %llu",
+                    (unsigned long long)mcast_pub.next_seq);
+    }
+    
+    /* Files go over a second connection: [TRANSFER_INFO][port:2]\n */
+    if (cli->features & FEATURE_TRANSFERS) {
+        uint8_t info[TRANSFER_INFO_LEN];
+        uint16_t port_net = htons(transfer_port);
+        info[0] = MSG_TYPE_TRANSFER_INFO;
+        memcpy(info + 1, &port_net, 2);
+        info[3] = '\n';
+        send_to_client(cli, info, sizeof(info));
+    }
+    
+    log_message(LOG_DEBUG, "Negotiated protocol v%u, features 0x%x", cli->version, cli->features);
+}
+
+/**
+ * @brief Resend multicast packets a subscriber missed
+ *
+ * [NAK][16 hex first seq][4 hex count]\n is answered with one
+ * [REPAIR][seq:8][len:2]\n header per packet followed by its frames; len 0
+ * means the packet has left the ring.
+ */
+void handle_nak(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint64_t first;
+    uint64_t count;
+    if (msg_len != NAK_LEN || hex_to_u64(msg + 1, 16, &first) != 0 ||
+        hex_to_u64(msg + 17, 4, &count) != 0 || count > MCAST_MAX_NAK) {
+        log_message(LOG_WARN, "Malformed NAK, disconnecting subscriber");
+        remove_client(cli, 0);
+        return;
+    }
+    
+    uint8_t repair[REPAIR_HEADER_LEN + MCAST_MAX_PACKET];
+    for (uint64_t seq = first; seq < first + count; seq++) {
+        size_t len = 0;
+        const uint8_t *frames = mcast_lookup(&mcast_pub, seq, &len);
+        repair[0] = MSG_TYPE_REPAIR;
+        for (int i = 0; i < 8; i++) {
+            repair[1 + i] = (uint8_t)(seq >> (56 - 8 * i));
+        }
+        repair[9] = (uint8_t)(len >> 8);
+        repair[10] = (uint8_t)len;
+        repair[11] = '\n';
+        if (frames) {
+            memcpy(repair + REPAIR_HEADER_LEN, frames, len);
+        }
+        
+        ssize_t total = (ssize_t)(REPAIR_HEADER_LEN + len);
+        if (send_to_client(cli, repair, (size_t)total) != total) {
+            log_message(LOG_WARN, "Failed to send repair");
+            return;
+        }
+    }
+    log_message(LOG_DEBUG, "Repaired %llu multicast packets from %llu",
+                (unsigned long long)count, (unsigned long long)first);
+}
+
+/**
+ * @brief Add a user to, or take one off, the sender's mute list
+ *
+ * [MUTE][1 mute / 0 unmute][username_len][username]\n, answered with
+ * [MUTE_ACK][status]\n. Only users registered directly on this connection's
+ * server can be muted, not sessions of gateways or relays.
+ */
+void handle_mute(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint8_t status = MUTE_UNKNOWN;
+    uint8_t username_len = msg_len > 3 ? (uint8_t)msg[2] : 0;
+    
+    if (username_len > 0 && username_len < MAX_USERNAME_LEN && msg_len == 4 + username_len) {
+        for (int i = 0; i < max_clients; i++) {
+            client_t *target = &clients[i];
+            if (target == cli || target->fd == -1 || !target->has_username ||
+                strlen(target->username) != username_len ||
+                memcmp(target->username, msg + 3, username_len) != 0) {
+                continue;
+            }
+            
+            size_t self = (size_t)(cli - clients);
+            if (msg[1]) {
+                if (slotset_add(&target->muted_by, self) == 0 &&
+                    slotset_add(&cli->mutes, (size_t)i) == 0) {
+                    status = MUTE_OK;
+                }
+            } else {
+                slotset_remove(&target->muted_by, self);
+                slotset_remove(&cli->mutes, (size_t)i);
+                status = MUTE_OK;
+            }
+            log_message(LOG_DEBUG, "%s %smuted %s", cli->username, msg[1] ? "" : "un",
+                        target->username);
+            break;
+        }
+    }
+    
+    uint8_t reply[3] = {MSG_TYPE_MUTE_ACK, status, '\n'};
+    send_to_client(cli, reply, sizeof(reply));
+}
+
+/**
+ * @brief Subscribe to or unsubscribe from a topic pattern
+ *
+ * [SUBSCRIBE][1 subscribe / 0 unsubscribe][pattern_len][pattern]\n, answered
+ * with [SUBSCRIBE_ACK][status]\n.
+ */
+void handle_subscribe(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint8_t status = TOPIC_INVALID;
+    uint8_t pattern_len = msg_len > 3 ? (uint8_t)msg[2] : 0;
+    const char *pattern = msg + 3;
+    size_t self = (size_t)(cli - clients);
+    
+    if (msg_len == 4 + pattern_len && topic_pattern_valid(pattern, pattern_len)) {
+        if (!msg[1]) {
+            if (topic_trie_unsubscribe(&topic_trie, pattern, pattern_len, self) == 1) {
+                cli->num_topics--;
+                status = TOPIC_OK;
+            }
+        } else if (cli->num_topics >= MAX_TOPICS_PER_CLIENT) {
+            status = TOPIC_LIMIT;
+        } else {
+            int added = topic_trie_subscribe(&topic_trie, pattern, pattern_len, self);
+            if (added >= 0) {
+                cli->num_topics += added;
+                status = TOPIC_OK;
+            } else {
+                log_message(LOG_ERROR, "Failed to add topic subscription");
+            }
+        }
+    }
+    log_message(LOG_DEBUG, "%s %ssubscribed %.*s: status %d", cli->username,
+                msg[1] ? "" : "un", (int)pattern_len, pattern, status);
+    
+    uint8_t reply[3] = {MSG_TYPE_SUBSCRIBE_ACK, status, '\n'};
+    send_to_client(cli, reply, sizeof(reply));
+}
+
+/**
+ * @brief Send a message to the subscribers of a topic
+ *
+ * [PUBLISH][topic_len][topic][message]\n is delivered as TOPIC_CHAT to every
+ * subscriber with a matching pattern, once, except those who muted the
+ * sender. Topic messages bypass the history, viewers and multicast.
+ */
+void handle_publish(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint8_t topic_len = msg_len > 2 ? (uint8_t)msg[1] : 0;
+    if (msg_len < 3 + topic_len || !topic_name_valid(msg + 2, topic_len) ||
+        !utf8_valid(msg + 2, topic_len)) {
+        log_message(LOG_WARN, "Malformed PUBLISH from %s", cli->username);
+        return;
+    }
+    
+    const char *text = msg + 2 + topic_len;
+    size_t text_len = (size_t)msg_len - 3 - topic_len;
+    if (message_blocked(cli->username, text, text_len) ||
+        plugins_drop(cli, cli->username, msg + 2, topic_len, &text, &text_len)) {
+        return;
+    }
+    
+    /* The payload of a TOPIC_CHAT frame is [topic_len][topic][message], which
+     * is already in the frame unless a plugin rewrote the message */
+    const char *payload = msg + 1;
+    char rewritten[BUF_SIZE];
+    if (text != msg + 2 + topic_len) {
+        memcpy(rewritten, msg + 1, 1 + (size_t)topic_len);
+        memcpy(rewritten + 1 + topic_len, text, text_len);
+        payload = rewritten;
+    }
+    
+    const slotset_t *subscribers = topic_trie_match(&topic_trie, msg + 2, topic_len);
+    if (!subscribers || slotset_andnot(&filtered_slots, subscribers, &cli->muted_by) == -1) {
+        log_message(LOG_ERROR, "Failed to resolve topic subscribers");
+        return;
+    }
+    uint8_t frame[BUF_SIZE + 8];
+    int len = encode_peer_frame(frame, sizeof(frame), MSG_TYPE_TOPIC_CHAT,
+                                cli->addr.sin_addr.s_addr, cli->addr.sin_port, cli->username,
+                                payload, 1 + (size_t)topic_len + text_len);
+    if (len < 0) {
+        return;
+    }
+    
+    /* Bulk and bot rooms wait their turn behind interactive traffic; the
+     * room's copies are counted by qos_deliver as they are written */
+    qos_class_t cls = qos_classify(&qos, msg + 2, topic_len);
+    if (cls != QOS_INTERACTIVE) {
+        if (qos_enqueue(&qos, cls, frame, (size_t)len, &filtered_slots) == -1) {
+            log_message(LOG_DEBUG, "Dropped message to %s room %.*s", qos_class_name(cls),
+                        (int)topic_len, msg + 2);
+            return;
+        }
+        count_traffic(cli->username, msg + 2, topic_len, 0);
+        return;
+    }
+    
+    size_t sent = 0;
+    for (long i = slotset_next(&filtered_slots, 0); i != -1;
+         i = slotset_next(&filtered_slots, (size_t)i + 1)) {
+        if (send_to_client(&clients[i], frame, (size_t)len) != len) {
+            log_message(LOG_WARN, "Failed to send topic message to client %ld", i);
+            continue;
+        }
+        sent++;
+    }
+    count_traffic(cli->username, msg + 2, topic_len, sent);
+}
+
+/**
+ * @brief Record a typing or presence signal: [SIGNAL][kind]\n
+ *
+ * The signal goes out at the next flush of the ephemeral state, merged with
+ * any others the sender sends before then.
+ */
+void handle_signal(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint8_t kind = msg_len == 3 ? (uint8_t)msg[1] : 0;
+    if (kind == 0 || kind > SIGNAL_KIND_MAX) {
+        log_message(LOG_WARN, "Malformed SIGNAL from %s", cli->username);
+        return;
+    }
+    ephemeral_set(&ephemeral, (size_t)(cli - clients), kind, monotonic_ms());
+}
+
+/**
+ * @brief Ephemeral sink: the clients that take a sender's signals, except
+ *        those who muted it
+ */
+static const slotset_t *signal_audience(size_t sender, void *arg) {
+    (void)arg;
+    const slotset_t *muted_by = &clients[sender].muted_by;
+    if (slotset_empty(muted_by)) {
+        return &signal_slots;
+    }
+    if (slotset_andnot(&filtered_slots, &signal_slots, muted_by) == -1) {
+        slotset_clear(&filtered_slots);
+    }
+    return &filtered_slots;
+}
+
+/**
+ * @brief Bytes written to a client's socket that it has not received yet
+ */
+static int unsent_bytes(const client_t *cli) {
+    int unsent = 0;
+#ifdef TIOCOUTQ
+    if (ioctl(cli->fd, TIOCOUTQ, &unsent) == -1) {
+        return 0;
+    }
+#else
+    (void)cli;
+#endif
+    return unsent;
+}
+
+/**
+ * @brief Ephemeral sink: whether chat is still waiting in a client's socket
+ */
+static int signal_backlogged(size_t recipient, void *arg) {
+    (void)arg;
+    return unsent_bytes(&clients[recipient]) > SIGNAL_MAX_BACKLOG;
+}
+
+/**
+ * @brief Ephemeral sink: send one signal,
+ *        [SIGNAL][ip][port][username_len][username][kind]\n
+ */
+static void signal_deliver(size_t recipient, size_t sender, uint8_t kind, void *arg) {
+    (void)arg;
+    const client_t *from = &clients[sender];
+    uint8_t frame[PEER_FRAME_HEADER + MAX_USERNAME_LEN + 2];
+    int len = encode_peer_frame(frame, sizeof(frame), MSG_TYPE_SIGNAL, from->addr.sin_addr.s_addr,
+                                from->addr.sin_port, from->username, (const char *)&kind, 1);
+    if (len > 0 && send_to_client(&clients[recipient], frame, (size_t)len) != len) {
+        log_message(LOG_DEBUG, "Failed to send signal to client %zu", recipient);
+    }
+}
+
+static const ephemeral_sink_t signal_sink = {signal_audience, signal_backlogged, signal_deliver,
+                                             NULL};
+
+/**
+ * @brief QoS sink: whether a client's socket is too full for queued frames
+ */
+static int qos_backlogged(size_t recipient, void *arg) {
+    (void)arg;
+    /* A closed slot is not waited for: writing to it fails instead */
+    return clients[recipient].fd != -1 && unsent_bytes(&clients[recipient]) > QOS_MAX_BACKLOG;
+}
+
+/**
+ * @brief QoS sink: write one queued frame
+ */
+static int qos_deliver(size_t recipient, const uint8_t *frame, size_t len, void *arg) {
+    (void)arg;
+    if (send_to_client(&clients[recipient], frame, len) != (ssize_t)len) {
+        return -1;
+    }
+    /* The payload of the TOPIC_CHAT frame starts [topic_len][topic] */
+    peer_frame_t peer;
+    if (decode_peer_frame(frame, len, &peer) == 0 && peer.payload_len > 0) {
+        count_room_traffic(peer.payload + 1, (uint8_t)peer.payload[0], 1);
+    }
+    return 0;
+}
+
+static const qos_sink_t qos_sink = {qos_backlogged, qos_deliver, NULL};
+
+/**
+ * @brief Add or remove a reaction to a recent chat message:
+ *        [REACT][1 add / 0 remove][16 hex seq][len][reaction]\n
+ *
+ * The change reaches the room with the next batch of counts.
+ */
+void handle_react(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint64_t seq;
+    uint8_t len = msg_len > REACT_HEADER ? (uint8_t)msg[REACT_HEADER - 1] : 0;
+    const char *text = msg + REACT_HEADER;
+    if (msg_len != REACT_HEADER + len + 1 || hex_to_u64(msg + 2, 16, &seq) != 0 ||
+        memchr(text, '\n', len) || !utf8_valid(text, len)) {
+        log_message(LOG_WARN, "Malformed REACT from %s", cli->username);
+        return;
+    }
+    if (reactions_apply(&reactions, (size_t)(cli - clients), seq, msg[1] != 0, text, len) == -1) {
+        log_message(LOG_DEBUG, "Rejected reaction from %s to message %llu", cli->username,
+                    (unsigned long long)seq);
+    }
+}
+
+/**
+ * @brief Send the reaction counts that changed since the last batch
+ */
+static void flush_reactions(void) {
+    uint8_t batch[BUF_SIZE * 4];
+    size_t len = reactions_flush(&reactions, monotonic_ms(), batch, sizeof(batch));
+    if (len == 0) {
+        return;
+    }
+    for (long i = slotset_next(&reaction_slots, 0); i != -1;
+         i = slotset_next(&reaction_slots, (size_t)i + 1)) {
+        if (send_to_client(&clients[i], batch, len) != (ssize_t)len) {
+            log_message(LOG_WARN, "Failed to send reaction counts to client %ld", i);
+        }
+    }
+}
+
+/**
+ * @brief Check whether a registered client or session already uses a username
+ */
+int username_taken(const char *username) {
+    for (int i = 0; i < max_clients; i++) {
+        if (clients[i].fd == -1) {
+            continue;
+        }
+        if ((clients[i].has_username || clients[i].registering) &&
+            strcmp(clients[i].username, username) == 0) {
+            return 1;
+        }
+        for (int j = 0; j < clients[i].num_sessions; j++) {
+            if (strcmp(clients[i].sessions[j].username, username) == 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse the session ID following the type byte
+ * @return 0 on success, -1 if the frame is too short or not hex
+ */
+static int parse_session_id(const char *msg, ssize_t msg_len, uint16_t *id) {
+    uint64_t value;
+    if (msg_len < 1 + SESSION_ID_HEX_LEN + 1 ||
+        hex_to_u64(msg + 1, SESSION_ID_HEX_LEN, &value) != 0) {
+        return -1;
+    }
+    *id = (uint16_t)value;
+    return 0;
+}
+
+/**
+ * @brief Position of a session in the client's sorted table, or where it
+ *        would be inserted
+ */
+static int session_slot(const client_t *cli, uint16_t id) {
+    int lo = 0;
+    int hi = cli->num_sessions;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cli->sessions[mid].id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Find an open session by ID
+ */
+static session_t *find_session(client_t *cli, uint16_t id) {
+    int slot = session_slot(cli, id);
+    if (slot < cli->num_sessions && cli->sessions[slot].id == id) {
+        return &cli->sessions[slot];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Remove a session from the client's table
+ */
+static void delete_session(client_t *cli, int slot) {
+    cli->num_sessions--;
+    memmove(&cli->sessions[slot], &cli->sessions[slot + 1],
+            (size_t)(cli->num_sessions - slot) * sizeof(session_t));
+    update_recipient(cli);
+}
+
+/**
+ * @brief Answer a session registration: [SESSION_ACK][session][status]\n
+ */
+void send_session_status(client_t *cli, uint16_t id, uint8_t status) {
+    uint8_t msg[1 + SESSION_ID_HEX_LEN + 1 + 1];
+    msg[0] = MSG_TYPE_SESSION_ACK;
+    snprintf((char *)msg + 1, SESSION_ID_HEX_LEN + 1, "%04x", id);
+    msg[1 + SESSION_ID_HEX_LEN] = status;
+    msg[2 + SESSION_ID_HEX_LEN] = '\n';
+    if (send_to_client(cli, msg, sizeof(msg)) != (ssize_t)sizeof(msg)) {
+        log_message(LOG_WARN, "Failed to send session status");
+    }
+}
+
+/**
+ * @brief Register one more username on a multiplexed connection
+ *
+ * [SESSION_OPEN][session][username_len][username]\n
+ */
+void handle_session_open(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint16_t id;
+    if (parse_session_id(msg, msg_len, &id) == -1) {
+        log_message(LOG_WARN, "Malformed session frame, disconnecting client");
+        remove_client(cli, 0);
+        return;
+    }
+    
+    const char *name = msg + 1 + SESSION_ID_HEX_LEN;
+    uint8_t username_len = msg_len > 2 + SESSION_ID_HEX_LEN ? (uint8_t)name[0] : 0;
+    if (username_len == 0 || username_len >= MAX_USERNAME_LEN ||
+        msg_len < 2 + SESSION_ID_HEX_LEN + username_len || !utf8_valid(name + 1, username_len)) {
+        send_session_status(cli, id, REGISTER_INVALID);
+        return;
+    }
+    
+    char username[MAX_USERNAME_LEN];
+    memcpy(username, name + 1, username_len);
+    username[username_len] = '\0';
+    if (username_taken(username)) {
+        log_message(LOG_INFO, "Rejected username already in use: %s", username);
+        send_session_status(cli, id, REGISTER_TAKEN);
+        return;
+    }
+    
+    /* A relay carries the sessions of its whole subtree */
+    int max_sessions = cli->is_relay ? MAX_SESSIONS_PER_RELAY : MAX_SESSIONS_PER_CONN;
+    int slot = session_slot(cli, id);
+    if ((slot < cli->num_sessions && cli->sessions[slot].id == id) ||
+        cli->num_sessions >= max_sessions) {
+        send_session_status(cli, id, REGISTER_FULL);
+        return;
+    }
+    if (cli->num_sessions == cli->sessions_cap) {
+        int new_cap = cli->sessions_cap ? cli->sessions_cap * 2 : 8;
+        session_t *sessions = realloc(cli->sessions, (size_t)new_cap * sizeof(session_t));
+        if (!sessions) {
+            send_session_status(cli, id, REGISTER_FULL);
+            return;
+        }
+        cli->sessions = sessions;
+        cli->sessions_cap = new_cap;
+    }
+    
+    memmove(&cli->sessions[slot + 1], &cli->sessions[slot],
+            (size_t)(cli->num_sessions - slot) * sizeof(session_t));
+    session_t *session = &cli->sessions[slot];
+    session->id = id;
+    strcpy(session->username, username);
+    session->pending = 0;
+    cli->num_sessions++;
+    update_recipient(cli);
+    
+    /* A relay answers once its parent has */
+    if (relay_enabled) {
+        relay_route_t owner = {(int)(cli - clients), id, 1, RELAY_ROUTE_FREE};
+        if (relay_open(&relay_link, &owner, username, &session->upstream_id) == -1) {
+            delete_session(cli, slot);
+            send_session_status(cli, id, REGISTER_FULL);
+            return;
+        }
+        session->pending = 1;
+        return;
+    }
+    
+    send_session_status(cli, id, REGISTER_OK);
+    
+    log_message(LOG_INFO, "Client opened session %u: %s", id, username);
+    broadcast_join(clients, max_clients, cli, username);
+}
+
+/**
+ * @brief Broadcast a chat message from one session
+ *
+ * [SESSION_CHAT][session][16 hex message id][message]\n
+ */
+void handle_session_chat(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint16_t id;
+    uint64_t msg_id;
+    const char *id_hex = msg + 1 + SESSION_ID_HEX_LEN;
+    if (parse_session_id(msg, msg_len, &id) == -1 ||
+        msg_len < 1 + SESSION_ID_HEX_LEN + MSG_ID_HEX_LEN + 1 ||
+        hex_to_u64(id_hex, MSG_ID_HEX_LEN, &msg_id) != 0) {
+        log_message(LOG_WARN, "Malformed session chat frame");
+        return;
+    }
+    
+    session_t *session = find_session(cli, id);
+    if (!session) {
+        log_message(LOG_WARN, "Chat frame for unknown session %u", id);
+        return;
+    }
+    
+    if (dedup_check(&dedup_table, session->username, msg_id)) {
+        log_message(LOG_DEBUG, "Dropped duplicate message %016llx from %s",
+                    (unsigned long long)msg_id, session->username);
+        return;
+    }
+    
+    const char *content = id_hex + MSG_ID_HEX_LEN;
+    ssize_t content_len = msg_len - 1 - SESSION_ID_HEX_LEN - MSG_ID_HEX_LEN;
+    if (relay_enabled) {
+        forward_chat(session->upstream_id, msg_id, content, content_len);
+    } else {
+        broadcast_chat(cli, session->username, content, content_len, &msg_id);
+    }
+}
+
+/**
+ * @brief End one session: [SESSION_CLOSE][session]\n
+ */
+void handle_session_close(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint16_t id;
+    if (parse_session_id(msg, msg_len, &id) == -1) {
+        return;
+    }
+    
+    int slot = session_slot(cli, id);
+    if (slot == cli->num_sessions || cli->sessions[slot].id != id) {
+        return;
+    }
+    
+    char username[MAX_USERNAME_LEN];
+    strcpy(username, cli->sessions[slot].username);
+    uint16_t upstream_id = cli->sessions[slot].upstream_id;
+    delete_session(cli, slot);
+    
+    log_message(LOG_INFO, "Client closed session %u: %s", id, username);
+    if (relay_enabled) {
+        relay_close(&relay_link, upstream_id);
+    } else {
+        broadcast_leave(&cli->addr, username);
+    }
+}
+
+/**
+ * @brief Take a relay node into the fan-out tree: [RELAY_ATTACH][4 hex port]\n
+ *
+ * Up to relay_fanout relays attach here. Further ones are redirected to
+ * the attached relay that has been sent the fewest so far, which repeats
+ * the decision one level down, so the tree grows evenly.
+ */
+void handle_relay_attach(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint64_t port;
+    if (msg_len != RELAY_ATTACH_LEN || hex_to_u64(msg + 1, 4, &port) != 0 || port == 0) {
+        log_message(LOG_WARN, "Malformed RELAY_ATTACH, disconnecting client");
+        remove_client(cli, 0);
+        return;
+    }
+    
+    client_t *child = NULL;
+    int num_children = 0;
+    for (int i = 0; i < max_clients; i++) {
+        if (clients[i].fd != -1 && clients[i].is_relay) {
+            num_children++;
+            if (!child || clients[i].relays_assigned < child->relays_assigned) {
+                child = &clients[i];
+            }
+        }
+    }
+    
+    char ip_str[INET_ADDRSTRLEN];
+    uint8_t reply[RELAY_REDIRECT_LEN];
+    if (num_children >= relay_fanout) {
+        child->relays_assigned++;
+        relay_encode_redirect(reply, child->addr.sin_addr.s_addr, htons(child->relay_port));
+        send_to_client(cli, reply, sizeof(reply));
+        inet_ntop(AF_INET, &child->addr.sin_addr, ip_str, sizeof(ip_str));
+        log_message(LOG_INFO, "Redirected relay to %s:%d", ip_str, child->relay_port);
+        return;
+    }
+    
+    relay_encode_redirect(reply, 0, 0);
+    if (send_to_client(cli, reply, sizeof(reply)) != (ssize_t)sizeof(reply)) {
+        remove_client(cli, 0);
+        return;
+    }
+    cli->is_relay = 1;
+    update_recipient(cli);
+    cli->relay_port = (int)port;
+    cli->relays_assigned = 0;
+    
+    inet_ntop(AF_INET, &cli->addr.sin_addr, ip_str, sizeof(ip_str));
+    log_message(LOG_INFO, "Relay attached from %s (serving port %d, %d relays here)", ip_str,
+                cli->relay_port, num_children + 1);
+}
+
+/**
+ * @brief Deliver the parent's answer to a registration made through this
+ *        relay: [SESSION_ACK][session][status]\n
+ */
+void handle_upstream_ack(const uint8_t *frame, size_t len) {
+    uint64_t id;
+    if (len != 1 + SESSION_ID_HEX_LEN + 2 ||
+        hex_to_u64((const char *)frame + 1, SESSION_ID_HEX_LEN, &id) != 0) {
+        return;
+    }
+    
+    uint8_t status = frame[1 + SESSION_ID_HEX_LEN];
+    relay_route_t route;
+    if (!relay_settle(&relay_link, (uint16_t)id, status, &route)) {
+        return;
+    }
+    
+    client_t *cli = &clients[route.client];
+    if (!route.is_session) {
+        cli->registering = 0;
+        if (status == REGISTER_OK) {
+            cli->has_username = 1;
+            update_recipient(cli);
+            log_message(LOG_INFO, "Client registered username: %s", cli->username);
+        }
+        send_register_status(cli, status);
+        return;
+    }
+    
+    /* Sessions closed while pending were abandoned, so this one exists */
+    int slot = session_slot(cli, route.session);
+    if (status == REGISTER_OK) {
+        cli->sessions[slot].pending = 0;
+        log_message(LOG_INFO, "Client opened session %u: %s", route.session,
+                    cli->sessions[slot].username);
+    } else {
+        delete_session(cli, slot);
+    }
+    send_session_status(cli, route.session, status);
+}
+
+/**
+ * @brief Hand the parent's report of a lost chat message to the local user
+ *        who sent it: [SESSION_FAILED][session][16 hex id]\n
+ */
+void handle_upstream_failed(const uint8_t *frame, size_t len) {
+    uint64_t id;
+    uint64_t msg_id;
+    if (len != SESSION_FAILED_LEN ||
+        hex_to_u64((const char *)frame + 1, SESSION_ID_HEX_LEN, &id) != 0 ||
+        hex_to_u64((const char *)frame + 1 + SESSION_ID_HEX_LEN, MSG_ID_HEX_LEN, &msg_id) != 0) {
+        return;
+    }
+    
+    relay_route_t route;
+    if (!relay_route(&relay_link, (uint16_t)id, &route)) {
+        return; /* The user has left */
+    }
+    
+    client_t *cli = &clients[route.client];
+    batch_sender_t sender = {route.client, "", 1, msg_id, 0, 0, 0, -1, 0};
+    if (route.is_session) {
+        session_t *session = find_session(cli, route.session);
+        if (!session) {
+            return;
+        }
+        strcpy(sender.username, session->username);
+    } else {
+        strcpy(sender.username, cli->username);
+    }
+    report_chat_failed(&sender);
+}
+
+/**
+ * @brief Repeat the broadcasts collected from one read of the parent
+ */
+static void flush_relay_batch(void) {
+    if (relay_batch.len > 0) {
+        broadcast_message(clients, max_clients, relay_batch.data, (ssize_t)relay_batch.len);
+        relay_batch.len = 0;
+    }
+}
+
+/**
+ * @brief Frame parser callback for frames from the parent
+ *
+ * Broadcasts are collected so that one read of the parent costs each local
+ * client a single write.
+ */
+int dispatch_upstream_frame(const uint8_t *frame, size_t len, void *arg) {
+    (void)arg;
+    switch (frame[0]) {
+    case MSG_TYPE_CHAT:
+    case MSG_TYPE_JOIN:
+    case MSG_TYPE_DISCONNECT:
+        if (batch_append(&relay_batch, (const char *)frame, len) == -1) {
+            log_message(LOG_ERROR, "Failed to queue broadcast from parent");
+        }
+        break;
+    case MSG_TYPE_SESSION_ACK:
+        /* Registration takes effect between the broadcasts around it */
+        flush_relay_batch();
+        handle_upstream_ack(frame, len);
+        break;
+    case MSG_TYPE_SESSION_FAILED:
+        handle_upstream_failed(frame, len);
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Handle data from the parent; losing it stops the relay
+ */
+void handle_upstream_data(void) {
+    ssize_t num_read = read(relay_link.fd, read_buf, sizeof(read_buf));
+    if (num_read > 0) {
+        if (frame_parser_feed(&relay_link.parser, read_buf, (size_t)num_read,
+                              dispatch_upstream_frame, NULL) == -1) {
+            log_message(LOG_ERROR, "Malformed frame from parent");
+            server_running = 0;
+        }
+        flush_relay_batch();
+        return;
+    }
+    if (num_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    
+    log_message(LOG_ERROR, "Lost connection to parent, shutting down relay");
+    server_running = 0;
+}
+
+/**
+ * @brief Process a complete message from a client
+ */
+void process_message(client_t *cli, const char *msg, ssize_t msg_len) {
+    uint8_t msg_type = (uint8_t)msg[0];
+    
+    if (msg_type == MSG_TYPE_HELLO && !client_registered(cli)) {
+        /* Handshake, only valid before registration */
+        handle_hello(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_USERNAME && !cli->has_username && !cli->registering) {
+        /* Username registration, answered so the client can start chatting
+         * without guessing when it has taken effect */
+        uint8_t username_len = msg_len > 2 ? (uint8_t)msg[1] : 0;
+        if (username_len == 0 || username_len >= MAX_USERNAME_LEN || msg_len < 2 + username_len ||
+            !utf8_valid(msg + 2, username_len)) {
+            send_register_status(cli, REGISTER_INVALID);
+            return;
+        }
+        
+        char username[MAX_USERNAME_LEN];
+        memcpy(username, msg + 2, username_len);
+        username[username_len] = '\0';
+        if (username_taken(username)) {
+            log_message(LOG_INFO, "Rejected username already in use: %s", username);
+            send_register_status(cli, REGISTER_TAKEN);
+            return;
         }
-    } else if (msg_type == MSG_TYPE_CHAT && cli->has_username) {
-        /* Chat message - broadcast to all clients */
-        ssize_t content_len = msg_len - 1; /* Exclude type byte */
         
-        char broadcast_msg[BUF_SIZE + 8];
-        int offset = 0;
+        strcpy(cli->username, username);
         
-        broadcast_msg[offset++] = MSG_TYPE_CHAT;
-        memcpy(broadcast_msg + offset, &cli->addr.sin_addr.s_addr, 4);
-        offset += 4;
-        memcpy(broadcast_msg + offset, &cli->addr.sin_port, 2);
-        offset += 2;
+        /* A relay registers the name with its parent and answers later */
+        if (relay_enabled) {
+            relay_route_t owner = {(int)(cli - clients), 0, 0, RELAY_ROUTE_FREE};
+            if (relay_open(&relay_link, &owner, username, &cli->upstream_id) == -1) {
+                send_register_status(cli, REGISTER_FULL);
+                return;
+            }
+            cli->registering = 1;
+            return;
+        }
         
-        uint8_t username_len = (uint8_t)strlen(cli->username);
-        broadcast_msg[offset++] = username_len;
-        memcpy(broadcast_msg + offset, cli->username, username_len);
-        offset += username_len;
+        cli->has_username = 1;
+        update_recipient(cli);
+        send_register_status(cli, REGISTER_OK);
         
-        if (content_len > 0) {
-            memcpy(broadcast_msg + offset, cli->buf + 1, content_len);
-            offset += content_len;
+        log_message(LOG_INFO, "Client registered username: %s", cli->username);
+        broadcast_join(clients, max_clients, cli, cli->username);
+    } else if (msg_type == MSG_TYPE_CHAT && cli->has_username) {
+        /* Chat message - broadcast to all clients */
+        if (relay_enabled) {
+            forward_chat(cli->upstream_id, relay_link.next_msg_id++, msg + 1, msg_len - 1);
+        } else {
+            broadcast_chat(cli, cli->username, msg + 1, msg_len - 1, NULL); /* Exclude type byte */
+        }
+    } else if (msg_type == MSG_TYPE_CHAT_ID && cli->has_username) {
+        /* Chat message with client ID: [type][16 hex id][message]\n */
+        uint64_t msg_id;
+        if (msg_len < 1 + MSG_ID_HEX_LEN + 1 ||
+            hex_to_u64(msg + 1, MSG_ID_HEX_LEN, &msg_id) != 0) {
+            log_message(LOG_WARN, "Malformed message ID from %s", cli->username);
+            return;
         }
         
-        broadcast_message(clients, max_clients, broadcast_msg, offset);
+        if (dedup_check(&dedup_table, cli->username, msg_id)) {
+            log_message(LOG_DEBUG, "Dropped duplicate message %016llx from %s",
+                        (unsigned long long)msg_id, cli->username);
+            return;
+        }
         
-        log_message(LOG_DEBUG, "Broadcast message from %s", cli->username);
+        if (relay_enabled) {
+            forward_chat(cli->upstream_id, msg_id, msg + 1 + MSG_ID_HEX_LEN,
+                         msg_len - 1 - MSG_ID_HEX_LEN);
+        } else {
+            broadcast_chat(cli, cli->username, msg + 1 + MSG_ID_HEX_LEN,
+                           msg_len - 1 - MSG_ID_HEX_LEN, &msg_id);
+        }
+    } else if (msg_type == MSG_TYPE_SESSION_OPEN && (cli->features & FEATURE_SESSIONS)) {
+        handle_session_open(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_SESSION_CHAT && cli->num_sessions > 0) {
+        handle_session_chat(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_SESSION_CLOSE && cli->num_sessions > 0) {
+        handle_session_close(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_RELAY_ATTACH && (cli->features & FEATURE_RELAY) &&
+               !client_registered(cli)) {
+        handle_relay_attach(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_MUTE && cli->has_username && (cli->features & FEATURE_MUTE)) {
+        handle_mute(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_SUBSCRIBE && cli->has_username &&
+               (cli->features & FEATURE_TOPICS)) {
+        handle_subscribe(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_PUBLISH && cli->has_username &&
+               (cli->features & FEATURE_TOPICS)) {
+        handle_publish(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_SIGNAL && cli->has_username &&
+               (cli->features & FEATURE_SIGNALS)) {
+        handle_signal(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_REACT && cli->has_username &&
+               (cli->features & FEATURE_REACTIONS)) {
+        handle_react(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_NAK && (cli->features & FEATURE_MULTICAST)) {
+        handle_nak(cli, msg, msg_len);
+    } else if (msg_type == MSG_TYPE_SEARCH && client_registered(cli)) {
+        /* History search: [type][query]\n */
+        handle_search(cli, msg + 1, msg_len - 2);
     } else if (msg_type == MSG_TYPE_DISCONNECT) {
         /* Client requested disconnect */
         remove_client(cli, 0);
@@ -208,12 +2054,14 @@ void process_message(client_t *cli, ssize_t msg_len) {
 
 /**
  * @brief Accept a new client connection
+ * @param listen_fd Listening socket
+ * @param is_websocket Whether listen_fd is the WebSocket listener
  */
-void accept_client(int server_fd) {
+void accept_client(int listen_fd, int is_websocket) {
     struct sockaddr_in remote_addr;
     socklen_t addrlen = sizeof(remote_addr);
     
-    int client_fd = accept(server_fd, (struct sockaddr *)&remote_addr, &addrlen);
+    int client_fd = accept(listen_fd, (struct sockaddr *)&remote_addr, &addrlen);
     if (client_fd == -1) {
         log_message(LOG_ERROR, "Failed to accept client: %s", strerror(errno));
         return;
@@ -229,15 +2077,31 @@ void accept_client(int server_fd) {
     int added = 0;
     for (int j = 0; j < max_clients; j++) {
         if (clients[j].fd == -1) {
+            if (is_websocket && !clients[j].ws) {
+                clients[j].ws = malloc(sizeof(ws_conn_t));
+                if (!clients[j].ws) {
+                    break;
+                }
+            }
+            if (is_websocket) {
+                ws_conn_init(clients[j].ws);
+            }
+            
             clients[j].fd = client_fd;
-            clients[j].len = 0;
+            clients[j].is_websocket = is_websocket;
+            frame_parser_init(&clients[j].parser, FRAME_TO_SERVER);
             clients[j].addr = remote_addr;
             clients[j].has_username = 0;
+            clients[j].registering = 0;
+            clients[j].is_relay = 0;
+            clients[j].version = 1;
+            /* Browsers always get registration results */
+            clients[j].features = is_websocket ? FEATURE_ACKS : 0;
             
             char ip_str[INET_ADDRSTRLEN];
             inet_ntop(AF_INET, &remote_addr.sin_addr, ip_str, sizeof(ip_str));
-            log_message(LOG_INFO, "New client connected from %s:%d (slot %d)", 
-                       ip_str, ntohs(remote_addr.sin_port), j);
+            log_message(LOG_INFO, "New %sclient connected from %s:%d (slot %d)",
+                       is_websocket ? "WebSocket " : "", ip_str, ntohs(remote_addr.sin_port), j);
             
             added = 1;
             break;
@@ -250,6 +2114,199 @@ void accept_client(int server_fd) {
     }
 }
 
+/**
+ * @brief Accept a read-only SSE viewer
+ */
+void accept_viewer(void) {
+    int fd = accept(sse_server_fd, NULL, NULL);
+    if (fd == -1) {
+        log_message(LOG_ERROR, "Failed to accept SSE viewer: %s", strerror(errno));
+        return;
+    }
+    if (set_nonblocking(fd) == -1) {
+        close(fd);
+        return;
+    }
+    if (sse_add_viewer(&sse_hub, fd, time(NULL)) == -1) {
+        log_message(LOG_WARN, "SSE viewer limit reached, rejecting viewer");
+    }
+}
+
+/**
+ * @brief Render the metrics served on the admin port (-a)
+ */
+int render_metrics(char *out, size_t cap, void *arg) {
+    (void)arg;
+    int registered = 0;
+    for (int i = 0; i < max_clients; i++) {
+        registered += clients[i].fd != -1 && clients[i].has_username;
+    }
+    
+    int len = snprintf(out, cap,
+                       "chat_clients_registered %d\n"
+                       "chat_messages_dropped_total{reason=\"utf8\"} %llu\n"
+                       "chat_messages_dropped_total{reason=\"banned_term\"} %llu\n"
+                       "chat_signals_coalesced_total %llu\n"
+                       "chat_signals_deferred_total %llu\n"
+                       "chat_signals_expired_total %llu\n"
+                       "chat_reactions_applied_total %llu\n"
+                       "chat_reaction_updates_total %llu\n"
+                       "chat_transfer_uploads_total %llu\n"
+                       "chat_transfer_downloads_total %llu\n"
+                       "chat_transfer_bytes_total{direction=\"in\"} %llu\n"
+                       "chat_transfer_bytes_total{direction=\"out\"} %llu\n"
+                       "chat_transfer_stored_bytes %llu\n",
+                       registered, (unsigned long long)invalid_utf8_dropped,
+                       (unsigned long long)(filter_enabled ? content_filter.blocked : 0),
+                       (unsigned long long)ephemeral.coalesced,
+                       (unsigned long long)ephemeral.deferred,
+                       (unsigned long long)ephemeral.expired,
+                       (unsigned long long)reactions.applied,
+                       (unsigned long long)reactions.updates,
+                       (unsigned long long)transfer.uploads,
+                       (unsigned long long)transfer.downloads,
+                       (unsigned long long)transfer.bytes_in,
+                       (unsigned long long)transfer.bytes_out,
+                       (unsigned long long)transfer.stored_bytes);
+    if (len < 0 || (size_t)len >= cap) {
+        return -1;
+    }
+    
+    /* Each part appends to what is already rendered */
+    size_t used = (size_t)len;
+    int part = hitters_render(&sender_hitters, "chat_top_sender_messages", "sender", out + used,
+                              cap - used);
+    if (part < 0) {
+        return -1;
+    }
+    used += (size_t)part;
+    part = hitters_render(&room_hitters, "chat_top_room_deliveries", "room", out + used,
+                          cap - used);
+    if (part < 0) {
+        return -1;
+    }
+    used += (size_t)part;
+    part = qos_render(&qos, out + used, cap - used);
+    if (part < 0) {
+        return -1;
+    }
+    used += (size_t)part;
+    part = plugin_host_render_metrics(&plugin_host, out + used, cap - used);
+    return part < 0 ? -1 : (int)(used + (size_t)part);
+}
+
+/**
+ * @brief Frame parser callback: process one frame, stop if the client left
+ */
+int dispatch_frame(const uint8_t *frame, size_t len, void *arg) {
+    client_t *cli = arg;
+    process_message(cli, (const char *)frame, (ssize_t)len);
+    return cli->fd == -1;
+}
+
+/**
+ * @brief Turn a WebSocket text message into a chat frame
+ *
+ * Before registration the text is the username; afterwards it is a chat
+ * message, or a history search when it starts with "/search ".
+ */
+void handle_ws_text(client_t *cli, const uint8_t *text, size_t len) {
+    char frame[BUF_SIZE];
+    size_t pos = 0;
+    
+    if (!client_registered(cli)) {
+        if (len == 0 || len >= MAX_USERNAME_LEN) {
+            send_register_status(cli, REGISTER_INVALID);
+            return;
+        }
+        frame[pos++] = MSG_TYPE_USERNAME;
+        frame[pos++] = (char)len;
+    } else if (len > 8 && memcmp(text, "/search ", 8) == 0) {
+        frame[pos++] = MSG_TYPE_SEARCH;
+        text += 8;
+        len -= 8;
+    } else {
+        frame[pos++] = MSG_TYPE_CHAT;
+    }
+    
+    if (pos + len + 1 > sizeof(frame)) {
+        log_message(LOG_WARN, "WebSocket message too long, dropped");
+        return;
+    }
+    
+    /* A newline would end the frame early */
+    for (size_t i = 0; i < len; i++) {
+        frame[pos++] = text[i] == '\n' ? ' ' : (char)text[i];
+    }
+    frame[pos++] = '\n';
+    process_message(cli, frame, (ssize_t)pos);
+}
+
+/**
+ * @brief WebSocket decoder callback: binary messages carry protocol frames,
+ *        text messages are mapped by handle_ws_text
+ * @return Non-zero once the client is gone
+ */
+int dispatch_ws_message(uint8_t opcode, const uint8_t *payload, size_t len, void *arg) {
+    client_t *cli = arg;
+    
+    if (opcode == WS_OPCODE_BINARY) {
+        if (frame_parser_feed(&cli->parser, payload, len, dispatch_frame, cli) == -1) {
+            log_message(LOG_WARN, "Malformed frame in WebSocket message, disconnecting client");
+            remove_client(cli, 0);
+        }
+    } else if (opcode == WS_OPCODE_TEXT) {
+        handle_ws_text(cli, payload, len);
+    } else if (opcode == WS_OPCODE_PING) {
+        uint8_t header[WS_MAX_HEADER];
+        size_t header_len = ws_frame_header(header, WS_OPCODE_PONG, len);
+        ws_send(cli->fd, header, header_len, payload, len);
+    } else if (opcode == WS_OPCODE_CLOSE) {
+        /* Echo the status code, then close */
+        uint8_t header[WS_MAX_HEADER];
+        size_t echo_len = len >= 2 ? 2 : 0;
+        size_t header_len = ws_frame_header(header, WS_OPCODE_CLOSE, echo_len);
+        ws_send(cli->fd, header, header_len, payload, echo_len);
+        remove_client(cli, 0);
+    }
+    return cli->fd == -1;
+}
+
+/**
+ * @brief Handle bytes from a WebSocket client: the upgrade request first,
+ *        frames after it
+ */
+void handle_ws_data(client_t *cli, const uint8_t *data, size_t len) {
+    if (!cli->ws->open) {
+        char response[256];
+        size_t consumed;
+        int response_len = ws_handshake_feed(cli->ws, data, len, &consumed, response,
+                                             sizeof(response));
+        if (response_len == 0) {
+            return;
+        }
+        if (response_len == -1) {
+            static const char bad_request[] =
+                "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+            send_exact(cli->fd, (const uint8_t *)bad_request, sizeof(bad_request) - 1);
+            log_message(LOG_WARN, "Invalid WebSocket upgrade request, disconnecting client");
+            remove_client(cli, 0);
+            return;
+        }
+        if (send_exact(cli->fd, (const uint8_t *)response, (size_t)response_len) != response_len) {
+            remove_client(cli, 0);
+            return;
+        }
+        data += consumed;
+        len -= consumed;
+    }
+    
+    if (ws_decode(cli->ws, data, len, dispatch_ws_message, cli) == -1) {
+        log_message(LOG_WARN, "WebSocket protocol error, disconnecting client");
+        remove_client(cli, 0);
+    }
+}
+
 /**
  * @brief Handle data from a connected client
  */
@@ -259,38 +2316,14 @@ void handle_client_data(client_t *cli) {
         return;
     }
     
-    ssize_t num_read = read(cli->fd, cli->buf + cli->len, BUF_SIZE - cli->len);
+    ssize_t num_read = read(cli->fd, read_buf, sizeof(read_buf));
     
-    if (num_read > 0) {
-        cli->len += num_read;
-        
-        /* Process all complete messages in buffer */
-        while (cli->fd != -1) {  /* Check fd is still valid */
-            char *newline_ptr = memchr(cli->buf, '\n', cli->len);
-            if (newline_ptr == NULL) {
-                /* No complete message yet */
-                if (cli->len == BUF_SIZE) {
-                    /* Buffer full without newline - invalid message */
-                    log_message(LOG_WARN, "Buffer overflow, disconnecting client");
-                    remove_client(cli, 0);
-                }
-                break;
-            }
-            
-            ssize_t msg_len = (newline_ptr - cli->buf) + 1;
-            process_message(cli, msg_len);
-            
-            /* Check if client was disconnected during processing */
-            if (cli->fd == -1) {
-                break;
-            }
-            
-            /* Remove processed message from buffer */
-            int remaining = cli->len - msg_len;
-            if (remaining > 0) {
-                memmove(cli->buf, cli->buf + msg_len, remaining);
-            }
-            cli->len = remaining;
+    if (num_read > 0 && cli->is_websocket) {
+        handle_ws_data(cli, read_buf, (size_t)num_read);
+    } else if (num_read > 0) {
+        if (frame_parser_feed(&cli->parser, read_buf, (size_t)num_read, dispatch_frame, cli) == -1) {
+            log_message(LOG_WARN, "Malformed or oversized frame, disconnecting client");
+            remove_client(cli, 0);
         }
     } else if (num_read == 0) {
         /* Connection closed */
@@ -304,17 +2337,217 @@ void handle_client_data(client_t *cli) {
     }
 }
 
+/**
+ * @brief Create a listening TCP socket on all interfaces
+ */
+static int create_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        handle_error("socket");
+    }
+    
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
+        handle_error("setsockopt");
+    }
+    
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        handle_error("bind");
+    }
+    
+    if (listen(fd, LISTEN_BACKLOG) == -1) {
+        handle_error("listen");
+    }
+    return fd;
+}
+
+/**
+ * @brief Parse "ip:port" in place
+ * @return 0 on success, -1 if malformed
+ */
+static int parse_ip_port(char *arg, struct sockaddr_in *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    char *colon = strrchr(arg, ':');
+    if (!colon || atoi(colon + 1) <= 0 || atoi(colon + 1) > 65535) {
+        return -1;
+    }
+    *colon = '\0';
+    addr->sin_port = htons(atoi(colon + 1));
+    return inet_pton(AF_INET, arg, &addr->sin_addr) == 1 ? 0 : -1;
+}
+
 /**
  * @brief Main server loop
  */
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <port> <max_clients>\n", argv[0]);
+    const char *usage = "Usage: %s [-H history_dir [-r max_age_sec] [-s max_history_mb] "
+                        "[-d none|write-behind|sync]] [-w ws_port] [-e sse_port] "
+                        "[-u parent_ip:port] [-f relay_fanout] "
+                        "[-m group_ip:port [-i iface_ip]] [-F send|splice] [-b banned_terms] "
+                        "[-P plugin.so[:arg]]... [-T plugin_budget_us] [-a admin_port] "
+                        "[-x transfer_port:dir] [-Q interactive|bulk|bot:pattern]... "
+                        "<port> <max_clients>\n";
+    const char *history_dir = NULL;
+    history_retention_t retention = {0, 0};
+    int opt_char;
+    int ws_port = 0;
+    int sse_port = 0;
+    struct sockaddr_in parent_addr;
+    struct sockaddr_in mcast_group;
+    struct in_addr mcast_iface = {htonl(INADDR_ANY)};
+    fanout_mode_t fanout_mode = FANOUT_SEND;
+    const char *banned_terms = NULL;
+    const char *plugin_specs[PLUGIN_MAX];
+    int num_plugin_specs = 0;
+    long plugin_budget_us = PLUGIN_DEFAULT_BUDGET_US;
+    int admin_port = 0;
+    const char *transfer_dir = NULL;
+    const char *qos_rules[QOS_MAX_RULES];
+    int num_qos_rules = 0;
+    while ((opt_char = getopt(argc, argv, "H:r:s:d:w:e:u:f:m:i:F:b:P:T:a:x:Q:")) != -1) {
+        switch (opt_char) {
+        case 'H':
+            history_dir = optarg;
+            break;
+        case 'r':
+            retention.max_age = atoll(optarg);
+            break;
+        case 's':
+            retention.max_bytes = (uint64_t)atoll(optarg) * 1024 * 1024;
+            break;
+        case 'd':
+            if (durability_mode_parse(optarg, &durability) == -1) {
+                fprintf(stderr, "Invalid durability mode: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'w':
+            ws_port = atoi(optarg);
+            if (ws_port <= 0 || ws_port > 65535) {
+                fprintf(stderr, "Invalid WebSocket port\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'e':
+            sse_port = atoi(optarg);
+            if (sse_port <= 0 || sse_port > 65535) {
+                fprintf(stderr, "Invalid SSE port\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'u':
+            if (parse_ip_port(optarg, &parent_addr) == -1) {
+                fprintf(stderr, "Invalid parent address (expected ip:port)\n");
+                return EXIT_FAILURE;
+            }
+            relay_enabled = 1;
+            break;
+        case 'f':
+            relay_fanout = atoi(optarg);
+            if (relay_fanout <= 0) {
+                fprintf(stderr, "Invalid relay fanout\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'm':
+            if (parse_ip_port(optarg, &mcast_group) == -1 ||
+                !IN_MULTICAST(ntohl(mcast_group.sin_addr.s_addr))) {
+                fprintf(stderr, "Invalid multicast group (expected group_ip:port)\n");
+                return EXIT_FAILURE;
+            }
+            mcast_enabled = 1;
+            break;
+        case 'i':
+            if (inet_pton(AF_INET, optarg, &mcast_iface) != 1) {
+                fprintf(stderr, "Invalid multicast interface address\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'F':
+            if (fanout_mode_parse(optarg, &fanout_mode) == -1) {
+                fprintf(stderr, "Invalid fan-out strategy: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            banned_terms = optarg;
+            break;
+        case 'P':
+            if (num_plugin_specs == PLUGIN_MAX) {
+                fprintf(stderr, "At most %d plugins\n", PLUGIN_MAX);
+                return EXIT_FAILURE;
+            }
+            plugin_specs[num_plugin_specs++] = optarg;
+            break;
+        case 'T':
+            plugin_budget_us = atol(optarg);
+            if (plugin_budget_us <= 0) {
+                fprintf(stderr, "Invalid plugin budget\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'a':
+            admin_port = atoi(optarg);
+            if (admin_port <= 0 || admin_port > 65535) {
+                fprintf(stderr, "Invalid admin port\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'x': {
+            char *colon = strchr(optarg, ':');
+            int value = atoi(optarg);
+            if (!colon || colon[1] == '\0' || value <= 0 || value > 65535) {
+                fprintf(stderr, "Invalid transfer option (expected port:dir)\n");
+                return EXIT_FAILURE;
+            }
+            transfer_port = (uint16_t)value;
+            transfer_dir = colon + 1;
+            break;
+        }
+        case 'Q':
+            if (num_qos_rules == QOS_MAX_RULES) {
+                fprintf(stderr, "At most %d QoS rules\n", QOS_MAX_RULES);
+                return EXIT_FAILURE;
+            }
+            qos_rules[num_qos_rules++] = optarg;
+            break;
+        default:
+            fprintf(stderr, usage, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    
+    if (argc - optind != 2) {
+        fprintf(stderr, usage, argv[0]);
+        return EXIT_FAILURE;
+    }
+    
+    if (durability != DURABILITY_NONE && !history_dir) {
+        fprintf(stderr, "Durability mode requires -H\n");
+        return EXIT_FAILURE;
+    }
+    
+    /* History is kept where messages are ordered, at the root of the tree */
+    if (relay_enabled && history_dir) {
+        fprintf(stderr, "A relay keeps no history; use -H on the origin\n");
+        return EXIT_FAILURE;
+    }
+    
+    /* Files are shared by id, so they must all be stored in one place */
+    if (relay_enabled && transfer_dir) {
+        fprintf(stderr, "A relay stores no files; use -x on the origin\n");
         return EXIT_FAILURE;
     }
     
-    int port = atoi(argv[1]);
-    max_clients = atoi(argv[2]);
+    int port = atoi(argv[optind]);
+    max_clients = atoi(argv[optind + 1]);
     
     if (port <= 0 || port > 65535) {
         fprintf(stderr, "Invalid port number\n");
@@ -334,6 +2567,7 @@ int main(int argc, char *argv[]) {
     /* Setup signal handling */
     signal(SIGINT, handle_shutdown);
     signal(SIGTERM, handle_shutdown);
+    signal(SIGHUP, handle_reload);
     signal(SIGPIPE, SIG_IGN); /* Ignore SIGPIPE when writing to closed sockets */
     
     /* Allocate client array */
@@ -344,39 +2578,170 @@ int main(int argc, char *argv[]) {
     
     for (int i = 0; i < max_clients; i++) {
         clients[i].fd = -1;
-        clients[i].len = 0;
         clients[i].has_username = 0;
+        slotset_init(&clients[i].muted_by, (size_t)max_clients);
+        slotset_init(&clients[i].mutes, (size_t)max_clients);
     }
     
-    /* Create server socket */
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == -1) {
-        handle_error("socket");
+    /* Recipient sets are used by every broadcast, so allocate them now */
+    slotset_init(&registered_slots, (size_t)max_clients);
+    slotset_init(&filtered_slots, (size_t)max_clients);
+    if (slotset_reserve(&registered_slots) == -1 || slotset_reserve(&filtered_slots) == -1) {
+        handle_error("slotset_reserve");
     }
     
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
-        handle_error("setsockopt");
+    /* Track recent message IDs for twice as many senders as slots, so
+     * clients that reconnect keep their history for a while */
+    if (dedup_table_init(&dedup_table, (size_t)max_clients * 2) == -1) {
+        handle_error("dedup_table_init");
     }
     
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (topic_trie_init(&topic_trie, (size_t)max_clients) == -1) {
+        handle_error("topic_trie_init");
+    }
     
-    if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
-        handle_error("bind");
+    slotset_init(&signal_slots, (size_t)max_clients);
+    if (ephemeral_init(&ephemeral, (size_t)max_clients) == -1) {
+        handle_error("ephemeral_init");
     }
+    slotset_init(&reaction_slots, (size_t)max_clients);
+    reactions_init(&reactions, (size_t)max_clients);
     
-    if (listen(server_fd, LISTEN_BACKLOG) == -1) {
-        handle_error("listen");
+    qos_init(&qos, (size_t)max_clients);
+    for (int i = 0; i < num_qos_rules; i++) {
+        if (qos_add_rule(&qos, qos_rules[i]) == -1) {
+            fprintf(stderr, "Invalid QoS rule: %s (expected class:pattern)\n", qos_rules[i]);
+            return EXIT_FAILURE;
+        }
+        log_message(LOG_INFO, "Rooms %s are %s", qos.rules[i].pattern,
+                    qos_class_name(qos.rules[i].cls));
+    }
+    
+    if (banned_terms) {
+        if (content_filter_start(&content_filter, banned_terms) == -1) {
+            log_message(LOG_ERROR, "Failed to load banned terms from %s", banned_terms);
+            return EXIT_FAILURE;
+        }
+        filter_enabled = 1;
+        log_message(LOG_INFO, "Filtering %zu banned terms from %s (SIGHUP reloads)",
+                    content_filter.active->num_terms, banned_terms);
+    }
+    
+    plugin_host_init(&plugin_host, (uint64_t)plugin_budget_us * 1000);
+    for (int i = 0; i < num_plugin_specs; i++) {
+        if (plugin_host_load(&plugin_host, plugin_specs[i]) == -1) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (num_plugin_specs > 0) {
+        log_message(LOG_INFO, "Running %d plugins with a %ld us budget per call",
+                    num_plugin_specs, plugin_budget_us);
     }
     
+    /* Create server sockets */
+    server_fd = create_listener(port);
     log_message(LOG_INFO, "Server listening on port %d", port);
     
-    /* Allocate poll array (server socket + client sockets) */
-    struct pollfd *poll_fds = calloc(max_clients + 1, sizeof(struct pollfd));
+    if (ws_port) {
+        ws_server_fd = create_listener(ws_port);
+        log_message(LOG_INFO, "WebSocket listener on port %d", ws_port);
+    }
+    
+    if (sse_port) {
+        if (sse_hub_init(&sse_hub, SSE_MAX_VIEWERS) == -1) {
+            handle_error("sse_hub_init");
+        }
+        sse_server_fd = create_listener(sse_port);
+        sse_enabled = 1;
+        log_message(LOG_INFO, "SSE event stream on port %d (GET /events)", sse_port);
+    }
+    int num_viewer_slots = sse_enabled ? sse_hub.max_viewers : 0;
+    
+    if (admin_port) {
+        admin_init(&admin, create_listener(admin_port), render_metrics, NULL);
+        hitters_init(&sender_hitters);
+        hitters_init(&room_hitters);
+        hitters_decay_ms = monotonic_ms() + HITTERS_HALF_LIFE_SEC * 1000;
+        admin_enabled = 1;
+        log_message(LOG_INFO, "Admin endpoint on port %d (GET %s)", admin_port,
+                    ADMIN_METRICS_PATH);
+    }
+    
+    if (transfer_dir) {
+        if (transfer_init(&transfer, create_listener(transfer_port), transfer_dir) == -1) {
+            return EXIT_FAILURE;
+        }
+        transfer_enabled = 1;
+        log_message(LOG_INFO, "File transfers on port %d, stored in %s", transfer_port,
+                    transfer_dir);
+    }
+    
+    if (relay_enabled) {
+        if (relay_link_init(&relay_link) == -1) {
+            handle_error("relay_link_init");
+        }
+        if (relay_attach(&relay_link, &parent_addr, port) == -1) {
+            fprintf(stderr, "Failed to attach to parent\n");
+            return EXIT_FAILURE;
+        }
+    }
+    
+    if (fanout_init(&fanout, fanout_mode) == -1) {
+        handle_error("fanout_init");
+    }
+    if (fanout_mode != FANOUT_SEND) {
+        log_message(LOG_INFO, "Broadcast fan-out: %s", fanout_mode_name(fanout_mode));
+    }
+    
+    if (mcast_enabled) {
+        if (mcast_publisher_open(&mcast_pub, &mcast_group, mcast_iface) == -1) {
+            handle_error("mcast_publisher_open");
+        }
+        char group_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &mcast_group.sin_addr, group_ip, sizeof(group_ip));
+        log_message(LOG_INFO, "Publishing broadcasts to multicast group %s:%d", group_ip,
+                    ntohs(mcast_group.sin_port));
+    }
+    
+    /* Open the history log after the listener so clients can connect at
+     * once; the search index over existing history is built in the
+     * background and swapped in when ready */
+    if (history_dir) {
+        if (search_index_init(&search_index) == -1) {
+            handle_error("search_index_init");
+        }
+        if (history_open(&history, history_dir) == -1) {
+            handle_error("history_open");
+        }
+        history_enabled = 1;
+        log_message(LOG_INFO, "History enabled in %s (next sequence %llu)", history_dir,
+                    (unsigned long long)history.next_seq);
+        
+        /* Synced batches index their own messages, and nothing before */
+        if (durability == DURABILITY_SYNC) {
+            history_hold_delivery(&history);
+        }
+        if (compactor_start(&compactor, &history, &retention, COMPACT_INTERVAL_SEC,
+                            COMPACT_IO_BYTES_PER_SEC) == -1) {
+            handle_error("compactor_start");
+        }
+        compactor_enabled = 1;
+        
+        if (group_commit_start(&group_commit, &history, durability) == -1) {
+            handle_error("group_commit_start");
+        }
+        log_message(LOG_INFO, "History durability: %s", durability_mode_name(durability));
+    }
+    
+    /* Allocate poll array (server socket + client sockets + sync notifications
+     * + WebSocket listener + SSE listener + parent link + admin listener
+     * + transfer listener + admin connections + transfer connections
+     * + SSE viewers) */
+    int admin_base = max_clients + 7;
+    int transfer_base = admin_base + ADMIN_MAX_CONNS;
+    int viewer_base = transfer_base + TRANSFER_MAX_CONNS;
+    int num_poll_fds = viewer_base + num_viewer_slots;
+    struct pollfd *poll_fds = calloc(num_poll_fds, sizeof(struct pollfd));
     if (!poll_fds) {
         handle_error("calloc poll_fds");
     }
@@ -390,14 +2755,118 @@ int main(int argc, char *argv[]) {
         poll_fds[i + 1].events = POLLIN;
     }
     
+    poll_fds[max_clients + 1].fd = history_enabled ? group_commit_fd(&group_commit) : -1;
+    poll_fds[max_clients + 1].events = POLLIN;
+    poll_fds[max_clients + 2].fd = ws_server_fd;
+    poll_fds[max_clients + 2].events = POLLIN;
+    poll_fds[max_clients + 3].fd = sse_server_fd;
+    poll_fds[max_clients + 3].events = POLLIN;
+    poll_fds[max_clients + 4].fd = relay_enabled ? relay_link.fd : -1;
+    poll_fds[max_clients + 4].events = POLLIN;
+    poll_fds[max_clients + 5].fd = admin_enabled ? admin.listen_fd : -1;
+    poll_fds[max_clients + 5].events = POLLIN;
+    poll_fds[max_clients + 6].fd = transfer_enabled ? transfer.listen_fd : -1;
+    poll_fds[max_clients + 6].events = POLLIN;
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        poll_fds[admin_base + i].fd = -1;
+    }
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        poll_fds[transfer_base + i].fd = -1;
+    }
+    for (int i = 0; i < num_viewer_slots; i++) {
+        poll_fds[viewer_base + i].events = POLLIN;
+    }
+    
     /* Main event loop */
     while (server_running) {
         /* Update poll array with current client sockets */
         for (int i = 0; i < max_clients; i++) {
             poll_fds[i + 1].fd = clients[i].fd;
         }
+        for (int i = 0; i < num_viewer_slots; i++) {
+            poll_fds[viewer_base + i].fd = sse_hub.viewers[i].fd;
+        }
+        for (int i = 0; admin_enabled && i < ADMIN_MAX_CONNS; i++) {
+            poll_fds[admin_base + i].fd = admin.conns[i].fd;
+            poll_fds[admin_base + i].events = admin_poll_events(&admin, i);
+        }
+        for (int i = 0; transfer_enabled && i < TRANSFER_MAX_CONNS; i++) {
+            poll_fds[transfer_base + i].fd = transfer.conns[i].fd;
+            poll_fds[transfer_base + i].events = transfer_poll_events(&transfer, i);
+        }
+        
+        /* Wake up when the open commit window closes */
+        int timeout_ms = 1000;
+        if (durability == DURABILITY_SYNC) {
+            start_commit_if_due();
+            if (!commit_in_flight && pending_batch.len > 0) {
+                int64_t wait_ms = commit_deadline_ms - monotonic_ms();
+                timeout_ms = wait_ms > 0 ? (int)wait_ms : 0;
+            }
+        }
+        /* ... and when signals or reaction counts are due to go out */
+        int64_t signal_wait_ms = ephemeral_wait_ms(&ephemeral, monotonic_ms());
+        if (signal_wait_ms >= 0 && signal_wait_ms < timeout_ms) {
+            timeout_ms = (int)signal_wait_ms;
+        }
+        int64_t reaction_wait_ms = reactions_wait_ms(&reactions, monotonic_ms());
+        if (reaction_wait_ms >= 0 && reaction_wait_ms < timeout_ms) {
+            timeout_ms = (int)reaction_wait_ms;
+        }
+        /* ... and right away while bulk or bot frames are queued, or soon
+         * if they are all waiting for busy sockets to drain */
+        if (qos_pending(&qos)) {
+            int qos_wait_ms = qos_stalled ? QOS_RETRY_MS : 0;
+            if (qos_wait_ms < timeout_ms) {
+                timeout_ms = qos_wait_ms;
+            }
+        }
         
-        int num_ready = poll(poll_fds, max_clients + 1, 1000);
+        int num_ready = poll(poll_fds, num_poll_fds, timeout_ms);
+        
+        /* Reload the banned terms in the background; the new automaton is
+         * swapped in between messages once it is compiled */
+        if (filter_enabled) {
+            if (filter_reload_pending) {
+                filter_reload_pending = 0;
+                content_filter_reload(&content_filter);
+            }
+            content_filter_poll(&content_filter);
+        }
+        /* Pick up a search index rebuilt by the compactor */
+        if (compactor_enabled) {
+            compactor_poll(&compactor, install_rebuilt_index, NULL);
+        }
+        if (sse_enabled) {
+            sse_keepalive(&sse_hub, time(NULL));
+            sse_sweep(&sse_hub, time(NULL));
+        }
+        if (mcast_enabled) {
+            mcast_heartbeat(&mcast_pub, monotonic_ms());
+        }
+        /* Let old traffic fade from the heavy-hitter counts */
+        if (admin_enabled && monotonic_ms() >= hitters_decay_ms) {
+            hitters_decay(&sender_hitters);
+            hitters_decay(&room_hitters);
+            hitters_decay_ms += HITTERS_HALF_LIFE_SEC * 1000;
+        }
+        if (ephemeral_wait_ms(&ephemeral, monotonic_ms()) == 0) {
+            ephemeral_flush(&ephemeral, monotonic_ms(), &signal_sink);
+        }
+        if (reactions_wait_ms(&reactions, monotonic_ms()) == 0) {
+            flush_reactions();
+        }
+        /* A bounded share of queued room traffic per pass; input from
+         * people is read again before the next share */
+        if (qos_pending(&qos)) {
+            qos_stalled = qos_flush(&qos, QOS_PASS_BYTES, &qos_sink) == 0;
+        }
+        if (transfer_enabled) {
+            transfer_sweep(&transfer, monotonic_ms());
+        }
+        if (admin_enabled) {
+            admin_sweep(&admin, monotonic_ms());
+        }
         
         if (num_ready == -1) {
             if (errno == EINTR) {
@@ -411,9 +2880,52 @@ int main(int argc, char *argv[]) {
             continue;
         }
         
+        /* Broadcast the batch whose sync just completed */
+        if (poll_fds[max_clients + 1].revents & POLLIN) {
+            finish_commit();
+        }
+        
         /* Check server socket for new connections */
         if (poll_fds[0].revents & POLLIN) {
-            accept_client(server_fd);
+            accept_client(server_fd, 0);
+        }
+        if (poll_fds[max_clients + 2].revents & POLLIN) {
+            accept_client(ws_server_fd, 1);
+        }
+        if (poll_fds[max_clients + 3].revents & POLLIN) {
+            accept_viewer();
+        }
+        if (poll_fds[max_clients + 4].revents & (POLLIN | POLLHUP | POLLERR)) {
+            handle_upstream_data();
+        }
+        if (poll_fds[max_clients + 5].revents & POLLIN) {
+            admin_accept(&admin, monotonic_ms());
+        }
+        for (int i = 0; admin_enabled && i < ADMIN_MAX_CONNS; i++) {
+            if (poll_fds[admin_base + i].revents && admin.conns[i].fd != -1) {
+                admin_handle_events(&admin, i, poll_fds[admin_base + i].revents,
+                                    monotonic_ms());
+            }
+        }
+        
+        /* Each transfer moves at most one chunk per pass, so chat below
+         * waits for no file */
+        if (poll_fds[max_clients + 6].revents & POLLIN) {
+            transfer_accept(&transfer, monotonic_ms());
+        }
+        for (int i = 0; transfer_enabled && i < TRANSFER_MAX_CONNS; i++) {
+            if (poll_fds[transfer_base + i].revents && transfer.conns[i].fd != -1) {
+                transfer_handle_events(&transfer, i, poll_fds[transfer_base + i].revents,
+                                       monotonic_ms());
+            }
+        }
+        
+        /* Viewers only send their request; afterwards input means hangup */
+        for (int i = 0; i < num_viewer_slots; i++) {
+            if ((poll_fds[viewer_base + i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+                sse_hub.viewers[i].fd != -1) {
+                sse_handle_input(&sse_hub, i);
+            }
         }
         
         /* Check client sockets for data */
@@ -428,16 +2940,86 @@ int main(int argc, char *argv[]) {
     
     /* Cleanup */
     log_message(LOG_INFO, "Shutting down server");
+    if (durability == DURABILITY_SYNC) {
+        drain_commits();
+    }
     
     for (int i = 0; i < max_clients; i++) {
         if (clients[i].fd != -1) {
             close(clients[i].fd);
         }
+        free(clients[i].sessions);
+        free(clients[i].ws);
+        slotset_free(&clients[i].muted_by);
+        slotset_free(&clients[i].mutes);
     }
+    slotset_free(&registered_slots);
+    slotset_free(&filtered_slots);
+    slotset_free(&signal_slots);
+    ephemeral_free(&ephemeral);
+    slotset_free(&reaction_slots);
+    reactions_free(&reactions);
+    qos_free(&qos);
     
     close(server_fd);
+    if (ws_server_fd != -1) {
+        close(ws_server_fd);
+    }
+    if (sse_enabled) {
+        close(sse_server_fd);
+        sse_hub_free(&sse_hub);
+    }
+    if (admin_enabled) {
+        admin_close(&admin);
+    }
+    if (transfer_enabled) {
+        transfer_close(&transfer);
+    }
+    plugin_host_free(&plugin_host);
+    if (relay_enabled) {
+        relay_link_free(&relay_link);
+        free(relay_batch.data);
+    }
+    if (mcast_enabled) {
+        mcast_publisher_close(&mcast_pub);
+    }
+    if (fanout_mode == FANOUT_SPLICE) {
+        log_message(LOG_INFO, "Fan-out: %llu sends spliced, %llu fell back to send()",
+                    (unsigned long long)fanout.spliced, (unsigned long long)fanout.fallbacks);
+    }
+    fanout_free(&fanout);
     free(clients);
     free(poll_fds);
+    dedup_table_free(&dedup_table);
+    if (topic_trie.hits + topic_trie.misses > 0) {
+        log_message(LOG_INFO, "Topics: %llu publishes resolved from cache, %llu from the trie",
+                    (unsigned long long)topic_trie.hits, (unsigned long long)topic_trie.misses);
+    }
+    topic_trie_free(&topic_trie);
+    if (invalid_utf8_dropped > 0) {
+        log_message(LOG_INFO, "Dropped %llu messages with invalid UTF-8",
+                    (unsigned long long)invalid_utf8_dropped);
+    }
+    if (filter_enabled) {
+        log_message(LOG_INFO, "Content filter: %llu of %llu messages dropped",
+                    (unsigned long long)content_filter.blocked,
+                    (unsigned long long)content_filter.checked);
+        content_filter_stop(&content_filter);
+    }
+    if (compactor_enabled) {
+        compactor_stop(&compactor);
+    }
+    if (history_enabled) {
+        group_commit_stop(&group_commit);
+        free(pending_batch.data);
+        free(committing_batch.data);
+        free(pending_batch.filtered);
+        free(committing_batch.filtered);
+        free(pending_batch.senders);
+        free(committing_batch.senders);
+        history_close(&history);
+        search_index_free(&search_index);
+    }
     log_close();
     
     return EXIT_SUCCESS;
@@ -0,0 +1,125 @@
+/**
+ * @file slotset.c
+ * @brief Implementation of bitmap slot sets
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "slotset.h"
+#include <stdlib.h>
+#include <string.h>
+
+void slotset_init(slotset_t *set, size_t num_slots) {
+    set->words = NULL;
+    set->num_slots = num_slots;
+    set->num_words = (num_slots + 63) / 64;
+}
+
+void slotset_free(slotset_t *set) {
+    free(set->words);
+    set->words = NULL;
+}
+
+int slotset_reserve(slotset_t *set) {
+    if (!set->words) {
+        set->words = calloc(set->num_words ? set->num_words : 1, sizeof(uint64_t));
+    }
+    return set->words ? 0 : -1;
+}
+
+int slotset_add(slotset_t *set, size_t slot) {
+    if (slot >= set->num_slots || slotset_reserve(set) == -1) {
+        return -1;
+    }
+    set->words[slot / 64] |= (uint64_t)1 << (slot % 64);
+    return 0;
+}
+
+void slotset_remove(slotset_t *set, size_t slot) {
+    if (set->words && slot < set->num_slots) {
+        set->words[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    }
+}
+
+int slotset_empty(const slotset_t *set) {
+    if (!set->words) {
+        return 1;
+    }
+    uint64_t any = 0;
+    for (size_t i = 0; i < set->num_words; i++) {
+        any |= set->words[i];
+    }
+    return any == 0;
+}
+
+size_t slotset_count(const slotset_t *set) {
+    size_t count = 0;
+    for (size_t i = 0; set->words && i < set->num_words; i++) {
+        count += (size_t)__builtin_popcountll(set->words[i]);
+    }
+    return count;
+}
+
+void slotset_clear(slotset_t *set) {
+    if (set->words) {
+        memset(set->words, 0, set->num_words * sizeof(uint64_t));
+    }
+}
+
+int slotset_andnot(slotset_t *out, const slotset_t *a, const slotset_t *b) {
+    if (!a->words) {
+        slotset_clear(out);
+        return 0;
+    }
+    if (slotset_reserve(out) == -1) {
+        return -1;
+    }
+
+    /* Word loops without branches are vectorized by the compiler */
+    uint64_t *restrict dst = out->words;
+    const uint64_t *src = a->words;
+    if (!b->words) {
+        if (dst != src) {
+            memcpy(dst, src, out->num_words * sizeof(uint64_t));
+        }
+        return 0;
+    }
+    const uint64_t *mask = b->words;
+    for (size_t i = 0; i < out->num_words; i++) {
+        dst[i] = src[i] & ~mask[i];
+    }
+    return 0;
+}
+
+int slotset_or(slotset_t *out, const slotset_t *a) {
+    if (!a->words) {
+        return 0;
+    }
+    if (slotset_reserve(out) == -1) {
+        return -1;
+    }
+    for (size_t i = 0; i < out->num_words; i++) {
+        out->words[i] |= a->words[i];
+    }
+    return 0;
+}
+
+long slotset_next(const slotset_t *set, size_t from) {
+    if (!set->words || from >= set->num_slots) {
+        return -1;
+    }
+
+    size_t i = from / 64;
+    uint64_t word = set->words[i] & (~(uint64_t)0 << (from % 64));
+    for (;;) {
+        if (word) {
+            size_t slot = i * 64 + (size_t)__builtin_ctzll(word);
+            return slot < set->num_slots ? (long)slot : -1;
+        }
+        if (++i == set->num_words) {
+            return -1;
+        }
+        word = set->words[i];
+    }
+}
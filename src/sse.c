@@ -0,0 +1,308 @@
+/**
+ * @file sse.c
+ * @brief Implementation of the Server-Sent Events stream
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "sse.h"
+#include "common.h"
+#include "frame_parser.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Room reserved per frame when rendering: every text byte may become \u00XX */
+#define SSE_EVENT_MAX (6 * BUF_SIZE + 256)
+
+static const char sse_headers[] = "HTTP/1.1 200 OK\r\n"
+                                  "Content-Type: text/event-stream\r\n"
+                                  "Cache-Control: no-cache\r\n"
+                                  "Connection: keep-alive\r\n"
+                                  "Access-Control-Allow-Origin: *\r\n"
+                                  "\r\n"
+                                  "retry: 3000\n\n";
+
+static const char sse_not_found[] = "HTTP/1.1 404 Not Found\r\n"
+                                    "Content-Length: 0\r\n"
+                                    "Connection: close\r\n"
+                                    "\r\n";
+
+static const char sse_keepalive_comment[] = ": keepalive\n\n";
+
+int sse_hub_init(sse_hub_t *hub, int max_viewers) {
+    if (!hub || max_viewers <= 0) {
+        return -1;
+    }
+
+    memset(hub, 0, sizeof(*hub));
+    hub->viewers = calloc((size_t)max_viewers, sizeof(sse_viewer_t));
+    hub->events_cap = SSE_EVENT_MAX;
+    hub->events = malloc(hub->events_cap);
+    if (!hub->viewers || !hub->events) {
+        free(hub->viewers);
+        free(hub->events);
+        return -1;
+    }
+    for (int i = 0; i < max_viewers; i++) {
+        hub->viewers[i].fd = -1;
+    }
+    hub->max_viewers = max_viewers;
+    hub->last_write = time(NULL);
+    return 0;
+}
+
+void sse_hub_free(sse_hub_t *hub) {
+    for (int i = 0; i < hub->max_viewers; i++) {
+        if (hub->viewers[i].fd != -1) {
+            close(hub->viewers[i].fd);
+        }
+    }
+    free(hub->viewers);
+    free(hub->events);
+    hub->viewers = NULL;
+    hub->events = NULL;
+    hub->max_viewers = 0;
+    hub->num_viewers = 0;
+    hub->num_pending = 0;
+}
+
+static void close_viewer(sse_hub_t *hub, sse_viewer_t *viewer) {
+    close(viewer->fd);
+    viewer->fd = -1;
+    hub->num_viewers--;
+    if (!viewer->streaming) {
+        hub->num_pending--;
+    }
+}
+
+int sse_add_viewer(sse_hub_t *hub, int fd, time_t now) {
+    for (int i = 0; i < hub->max_viewers; i++) {
+        if (hub->viewers[i].fd == -1) {
+            memset(&hub->viewers[i], 0, sizeof(sse_viewer_t));
+            hub->viewers[i].fd = fd;
+            hub->viewers[i].accepted = now;
+            hub->num_viewers++;
+            hub->num_pending++;
+            return i;
+        }
+    }
+    close(fd);
+    return -1;
+}
+
+int sse_request_feed(sse_viewer_t *viewer, const uint8_t *data, size_t len) {
+    static const char prefix[] = SSE_REQUEST_PREFIX;
+    static const char end[] = "\r\n\r\n";
+
+    for (size_t i = 0; i < len; i++) {
+        char c = (char)data[i];
+        if (++viewer->request_len >= SSE_MAX_REQUEST) {
+            return -1;
+        }
+
+        /* "GET /events" followed by the end of the path or a query */
+        if (!viewer->path_ok) {
+            if (viewer->path_match < sizeof(prefix) - 1) {
+                if (c != prefix[viewer->path_match++]) {
+                    return -1;
+                }
+                continue;
+            }
+            if (c != ' ' && c != '?') {
+                return -1;
+            }
+            viewer->path_ok = 1;
+        }
+
+        if (c == end[viewer->end_match]) {
+            viewer->end_match++;
+        } else {
+            viewer->end_match = c == '\r' ? 1 : 0;
+        }
+        if (viewer->end_match == sizeof(end) - 1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void sse_handle_input(sse_hub_t *hub, int index) {
+    sse_viewer_t *viewer = &hub->viewers[index];
+    uint8_t buf[1024];
+
+    ssize_t n = read(viewer->fd, buf, sizeof(buf));
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        close_viewer(hub, viewer);
+        return;
+    }
+    if (viewer->streaming) {
+        return;
+    }
+
+    int rc = sse_request_feed(viewer, buf, (size_t)n);
+    if (rc == -1) {
+        send_exact(viewer->fd, (const uint8_t *)sse_not_found, sizeof(sse_not_found) - 1);
+        close_viewer(hub, viewer);
+    } else if (rc == 1) {
+        if (send_exact(viewer->fd, (const uint8_t *)sse_headers, sizeof(sse_headers) - 1) !=
+            (ssize_t)(sizeof(sse_headers) - 1)) {
+            close_viewer(hub, viewer);
+            return;
+        }
+        viewer->streaming = 1;
+        hub->num_pending--;
+        log_message(LOG_INFO, "SSE viewer attached (%d viewers)", hub->num_viewers);
+    }
+}
+
+/* Append a JSON string literal, escaping quotes, backslashes and controls */
+static size_t json_string(char *out, const char *str, size_t len) {
+    size_t o = 0;
+    out[o++] = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\') {
+            out[o++] = '\\';
+            out[o++] = (char)c;
+        } else if (c < 0x20) {
+            o += (size_t)sprintf(out + o, "\\u%04x", c);
+        } else {
+            out[o++] = (char)c;
+        }
+    }
+    out[o++] = '"';
+    return o;
+}
+
+int sse_render_frame(const uint8_t *frame, size_t len, char *out, size_t cap) {
+    const char *event;
+    switch (frame[0]) {
+    case MSG_TYPE_CHAT:
+        event = "chat";
+        break;
+    case MSG_TYPE_JOIN:
+        event = "join";
+        break;
+    case MSG_TYPE_DISCONNECT:
+        event = "leave";
+        break;
+    default:
+        return 0;
+    }
+
+    peer_frame_t peer;
+    if (decode_peer_frame(frame, len, &peer) == -1) {
+        return -1;
+    }
+
+    /* Worst case: every username and text byte escaped as \u00XX */
+    size_t worst = 96 + 6 * ((size_t)peer.username_len + peer.payload_len);
+    if (worst > cap) {
+        return -1;
+    }
+
+    struct in_addr addr;
+    addr.s_addr = peer.ip;
+    char ip_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr, ip_str, sizeof(ip_str));
+
+    size_t o = (size_t)sprintf(out, "event: %s\ndata: {\"user\":", event);
+    o += json_string(out + o, peer.username, peer.username_len);
+    o += (size_t)sprintf(out + o, ",\"addr\":\"%s:%u\"", ip_str, ntohs(peer.port));
+    if (frame[0] == MSG_TYPE_CHAT) {
+        o += (size_t)sprintf(out + o, ",\"text\":");
+        o += json_string(out + o, peer.payload, peer.payload_len);
+    }
+    o += (size_t)sprintf(out + o, "}\n\n");
+    return (int)o;
+}
+
+/* Rendering state for one broadcast */
+typedef struct {
+    sse_hub_t *hub;
+    size_t len;
+} render_ctx_t;
+
+static int render_one(const uint8_t *frame, size_t len, void *arg) {
+    render_ctx_t *ctx = arg;
+    sse_hub_t *hub = ctx->hub;
+
+    if (hub->events_cap - ctx->len < SSE_EVENT_MAX) {
+        char *events = realloc(hub->events, hub->events_cap * 2);
+        if (!events) {
+            return 1;
+        }
+        hub->events = events;
+        hub->events_cap *= 2;
+    }
+
+    int n = sse_render_frame(frame, len, hub->events + ctx->len, hub->events_cap - ctx->len);
+    if (n > 0) {
+        ctx->len += (size_t)n;
+    }
+    return 0;
+}
+
+void sse_broadcast(sse_hub_t *hub, const uint8_t *frames, size_t len) {
+    if (hub->num_viewers == 0) {
+        return;
+    }
+
+    /* Render once for all viewers */
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    render_ctx_t ctx = {hub, 0};
+    frame_parser_feed(&parser, frames, len, render_one, &ctx);
+    if (ctx.len == 0) {
+        return;
+    }
+
+    for (int i = 0; i < hub->max_viewers; i++) {
+        sse_viewer_t *viewer = &hub->viewers[i];
+        if (viewer->fd == -1 || !viewer->streaming) {
+            continue;
+        }
+        /* A partial write would corrupt the stream, so slow viewers go */
+        if (send_exact(viewer->fd, (const uint8_t *)hub->events, ctx.len) != (ssize_t)ctx.len) {
+            log_message(LOG_WARN, "Dropping SSE viewer that fell behind");
+            close_viewer(hub, viewer);
+        }
+    }
+    hub->last_write = time(NULL);
+}
+
+void sse_keepalive(sse_hub_t *hub, time_t now) {
+    if (hub->num_viewers == 0 || now - hub->last_write < SSE_KEEPALIVE_SEC) {
+        return;
+    }
+
+    for (int i = 0; i < hub->max_viewers; i++) {
+        sse_viewer_t *viewer = &hub->viewers[i];
+        if (viewer->fd != -1 && viewer->streaming &&
+            send_exact(viewer->fd, (const uint8_t *)sse_keepalive_comment,
+                       sizeof(sse_keepalive_comment) - 1) == -1) {
+            close_viewer(hub, viewer);
+        }
+    }
+    hub->last_write = now;
+}
+
+void sse_sweep(sse_hub_t *hub, time_t now) {
+    for (int i = 0; hub->num_pending > 0 && i < hub->max_viewers; i++) {
+        sse_viewer_t *viewer = &hub->viewers[i];
+        if (viewer->fd != -1 && !viewer->streaming &&
+            now - viewer->accepted >= SSE_REQUEST_TIMEOUT_SEC) {
+            log_message(LOG_INFO, "Closing SSE viewer that sent no complete request");
+            close_viewer(hub, viewer);
+        }
+    }
+}
@@ -0,0 +1,372 @@
+/**
+ * @file subscriber.c
+ * @brief Read-only chat subscriber fed by UDP multicast
+ *
+ * The subscriber connects to a server started with -m, negotiates
+ * FEATURE_MULTICAST and never registers a username. Broadcasts arrive on
+ * the multicast group; the TCP connection is used only to ask for missing
+ * packets (NAK) and to receive them back (REPAIR). Messages are logged in
+ * the same format as the batch client.
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "common.h"
+#include "frame_parser.h"
+#include "multicast.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Bytes requested from the socket per recv() call */
+#define RECV_CHUNK_SIZE 4096
+
+/* Poll timeout, bounding how late a NAK is sent */
+#define POLL_TIMEOUT_MS 100
+
+/* Subscriber state */
+typedef struct {
+    int socket_fd;
+    FILE *log_file;
+    int negotiated;             /* Whether the server's HELLO has been seen */
+    mcast_subscriber_t sub;     /* fd is -1 until MCAST_INFO arrives */
+    unsigned drop_every;
+
+    /* Repair being collected: its frames follow the REPAIR header */
+    int repairing;
+    uint64_t repair_seq;
+    size_t repair_len;
+    size_t repair_got;
+    uint8_t repair_buf[MCAST_MAX_PACKET];
+} subscriber_t;
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_shutdown(int signum) {
+    (void)signum;
+    running = 0;
+}
+
+/**
+ * @brief Milliseconds on the monotonic clock
+ */
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Extract printable username and address from a peer frame
+ */
+static void peer_names(const peer_frame_t *peer, char *username, char *ip_str) {
+    if (peer->username_len > 0 && peer->username_len < MAX_USERNAME_LEN) {
+        memcpy(username, peer->username, peer->username_len);
+        username[peer->username_len] = '\0';
+    } else {
+        strcpy(username, "unknown");
+    }
+
+    struct in_addr addr;
+    addr.s_addr = peer->ip;
+    inet_ntop(AF_INET, &addr, ip_str, INET_ADDRSTRLEN);
+}
+
+/**
+ * @brief Frame parser callback - logs one broadcast frame
+ */
+static int log_frame(const uint8_t *frame, size_t len, void *arg) {
+    subscriber_t *s = arg;
+    uint8_t type = frame[0];
+    peer_frame_t peer;
+    if ((type != MSG_TYPE_CHAT && type != MSG_TYPE_JOIN && type != MSG_TYPE_DISCONNECT) ||
+        decode_peer_frame(frame, len, &peer) != 0) {
+        log_message(LOG_WARN, "Unexpected multicast frame type: %u", type);
+        return 0;
+    }
+
+    char username[MAX_USERNAME_LEN];
+    char ip_str[INET_ADDRSTRLEN];
+    peer_names(&peer, username, ip_str);
+    uint16_t port_host = ntohs(peer.port);
+
+    if (type == MSG_TYPE_CHAT) {
+        fprintf(s->log_file, "[%s@%s:%u] %.*s\n",
+                username, ip_str, port_host, (int)peer.payload_len, peer.payload);
+    } else if (type == MSG_TYPE_JOIN) {
+        fprintf(s->log_file, "*** %s joined the chat from %s:%u ***\n",
+                username, ip_str, port_host);
+    } else {
+        fprintf(s->log_file, "*** %s left the chat from %s:%u ***\n",
+                username, ip_str, port_host);
+    }
+    return 0;
+}
+
+/**
+ * @brief Delivery callback - logs the frames of one packet, in order
+ */
+static int deliver_packet(const uint8_t *frames, size_t len, void *arg) {
+    subscriber_t *s = arg;
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    if (frame_parser_feed(&parser, frames, len, log_frame, s) != 0) {
+        log_message(LOG_WARN, "Malformed multicast packet");
+    }
+    fflush(s->log_file);
+    return 0;
+}
+
+/**
+ * @brief Join the group announced by MCAST_INFO
+ *
+ * [MCAST_INFO][group ip:4][port:2][next seq:8]\n. The group is joined on the
+ * interface that carries the TCP connection.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int join_group(subscriber_t *s, const uint8_t *frame) {
+    struct sockaddr_in group;
+    memset(&group, 0, sizeof(group));
+    group.sin_family = AF_INET;
+    memcpy(&group.sin_addr.s_addr, frame + 1, 4);
+    memcpy(&group.sin_port, frame + 5, 2);
+    uint64_t next_seq = 0;
+    for (int i = 0; i < 8; i++) {
+        next_seq = (next_seq << 8) | frame[7 + i];
+    }
+
+    struct sockaddr_in local;
+    socklen_t local_len = sizeof(local);
+    if (getsockname(s->socket_fd, (struct sockaddr *)&local, &local_len) == -1 ||
+        mcast_subscriber_open(&s->sub, &group, local.sin_addr, next_seq) == -1) {
+        log_message(LOG_ERROR, "Failed to join multicast group");
+        return -1;
+    }
+    s->sub.drop_every = s->drop_every;
+
+    char group_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &group.sin_addr, group_ip, sizeof(group_ip));
+    log_message(LOG_INFO, "Joined multicast group %s:%u at packet %llu", group_ip,
+                ntohs(group.sin_port), (unsigned long long)next_seq);
+    return 0;
+}
+
+/**
+ * @brief Frame parser callback - handles one frame from the TCP connection
+ * @return 0 to keep reading, 1 to stop
+ */
+static int handle_frame(const uint8_t *frame, size_t len, void *arg) {
+    subscriber_t *s = arg;
+    uint8_t type = frame[0];
+
+    /* Frames of a repair, collected until its length is reached */
+    if (s->repairing) {
+        if (s->repair_got + len > s->repair_len) {
+            log_message(LOG_ERROR, "Repair longer than announced");
+            return 1;
+        }
+        memcpy(s->repair_buf + s->repair_got, frame, len);
+        s->repair_got += len;
+        if (s->repair_got == s->repair_len) {
+            s->repairing = 0;
+            mcast_accept(&s->sub, s->repair_seq, s->repair_buf, s->repair_len,
+                         deliver_packet, s);
+        }
+        return 0;
+    }
+
+    if (!s->negotiated) {
+        /* Server HELLO: [type][version][features:4]\n */
+        uint32_t features_net = 0;
+        if (type == MSG_TYPE_HELLO && len == HELLO_SERVER_LEN) {
+            memcpy(&features_net, frame + 2, 4);
+        }
+        if (!(ntohl(features_net) & FEATURE_MULTICAST)) {
+            log_message(LOG_ERROR, "Server does not publish to a multicast group");
+            return 1;
+        }
+        s->negotiated = 1;
+    } else if (type == MSG_TYPE_MCAST_INFO && s->sub.fd == -1) {
+        return join_group(s, frame) == 0 ? 0 : 1;
+    } else if (type == MSG_TYPE_REPAIR && s->sub.fd != -1) {
+        /* [REPAIR][seq:8][len:2]\n, then len bytes of frames */
+        uint64_t seq = 0;
+        for (int i = 0; i < 8; i++) {
+            seq = (seq << 8) | frame[1 + i];
+        }
+        size_t repair_len = ((size_t)frame[9] << 8) | frame[10];
+        if (repair_len == 0) {
+            log_message(LOG_WARN, "Packet %llu is lost", (unsigned long long)seq);
+            mcast_accept(&s->sub, seq, NULL, 0, deliver_packet, s);
+        } else if (repair_len > sizeof(s->repair_buf)) {
+            log_message(LOG_ERROR, "Repair too long");
+            return 1;
+        } else {
+            s->repairing = 1;
+            s->repair_seq = seq;
+            s->repair_len = repair_len;
+            s->repair_got = 0;
+        }
+    } else {
+        log_message(LOG_WARN, "Unknown message type: %u", type);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Ask for missing packets if a gap is due for a NAK
+ * @return 0 on success, -1 if the connection failed
+ */
+static int send_nak(subscriber_t *s) {
+    uint64_t first;
+    uint32_t count;
+    if (s->sub.fd == -1 || !mcast_next_nak(&s->sub, monotonic_ms(), &first, &count)) {
+        return 0;
+    }
+
+    /* [NAK][16 hex first seq][4 hex count]\n */
+    uint8_t nak[NAK_LEN + 1];
+    nak[0] = MSG_TYPE_NAK;
+    snprintf((char *)nak + 1, sizeof(nak) - 1, "%016llx%04x", (unsigned long long)first, count);
+    nak[NAK_LEN - 1] = '\n';
+    log_message(LOG_DEBUG, "NAK %u packets from %llu", count, (unsigned long long)first);
+    return send_exact(s->socket_fd, nak, NAK_LEN) == NAK_LEN ? 0 : -1;
+}
+
+/**
+ * @brief Main subscriber function
+ */
+int main(int argc, char *argv[]) {
+    const char *usage = "Usage: %s [-l drop_every] <IP> <port> <log_file>\n";
+    unsigned drop_every = 0;
+    int opt_char;
+    while ((opt_char = getopt(argc, argv, "l:")) != -1) {
+        if (opt_char != 'l') {
+            fprintf(stderr, usage, argv[0]);
+            return EXIT_FAILURE;
+        }
+        drop_every = (unsigned)atoi(optarg);
+    }
+    if (argc - optind != 3) {
+        fprintf(stderr, usage, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char *ip_addr = argv[optind];
+    int port = atoi(argv[optind + 1]);
+    char *log_file_path = argv[optind + 2];
+
+    log_init(NULL, LOG_INFO);
+    signal(SIGINT, handle_shutdown);
+    signal(SIGTERM, handle_shutdown);
+    signal(SIGPIPE, SIG_IGN);
+
+    FILE *log_file = fopen(log_file_path, "w");
+    if (log_file == NULL) {
+        handle_error("fopen");
+    }
+
+    int sfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sfd == -1) {
+        fclose(log_file);
+        handle_error("socket");
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip_addr, &addr.sin_addr) <= 0) {
+        close(sfd);
+        fclose(log_file);
+        handle_error("inet_pton");
+    }
+    if (connect(sfd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(sfd);
+        fclose(log_file);
+        handle_error("connect");
+    }
+
+    /* Ask for multicast only; no username is ever registered */
+    uint8_t hello[HELLO_CLIENT_LEN + 1];
+    int hello_len = encode_client_hello(hello, FEATURE_MULTICAST);
+    if (send_exact(sfd, hello, (size_t)hello_len) != hello_len) {
+        close(sfd);
+        fclose(log_file);
+        handle_error("send");
+    }
+    log_message(LOG_INFO, "Subscribed to %s:%d", ip_addr, port);
+
+    subscriber_t s;
+    memset(&s, 0, sizeof(s));
+    s.socket_fd = sfd;
+    s.log_file = log_file;
+    s.sub.fd = -1;
+    s.drop_every = drop_every;
+
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    uint8_t chunk[RECV_CHUNK_SIZE];
+
+    while (running) {
+        struct pollfd fds[2] = {{sfd, POLLIN, 0}, {s.sub.fd, POLLIN, 0}};
+        if (poll(fds, 2, POLL_TIMEOUT_MS) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_message(LOG_ERROR, "poll failed");
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            if (mcast_receive(&s.sub, deliver_packet, &s) == -1) {
+                log_message(LOG_ERROR, "Multicast receive failed");
+                break;
+            }
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t r = recv(sfd, chunk, sizeof(chunk), 0);
+            if (r == -1 && errno == EINTR) {
+                continue;
+            }
+            if (r <= 0) {
+                log_message(LOG_INFO, "Server closed connection");
+                break;
+            }
+            int rc = frame_parser_feed(&parser, chunk, (size_t)r, handle_frame, &s);
+            if (rc == -1) {
+                log_message(LOG_WARN, "Malformed frame from server");
+            }
+            if (rc != 0) {
+                break;
+            }
+        }
+
+        if (send_nak(&s) == -1) {
+            log_message(LOG_ERROR, "Failed to send NAK");
+            break;
+        }
+    }
+
+    if (s.sub.fd != -1) {
+        mcast_subscriber_close(&s.sub);
+    }
+    close(sfd);
+    fclose(log_file);
+    log_close();
+
+    return EXIT_SUCCESS;
+}
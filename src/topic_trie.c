@@ -0,0 +1,324 @@
+/**
+ * @file topic_trie.c
+ * @brief Implementation of wildcard topic subscriptions
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "topic_trie.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* FNV-1a 64-bit hash of a topic */
+static uint64_t hash_topic(const char *topic, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)topic[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1; /* 0 marks a free entry */
+}
+
+/* Split off the segment starting at *pos; returns 0 once all were taken */
+static int next_segment(const char *str, size_t len, size_t *pos, const char **seg,
+                        size_t *seg_len) {
+    if (*pos > len) {
+        return 0;
+    }
+    const char *dot = memchr(str + *pos, '.', len - *pos);
+    size_t end = dot ? (size_t)(dot - str) : len;
+    *seg = str + *pos;
+    *seg_len = end - *pos;
+    *pos = end + 1;
+    return 1;
+}
+
+static int is_wildcard(const char *seg, size_t seg_len, char wildcard) {
+    return seg_len == 1 && seg[0] == wildcard;
+}
+
+/* Shared checks; wildcards says whether '*' and '#' segments are allowed */
+static int valid(const char *str, size_t len, int wildcards) {
+    if (len == 0 || len > TOPIC_MAX_LEN) {
+        return 0;
+    }
+    size_t pos = 0;
+    const char *seg;
+    size_t seg_len;
+    while (next_segment(str, len, &pos, &seg, &seg_len)) {
+        if (seg_len == 0) {
+            return 0;
+        }
+        if (wildcards && (is_wildcard(seg, seg_len, '*') || is_wildcard(seg, seg_len, '#'))) {
+            if (seg[0] == '#' && pos <= len) {
+                return 0; /* '#' must be the last segment */
+            }
+            continue;
+        }
+        for (size_t i = 0; i < seg_len; i++) {
+            if ((uint8_t)seg[i] < 0x20 || seg[i] == '*' || seg[i] == '#') {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int topic_name_valid(const char *topic, size_t len) {
+    return valid(topic, len, 0);
+}
+
+int topic_pattern_valid(const char *pattern, size_t len) {
+    return valid(pattern, len, 1);
+}
+
+int topic_pattern_matches(const char *pattern, size_t pattern_len, const char *topic,
+                          size_t topic_len) {
+    size_t ppos = 0;
+    size_t tpos = 0;
+    const char *pseg, *tseg;
+    size_t pseg_len, tseg_len;
+    while (next_segment(pattern, pattern_len, &ppos, &pseg, &pseg_len)) {
+        if (is_wildcard(pseg, pseg_len, '#')) {
+            return 1;
+        }
+        if (!next_segment(topic, topic_len, &tpos, &tseg, &tseg_len)) {
+            return 0;
+        }
+        if (!is_wildcard(pseg, pseg_len, '*') &&
+            (pseg_len != tseg_len || memcmp(pseg, tseg, tseg_len) != 0)) {
+            return 0;
+        }
+    }
+    return tpos > topic_len;
+}
+
+static topic_node_t *find_child(const topic_node_t *node, const char *seg, size_t seg_len) {
+    for (size_t i = 0; i < node->num_children; i++) {
+        topic_node_t *child = node->children[i];
+        if (child->segment_len == seg_len && memcmp(child->segment, seg, seg_len) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+static topic_node_t *add_child(topic_node_t *node, const char *seg, size_t seg_len,
+                               size_t num_slots) {
+    if (node->num_children == node->children_cap) {
+        size_t cap = node->children_cap ? node->children_cap * 2 : 4;
+        topic_node_t **children = realloc(node->children, cap * sizeof(*children));
+        if (!children) {
+            return NULL;
+        }
+        node->children = children;
+        node->children_cap = cap;
+    }
+
+    topic_node_t *child = calloc(1, sizeof(*child));
+    if (!child || !(child->segment = malloc(seg_len))) {
+        free(child);
+        return NULL;
+    }
+    memcpy(child->segment, seg, seg_len);
+    child->segment_len = seg_len;
+    slotset_init(&child->subscribers, num_slots);
+    node->children[node->num_children++] = child;
+    return child;
+}
+
+static void free_node(topic_node_t *node) {
+    for (size_t i = 0; i < node->num_children; i++) {
+        free_node(node->children[i]);
+        free(node->children[i]);
+    }
+    free(node->children);
+    free(node->segment);
+    slotset_free(&node->subscribers);
+}
+
+/* Free the children of node that hold no subscriber and lead to none */
+static void prune_children(topic_node_t *node) {
+    size_t kept = 0;
+    for (size_t i = 0; i < node->num_children; i++) {
+        topic_node_t *child = node->children[i];
+        if (child->num_children == 0 && slotset_empty(&child->subscribers)) {
+            free_node(child);
+            free(child);
+        } else {
+            node->children[kept++] = child;
+        }
+    }
+    node->num_children = kept;
+}
+
+static void drop_entry(topic_cache_entry_t *entry) {
+    entry->hash = 0;
+    slotset_free(&entry->subscribers);
+}
+
+int topic_trie_init(topic_trie_t *trie, size_t num_slots) {
+    memset(trie, 0, sizeof(*trie));
+    trie->num_slots = num_slots;
+    slotset_init(&trie->root.subscribers, num_slots);
+    trie->cache = calloc(TOPIC_CACHE_SIZE, sizeof(topic_cache_entry_t));
+    if (!trie->cache) {
+        return -1;
+    }
+    for (size_t i = 0; i < TOPIC_CACHE_SIZE; i++) {
+        slotset_init(&trie->cache[i].subscribers, num_slots);
+    }
+    return 0;
+}
+
+void topic_trie_free(topic_trie_t *trie) {
+    free_node(&trie->root);
+    memset(&trie->root, 0, sizeof(trie->root));
+    if (trie->cache) {
+        for (size_t i = 0; i < TOPIC_CACHE_SIZE; i++) {
+            drop_entry(&trie->cache[i]);
+        }
+        free(trie->cache);
+        trie->cache = NULL;
+    }
+}
+
+int topic_trie_subscribe(topic_trie_t *trie, const char *pattern, size_t len, size_t slot) {
+    topic_node_t *node = &trie->root;
+    size_t pos = 0;
+    const char *seg;
+    size_t seg_len;
+    while (next_segment(pattern, len, &pos, &seg, &seg_len)) {
+        topic_node_t *child = find_child(node, seg, seg_len);
+        if (!child && !(child = add_child(node, seg, seg_len, trie->num_slots))) {
+            return -1;
+        }
+        node = child;
+    }
+    if (slotset_contains(&node->subscribers, slot)) {
+        return 0;
+    }
+    if (slotset_add(&node->subscribers, slot) == -1) {
+        return -1;
+    }
+
+    /* The slot now receives every cached topic the pattern matches */
+    for (size_t i = 0; i < TOPIC_CACHE_SIZE; i++) {
+        topic_cache_entry_t *entry = &trie->cache[i];
+        if (entry->hash != 0 &&
+            topic_pattern_matches(pattern, len, entry->topic, entry->topic_len) &&
+            slotset_add(&entry->subscribers, slot) == -1) {
+            drop_entry(entry);
+        }
+    }
+    return 1;
+}
+
+/* Remove slot from the pattern's node and prune the path below node */
+static int unsubscribe_at(topic_node_t *node, const char *pattern, size_t len, size_t pos,
+                          size_t slot) {
+    const char *seg;
+    size_t seg_len;
+    if (!next_segment(pattern, len, &pos, &seg, &seg_len)) {
+        int removed = slotset_contains(&node->subscribers, slot);
+        slotset_remove(&node->subscribers, slot);
+        return removed;
+    }
+    topic_node_t *child = find_child(node, seg, seg_len);
+    if (!child) {
+        return 0;
+    }
+    int removed = unsubscribe_at(child, pattern, len, pos, slot);
+    prune_children(node);
+    return removed;
+}
+
+int topic_trie_unsubscribe(topic_trie_t *trie, const char *pattern, size_t len, size_t slot) {
+    if (!unsubscribe_at(&trie->root, pattern, len, 0, slot)) {
+        return 0;
+    }
+
+    /* Other patterns may still match these topics; resolve them again */
+    for (size_t i = 0; i < TOPIC_CACHE_SIZE; i++) {
+        topic_cache_entry_t *entry = &trie->cache[i];
+        if (entry->hash != 0 && slotset_contains(&entry->subscribers, slot) &&
+            topic_pattern_matches(pattern, len, entry->topic, entry->topic_len)) {
+            drop_entry(entry);
+        }
+    }
+    return 1;
+}
+
+static void remove_slot_below(topic_node_t *node, size_t slot) {
+    slotset_remove(&node->subscribers, slot);
+    for (size_t i = 0; i < node->num_children; i++) {
+        remove_slot_below(node->children[i], slot);
+    }
+    prune_children(node);
+}
+
+void topic_trie_remove_slot(topic_trie_t *trie, size_t slot) {
+    remove_slot_below(&trie->root, slot);
+    for (size_t i = 0; i < TOPIC_CACHE_SIZE; i++) {
+        slotset_remove(&trie->cache[i].subscribers, slot);
+    }
+}
+
+/* OR into out the subscribers of every pattern below node matching the rest of topic */
+static int collect(const topic_node_t *node, const char *topic, size_t len, size_t pos,
+                   slotset_t *out) {
+    const topic_node_t *rest = find_child(node, "#", 1);
+    if (rest && slotset_or(out, &rest->subscribers) == -1) {
+        return -1;
+    }
+
+    const char *seg;
+    size_t seg_len;
+    if (!next_segment(topic, len, &pos, &seg, &seg_len)) {
+        return slotset_or(out, &node->subscribers);
+    }
+    const topic_node_t *child = find_child(node, seg, seg_len);
+    if (child && collect(child, topic, len, pos, out) == -1) {
+        return -1;
+    }
+    child = find_child(node, "*", 1);
+    if (child && collect(child, topic, len, pos, out) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+const slotset_t *topic_trie_match(topic_trie_t *trie, const char *topic, size_t len) {
+    uint64_t hash = hash_topic(topic, len);
+    size_t start = (size_t)(hash % TOPIC_CACHE_SIZE);
+    trie->clock++;
+
+    topic_cache_entry_t *victim = NULL;
+    for (size_t i = 0; i < TOPIC_CACHE_PROBE; i++) {
+        topic_cache_entry_t *entry = &trie->cache[(start + i) % TOPIC_CACHE_SIZE];
+        if (entry->hash == hash && entry->topic_len == len &&
+            memcmp(entry->topic, topic, len) == 0) {
+            entry->last_used = trie->clock;
+            trie->hits++;
+            return &entry->subscribers;
+        }
+        if (!victim || (victim->hash != 0 &&
+                        (entry->hash == 0 || entry->last_used < victim->last_used))) {
+            victim = entry;
+        }
+    }
+
+    /* Miss: resolve through the trie and cache the result */
+    trie->misses++;
+    slotset_clear(&victim->subscribers);
+    if (collect(&trie->root, topic, len, 0, &victim->subscribers) == -1) {
+        drop_entry(victim);
+        return NULL;
+    }
+    victim->hash = hash;
+    victim->last_used = trie->clock;
+    victim->topic_len = len;
+    memcpy(victim->topic, topic, len);
+    return &victim->subscribers;
+}
@@ -0,0 +1,493 @@
+/**
+ * @file transfer.c
+ * @brief Implementation of file transfers
+ */
+
+/* splice() and pipe2() are Linux extensions */
+#define _GNU_SOURCE
+
+#include "transfer.h"
+#include "common.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+static void file_name(char *out, size_t cap, uint64_t id, int partial) {
+    snprintf(out, cap, "%016llx%s", (unsigned long long)id, partial ? ".part" : "");
+}
+
+/* Add up the stored files, deleting partial uploads if asked to
+ * @return 0 on success, -1 if the directory cannot be read */
+static int scan_dir(transfer_t *transfer, int remove_partial) {
+    int fd = openat(transfer->dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fd != -1 ? fdopendir(fd) : NULL;
+    if (!dir) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    uint64_t total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        uint64_t id;
+        size_t len = strlen(entry->d_name);
+        if ((len != 16 && len != 16 + 5) || hex_to_u64(entry->d_name, 16, &id) != 0) {
+            continue;
+        }
+        struct stat st;
+        if (len == 16 && fstatat(transfer->dir_fd, entry->d_name, &st, 0) == 0 &&
+            S_ISREG(st.st_mode)) {
+            total += (uint64_t)st.st_size;
+        } else if (len == 16 + 5 && remove_partial && strcmp(entry->d_name + 16, ".part") == 0) {
+            unlinkat(transfer->dir_fd, entry->d_name, 0);
+        }
+    }
+    closedir(dir);
+    transfer->stored_bytes = total;
+    return 0;
+}
+
+int transfer_init(transfer_t *transfer, int listen_fd, const char *dir) {
+    memset(transfer, 0, sizeof(*transfer));
+    transfer->listen_fd = listen_fd;
+    transfer->max_stored = TRANSFER_MAX_STORED;
+    transfer->dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (transfer->dir_fd == -1 || scan_dir(transfer, 1) == -1) {
+        log_message(LOG_ERROR, "Failed to open transfer directory %s: %s", dir, strerror(errno));
+        if (transfer->dir_fd != -1) {
+            close(transfer->dir_fd);
+        }
+        return -1;
+    }
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        transfer->conns[i].fd = -1;
+    }
+    return 0;
+}
+
+/* Drop an upload that did not complete, with its partial file */
+static void discard_upload(transfer_t *transfer, transfer_conn_t *conn) {
+    if (conn->pipe[0] != -1) {
+        close(conn->pipe[0]);
+        close(conn->pipe[1]);
+        conn->pipe[0] = conn->pipe[1] = -1;
+    }
+    if (conn->file_fd != -1) {
+        close(conn->file_fd);
+        conn->file_fd = -1;
+        char name[32];
+        file_name(name, sizeof(name), conn->id, 1);
+        unlinkat(transfer->dir_fd, name, 0);
+    }
+}
+
+static void close_conn(transfer_t *transfer, transfer_conn_t *conn) {
+    if (conn->state == TRANSFER_UPLOAD) {
+        discard_upload(transfer, conn);
+    }
+    if (conn->file_fd != -1) {
+        close(conn->file_fd);
+    }
+    close(conn->fd);
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = -1;
+    conn->file_fd = -1;
+    conn->pipe[0] = conn->pipe[1] = -1;
+}
+
+void transfer_accept(transfer_t *transfer, int64_t now_ms) {
+    int fd = accept(transfer->listen_fd, NULL, NULL);
+    if (fd == -1) {
+        log_message(LOG_ERROR, "Failed to accept transfer connection: %s", strerror(errno));
+        return;
+    }
+    if (set_nonblocking(fd) == -1) {
+        close(fd);
+        return;
+    }
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        transfer_conn_t *conn = &transfer->conns[i];
+        if (conn->fd == -1) {
+            memset(conn, 0, sizeof(*conn));
+            conn->fd = fd;
+            conn->state = TRANSFER_REQUEST;
+            conn->file_fd = -1;
+            conn->pipe[0] = conn->pipe[1] = -1;
+            conn->active_ms = now_ms;
+            return;
+        }
+    }
+    log_message(LOG_WARN, "Transfer connection limit reached, rejecting connection");
+    close(fd);
+}
+
+short transfer_poll_events(const transfer_t *transfer, int index) {
+    transfer_state_t state = transfer->conns[index].state;
+    return state == TRANSFER_REQUEST || state == TRANSFER_UPLOAD ? POLLIN : POLLOUT;
+}
+
+int transfer_parse_request(const char *line, size_t len, uint64_t *value) {
+    if (len > 4 && memcmp(line, "PUT ", 4) == 0) {
+        if (len - 4 > 20) {
+            return -1;
+        }
+        uint64_t size = 0;
+        for (size_t i = 4; i < len; i++) {
+            if (line[i] < '0' || line[i] > '9' || size > (UINT64_MAX - 9) / 10) {
+                return -1;
+            }
+            size = size * 10 + (uint64_t)(line[i] - '0');
+        }
+        *value = size;
+        return 1;
+    }
+    if (len == 4 + 16 && memcmp(line, "GET ", 4) == 0) {
+        return hex_to_u64(line + 4, 16, value) == 0 ? 2 : -1;
+    }
+    return -1;
+}
+
+/* Queue the reply line; sending the file, if any, starts once it is out */
+static void reply(transfer_conn_t *conn, int then_download, const char *fmt,
+                  unsigned long long arg) {
+    int len = snprintf(conn->reply, sizeof(conn->reply), fmt, arg);
+    conn->reply_len = len > 0 ? (size_t)len : 0;
+    conn->reply_sent = 0;
+    conn->then_download = then_download;
+    conn->state = TRANSFER_REPLY;
+}
+
+static void fail(transfer_conn_t *conn, const char *reason) {
+    int len = snprintf(conn->reply, sizeof(conn->reply), "ERR %s\n", reason);
+    conn->reply_len = len > 0 ? (size_t)len : 0;
+    conn->reply_sent = 0;
+    conn->then_download = 0;
+    conn->state = TRANSFER_REPLY;
+}
+
+/* Rename a complete upload into place and tell the client its id */
+static void finish_upload(transfer_t *transfer, transfer_conn_t *conn) {
+    char part[32];
+    char name[32];
+    file_name(part, sizeof(part), conn->id, 1);
+    file_name(name, sizeof(name), conn->id, 0);
+    if (renameat(transfer->dir_fd, part, transfer->dir_fd, name) == -1) {
+        log_message(LOG_ERROR, "Failed to store transfer %s: %s", name, strerror(errno));
+        discard_upload(transfer, conn);
+        fail(conn, "storage");
+        return;
+    }
+    if (conn->pipe[0] != -1) {
+        close(conn->pipe[0]);
+        close(conn->pipe[1]);
+        conn->pipe[0] = conn->pipe[1] = -1;
+    }
+    close(conn->file_fd);
+    conn->file_fd = -1;
+    transfer->uploads++;
+    transfer->stored_bytes += conn->size;
+    log_message(LOG_INFO, "Stored transfer %s (%llu bytes)", name,
+                (unsigned long long)conn->size);
+    reply(conn, 0, "OK %016llx\n", (unsigned long long)conn->id);
+}
+
+/* Whether an upload of size bytes fits next to the stored files and the
+ * uploads in progress */
+static int have_room(transfer_t *transfer, uint64_t size) {
+    uint64_t reserved = size;
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        if (transfer->conns[i].fd != -1 && transfer->conns[i].state == TRANSFER_UPLOAD) {
+            reserved += transfer->conns[i].size;
+        }
+    }
+    if (transfer->stored_bytes + reserved <= transfer->max_stored) {
+        return 1;
+    }
+    /* Files may have been removed by hand since the last count */
+    return scan_dir(transfer, 0) == 0 && transfer->stored_bytes + reserved <= transfer->max_stored;
+}
+
+static void start_upload(transfer_t *transfer, transfer_conn_t *conn, uint64_t size) {
+    if (size > TRANSFER_MAX_SIZE) {
+        fail(conn, "too large");
+        return;
+    }
+    if (!have_room(transfer, size)) {
+        log_message(LOG_WARN, "Transfer directory full, refusing an upload of %llu bytes",
+                    (unsigned long long)size);
+        fail(conn, "full");
+        return;
+    }
+    if (random_u64(&conn->id) == -1) {
+        fail(conn, "storage");
+        return;
+    }
+    char part[32];
+    file_name(part, sizeof(part), conn->id, 1);
+    conn->file_fd = openat(transfer->dir_fd, part, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (conn->file_fd == -1) {
+        log_message(LOG_ERROR, "Failed to create transfer %s: %s", part, strerror(errno));
+        fail(conn, "storage");
+        return;
+    }
+#ifdef __linux__
+    /* Without a pipe the upload is copied through a buffer instead */
+    if (pipe2(conn->pipe, O_CLOEXEC) == -1) {
+        conn->pipe[0] = conn->pipe[1] = -1;
+    }
+#endif
+    conn->size = size;
+    conn->done = 0;
+    conn->state = TRANSFER_UPLOAD;
+    if (size == 0) {
+        finish_upload(transfer, conn);
+    }
+}
+
+static void start_download(transfer_t *transfer, transfer_conn_t *conn, uint64_t id) {
+    char name[32];
+    file_name(name, sizeof(name), id, 0);
+    struct stat st;
+    conn->file_fd = openat(transfer->dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (conn->file_fd == -1 || fstat(conn->file_fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        fail(conn, "not found");
+        return;
+    }
+    conn->id = id;
+    conn->size = (uint64_t)st.st_size;
+    conn->done = 0;
+    reply(conn, 1, "OK %llu\n", (unsigned long long)conn->size);
+}
+
+/* Read up to the end of the request line and no further, so the upload
+ * that follows is still in the socket for splice() */
+static void read_request(transfer_t *transfer, transfer_conn_t *conn) {
+    size_t room = sizeof(conn->request) - conn->request_len;
+    ssize_t peeked = recv(conn->fd, conn->request + conn->request_len, room, MSG_PEEK);
+    if (peeked == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (peeked <= 0) {
+        close_conn(transfer, conn);
+        return;
+    }
+    char *newline = memchr(conn->request + conn->request_len, '\n', (size_t)peeked);
+    size_t take = newline ? (size_t)(newline - (conn->request + conn->request_len)) + 1
+                          : (size_t)peeked;
+    if (recv(conn->fd, conn->request + conn->request_len, take, 0) != (ssize_t)take) {
+        close_conn(transfer, conn);
+        return;
+    }
+    conn->request_len += take;
+    if (!newline) {
+        if (conn->request_len == sizeof(conn->request)) {
+            fail(conn, "bad request");
+        }
+        return;
+    }
+
+    uint64_t value;
+    switch (transfer_parse_request(conn->request, conn->request_len - 1, &value)) {
+    case 1:
+        start_upload(transfer, conn, value);
+        break;
+    case 2:
+        start_download(transfer, conn, value);
+        break;
+    default:
+        fail(conn, "bad request");
+        break;
+    }
+}
+
+/* Move up to want bytes from the socket into the file
+ * @return Bytes stored, 0 at end of stream, -1 with errno set */
+static ssize_t store(transfer_conn_t *conn, size_t want) {
+#ifdef __linux__
+    if (conn->pipe[0] != -1) {
+        ssize_t n = splice(conn->fd, NULL, conn->pipe[1], NULL, want,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n <= 0) {
+            return n;
+        }
+        /* The pipe is emptied before returning so it never holds stale bytes */
+        for (ssize_t left = n; left > 0;) {
+            ssize_t m = splice(conn->pipe[0], NULL, conn->file_fd, NULL, (size_t)left,
+                               SPLICE_F_MOVE);
+            if (m == -1 && errno == EINTR) {
+                continue;
+            }
+            if (m <= 0) {
+                /* Not EAGAIN: the caller would wait with bytes left in the pipe */
+                errno = EIO;
+                return -1;
+            }
+            left -= m;
+        }
+        return n;
+    }
+#endif
+    char buf[65536];
+    ssize_t n = recv(conn->fd, buf, want < sizeof(buf) ? want : sizeof(buf), 0);
+    if (n <= 0) {
+        return n;
+    }
+    for (ssize_t off = 0; off < n;) {
+        ssize_t m = write(conn->file_fd, buf + off, (size_t)(n - off));
+        if (m == -1 && errno == EINTR) {
+            continue;
+        }
+        if (m <= 0) {
+            errno = EIO;
+            return -1;
+        }
+        off += m;
+    }
+    return n;
+}
+
+static void upload(transfer_t *transfer, transfer_conn_t *conn) {
+    size_t moved = 0;
+    while (moved < TRANSFER_CHUNK && conn->done < conn->size) {
+        uint64_t left = conn->size - conn->done;
+        size_t want = TRANSFER_CHUNK - moved < left ? TRANSFER_CHUNK - moved : (size_t)left;
+        ssize_t n = store(conn, want);
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (n == 0) {
+            /* The client gave up part way; there is nobody to tell */
+            close_conn(transfer, conn);
+            return;
+        }
+        if (n < 0) {
+            log_message(LOG_ERROR, "Failed to store transfer: %s", strerror(errno));
+            discard_upload(transfer, conn);
+            fail(conn, "storage");
+            return;
+        }
+        moved += (size_t)n;
+        conn->done += (uint64_t)n;
+        transfer->bytes_in += (uint64_t)n;
+    }
+    if (conn->done == conn->size) {
+        finish_upload(transfer, conn);
+    }
+}
+
+/* Move up to want bytes of the file into the socket
+ * @return Bytes sent, 0 if the file ended early, -1 with errno set */
+static ssize_t send_file(transfer_conn_t *conn, size_t want) {
+#ifdef __linux__
+    off_t offset = (off_t)conn->done;
+    return sendfile(conn->fd, conn->file_fd, &offset, want);
+#else
+    char buf[65536];
+    ssize_t n = pread(conn->file_fd, buf, want < sizeof(buf) ? want : sizeof(buf),
+                      (off_t)conn->done);
+    if (n <= 0) {
+        return n;
+    }
+    return send(conn->fd, buf, (size_t)n, MSG_NOSIGNAL);
+#endif
+}
+
+static void download(transfer_t *transfer, transfer_conn_t *conn) {
+    size_t moved = 0;
+    while (moved < TRANSFER_CHUNK && conn->done < conn->size) {
+        uint64_t left = conn->size - conn->done;
+        size_t want = TRANSFER_CHUNK - moved < left ? TRANSFER_CHUNK - moved : (size_t)left;
+        ssize_t n = send_file(conn, want);
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (n <= 0) {
+            close_conn(transfer, conn);
+            return;
+        }
+        moved += (size_t)n;
+        conn->done += (uint64_t)n;
+        transfer->bytes_out += (uint64_t)n;
+    }
+    if (conn->done == conn->size) {
+        transfer->downloads++;
+        close_conn(transfer, conn);
+    }
+}
+
+static void send_reply(transfer_t *transfer, transfer_conn_t *conn) {
+    ssize_t sent = send(conn->fd, conn->reply + conn->reply_sent,
+                        conn->reply_len - conn->reply_sent, MSG_NOSIGNAL);
+    if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (sent <= 0) {
+        close_conn(transfer, conn);
+        return;
+    }
+    conn->reply_sent += (size_t)sent;
+    if (conn->reply_sent < conn->reply_len) {
+        return;
+    }
+    if (!conn->then_download) {
+        close_conn(transfer, conn);
+        return;
+    }
+    conn->state = TRANSFER_DOWNLOAD;
+    download(transfer, conn);
+}
+
+void transfer_handle_events(transfer_t *transfer, int index, short revents, int64_t now_ms) {
+    transfer_conn_t *conn = &transfer->conns[index];
+    if (!revents) {
+        return;
+    }
+    conn->active_ms = now_ms;
+    switch (conn->state) {
+    case TRANSFER_REQUEST:
+        read_request(transfer, conn);
+        break;
+    case TRANSFER_UPLOAD:
+        upload(transfer, conn);
+        break;
+    case TRANSFER_REPLY:
+        send_reply(transfer, conn);
+        break;
+    case TRANSFER_DOWNLOAD:
+        download(transfer, conn);
+        break;
+    }
+}
+
+void transfer_sweep(transfer_t *transfer, int64_t now_ms) {
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        transfer_conn_t *conn = &transfer->conns[i];
+        if (conn->fd != -1 && now_ms - conn->active_ms >= TRANSFER_IDLE_MS) {
+            log_message(LOG_INFO, "Closing idle transfer connection");
+            close_conn(transfer, conn);
+        }
+    }
+}
+
+void transfer_close(transfer_t *transfer) {
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        if (transfer->conns[i].fd != -1) {
+            close_conn(transfer, &transfer->conns[i]);
+        }
+    }
+    close(transfer->listen_fd);
+    close(transfer->dir_fd);
+    transfer->listen_fd = -1;
+    transfer->dir_fd = -1;
+}
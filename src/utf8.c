@@ -0,0 +1,206 @@
+/**
+ * @file utf8.c
+ * @brief Implementation of UTF-8 validation
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "utf8.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define UTF8_HAVE_SSSE3 1
+#endif
+
+#define ASCII_MASK 0x8080808080808080ull
+
+int utf8_valid_scalar(const char *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + len;
+
+    while (p < end) {
+        /* Chat text is mostly ASCII: skip it a word at a time */
+        uint64_t word;
+        if (end - p >= 8 && (memcpy(&word, p, 8), (word & ASCII_MASK) == 0)) {
+            p += 8;
+            continue;
+        }
+        uint8_t lead = *p;
+        if (lead < 0x80) {
+            p++;
+            continue;
+        }
+
+        size_t conts;
+        uint8_t low = 0x80;
+        uint8_t high = 0xbf;
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            conts = 1;
+        } else if (lead >= 0xe0 && lead <= 0xef) {
+            conts = 2;
+            if (lead == 0xe0) {
+                low = 0xa0;  /* Overlong */
+            } else if (lead == 0xed) {
+                high = 0x9f; /* Surrogates */
+            }
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            conts = 3;
+            if (lead == 0xf0) {
+                low = 0x90;  /* Overlong */
+            } else if (lead == 0xf4) {
+                high = 0x8f; /* Above U+10FFFF */
+            }
+        } else {
+            return 0;
+        }
+
+        if ((size_t)(end - p) <= conts || p[1] < low || p[1] > high) {
+            return 0;
+        }
+        for (size_t i = 2; i <= conts; i++) {
+            if ((p[i] & 0xc0) != 0x80) {
+                return 0;
+            }
+        }
+        p += conts + 1;
+    }
+    return 1;
+}
+
+#ifdef UTF8_HAVE_SSSE3
+/* Error bits for a pair of adjacent bytes, after Keiser and Lemire,
+ * "Validating UTF-8 In Less Than One Instruction Per Byte" */
+#define TOO_SHORT      (1 << 0) /* 11______ 0_______ or 11______ 11______ */
+#define TOO_LONG       (1 << 1) /* 0_______ 10______ */
+#define OVERLONG_3     (1 << 2) /* 11100000 100_____ */
+#define TOO_LARGE      (1 << 3) /* 11110100 1001____ and above */
+#define SURROGATE      (1 << 4) /* 11101101 101_____ */
+#define OVERLONG_2     (1 << 5) /* 1100000_ 10______ */
+#define TOO_LARGE_1000 (1 << 6) /* 11110101 1000____ and above */
+#define OVERLONG_4     (1 << 6) /* 11110000 1000____ */
+#define TWO_CONTS      (1 << 7) /* 10______ 10______ */
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/**
+ * @brief Errors in one block, given the block before it
+ *
+ * Each byte is classified together with the byte before it by three table
+ * lookups, on the high and low nibble of the earlier byte and the high
+ * nibble of the later one, whose intersection is the set of errors. A
+ * continuation after a continuation is only valid as the third or fourth
+ * byte of a sequence, which is checked against the bytes two and three back.
+ */
+__attribute__((target("ssse3")))
+static __m128i check_block(__m128i input, __m128i prev_input) {
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        (char)TWO_CONTS, (char)TWO_CONTS, (char)TWO_CONTS, (char)TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        (char)(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4),
+        (char)(CARRY | OVERLONG_2),
+        (char)CARRY,
+        (char)CARRY,
+        (char)(CARRY | TOO_LARGE),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+        (char)(CARRY | TOO_LARGE | TOO_LARGE_1000));
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table,
+                                           _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table,
+                                           _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    /* Only 111_____ two back or 1111____ three back stay at or above 0x80 */
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80)));
+    __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+    __m128i must_be_cont = _mm_and_si128(_mm_or_si128(is_third, is_fourth),
+                                         _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must_be_cont, special);
+}
+
+/* Nonzero if the block ends inside a sequence that needs more bytes */
+__attribute__((target("ssse3")))
+static __m128i incomplete_tail(__m128i input) {
+    const __m128i max = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                      (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    return _mm_subs_epu8(input, max);
+}
+
+__attribute__((target("ssse3")))
+static int utf8_valid_ssse3(const char *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + len;
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    __m128i error = _mm_setzero_si128();
+    uint8_t tail[16];
+
+    while (p < end) {
+        __m128i input;
+        if (end - p >= 16) {
+            input = _mm_loadu_si128((const __m128i *)p);
+            p += 16;
+        } else {
+            /* Zero padding is ASCII, so a truncated sequence shows up as TOO_SHORT */
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p, (size_t)(end - p));
+            input = _mm_loadu_si128((const __m128i *)tail);
+            p = end;
+        }
+
+        if (_mm_movemask_epi8(input) == 0) {
+            /* All ASCII: valid unless the previous block left a sequence open */
+            error = _mm_or_si128(error, prev_incomplete);
+            prev_incomplete = _mm_setzero_si128();
+        } else {
+            error = _mm_or_si128(error, check_block(input, prev_input));
+            prev_incomplete = incomplete_tail(input);
+        }
+        prev_input = input;
+    }
+    error = _mm_or_si128(error, prev_incomplete);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+#endif
+
+int utf8_valid(const char *data, size_t len) {
+#ifdef UTF8_HAVE_SSSE3
+    static int have_ssse3 = -1;
+    if (have_ssse3 < 0) {
+        have_ssse3 = __builtin_cpu_supports("ssse3");
+    }
+    if (have_ssse3) {
+        return utf8_valid_ssse3(data, len);
+    }
+#endif
+    return utf8_valid_scalar(data, len);
+}
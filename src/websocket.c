@@ -0,0 +1,419 @@
+/**
+ * @file websocket.c
+ * @brief Implementation of the WebSocket handshake and framing
+ */
+
+/* Feature test macros defined in Makefile */
+#define _POSIX_C_SOURCE 200809L
+
+#include "websocket.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Appended to the client key before hashing (RFC 6455 section 1.3) */
+static const char ws_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static uint32_t rotl32(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static void sha1_block(uint32_t state[5], const uint8_t block[64]) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        uint32_t t = rotl32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl32(b, 30);
+        b = a;
+        a = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+/* SHA-1 of a short message; only used for handshake keys */
+static void sha1(const uint8_t *data, size_t len, uint8_t digest[20]) {
+    uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+    size_t pos = 0;
+    for (; len - pos >= 64; pos += 64) {
+        sha1_block(state, data + pos);
+    }
+
+    /* Final block(s): remaining bytes, 0x80, zero padding, bit length */
+    uint8_t tail[128] = {0};
+    size_t rest = len - pos;
+    memcpy(tail, data + pos, rest);
+    tail[rest] = 0x80;
+    size_t tail_len = rest + 1 + 8 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) {
+        tail[tail_len - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+    sha1_block(state, tail);
+    if (tail_len == 128) {
+        sha1_block(state, tail + 64);
+    }
+
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = (uint8_t)(state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
+
+static void base64_encode(const uint8_t *data, size_t len, char *out) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) {
+            v |= (uint32_t)data[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            v |= data[i + 2];
+        }
+        out[o++] = alphabet[(v >> 18) & 0x3f];
+        out[o++] = alphabet[(v >> 12) & 0x3f];
+        out[o++] = i + 1 < len ? alphabet[(v >> 6) & 0x3f] : '=';
+        out[o++] = i + 2 < len ? alphabet[v & 0x3f] : '=';
+    }
+    out[o] = '\0';
+}
+
+void ws_conn_init(ws_conn_t *ws) {
+    ws->open = 0;
+    ws->request_len = 0;
+    ws->header_len = 0;
+    ws->in_payload = 0;
+    ws->message_opcode = 0;
+    ws->message_len = 0;
+    ws->control_len = 0;
+}
+
+void ws_accept_key(const char *key, size_t key_len, char *out) {
+    uint8_t input[WS_MAX_REQUEST + sizeof(ws_guid)];
+    if (key_len > WS_MAX_REQUEST) {
+        key_len = WS_MAX_REQUEST;
+    }
+    memcpy(input, key, key_len);
+    memcpy(input + key_len, ws_guid, sizeof(ws_guid) - 1);
+
+    uint8_t digest[20];
+    sha1(input, key_len + sizeof(ws_guid) - 1, digest);
+    base64_encode(digest, sizeof(digest), out);
+}
+
+/**
+ * @brief Find a header in a NUL-terminated request, trimming whitespace
+ * @return 0 if found, -1 otherwise
+ */
+static int find_header(const char *request, const char *name, const char **value,
+                       size_t *value_len) {
+    size_t name_len = strlen(name);
+    const char *line = strstr(request, "\r\n");
+
+    while (line && line[2] != '\r') {
+        line += 2;
+        const char *end = strstr(line, "\r\n");
+        if (!end) {
+            break;
+        }
+        if ((size_t)(end - line) > name_len && line[name_len] == ':' &&
+            strncasecmp(line, name, name_len) == 0) {
+            const char *v = line + name_len + 1;
+            while (v < end && (*v == ' ' || *v == '\t')) {
+                v++;
+            }
+            const char *v_end = end;
+            while (v_end > v && (v_end[-1] == ' ' || v_end[-1] == '\t')) {
+                v_end--;
+            }
+            *value = v;
+            *value_len = (size_t)(v_end - v);
+            return 0;
+        }
+        line = end;
+    }
+    return -1;
+}
+
+/**
+ * @brief Whether a comma-separated header value contains a token
+ */
+static int has_token(const char *value, size_t len, const char *token) {
+    size_t token_len = strlen(token);
+    for (size_t i = 0; i + token_len <= len; i++) {
+        if (strncasecmp(value + i, token, token_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int ws_handshake_feed(ws_conn_t *ws, const uint8_t *data, size_t len, size_t *consumed,
+                      char *response, size_t cap) {
+    size_t old_len = ws->request_len;
+    size_t take = WS_MAX_REQUEST - 1 - old_len;
+    if (take > len) {
+        take = len;
+    }
+    memcpy(ws->request + old_len, data, take);
+    ws->request_len += take;
+    ws->request[ws->request_len] = '\0';
+
+    /* The terminator may straddle the previous chunk */
+    size_t search_from = old_len > 3 ? old_len - 3 : 0;
+    char *end = strstr(ws->request + search_from, "\r\n\r\n");
+    if (!end) {
+        *consumed = take;
+        return ws->request_len == WS_MAX_REQUEST - 1 ? -1 : 0;
+    }
+
+    size_t request_end = (size_t)(end - ws->request) + 4;
+    *consumed = request_end - old_len;
+    ws->request[request_end] = '\0';
+
+    const char *value;
+    size_t value_len;
+    if (strncmp(ws->request, "GET ", 4) != 0 ||
+        find_header(ws->request, "Upgrade", &value, &value_len) == -1 ||
+        !has_token(value, value_len, "websocket") ||
+        find_header(ws->request, "Sec-WebSocket-Key", &value, &value_len) == -1 ||
+        value_len == 0) {
+        return -1;
+    }
+
+    char accept[WS_ACCEPT_LEN + 1];
+    ws_accept_key(value, value_len, accept);
+    int n = snprintf(response, cap,
+                     "HTTP/1.1 101 Switching Protocols\r\n"
+                     "Upgrade: websocket\r\n"
+                     "Connection: Upgrade\r\n"
+                     "Sec-WebSocket-Accept: %s\r\n\r\n",
+                     accept);
+    if (n < 0 || (size_t)n >= cap) {
+        return -1;
+    }
+
+    ws->open = 1;
+    return n;
+}
+
+/* Bytes of header needed given what has been received */
+static size_t header_needed(const uint8_t *header, size_t have) {
+    if (have < 2) {
+        return 2;
+    }
+    size_t len7 = header[1] & 0x7f;
+    size_t ext = len7 == 126 ? 2 : len7 == 127 ? 8 : 0;
+    return 2 + ext + ((header[1] & 0x80) ? 4 : 0);
+}
+
+/* Validate a complete header and set up payload reception */
+static int start_frame(ws_conn_t *ws) {
+    const uint8_t *h = ws->header;
+    uint8_t opcode = h[0] & 0x0f;
+    int is_control = (opcode & 0x08) != 0;
+
+    /* No extensions were negotiated, and clients must mask */
+    if ((h[0] & 0x70) != 0 || !(h[1] & 0x80)) {
+        return -1;
+    }
+
+    uint64_t len = h[1] & 0x7f;
+    size_t pos = 2;
+    if (len == 126) {
+        len = ((uint64_t)h[2] << 8) | h[3];
+        pos = 4;
+    } else if (len == 127) {
+        len = 0;
+        for (int i = 0; i < 8; i++) {
+            len = (len << 8) | h[2 + i];
+        }
+        pos = 10;
+    }
+    memcpy(ws->mask, h + pos, 4);
+
+    if (is_control) {
+        if (opcode > WS_OPCODE_PONG || !(h[0] & 0x80) || len > WS_MAX_CONTROL) {
+            return -1;
+        }
+        ws->control_len = (size_t)len;
+    } else if (opcode == WS_OPCODE_CONTINUATION) {
+        if (ws->message_opcode == 0) {
+            return -1;
+        }
+    } else if (opcode == WS_OPCODE_TEXT || opcode == WS_OPCODE_BINARY) {
+        if (ws->message_opcode != 0) {
+            return -1;
+        }
+        ws->message_opcode = opcode;
+    } else {
+        return -1;
+    }
+    if (!is_control && len > WS_MAX_MESSAGE - ws->message_len) {
+        return -1;
+    }
+
+    ws->opcode = opcode;
+    ws->fin = (h[0] & 0x80) != 0;
+    ws->payload_left = len;
+    ws->payload_pos = 0;
+    ws->in_payload = 1;
+    return 0;
+}
+
+/* Deliver a frame whose payload is complete */
+static int finish_frame(ws_conn_t *ws, ws_message_fn handler, void *arg) {
+    ws->in_payload = 0;
+    ws->header_len = 0;
+
+    if (ws->opcode & 0x08) {
+        return handler(ws->opcode, ws->control, ws->control_len, arg) != 0;
+    }
+    if (!ws->fin) {
+        return 0;
+    }
+
+    uint8_t opcode = ws->message_opcode;
+    size_t len = ws->message_len;
+    ws->message_opcode = 0;
+    ws->message_len = 0;
+    return handler(opcode, ws->message, len, arg) != 0;
+}
+
+int ws_decode(ws_conn_t *ws, const uint8_t *data, size_t len, ws_message_fn handler, void *arg) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        if (!ws->in_payload) {
+            ws->header[ws->header_len++] = data[pos++];
+            if (ws->header_len < header_needed(ws->header, ws->header_len)) {
+                continue;
+            }
+            if (start_frame(ws) == -1) {
+                return -1;
+            }
+            if (ws->payload_left == 0 && finish_frame(ws, handler, arg)) {
+                return 1;
+            }
+            continue;
+        }
+
+        size_t take = len - pos;
+        if (take > ws->payload_left) {
+            take = (size_t)ws->payload_left;
+        }
+        int is_control = (ws->opcode & 0x08) != 0;
+        uint8_t *dst = is_control ? ws->control + ws->payload_pos
+                                  : ws->message + ws->message_len;
+        for (size_t i = 0; i < take; i++) {
+            dst[i] = data[pos + i] ^ ws->mask[(ws->payload_pos + i) & 3];
+        }
+        if (!is_control) {
+            ws->message_len += take;
+        }
+        ws->payload_pos += take;
+        ws->payload_left -= take;
+        pos += take;
+
+        if (ws->payload_left == 0 && finish_frame(ws, handler, arg)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t ws_frame_header(uint8_t *out, uint8_t opcode, uint64_t payload_len) {
+    out[0] = 0x80 | (opcode & 0x0f);
+    if (payload_len < 126) {
+        out[1] = (uint8_t)payload_len;
+        return 2;
+    }
+    if (payload_len <= 0xffff) {
+        out[1] = 126;
+        out[2] = (uint8_t)(payload_len >> 8);
+        out[3] = (uint8_t)payload_len;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) {
+        out[2 + i] = (uint8_t)(payload_len >> (8 * (7 - i)));
+    }
+    return 10;
+}
+
+ssize_t ws_send(int fd, const uint8_t *header, size_t header_len, const uint8_t *payload,
+                size_t payload_len) {
+    struct iovec iov[2];
+    iov[0].iov_base = (void *)header;
+    iov[0].iov_len = header_len;
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = payload_len;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    size_t left = header_len + payload_len;
+    while (left > 0) {
+        ssize_t sent = sendmsg(fd, &msg, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        left -= (size_t)sent;
+
+        /* Skip what was sent, then retry with the remainder */
+        while (sent > 0 && msg.msg_iovlen > 0) {
+            if ((size_t)sent >= msg.msg_iov[0].iov_len) {
+                sent -= (ssize_t)msg.msg_iov[0].iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            } else {
+                msg.msg_iov[0].iov_base = (uint8_t *)msg.msg_iov[0].iov_base + sent;
+                msg.msg_iov[0].iov_len -= (size_t)sent;
+                sent = 0;
+            }
+        }
+    }
+    return (ssize_t)payload_len;
+}
@@ -0,0 +1,280 @@
+/**
+ * @file bench_fanout.c
+ * @brief Benchmark of broadcast fan-out strategies over loopback TCP
+ *
+ * Sends the same frame to every recipient socket, the way broadcast_message
+ * does, with each strategy in turn:
+ * - send:     one send() per recipient (the server's default)
+ * - writev:   one writev() per recipient with the frame split into a header
+ *             and a payload, as for WebSocket clients
+ * - zerocopy: send() with MSG_ZEROCOPY, reaping completions from the error
+ *             queue
+ * - splice:   the fanout module's tee()/splice() path
+ *
+ * A reader thread drains the other ends of the connections. Reported CPU time
+ * is the sending thread's only. Linux only.
+ *
+ * Usage: bench_fanout [recipients] [frame_bytes] [frames]
+ */
+
+#define _GNU_SOURCE
+
+#include "fanout.h"
+#include "common.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Bytes of the frame sent as a separate header by the writev strategy */
+#define WRITEV_HEADER_LEN 8
+
+typedef enum { STRATEGY_SEND, STRATEGY_WRITEV, STRATEGY_ZEROCOPY, STRATEGY_SPLICE } strategy_t;
+
+static const char *strategy_names[] = {"send", "writev", "zerocopy", "splice"};
+
+/* Connections under test */
+typedef struct {
+    int num;
+    int *senders;         /* Server side, written by the strategy */
+    int *readers;         /* Client side, drained by the reader thread */
+    uint64_t expected;    /* Bytes the reader waits for in one run */
+} bench_t;
+
+static double seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Reader thread: drain every connection until a run's bytes have arrived */
+static void *drain_readers(void *arg) {
+    bench_t *bench = arg;
+    struct pollfd *fds = calloc((size_t)bench->num, sizeof(*fds));
+    for (int i = 0; i < bench->num; i++) {
+        fds[i].fd = bench->readers[i];
+        fds[i].events = POLLIN;
+    }
+
+    static uint8_t buf[256 * 1024];
+    uint64_t received = 0;
+    while (received < bench->expected) {
+        if (poll(fds, (nfds_t)bench->num, 5000) <= 0) {
+            fprintf(stderr, "Reader stalled at %llu of %llu bytes\n",
+                    (unsigned long long)received, (unsigned long long)bench->expected);
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < bench->num; i++) {
+            if (fds[i].revents & POLLIN) {
+                ssize_t n = recv(fds[i].fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (n > 0) {
+                    received += (uint64_t)n;
+                }
+            }
+        }
+    }
+    free(fds);
+    return NULL;
+}
+
+/* Discard MSG_ZEROCOPY completions; returns how many were copies after all */
+static uint64_t reap_zerocopy(int fd, uint64_t *completions) {
+    uint64_t copied = 0;
+    for (;;) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            return copied;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            uint64_t range = (uint64_t)(err->ee_data - err->ee_info) + 1;
+            *completions += range;
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                copied += range;
+            }
+        }
+    }
+}
+
+static ssize_t send_zerocopy(int fd, const uint8_t *data, size_t len, uint64_t *completions,
+                             uint64_t *copied) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(fd, data + sent, len - sent, MSG_ZEROCOPY);
+        if (n == -1 && errno == ENOBUFS) {
+            /* Too many completions outstanding: collect them and retry */
+            *copied += reap_zerocopy(fd, completions);
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    return (ssize_t)len;
+}
+
+static ssize_t send_writev(int fd, const uint8_t *data, size_t len) {
+    size_t header = len < WRITEV_HEADER_LEN ? len : WRITEV_HEADER_LEN;
+    struct iovec iov[2] = {{(void *)data, header}, {(void *)(data + header), len - header}};
+    ssize_t n = writev(fd, iov, 2);
+    if (n < 0) {
+        return -1;
+    }
+    if ((size_t)n < len && send_exact(fd, data + n, len - (size_t)n) == -1) {
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+/* Run one strategy and print its line of the report */
+static void run(bench_t *bench, strategy_t strategy, const uint8_t *frame, size_t frame_len,
+                int frames) {
+    fanout_t fanout;
+    if (strategy == STRATEGY_SPLICE && fanout_init(&fanout, FANOUT_SPLICE) == -1) {
+        printf("%-9s unavailable (%s)\n", strategy_names[strategy], strerror(errno));
+        return;
+    }
+    if (strategy == STRATEGY_ZEROCOPY) {
+        int one = 1;
+        for (int i = 0; i < bench->num; i++) {
+            if (setsockopt(bench->senders[i], SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == -1) {
+                printf("%-9s unavailable (%s)\n", strategy_names[strategy], strerror(errno));
+                return;
+            }
+        }
+    }
+
+    bench->expected = (uint64_t)bench->num * frame_len * (uint64_t)frames;
+    pthread_t reader;
+    pthread_create(&reader, NULL, drain_readers, bench);
+
+    uint64_t completions = 0;
+    uint64_t copied = 0;
+    double wall = seconds(CLOCK_MONOTONIC);
+    double cpu = seconds(CLOCK_THREAD_CPUTIME_ID);
+    for (int f = 0; f < frames; f++) {
+        if (strategy == STRATEGY_SPLICE) {
+            fanout_begin(&fanout, frame, frame_len);
+        }
+        for (int i = 0; i < bench->num; i++) {
+            int fd = bench->senders[i];
+            ssize_t sent;
+            switch (strategy) {
+            case STRATEGY_WRITEV:
+                sent = send_writev(fd, frame, frame_len);
+                break;
+            case STRATEGY_ZEROCOPY:
+                sent = send_zerocopy(fd, frame, frame_len, &completions, &copied);
+                break;
+            case STRATEGY_SPLICE:
+                sent = fanout_send(&fanout, fd, frame, frame_len);
+                break;
+            default:
+                sent = send_exact(fd, frame, frame_len);
+                break;
+            }
+            if (sent != (ssize_t)frame_len) {
+                perror(strategy_names[strategy]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (strategy == STRATEGY_SPLICE) {
+            fanout_end(&fanout);
+        }
+    }
+    cpu = seconds(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    pthread_join(reader, NULL);
+    wall = seconds(CLOCK_MONOTONIC) - wall;
+
+    double writes = (double)frames * bench->num;
+    printf("%-9s %10.0f %12.0f %10.1f %9.2f %9.2f", strategy_names[strategy],
+           frames / wall, writes / wall, (double)bench->expected / wall / 1e6, wall, cpu);
+    if (strategy == STRATEGY_ZEROCOPY) {
+        for (int i = 0; i < bench->num; i++) {
+            copied += reap_zerocopy(bench->senders[i], &completions);
+        }
+        printf("   (%llu of %llu completions copied)", (unsigned long long)copied,
+               (unsigned long long)completions);
+    } else if (strategy == STRATEGY_SPLICE) {
+        printf("   (%llu spliced, %llu fell back)", (unsigned long long)fanout.spliced,
+               (unsigned long long)fanout.fallbacks);
+        fanout_free(&fanout);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    int num = argc > 1 ? atoi(argv[1]) : 64;
+    size_t frame_len = argc > 2 ? (size_t)atoi(argv[2]) : 128;
+    int frames = argc > 3 ? atoi(argv[3]) : 20000;
+    if (num <= 0 || frame_len == 0 || frames <= 0) {
+        fprintf(stderr, "Usage: %s [recipients] [frame_bytes] [frames]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (listener == -1 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(listener, num) == -1 ||
+        getsockname(listener, (struct sockaddr *)&addr, &addr_len) == -1) {
+        perror("listener");
+        return EXIT_FAILURE;
+    }
+
+    bench_t bench = {num, calloc((size_t)num, sizeof(int)), calloc((size_t)num, sizeof(int)), 0};
+    for (int i = 0; i < num; i++) {
+        bench.readers[i] = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(bench.readers[i], (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+            (bench.senders[i] = accept(listener, NULL, NULL)) == -1) {
+            perror("connect");
+            return EXIT_FAILURE;
+        }
+        /* Like the server: small frames go out at once */
+        int one = 1;
+        setsockopt(bench.senders[i], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    close(listener);
+
+    uint8_t *frame = malloc(frame_len);
+    for (size_t i = 0; i < frame_len; i++) {
+        frame[i] = (uint8_t)('a' + i % 26);
+    }
+
+    printf("%d recipients, %zu-byte frames, %d frames\n\n", num, frame_len, frames);
+    printf("%-9s %10s %12s %10s %9s %9s\n", "strategy", "frames/s", "writes/s", "MB/s",
+           "wall s", "cpu s");
+    for (int s = STRATEGY_SEND; s <= STRATEGY_SPLICE; s++) {
+        run(&bench, (strategy_t)s, frame, frame_len, frames);
+    }
+
+    for (int i = 0; i < num; i++) {
+        close(bench.senders[i]);
+        close(bench.readers[i]);
+    }
+    free(bench.senders);
+    free(bench.readers);
+    free(frame);
+    return EXIT_SUCCESS;
+}
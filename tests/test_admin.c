@@ -0,0 +1,147 @@
+/**
+ * @file test_admin.c
+ * @brief Unit tests for the admin endpoint
+ */
+
+#include "admin.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int parse(const char *request, const char **path, size_t *path_len) {
+    return admin_parse_request(request, strlen(request), path, path_len);
+}
+
+/* Test request parsing */
+void test_admin_parse() {
+    printf("Testing admin request parsing... ");
+
+    const char *path;
+    size_t path_len;
+    assert(parse("GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n", &path, &path_len) == 1);
+    assert(path_len == 8 && memcmp(path, "/metrics", 8) == 0);
+    assert(parse("GET /metrics HTTP/1.1\r\nHost: x\r\n", &path, &path_len) == 0);
+    assert(parse("GE", &path, &path_len) == 0);
+    assert(parse("POST /metrics HTTP/1.1\r\n\r\n", &path, &path_len) == -1);
+
+    /* HTTP/0.9-style request line without a version */
+    assert(parse("GET /\r\n\r\n", &path, &path_len) == 1);
+    assert(path_len == 1 && path[0] == '/');
+
+    printf("PASSED\n");
+}
+
+static int render(char *out, size_t cap, void *arg) {
+    (void)arg;
+    return snprintf(out, cap, "up 1\n");
+}
+
+static int connect_to(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = port};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+/* Handle whatever the admin connections are ready for, waiting up to
+ * wait_ms for the first event */
+static void pump(admin_t *admin, int64_t now_ms, int wait_ms) {
+    struct pollfd fds[ADMIN_MAX_CONNS];
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        fds[i].fd = admin->conns[i].fd;
+        fds[i].events = admin_poll_events(admin, i);
+    }
+    assert(poll(fds, ADMIN_MAX_CONNS, wait_ms) >= 0);
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        if (fds[i].revents && admin->conns[i].fd != -1) {
+            admin_handle_events(admin, i, fds[i].revents, now_ms);
+        }
+    }
+}
+
+/* Test that connections which never finish a request give their slots up */
+void test_admin_timeout() {
+    printf("Testing admin request timeout... ");
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    assert(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listen_fd, ADMIN_MAX_CONNS + 2) == 0);
+    assert(getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) == 0);
+    static admin_t admin;
+    admin_init(&admin, listen_fd, render, NULL);
+
+    /* Every slot is taken by a connection that sends part of a request or
+     * nothing at all, and the next one is turned away */
+    int64_t now_ms = 1000;
+    int idle[ADMIN_MAX_CONNS];
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        idle[i] = connect_to(addr.sin_port);
+        admin_accept(&admin, now_ms);
+    }
+    const char partial[] = "GET /metrics HTTP/1.1\r\n";
+    assert(send(idle[0], partial, strlen(partial), 0) == (ssize_t)strlen(partial));
+    pump(&admin, now_ms, 100);
+    assert(admin.conns[0].request_len == strlen(partial) && !admin.conns[0].response);
+    int turned_away = connect_to(addr.sin_port);
+    admin_accept(&admin, now_ms);
+    char byte;
+    assert(recv(turned_away, &byte, 1, 0) == 0);
+    close(turned_away);
+
+    /* Reading more of the request does not buy time */
+    admin_sweep(&admin, now_ms + ADMIN_TIMEOUT_MS - 1);
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        assert(admin.conns[i].fd != -1);
+    }
+    assert(send(idle[0], "Host: x", 7, 0) == 7);
+    pump(&admin, now_ms + ADMIN_TIMEOUT_MS - 1, 100);
+    admin_sweep(&admin, now_ms + ADMIN_TIMEOUT_MS);
+    for (int i = 0; i < ADMIN_MAX_CONNS; i++) {
+        assert(admin.conns[i].fd == -1);
+        assert(recv(idle[i], &byte, 1, 0) <= 0);
+        close(idle[i]);
+    }
+
+    /* The freed slots serve the metrics again */
+    now_ms += ADMIN_TIMEOUT_MS;
+    int scraper = connect_to(addr.sin_port);
+    admin_accept(&admin, now_ms);
+    const char request[] = "GET /metrics HTTP/1.1\r\n\r\n";
+    assert(send(scraper, request, strlen(request), 0) == (ssize_t)strlen(request));
+    for (int i = 0; i < 10 && admin.conns[0].fd != -1; i++) {
+        pump(&admin, now_ms, 100);
+    }
+    assert(admin.conns[0].fd == -1);
+    char response[256];
+    size_t got = 0;
+    ssize_t n;
+    while ((n = recv(scraper, response + got, sizeof(response) - 1 - got, 0)) > 0) {
+        got += (size_t)n;
+    }
+    response[got] = '\0';
+    assert(strstr(response, "200 OK") && strstr(response, "\r\n\r\nup 1\n"));
+    close(scraper);
+
+    admin_close(&admin);
+    printf("PASSED\n");
+}
+
+/* Run all admin endpoint tests */
+int test_admin_main(void) {
+    printf("\n=== Running Admin Endpoint Tests ===\n\n");
+
+    test_admin_parse();
+    test_admin_timeout();
+
+    printf("\n=== All Admin Endpoint Tests Passed ===\n\n");
+    return 0;
+}
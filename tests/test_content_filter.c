@@ -0,0 +1,148 @@
+/**
+ * @file test_content_filter.c
+ * @brief Unit tests for the banned-term filter
+ */
+
+#include "content_filter.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+static ac_automaton_t *build(const char *const *terms, size_t num_terms) {
+    size_t lens[16];
+    for (size_t i = 0; i < num_terms; i++) {
+        lens[i] = strlen(terms[i]);
+    }
+    ac_automaton_t *ac = ac_build(terms, lens, num_terms);
+    assert(ac);
+    return ac;
+}
+
+static int match(const ac_automaton_t *ac, const char *text) {
+    return ac_match(ac, text, strlen(text));
+}
+
+/* Naive reference: case-insensitive substring search */
+static int naive_match(const char *const *terms, size_t num_terms, const char *text,
+                       size_t len) {
+    for (size_t t = 0; t < num_terms; t++) {
+        size_t term_len = strlen(terms[t]);
+        for (size_t i = 0; term_len > 0 && i + term_len <= len; i++) {
+            if (strncasecmp(text + i, terms[t], term_len) == 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Test matching, including terms found only through failure links */
+void test_ac_match() {
+    printf("Testing Aho-Corasick matching... ");
+
+    const char *terms[] = {"he", "she", "his", "hers", "spam"};
+    ac_automaton_t *ac = build(terms, 5);
+    assert(ac->num_terms == 5);
+
+    assert(match(ac, "ushers"));
+    assert(match(ac, "a shell"));
+    assert(match(ac, "THIS"));
+    assert(match(ac, "buy SpAm now"));
+    assert(!match(ac, "spa m"));
+    assert(!match(ac, "quiet words only"));
+    assert(!match(ac, ""));
+    ac_free(ac);
+
+    /* No terms: nothing matches */
+    ac = ac_build(NULL, NULL, 0);
+    assert(ac && !match(ac, "anything"));
+    ac_free(ac);
+
+    printf("PASSED\n");
+}
+
+/* Test that the start-state prefilter never changes the result */
+void test_ac_prefilter() {
+    printf("Testing Aho-Corasick prefilter... ");
+
+    const char *terms[] = {"zq", "xqz", "qqq", "\x80\xff", "Zx"};
+    ac_automaton_t *ac = build(terms, 5);
+    assert(ac->prefilter > 0);
+    int mode = ac->prefilter;
+
+    srand(7);
+    char text[64];
+    for (int round = 0; round < 2000; round++) {
+        size_t len = (size_t)(rand() % (int)sizeof(text));
+        for (size_t i = 0; i < len; i++) {
+            /* Mostly bytes that cannot start a term, some that can */
+            int r = rand() % 16;
+            text[i] = r == 0 ? 'z' : r == 1 ? 'q' : r == 2 ? 'X' : r == 3 ? (char)0x80
+                    : r == 4 ? (char)0xff : (char)('a' + rand() % 16);
+        }
+        int expected = naive_match(terms, 5, text, len);
+        for (int m = 0; m <= mode; m++) {
+            ac->prefilter = m;
+            assert(ac_match(ac, text, len) == expected);
+        }
+    }
+    ac_free(ac);
+
+    printf("PASSED\n");
+}
+
+/* Test loading a term list and swapping in a reloaded one */
+void test_content_filter_reload() {
+    printf("Testing content filter reload... ");
+
+    char path[] = "/tmp/test_banned_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    const char list[] = "# comment\n\nbadword\r\nworse\n";
+    assert(write(fd, list, sizeof(list) - 1) == (ssize_t)(sizeof(list) - 1));
+
+    content_filter_t filter;
+    assert(content_filter_start(&filter, path) == 0);
+    assert(filter.active->num_terms == 2);
+    assert(content_filter_check(&filter, "a BadWord here", 14));
+    assert(!content_filter_check(&filter, "# comment", 9));
+    assert(!content_filter_check(&filter, "fresh", 5));
+    assert(filter.checked == 3 && filter.blocked == 1);
+
+    assert(ftruncate(fd, 0) == 0);
+    assert(pwrite(fd, "fresh\n", 6, 0) == 6);
+    content_filter_reload(&filter);
+    for (int i = 0; i < 1000 && !content_filter_poll(&filter); i++) {
+        usleep(1000);
+    }
+    assert(content_filter_check(&filter, "fresh", 5));
+    assert(!content_filter_check(&filter, "a BadWord here", 14));
+
+    /* A list that cannot be read leaves the current one active */
+    close(fd);
+    unlink(path);
+    content_filter_reload(&filter);
+    usleep(20000);
+    assert(!content_filter_poll(&filter));
+    assert(content_filter_check(&filter, "fresh", 5));
+
+    content_filter_stop(&filter);
+    assert(content_filter_start(&filter, path) == -1);
+
+    printf("PASSED\n");
+}
+
+/* Run all content filter tests */
+int test_content_filter_main(void) {
+    printf("\n=== Running Content Filter Tests ===\n\n");
+
+    test_ac_match();
+    test_ac_prefilter();
+    test_content_filter_reload();
+
+    printf("\n=== All Content Filter Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file test_ephemeral.c
+ * @brief Unit tests for ephemeral signal coalescing
+ */
+
+#include "ephemeral.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_SLOTS 8
+
+/* Recording sink: every slot hears every other, busy[] marks backed-up
+ * recipients and got[r][s] holds the last kind delivered */
+typedef struct {
+    slotset_t everyone;
+    int busy[NUM_SLOTS];
+    uint8_t got[NUM_SLOTS][NUM_SLOTS];
+    int deliveries;
+} recorder_t;
+
+static const slotset_t *audience(size_t sender, void *arg) {
+    (void)sender;
+    return &((recorder_t *)arg)->everyone;
+}
+
+static int busy(size_t recipient, void *arg) {
+    return ((recorder_t *)arg)->busy[recipient];
+}
+
+static void deliver(size_t recipient, size_t sender, uint8_t kind, void *arg) {
+    recorder_t *rec = arg;
+    rec->got[recipient][sender] = kind;
+    rec->deliveries++;
+}
+
+static void recorder_init(recorder_t *rec, ephemeral_sink_t *sink) {
+    memset(rec, 0, sizeof(*rec));
+    slotset_init(&rec->everyone, NUM_SLOTS);
+    for (size_t i = 0; i < 4; i++) {
+        slotset_add(&rec->everyone, i);
+    }
+    *sink = (ephemeral_sink_t){audience, busy, deliver, rec};
+}
+
+/* Test that signals within one interval go out once, latest first */
+void test_ephemeral_coalesce() {
+    printf("Testing ephemeral signal coalescing... ");
+
+    ephemeral_t eph;
+    recorder_t rec;
+    ephemeral_sink_t sink;
+    assert(ephemeral_init(&eph, NUM_SLOTS) == 0);
+    recorder_init(&rec, &sink);
+    assert(ephemeral_wait_ms(&eph, 0) == -1);
+
+    /* Keystrokes from slot 0 collapse into one announcement */
+    int64_t now = 1000;
+    for (int i = 0; i < 50; i++) {
+        assert(ephemeral_set(&eph, 0, 1, now) == 1);
+    }
+    assert(ephemeral_set(&eph, 0, 2, now) == 1);
+    assert(eph.coalesced == 50);
+    assert(ephemeral_wait_ms(&eph, now) == 0);
+    ephemeral_flush(&eph, now, &sink);
+    assert(rec.deliveries == 3);
+    assert(rec.got[1][0] == 2 && rec.got[2][0] == 2 && rec.got[3][0] == 2);
+    assert(rec.got[0][0] == 0);
+    assert(ephemeral_wait_ms(&eph, now) == -1);
+
+    /* An unchanged signal is not announced again until the refresh */
+    assert(ephemeral_set(&eph, 0, 2, now + 10) == 0);
+    assert(ephemeral_wait_ms(&eph, now + 10) == -1);
+    assert(ephemeral_set(&eph, 0, 2, now + EPHEMERAL_REFRESH_MS) == 1);
+
+    /* A flush is not due until the interval has passed */
+    assert(ephemeral_set(&eph, 1, 1, now + 20) == 1);
+    ephemeral_flush(&eph, now + 20, &sink);
+    assert(rec.deliveries == 3);
+    assert(ephemeral_wait_ms(&eph, now + 20) == EPHEMERAL_INTERVAL_MS - 20);
+
+    ephemeral_free(&eph);
+    slotset_free(&rec.everyone);
+    printf("PASSED\n");
+}
+
+/* Test that busy recipients get only the latest fresh signal later */
+void test_ephemeral_backlog() {
+    printf("Testing ephemeral signals to busy recipients... ");
+
+    ephemeral_t eph;
+    recorder_t rec;
+    ephemeral_sink_t sink;
+    assert(ephemeral_init(&eph, NUM_SLOTS) == 0);
+    recorder_init(&rec, &sink);
+
+    /* Slot 3 is behind on chat: it is skipped and owed slot 0's signal */
+    int64_t now = 1000;
+    rec.busy[3] = 1;
+    ephemeral_set(&eph, 0, 1, now);
+    ephemeral_flush(&eph, now, &sink);
+    assert(rec.got[1][0] == 1 && rec.got[3][0] == 0);
+    assert(eph.deferred == 1);
+
+    /* Newer signals replace the owed one instead of piling up */
+    now += EPHEMERAL_INTERVAL_MS;
+    ephemeral_set(&eph, 0, 2, now);
+    ephemeral_flush(&eph, now, &sink);
+    now += EPHEMERAL_INTERVAL_MS;
+    ephemeral_set(&eph, 0, 1, now);
+    ephemeral_set(&eph, 2, 3, now);
+    ephemeral_flush(&eph, now, &sink);
+    assert(rec.got[3][0] == 0);
+
+    /* Caught up: one delivery per sender, the latest kind */
+    rec.busy[3] = 0;
+    int before = rec.deliveries;
+    now += EPHEMERAL_INTERVAL_MS;
+    assert(ephemeral_wait_ms(&eph, now) == 0);
+    ephemeral_flush(&eph, now, &sink);
+    assert(rec.deliveries == before + 2);
+    assert(rec.got[3][0] == 1 && rec.got[3][2] == 3);
+    assert(ephemeral_wait_ms(&eph, now) == -1);
+
+    /* Stale signals are dropped rather than delivered late */
+    rec.busy[3] = 1;
+    now += EPHEMERAL_INTERVAL_MS;
+    ephemeral_set(&eph, 1, 1, now);
+    ephemeral_flush(&eph, now, &sink);
+    rec.busy[3] = 0;
+    before = rec.deliveries;
+    ephemeral_flush(&eph, now + EPHEMERAL_TTL_MS, &sink);
+    assert(rec.deliveries == before && eph.expired == 1);
+
+    /* A sender that leaves is no longer owed to anyone */
+    rec.busy[3] = 1;
+    now += EPHEMERAL_TTL_MS + EPHEMERAL_INTERVAL_MS;
+    ephemeral_set(&eph, 2, 1, now);
+    ephemeral_flush(&eph, now, &sink);
+    ephemeral_forget(&eph, 2);
+    rec.busy[3] = 0;
+    before = rec.deliveries;
+    ephemeral_flush(&eph, now + EPHEMERAL_INTERVAL_MS, &sink);
+    assert(rec.deliveries == before);
+    assert(ephemeral_wait_ms(&eph, now) == -1);
+
+    ephemeral_free(&eph);
+    slotset_free(&rec.everyone);
+    printf("PASSED\n");
+}
+
+/* Run all ephemeral signal tests */
+int test_ephemeral_main(void) {
+    printf("\n=== Running Ephemeral Signal Tests ===\n\n");
+
+    test_ephemeral_coalesce();
+    test_ephemeral_backlog();
+
+    printf("\n=== All Ephemeral Signal Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file test_fanout.c
+ * @brief Unit tests for the broadcast fan-out strategies
+ */
+
+#include "fanout.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define NUM_RECIPIENTS 3
+
+/* Broadcast one buffer through a strategy and check every recipient got it */
+static void broadcast_and_check(fanout_t *fanout, const uint8_t *data, size_t len) {
+    int pairs[NUM_RECIPIENTS][2];
+    for (int i = 0; i < NUM_RECIPIENTS; i++) {
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) == 0);
+        int size = (int)len * 2 + 4096;
+        setsockopt(pairs[i][0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(pairs[i][1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    fanout_begin(fanout, data, len);
+    for (int i = 0; i < NUM_RECIPIENTS; i++) {
+        assert(fanout_send(fanout, pairs[i][0], data, len) == (ssize_t)len);
+    }
+    fanout_end(fanout);
+
+    uint8_t *received = malloc(len);
+    for (int i = 0; i < NUM_RECIPIENTS; i++) {
+        size_t got = 0;
+        while (got < len) {
+            ssize_t n = read(pairs[i][1], received + got, len - got);
+            assert(n > 0);
+            got += (size_t)n;
+        }
+        assert(memcmp(received, data, len) == 0);
+        close(pairs[i][0]);
+        close(pairs[i][1]);
+    }
+    free(received);
+}
+
+/* Test strategy names */
+void test_fanout_modes() {
+    printf("Testing fan-out strategy names... ");
+
+    fanout_mode_t mode;
+    assert(fanout_mode_parse("send", &mode) == 0 && mode == FANOUT_SEND);
+    assert(fanout_mode_parse("splice", &mode) == 0 && mode == FANOUT_SPLICE);
+    assert(fanout_mode_parse("zerocopy", &mode) == -1);
+    assert(strcmp(fanout_mode_name(FANOUT_SPLICE), "splice") == 0);
+
+    printf("PASSED\n");
+}
+
+/* Test that both strategies deliver the same bytes */
+void test_fanout_delivery() {
+    printf("Testing fan-out delivery... ");
+
+    const uint8_t frame[] = "\x01\x7f\x00\x00\x01\x1f\x90\x05" "alicehello\n";
+    size_t frame_len = sizeof(frame) - 1;
+
+    fanout_t fanout;
+    assert(fanout_init(&fanout, FANOUT_SEND) == 0);
+    broadcast_and_check(&fanout, frame, frame_len);
+    fanout_free(&fanout);
+
+    assert(fanout_init(&fanout, FANOUT_SPLICE) == 0);
+    broadcast_and_check(&fanout, frame, frame_len);
+    assert(fanout.spliced == NUM_RECIPIENTS && fanout.fallbacks == 0);
+
+    /* The source pipe is empty again, so the next broadcast starts clean */
+    broadcast_and_check(&fanout, frame, 8);
+    assert(fanout.spliced == 2 * NUM_RECIPIENTS);
+
+    /* Broadcasts larger than the pipe fall back to send() */
+    uint8_t big[4096];
+    for (size_t i = 0; i < sizeof(big); i++) {
+        big[i] = (uint8_t)(i * 7);
+    }
+    fanout.capacity = sizeof(big) - 1;
+    broadcast_and_check(&fanout, big, sizeof(big));
+    assert(fanout.fallbacks == NUM_RECIPIENTS);
+    fanout_free(&fanout);
+
+    printf("PASSED\n");
+}
+
+/* Run all fan-out tests */
+int test_fanout_main(void) {
+    printf("\n=== Running Fan-out Tests ===\n\n");
+
+    test_fanout_modes();
+    test_fanout_delivery();
+
+    printf("\n=== All Fan-out Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file test_frame.cpp
+ * @brief Unit tests for the compile-time frame schemas
+ */
+
+#include "Frame.hpp"
+
+extern "C" {
+    #include "frame_parser.h"
+}
+
+#include <cassert>
+#include <cstdio>
+#include <string_view>
+
+using namespace chat;
+
+/* Test that C++ encoders and C decoders agree on the peer frame layout */
+static void test_chat_roundtrip() {
+    printf("Testing Chat frame encode/parse... ");
+
+    char buf[BUF_SIZE];
+    size_t len = frame::encode<frames::Chat>(buf, sizeof(buf), uint32_t(0x0100007f),
+                                             uint16_t(0x901f), std::string_view("alice"),
+                                             std::string_view("hello there"));
+    assert(len == PEER_FRAME_HEADER + 5 + 11 + 1);
+
+    auto view = frame::FrameView<frames::Chat>::parse(std::string_view(buf, len));
+    assert(view);
+    assert(view->get<0>() == 0x0100007f);
+    assert(view->get<1>() == 0x901f);
+    assert(view->get<2>() == "alice");
+    assert(view->get<3>() == "hello there");
+
+    /* Views point into the receive buffer rather than copying */
+    assert(view->get<3>().data() == buf + PEER_FRAME_HEADER + 5);
+
+    peer_frame_t peer;
+    assert(decode_peer_frame(reinterpret_cast<const uint8_t *>(buf), len, &peer) == 0);
+    assert(peer.ip == 0x0100007f && peer.port == 0x901f);
+    assert(std::string_view(peer.username, peer.username_len) == "alice");
+    assert(std::string_view(peer.payload, peer.payload_len) == "hello there");
+
+    printf("PASSED\n");
+}
+
+/* Test that parsing rejects frames that do not match the schema */
+static void test_parse_bounds() {
+    printf("Testing FrameView bounds checks... ");
+
+    char buf[BUF_SIZE];
+    size_t len = frame::encode<frames::Join>(buf, sizeof(buf), uint32_t(1), uint16_t(2),
+                                             std::string_view("bob"));
+    assert(len == PEER_FRAME_HEADER + 3 + 1);
+    assert(frame::FrameView<frames::Join>::parse(std::string_view(buf, len)));
+
+    /* Truncated, wrong type, trailing bytes, missing terminator */
+    assert(!frame::FrameView<frames::Join>::parse(std::string_view(buf, len - 2)));
+    assert(!frame::FrameView<frames::Disconnect>::parse(std::string_view(buf, len)));
+    buf[len - 1] = 'x';
+    buf[len] = '\n';
+    assert(!frame::FrameView<frames::Join>::parse(std::string_view(buf, len + 1)));
+    assert(!frame::FrameView<frames::Join>::parse(std::string_view(buf, len)));
+
+    /* Username length pointing past the end */
+    len = frame::encode<frames::Join>(buf, sizeof(buf), uint32_t(1), uint16_t(2),
+                                      std::string_view("bob"));
+    buf[7] = 100;
+    assert(!frame::FrameView<frames::Join>::parse(std::string_view(buf, len)));
+
+    printf("PASSED\n");
+}
+
+/* Test fixed-layout frames and encoder validation */
+static void test_fixed_frames() {
+    printf("Testing fixed frames... ");
+
+    char buf[64];
+    size_t len = frame::encode<frames::ClientHello>(buf, sizeof(buf), uint8_t(PROTOCOL_VERSION),
+                                                    uint64_t(FEATURE_ACKS | FEATURE_MSG_IDS));
+    assert(len == HELLO_CLIENT_LEN);
+
+    uint8_t c_hello[HELLO_CLIENT_LEN + 1];
+    encode_client_hello(c_hello, FEATURE_ACKS | FEATURE_MSG_IDS);
+    assert(std::string_view(buf, len) ==
+           std::string_view(reinterpret_cast<const char *>(c_hello), HELLO_CLIENT_LEN));
+
+    len = frame::encode<frames::SearchEnd>(buf, sizeof(buf), uint32_t(258));
+    auto end = frame::FrameView<frames::SearchEnd>::parse(std::string_view(buf, len));
+    assert(end && end->get<0>() == 258);
+    assert(buf[3] == 1 && buf[4] == 2);
+
+    len = frame::encode<frames::ChatId>(buf, sizeof(buf), uint64_t(0xabcdef), std::string_view("hi"));
+    auto chat_id = frame::FrameView<frames::ChatId>::parse(std::string_view(buf, len));
+    assert(chat_id && chat_id->get<0>() == 0xabcdef && chat_id->get<1>() == "hi");
+
+    /* Values that would break framing or do not fit are refused */
+    assert(frame::encode<frames::Search>(buf, sizeof(buf), std::string_view("a\nb")) == 0);
+    assert(frame::encode<frames::Search>(buf, 3, std::string_view("abc")) == 0);
+    assert(frame::encode<frames::ClientHello>(buf, sizeof(buf), uint8_t(2), uint64_t(1) << 32) == 0);
+
+    len = frame::encode<frames::Leave>(buf, sizeof(buf));
+    assert(len == 2 && buf[0] == MSG_TYPE_DISCONNECT && buf[1] == '\n');
+
+    printf("PASSED\n");
+}
+
+/* Count frames found by the C parser */
+static int count_frame(const uint8_t *, size_t len, void *arg) {
+    auto *lengths = static_cast<size_t *>(arg);
+    lengths[lengths[0]++ + 1] = len;
+    return 0;
+}
+
+/* Test that session frames built from the schemas split where the C parser
+ * expects, including a username length byte equal to '\n' */
+static void test_session_frames() {
+    printf("Testing session frames... ");
+
+    char buf[256];
+    size_t len = frame::encode<frames::SessionOpen>(buf, sizeof(buf), uint64_t(0x1f),
+                                                    std::string_view("abcdefghij"));
+    assert(len == 1 + SESSION_ID_HEX_LEN + 1 + 10 + 1);
+    size_t chat_len = frame::encode<frames::SessionChat>(buf + len, sizeof(buf) - len,
+                                                         uint64_t(0x1f), uint64_t(7),
+                                                         std::string_view("hi"));
+    size_t close_len = frame::encode<frames::SessionClose>(buf + len + chat_len,
+                                                           sizeof(buf) - len - chat_len,
+                                                           uint64_t(0x1f));
+    assert(chat_len == 1 + SESSION_ID_HEX_LEN + MSG_ID_HEX_LEN + 2 + 1);
+    assert(close_len == 1 + SESSION_ID_HEX_LEN + 1);
+
+    size_t lengths[8] = {0};
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    assert(frame_parser_feed(&parser, reinterpret_cast<const uint8_t *>(buf),
+                             len + chat_len + close_len, count_frame, lengths) == 0);
+    assert(lengths[0] == 3 && lengths[1] == len && lengths[2] == chat_len &&
+           lengths[3] == close_len);
+
+    auto open = frame::FrameView<frames::SessionOpen>::parse(std::string_view(buf, len));
+    assert(open && open->get<0>() == 0x1f && open->get<1>() == "abcdefghij");
+
+    /* Status byte of an ack, seen by a client */
+    len = frame::encode<frames::SessionAck>(buf, sizeof(buf), uint64_t(0xffff),
+                                            uint8_t(REGISTER_TAKEN));
+    lengths[0] = 0;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    assert(frame_parser_feed(&parser, reinterpret_cast<const uint8_t *>(buf), len, count_frame,
+                             lengths) == 0);
+    assert(lengths[0] == 1 && lengths[1] == len);
+    assert(frame::encode<frames::SessionClose>(buf, sizeof(buf), uint64_t(0x10000)) == 0);
+
+    printf("PASSED\n");
+}
+
+/* Run all frame schema tests */
+extern "C" int test_frame_main(void) {
+    printf("\n=== Running Frame Schema Tests ===\n\n");
+
+    test_chat_roundtrip();
+    test_parse_bounds();
+    test_fixed_frames();
+    test_session_frames();
+
+    printf("\n=== All Frame Schema Tests Passed ===\n\n");
+    return 0;
+}
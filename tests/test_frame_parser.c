@@ -0,0 +1,278 @@
+/**
+ * @file test_frame_parser.c
+ * @brief Unit tests for the incremental frame parser
+ */
+
+#include "frame_parser.h"
+#include "protocol.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_FRAMES 16
+
+/* Frames collected by the test handler */
+typedef struct {
+    const uint8_t *ptr[MAX_FRAMES];
+    uint8_t copy[MAX_FRAMES][FRAME_MAX_LEN];
+    size_t len[MAX_FRAMES];
+    int count;
+    int stop_after;
+} collected_t;
+
+static int collect(const uint8_t *frame, size_t len, void *arg) {
+    collected_t *c = arg;
+    assert(c->count < MAX_FRAMES);
+    c->ptr[c->count] = frame;
+    memcpy(c->copy[c->count], frame, len);
+    c->len[c->count] = len;
+    c->count++;
+    return c->stop_after > 0 && c->count >= c->stop_after;
+}
+
+/* Build a USERNAME frame: [type][len][name]\n */
+static size_t username_frame(uint8_t *buf, const char *name) {
+    size_t name_len = strlen(name);
+    buf[0] = MSG_TYPE_USERNAME;
+    buf[1] = (uint8_t)name_len;
+    memcpy(buf + 2, name, name_len);
+    buf[2 + name_len] = '\n';
+    return name_len + 3;
+}
+
+/* Test that several frames in one chunk are delivered in place */
+void test_parser_whole_chunk() {
+    printf("Testing frame parser with whole chunk... ");
+
+    uint8_t stream[256];
+    size_t len = username_frame(stream, "alice");
+    size_t first = len;
+    memcpy(stream + len, "\x00hello\n\x05hi\n", 11);
+    len += 11;
+
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    collected_t c = {0};
+    assert(frame_parser_feed(&parser, stream, len, collect, &c) == 0);
+
+    assert(c.count == 3);
+    assert(c.len[0] == first && memcmp(c.copy[0], stream, first) == 0);
+    assert(c.len[1] == 7 && memcmp(c.copy[1], "\x00hello\n", 7) == 0);
+    assert(c.len[2] == 4 && memcmp(c.copy[2], "\x05hi\n", 4) == 0);
+
+    /* No copies for frames that did not span chunks */
+    assert(c.ptr[0] == stream);
+    assert(c.ptr[1] == stream + first);
+    assert(c.ptr[2] == stream + first + 7);
+
+    printf("PASSED\n");
+}
+
+/* Test that feeding one byte at a time yields the same frames */
+void test_parser_byte_at_a_time() {
+    printf("Testing frame parser byte by byte... ");
+
+    uint8_t stream[256];
+    size_t len = 0;
+    uint8_t hello[HELLO_CLIENT_LEN + 1];
+    encode_client_hello(hello, FEATURE_ACKS);
+    memcpy(stream, hello, HELLO_CLIENT_LEN);
+    len += HELLO_CLIENT_LEN;
+    len += username_frame(stream + len, "bob");
+    memcpy(stream + len, "\x00some text\n", 11);
+    len += 11;
+
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    collected_t c = {0};
+    for (size_t i = 0; i < len; i++) {
+        assert(frame_parser_feed(&parser, stream + i, 1, collect, &c) == 0);
+    }
+
+    assert(c.count == 3);
+    assert(c.len[0] == HELLO_CLIENT_LEN && memcmp(c.copy[0], hello, HELLO_CLIENT_LEN) == 0);
+    assert(c.len[1] == 6 && memcmp(c.copy[1], "\x03\x03" "bob\n", 6) == 0);
+    assert(c.len[2] == 11 && memcmp(c.copy[2], "\x00some text\n", 11) == 0);
+
+    printf("PASSED\n");
+}
+
+/* Test length and address bytes equal to '\n' inside frames */
+void test_parser_embedded_newline() {
+    printf("Testing frame parser with embedded newline bytes... ");
+
+    /* A ten-character username has length byte '\n' */
+    uint8_t stream[256];
+    size_t len = username_frame(stream, "abcdefghij");
+    assert(stream[1] == '\n');
+
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    collected_t c = {0};
+    assert(frame_parser_feed(&parser, stream, 5, collect, &c) == 0);
+    assert(frame_parser_feed(&parser, stream + 5, len - 5, collect, &c) == 0);
+    assert(c.count == 1 && c.len[0] == len);
+
+    /* Peer frame from 10.0.0.10, port 10, split inside the header */
+    uint32_t ip = 0x0a00000a;
+    uint16_t port = 0x0a00;
+    len = (size_t)encode_peer_frame(stream, sizeof(stream), MSG_TYPE_CHAT, ip, port, "joe",
+                                    "msg", 3);
+    uint8_t join[64];
+    int join_len = encode_peer_frame(join, sizeof(join), MSG_TYPE_JOIN, ip, port, "joe", NULL, 0);
+    memcpy(stream + len, join, (size_t)join_len);
+    len += (size_t)join_len;
+
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    memset(&c, 0, sizeof(c));
+    assert(frame_parser_feed(&parser, stream, 3, collect, &c) == 0);
+    assert(c.count == 0);
+    assert(frame_parser_feed(&parser, stream + 3, len - 3, collect, &c) == 0);
+    assert(c.count == 2);
+
+    peer_frame_t peer;
+    assert(decode_peer_frame(c.copy[0], c.len[0], &peer) == 0);
+    assert(peer.ip == ip && peer.port == port);
+    assert(peer.payload_len == 3 && memcmp(peer.payload, "msg", 3) == 0);
+    assert(decode_peer_frame(c.copy[1], c.len[1], &peer) == 0);
+    assert(c.copy[1][0] == MSG_TYPE_JOIN && peer.username_len == 3);
+
+    printf("PASSED\n");
+}
+
+/* Test frames with a second length-prefixed field */
+void test_parser_topic_frames() {
+    printf("Testing frame parser with topic frames... ");
+
+    /* Ten-character topic and username: both length bytes are '\n' */
+    uint8_t payload[64];
+    payload[0] = 10;
+    memcpy(payload + 1, "team.infrahi", 12);
+    uint8_t stream[256];
+    size_t len = (size_t)encode_peer_frame(stream, sizeof(stream), MSG_TYPE_TOPIC_CHAT,
+                                           0x0a00000a, 0x0a00, "abcdefghij", (char *)payload, 13);
+    size_t first = len;
+    uint8_t ack[] = {MSG_TYPE_SUBSCRIBE_ACK, TOPIC_OK, '\n'};
+    memcpy(stream + len, ack, sizeof(ack));
+    len += sizeof(ack);
+
+    frame_parser_t parser;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    collected_t c = {0};
+    for (size_t i = 0; i < len; i++) {
+        assert(frame_parser_feed(&parser, stream + i, 1, collect, &c) == 0);
+    }
+    assert(c.count == 2 && c.len[0] == first && c.len[1] == sizeof(ack));
+
+    peer_frame_t peer;
+    assert(decode_peer_frame(c.copy[0], c.len[0], &peer) == 0);
+    assert(peer.payload_len == 13 && (uint8_t)peer.payload[0] == 10);
+    assert(memcmp(peer.payload + 1, "team.infrahi", 12) == 0);
+
+    /* PUBLISH: [type][topic_len][topic][message]\n */
+    uint8_t publish[] = {MSG_TYPE_PUBLISH, 3, 'a', '.', 'b', 'h', 'i', '\n',
+                         MSG_TYPE_SUBSCRIBE, 1, 1, '#', '\n'};
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    memset(&c, 0, sizeof(c));
+    assert(frame_parser_feed(&parser, publish, sizeof(publish), collect, &c) == 0);
+    assert(c.count == 2 && c.len[0] == 8 && c.len[1] == 5);
+
+    /* SIGNAL: [type][kind]\n to the server, a peer frame carrying the kind
+     * back, here after a username whose length byte is '\n' */
+    uint8_t signal[] = {MSG_TYPE_SIGNAL, SIGNAL_TYPING, '\n', MSG_TYPE_SIGNAL, SIGNAL_IDLE, '\n'};
+    memset(&c, 0, sizeof(c));
+    assert(frame_parser_feed(&parser, signal, sizeof(signal), collect, &c) == 0);
+    assert(c.count == 2 && c.len[0] == 3 && c.len[1] == 3);
+
+    uint8_t kind = SIGNAL_PRESENCE;
+    len = (size_t)encode_peer_frame(stream, sizeof(stream), MSG_TYPE_SIGNAL, 0, 0, "abcdefghij",
+                                    (char *)&kind, 1);
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    memset(&c, 0, sizeof(c));
+    for (size_t i = 0; i < len; i++) {
+        assert(frame_parser_feed(&parser, stream + i, 1, collect, &c) == 0);
+    }
+    assert(c.count == 1 && c.len[0] == len);
+    assert(decode_peer_frame(c.copy[0], c.len[0], &peer) == 0);
+    assert(peer.payload_len == 1 && (uint8_t)peer.payload[0] == SIGNAL_PRESENCE);
+
+    /* Reactions: a number and a count whose bytes are all '\n' */
+    uint8_t reaction[] = {MSG_TYPE_CHAT_SEQ, 10, 10, 10, 10, 10, 10, 10, 10, '\n',
+                          MSG_TYPE_REACTION_COUNT, 10, 10, 10, 10, 10, 10, 10, 10,
+                          10, 10, 10, 10, 2, '+', '1', '\n'};
+    memset(&c, 0, sizeof(c));
+    for (size_t i = 0; i < sizeof(reaction); i++) {
+        assert(frame_parser_feed(&parser, reaction + i, 1, collect, &c) == 0);
+    }
+    assert(c.count == 2 && c.len[0] == CHAT_SEQ_LEN && c.len[1] == 17);
+
+    /* Transfer port 10 * 256 + 10 */
+    uint8_t transfer_info[] = {MSG_TYPE_TRANSFER_INFO, 10, 10, '\n'};
+    memset(&c, 0, sizeof(c));
+    assert(frame_parser_feed(&parser, transfer_info, sizeof(transfer_info), collect, &c) == 0);
+    assert(c.count == 1 && c.len[0] == TRANSFER_INFO_LEN);
+
+    uint8_t chat_failed[] = "\x1e" "00000000000000ff" "\n";
+    memset(&c, 0, sizeof(c));
+    assert(frame_parser_feed(&parser, chat_failed, sizeof(chat_failed) - 1, collect, &c) == 0);
+    assert(c.count == 1 && c.len[0] == CHAT_FAILED_LEN);
+
+    uint8_t session_failed[] = "\x1f" "0012" "00000000000000ff" "\n";
+    memset(&c, 0, sizeof(c));
+    assert(frame_parser_feed(&parser, session_failed, sizeof(session_failed) - 1, collect, &c) ==
+           0);
+    assert(c.count == 1 && c.len[0] == SESSION_FAILED_LEN);
+
+    uint8_t react[] = "\x1a\x01" "000000000000000a" "\x02+1\n";
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    memset(&c, 0, sizeof(c));
+    assert(frame_parser_feed(&parser, react, sizeof(react) - 1, collect, &c) == 0);
+    assert(c.count == 1 && c.len[0] == REACT_HEADER + 3);
+
+    printf("PASSED\n");
+}
+
+/* Test malformed input and handler-requested stops */
+void test_parser_errors() {
+    printf("Testing frame parser errors... ");
+
+    frame_parser_t parser;
+    collected_t c = {0};
+
+    /* Text frame with no terminator in sight */
+    static uint8_t big[FRAME_MAX_LEN + 1];
+    memset(big, 'x', sizeof(big));
+    big[0] = MSG_TYPE_CHAT;
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    assert(frame_parser_feed(&parser, big, 100, collect, &c) == 0);
+    assert(frame_parser_feed(&parser, big + 100, sizeof(big) - 100, collect, &c) == -1);
+    assert(c.count == 0);
+
+    /* Fixed frame whose terminator is missing */
+    uint8_t bad[] = {MSG_TYPE_USERNAME, 2, 'a', 'b', 'X'};
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    assert(frame_parser_feed(&parser, bad, sizeof(bad), collect, &c) == -1);
+
+    /* Stop after the first frame; the rest of the chunk is dropped */
+    uint8_t two[] = {MSG_TYPE_CHAT, 'a', '\n', MSG_TYPE_CHAT, 'b', '\n'};
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    c.stop_after = 1;
+    assert(frame_parser_feed(&parser, two, sizeof(two), collect, &c) == 1);
+    assert(c.count == 1 && c.len[0] == 3);
+
+    printf("PASSED\n");
+}
+
+/* Run all frame parser tests */
+int test_frame_parser_main(void) {
+    printf("\n=== Running Frame Parser Tests ===\n\n");
+
+    test_parser_whole_chunk();
+    test_parser_byte_at_a_time();
+    test_parser_embedded_newline();
+    test_parser_topic_frames();
+    test_parser_errors();
+
+    printf("\n=== All Frame Parser Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,495 @@
+/**
+ * @file test_history.c
+ * @brief Unit tests for the history log and search index
+ */
+
+#include "compactor.h"
+#include "group_commit.h"
+#include "history.h"
+#include "search_index.h"
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Create a fresh temporary directory for a history log */
+static void make_temp_dir(char *path, size_t size) {
+    snprintf(path, size, "/tmp/chat_history_XXXXXX");
+    assert(mkdtemp(path) != NULL);
+}
+
+static void remove_temp_dir(const char *path) {
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", path);
+    assert(system(cmd) == 0);
+}
+
+static void fill_record(history_record_t *rec, const char *username, const char *text) {
+    memset(rec, 0, sizeof(*rec));
+    rec->timestamp = 1000;
+    strcpy(rec->username, username);
+    rec->text_len = strlen(text);
+    memcpy(rec->text, text, rec->text_len);
+}
+
+/* Scan callback that counts records and remembers the last offset */
+static void count_records(uint64_t offset, const history_record_t *rec, void *arg) {
+    uint64_t *state = arg;
+    (void)rec;
+    state[0]++;
+    state[1] = offset;
+}
+
+/* Test search_index tokenization and intersection */
+void test_search_index_query() {
+    printf("Testing search_index_query... ");
+    
+    search_index_t index;
+    assert(search_index_init(&index) == 0);
+    
+    assert(search_index_add(&index, 0, "Deploy the backend", 18) == 0);
+    assert(search_index_add(&index, 50, "backend is down, backend!", 25) == 0);
+    assert(search_index_add(&index, 90, "frontend deploy done", 20) == 0);
+    
+    uint64_t hits[4];
+    assert(search_index_query(&index, "BACKEND", 7, hits, 4) == 2);
+    assert(hits[0] == 50 && hits[1] == 0);
+    
+    assert(search_index_query(&index, "deploy backend", 14, hits, 4) == 1);
+    assert(hits[0] == 0);
+    
+    assert(search_index_query(&index, "deploy", 6, hits, 1) == 1);
+    assert(hits[0] == 90);
+    
+    assert(search_index_query(&index, "missing", 7, hits, 4) == 0);
+    assert(search_index_query(&index, "  ", 2, hits, 4) == 0);
+    
+    search_index_free(&index);
+    printf("PASSED\n");
+}
+
+/* Test that the index keeps working after the term table grows */
+void test_search_index_growth() {
+    printf("Testing search_index growth... ");
+    
+    search_index_t index;
+    assert(search_index_init(&index) == 0);
+    
+    char text[32];
+    for (uint64_t i = 0; i < 5000; i++) {
+        int len = snprintf(text, sizeof(text), "common word%llu", (unsigned long long)i);
+        assert(search_index_add(&index, i * 100, text, (size_t)len) == 0);
+    }
+    
+    uint64_t hits[2];
+    assert(search_index_query(&index, "word1234", 8, hits, 2) == 1);
+    assert(hits[0] == 123400);
+    assert(search_index_query(&index, "common", 6, hits, 2) == 2);
+    assert(hits[0] == 499900 && hits[1] == 499800);
+    
+    search_index_free(&index);
+    printf("PASSED\n");
+}
+
+/* Test append, read back and reopen of a history log */
+void test_history_append_read() {
+    printf("Testing history append/read... ");
+    
+    char dir[64];
+    make_temp_dir(dir, sizeof(dir));
+    
+    history_t history;
+    assert(history_open(&history, dir) == 0);
+    
+    history_record_t rec;
+    uint64_t first, second;
+    fill_record(&rec, "alice", "hello world");
+    assert(history_append(&history, &rec, &first) == 0);
+    assert(rec.seq == 1);
+    fill_record(&rec, "bob", "second message");
+    assert(history_append(&history, &rec, &second) == 0);
+    assert(rec.seq == 2);
+    assert(second > first);
+    
+    history_record_t out;
+    assert(history_read(&history, second, &out) == 0);
+    assert(out.seq == 2);
+    assert(strcmp(out.username, "bob") == 0);
+    assert(out.text_len == 14 && memcmp(out.text, "second message", 14) == 0);
+    history_close(&history);
+    
+    /* Reopening continues the sequence and still finds both records */
+    uint64_t state[2] = {0, 0};
+    assert(history_open(&history, dir) == 0);
+    assert(history.next_seq == 3);
+    assert(history_scan_range(&history, 0, history_end_offset(&history), count_records, state,
+                              0) == 0);
+    assert(state[0] == 2 && state[1] == second);
+    history_close(&history);
+    
+    remove_temp_dir(dir);
+    printf("PASSED\n");
+}
+
+/* Test that a torn record at the end of the log is truncated on open */
+void test_history_torn_tail() {
+    printf("Testing history torn tail... ");
+    
+    char dir[64];
+    make_temp_dir(dir, sizeof(dir));
+    
+    history_t history;
+    assert(history_open(&history, dir) == 0);
+    history_record_t rec;
+    fill_record(&rec, "alice", "complete");
+    assert(history_append(&history, &rec, NULL) == 0);
+    uint64_t good_size = history.segments[0].size;
+    
+    /* Simulate a crash half-way through the next record */
+    assert(pwrite(history.segments[0].fd, "\x40\x00\x00\x00partial", 11, (off_t)good_size) == 11);
+    history_close(&history);
+    
+    assert(history_open(&history, dir) == 0);
+    assert(history.segments[0].size == good_size);
+    assert(history.next_seq == 2);
+    history_close(&history);
+    
+    remove_temp_dir(dir);
+    printf("PASSED\n");
+}
+
+/* Test retention by size and by age, and scanning what remains */
+void test_history_expire() {
+    printf("Testing history_expire... ");
+    
+    char dir[64];
+    make_temp_dir(dir, sizeof(dir));
+    
+    history_t history;
+    assert(history_open(&history, dir) == 0);
+    history.segment_bytes = 100; /* Roll after every couple of records */
+    
+    history_record_t rec;
+    for (int i = 0; i < 10; i++) {
+        fill_record(&rec, "alice", "a message of some length");
+        rec.timestamp = 1000 + i;
+        assert(history_append(&history, &rec, NULL) == 0);
+    }
+    size_t before = history.num_segments;
+    assert(before >= 4);
+    
+    /* Nothing is old enough yet */
+    history_retention_t by_age = {100, 0};
+    assert(history_expire(&history, &by_age, 1050) == 0);
+    
+    /* Records with timestamp < 1004 expire; a segment goes only once all of it has */
+    assert(history_expire(&history, &by_age, 1104) > 0);
+    assert(history.segments[0].max_timestamp >= 1004);
+    
+    /* Size limit drops down to the active segment but never deletes it */
+    history_retention_t by_size = {0, 1};
+    assert(history_expire(&history, &by_size, 0) > 0);
+    assert(history.num_segments == 1);
+    
+    /* Scanning from the old start skips straight to what is left */
+    uint64_t state[2] = {0, 0};
+    assert(history_scan_range(&history, 0, history_end_offset(&history), count_records, state,
+                              0) == 0);
+    assert(state[0] >= 1 && state[1] >= history_start_offset(&history));
+    
+    history_close(&history);
+    remove_temp_dir(dir);
+    printf("PASSED\n");
+}
+
+/* Test that rolled-back records are gone and their numbers reused */
+/* Release a history log without writing a checkpoint, as if the server crashed */
+static void abandon_history(history_t *history) {
+    for (size_t i = 0; i < history->num_segments; i++) {
+        close(history->segments[i].fd);
+    }
+    free(history->segments);
+    free(history->active_entries);
+    pthread_mutex_destroy(&history->lock);
+}
+
+void test_history_rollback() {
+    printf("Testing history rollback... ");
+    
+    char dir[64];
+    make_temp_dir(dir, sizeof(dir));
+    
+    history_t history;
+    assert(history_open(&history, dir) == 0);
+    history.segment_bytes = 4096;
+    
+    history_record_t rec;
+    uint64_t offsets[201];
+    for (int i = 1; i <= 200; i++) {
+        fill_record(&rec, "alice", "rollback");
+        rec.timestamp = 1000 + i;
+        assert(history_append(&history, &rec, &offsets[i]) == 0);
+    }
+    assert(history.num_segments > 1);
+    assert(history_checkpoint(&history) == 0);
+    const history_segment_t *active = &history.segments[history.num_segments - 1];
+    
+    /* Sealed segments cannot be rolled back */
+    assert(history_rollback(&history, offsets[1]) == -1);
+    assert(history_rollback(&history, history_end_offset(&history)) == 0);
+    assert(history.next_seq == 201);
+    
+    uint64_t count = history.active_count;
+    uint64_t old_end = history_end_offset(&history);
+    assert(history_rollback(&history, offsets[197]) == 0);
+    assert(history.next_seq == 197);
+    assert(history.active_count == count - 4);
+    assert(history_end_offset(&history) == offsets[197]);
+    assert(active->last_seq == 196);
+    assert(active->max_timestamp == 1196);
+    assert(history_read(&history, offsets[197], &rec) == -1);
+    
+    fill_record(&rec, "bob", "again, but longer than before");
+    uint64_t offset;
+    assert(history_append(&history, &rec, &offset) == 0);
+    assert(rec.seq == 197 && offset == offsets[197]);
+    assert(history_read(&history, offset, &rec) == 0);
+    assert(strcmp(rec.username, "bob") == 0);
+    
+    /* Grow the segment past where the checkpoint taken before the rollback ended */
+    while (history_end_offset(&history) <= old_end) {
+        fill_record(&rec, "bob", "again, but longer than before");
+        assert(history_append(&history, &rec, NULL) == 0);
+    }
+    uint64_t end = history_end_offset(&history);
+    uint64_t next_seq = history.next_seq;
+    
+    /* The rollback survives a crash without cutting into the new record */
+    abandon_history(&history);
+    assert(history_open(&history, dir) == 0);
+    assert(history.next_seq == next_seq);
+    assert(history_end_offset(&history) == end);
+    assert(history_read(&history, offset, &rec) == 0 && rec.seq == 197);
+    
+    history_close(&history);
+    remove_temp_dir(dir);
+    printf("PASSED\n");
+}
+
+/* Test that sealed segment metadata is only read when retention needs it */
+void test_history_lazy_index() {
+    printf("Testing lazy segment indexes... ");
+    
+    char dir[64];
+    make_temp_dir(dir, sizeof(dir));
+    
+    history_t history;
+    assert(history_open(&history, dir) == 0);
+    history.segment_bytes = 4096; /* Several sealed segments */
+    
+    history_record_t rec;
+    for (int i = 1; i <= 1000; i++) {
+        fill_record(&rec, "alice", "lookup");
+        assert(history_append(&history, &rec, NULL) == 0);
+    }
+    assert(history.num_segments > 2);
+    size_t num_segments = history.num_segments;
+    history_close(&history);
+    
+    /* Reopen: nothing is read until a retention pass looks at the segments */
+    assert(history_open(&history, dir) == 0);
+    assert(history.next_seq == 1001);
+    assert(history.num_segments == num_segments);
+    assert(history.segments[0].meta_loaded == 0);
+    
+    history_retention_t by_age = {100, 0};
+    assert(history_expire(&history, &by_age, 1050) == 0);
+    assert(history.segments[0].meta_loaded == 1);
+    assert(history.segments[0].first_seq == 1);
+    assert(history.segments[1].first_seq == history.segments[0].last_seq + 1);
+    
+    history_close(&history);
+    remove_temp_dir(dir);
+    printf("PASSED\n");
+}
+
+/* Test that recovery after a crash only needs the tail past the checkpoint */
+void test_history_checkpoint_recovery() {
+    printf("Testing history checkpoint recovery... ");
+    
+    char dir[64];
+    make_temp_dir(dir, sizeof(dir));
+    
+    history_t history;
+    assert(history_open(&history, dir) == 0);
+    history_record_t rec;
+    for (int i = 0; i < 100; i++) {
+        fill_record(&rec, "alice", "before checkpoint");
+        assert(history_append(&history, &rec, NULL) == 0);
+    }
+    assert(history_checkpoint(&history) == 0);
+    
+    uint64_t last_offset;
+    for (int i = 0; i < 30; i++) {
+        fill_record(&rec, "bob", "after checkpoint");
+        assert(history_append(&history, &rec, &last_offset) == 0);
+    }
+    abandon_history(&history);
+    
+    assert(history_open(&history, dir) == 0);
+    assert(history.next_seq == 131);
+    assert(history.active_count == 130);
+    
+    assert(history_read(&history, last_offset, &rec) == 0);
+    assert(rec.seq == 130);
+    
+    /* New appends continue where the crashed process stopped */
+    fill_record(&rec, "carol", "after restart");
+    assert(history_append(&history, &rec, NULL) == 0);
+    assert(rec.seq == 131);
+    
+    history_close(&history);
+    remove_temp_dir(dir);
+    printf("PASSED\n");
+}
+
+/* Test that one group commit covers every append made before it */
+void test_group_commit_sync() {
+    printf("Testing group commit sync... ");
+    
+    durability_mode_t mode;
+    assert(durability_mode_parse("write-behind", &mode) == 0);
+    assert(mode == DURABILITY_WRITE_BEHIND);
+    assert(durability_mode_parse("sync", &mode) == 0);
+    assert(mode == DURABILITY_SYNC);
+    assert(durability_mode_parse("always", &mode) == -1);
+    
+    char dir[64];
+    make_temp_dir(dir, sizeof(dir));
+    
+    history_t history;
+    assert(history_open(&history, dir) == 0);
+    history.segment_bytes = 4096;
+    
+    group_commit_t gc;
+    assert(group_commit_start(&gc, &history, DURABILITY_SYNC) == 0);
+    assert(group_commit_fd(&gc) != -1);
+    
+    /* A batch spanning a segment roll */
+    history_record_t rec;
+    for (int i = 0; i < 200; i++) {
+        fill_record(&rec, "alice", "durable message");
+        assert(history_append(&history, &rec, NULL) == 0);
+    }
+    assert(history.num_segments > 1);
+    assert(history.synced_end < history_end_offset(&history));
+    
+    group_commit_request(&gc);
+    struct pollfd pfd = {group_commit_fd(&gc), POLLIN, 0};
+    assert(poll(&pfd, 1, 5000) == 1);
+    assert(group_commit_complete(&gc) == 0);
+    assert(history.synced_end == history_end_offset(&history));
+    assert(gc.syncs == 1);
+    
+    group_commit_stop(&gc);
+    history_close(&history);
+    
+    /* None mode starts no thread */
+    assert(history_open(&history, dir) == 0);
+    assert(history.synced_end == history_end_offset(&history));
+    assert(group_commit_start(&gc, &history, DURABILITY_NONE) == 0);
+    assert(group_commit_fd(&gc) == -1);
+    group_commit_stop(&gc);
+    history_close(&history);
+    
+    remove_temp_dir(dir);
+    printf("PASSED\n");
+}
+
+/* Run all history tests */
+/* Index handed over by the compactor */
+typedef struct {
+    search_index_t *index;
+    uint64_t indexed_end;
+} installed_index_t;
+
+static void capture_index(search_index_t *index, uint64_t indexed_end, void *arg) {
+    installed_index_t *installed = arg;
+    installed->index = index;
+    installed->indexed_end = indexed_end;
+}
+
+/* Test that an index rebuilt while a commit is in flight leaves its batch out */
+void test_compactor_held_delivery() {
+    printf("Testing index rebuild during a commit... ");
+    
+    char dir[64];
+    make_temp_dir(dir, sizeof(dir));
+    
+    history_t history;
+    assert(history_open(&history, dir) == 0);
+    history_hold_delivery(&history);
+    
+    history_record_t rec;
+    for (int i = 0; i < 10; i++) {
+        fill_record(&rec, "alice", "delivered message");
+        assert(history_append(&history, &rec, NULL) == 0);
+    }
+    uint64_t delivered = history_end_offset(&history);
+    history_deliver(&history, delivered);
+    
+    /* A batch still waiting for its sync */
+    uint64_t pending;
+    fill_record(&rec, "bob", "pending message");
+    assert(history_append(&history, &rec, &pending) == 0);
+    for (int i = 0; i < 4; i++) {
+        fill_record(&rec, "bob", "pending message");
+        assert(history_append(&history, &rec, NULL) == 0);
+    }
+    assert(history_delivered_offset(&history) == delivered);
+    
+    history_retention_t keep_all = {0, 0};
+    compactor_t compactor;
+    assert(compactor_start(&compactor, &history, &keep_all, 60, 0) == 0);
+    installed_index_t installed = {NULL, 0};
+    for (int i = 0; i < 500 && !compactor_poll(&compactor, capture_index, &installed); i++) {
+        poll(NULL, 0, 10);
+    }
+    compactor_stop(&compactor);
+    assert(installed.index != NULL);
+    assert(installed.indexed_end == delivered);
+    
+    uint64_t hits[16];
+    assert(search_index_query(installed.index, "delivered", 9, hits, 16) == 10);
+    assert(search_index_query(installed.index, "pending", 7, hits, 16) == 0);
+    
+    /* The sync fails and the batch is rolled back */
+    assert(history_rollback(&history, pending) == 0);
+    assert(history_delivered_offset(&history) == delivered);
+    
+    search_index_free(installed.index);
+    free(installed.index);
+    history_close(&history);
+    remove_temp_dir(dir);
+    printf("PASSED\n");
+}
+
+int test_history_main(void) {
+    printf("\n=== Running History Tests ===\n\n");
+    
+    test_search_index_query();
+    test_search_index_growth();
+    test_history_append_read();
+    test_history_torn_tail();
+    test_history_expire();
+    test_history_lazy_index();
+    test_history_rollback();
+    test_history_checkpoint_recovery();
+    test_group_commit_sync();
+    test_compactor_held_delivery();
+    
+    printf("\n=== All History Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file test_hitters.c
+ * @brief Unit tests for heavy-hitter detection
+ */
+
+#include "hitters.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define S(str) str, strlen(str)
+
+/* Test that a few heavy keys are found among many light ones */
+void test_hitters_top() {
+    printf("Testing heavy-hitter top-K... ");
+
+    static hitters_t hitters;
+    hitters_init(&hitters);
+
+    /* 5000 senders with one message each, interleaved with 5 bots */
+    char key[32];
+    for (int i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "user%d", i);
+        hitters_add(&hitters, key, strlen(key), 1);
+        if (i % 10 == 0) {
+            snprintf(key, sizeof(key), "bot%d", i / 10 % 5);
+            hitters_add(&hitters, key, strlen(key), 1);
+        }
+    }
+    hitters_add(&hitters, S("bot0"), 400);
+    assert(hitters.total == 5000 + 500 + 400);
+
+    hitter_t top[HITTERS_TOP_K];
+    int n = hitters_top(&hitters, top);
+    assert(n == HITTERS_TOP_K);
+    assert(top[0].key_len == 4 && memcmp(top[0].key, "bot0", 4) == 0);
+    for (int i = 1; i < 5; i++) {
+        assert(top[i].key_len == 4 && memcmp(top[i].key, "bot", 3) == 0);
+        assert(top[i].estimate >= 100 && top[i].estimate <= top[i - 1].estimate);
+    }
+
+    /* Estimates never fall below the true count */
+    assert(hitters_estimate(&hitters, S("bot0")) >= 500);
+    assert(hitters_estimate(&hitters, S("user42")) >= 1);
+    assert(hitters_estimate(&hitters, S("user42")) < 50);
+
+    printf("PASSED\n");
+}
+
+/* Test decay and rendering */
+void test_hitters_decay() {
+    printf("Testing heavy-hitter decay... ");
+
+    static hitters_t hitters;
+    hitters_init(&hitters);
+    hitters_add(&hitters, S("old"), 100);
+    hitters_decay(&hitters);
+    hitters_decay(&hitters);
+    assert(hitters_estimate(&hitters, S("old")) == 25);
+
+    /* New traffic overtakes decayed traffic */
+    hitters_add(&hitters, S("new"), 30);
+    hitter_t top[HITTERS_TOP_K];
+    assert(hitters_top(&hitters, top) == 2);
+    assert(top[0].key_len == 3 && memcmp(top[0].key, "new", 3) == 0);
+
+    hitters_add(&hitters, S("say \"hi\"\\"), 1);
+    char out[512];
+    int len = hitters_render(&hitters, "m", "k", out, sizeof(out));
+    assert(len > 0 && (size_t)len == strlen(out));
+    assert(strcmp(out, "m{rank=\"1\",k=\"new\"} 30\n"
+                       "m{rank=\"2\",k=\"old\"} 25\n"
+                       "m{rank=\"3\",k=\"say \\\"hi\\\"\\\\\"} 1\n") == 0);
+    assert(hitters_render(&hitters, "m", "k", out, 20) == -1);
+
+    printf("PASSED\n");
+}
+
+/* Run all heavy-hitter tests */
+int test_hitters_main(void) {
+    printf("\n=== Running Heavy-Hitter Tests ===\n\n");
+
+    test_hitters_top();
+    test_hitters_decay();
+
+    printf("\n=== All Heavy-Hitter Tests Passed ===\n\n");
+    return 0;
+}
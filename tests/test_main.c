@@ -7,6 +7,26 @@
 
 /* External test functions */
 extern int test_protocol_main(void);
+extern int test_dedup_main(void);
+extern int test_history_main(void);
+extern int test_frame_parser_main(void);
+extern int test_websocket_main(void);
+extern int test_sse_main(void);
+extern int test_relay_main(void);
+extern int test_multicast_main(void);
+extern int test_fanout_main(void);
+extern int test_slotset_main(void);
+extern int test_topic_trie_main(void);
+extern int test_content_filter_main(void);
+extern int test_utf8_main(void);
+extern int test_plugin_host_main(void);
+extern int test_admin_main(void);
+extern int test_hitters_main(void);
+extern int test_ephemeral_main(void);
+extern int test_reactions_main(void);
+extern int test_transfer_main(void);
+extern int test_qos_main(void);
+extern int test_frame_main(void);
 
 int main() {
     printf("\n╔════════════════════════════════════════╗\n");
@@ -16,6 +36,66 @@ int main() {
     /* Run protocol tests */
     int result = test_protocol_main();
     
+    /* Run deduplication tests */
+    result |= test_dedup_main();
+    
+    /* Run history and search tests */
+    result |= test_history_main();
+    
+    /* Run incremental frame parser tests */
+    result |= test_frame_parser_main();
+    
+    /* Run WebSocket tests */
+    result |= test_websocket_main();
+    
+    /* Run SSE tests */
+    result |= test_sse_main();
+    
+    /* Run relay tests */
+    result |= test_relay_main();
+    
+    /* Run multicast tests */
+    result |= test_multicast_main();
+    
+    /* Run fan-out tests */
+    result |= test_fanout_main();
+    
+    /* Run slot set tests */
+    result |= test_slotset_main();
+    
+    /* Run topic tests */
+    result |= test_topic_trie_main();
+    
+    /* Run content filter tests */
+    result |= test_content_filter_main();
+    
+    /* Run UTF-8 tests */
+    result |= test_utf8_main();
+    
+    /* Run plugin tests */
+    result |= test_plugin_host_main();
+    
+    /* Run admin endpoint tests */
+    result |= test_admin_main();
+    
+    /* Run heavy-hitter tests */
+    result |= test_hitters_main();
+    
+    /* Run ephemeral signal tests */
+    result |= test_ephemeral_main();
+    
+    /* Run reaction tests */
+    result |= test_reactions_main();
+    
+    /* Run file transfer tests */
+    result |= test_transfer_main();
+    
+    /* Run QoS tests */
+    result |= test_qos_main();
+    
+    /* Run C++ frame schema tests */
+    result |= test_frame_main();
+    
     if (result == 0) {
         printf("\n✓ All tests passed!\n\n");
     } else {
@@ -24,10 +104,3 @@ int main() {
     
     return result;
 }
-
-/* Wrapper to run the test_protocol tests */
-int test_protocol_main(void) {
-    /* Include the test_protocol.c file to run its tests */
-    extern int main();
-    return 0; /* test_protocol.c will handle its own assertions */
-}
@@ -0,0 +1,241 @@
+/**
+ * @file test_multicast.c
+ * @brief Unit tests for sequenced multicast and NAK-based repair
+ */
+
+#include "multicast.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Frames delivered so far, in order */
+typedef struct {
+    uint8_t data[65536];
+    size_t len;
+    int packets;
+} delivered_t;
+
+static int collect(const uint8_t *frames, size_t len, void *arg) {
+    delivered_t *out = arg;
+    assert(out->len + len <= sizeof(out->data));
+    memcpy(out->data + out->len, frames, len);
+    out->len += len;
+    out->packets++;
+    return 0;
+}
+
+/* Build a JOIN frame whose username encodes n */
+static size_t make_frame(uint8_t *buf, int n) {
+    char name[16];
+    snprintf(name, sizeof(name), "user%04d", n);
+    return (size_t)encode_peer_frame(buf, PEER_FRAME_HEADER + 16, MSG_TYPE_JOIN, 0, 0, name,
+                                     NULL, 0);
+}
+
+/* Publisher and subscriber joined on loopback */
+static void open_pair(mcast_publisher_t *pub, mcast_subscriber_t *sub) {
+    struct in_addr loopback = {htonl(INADDR_LOOPBACK)};
+    struct sockaddr_in group;
+    memset(&group, 0, sizeof(group));
+    group.sin_family = AF_INET;
+    inet_pton(AF_INET, "239.255.42.99", &group.sin_addr);
+
+    /* Let the subscriber pick a free port, then publish to it */
+    assert(mcast_subscriber_open(sub, &group, loopback, 1) == 0);
+    socklen_t len = sizeof(group);
+    assert(getsockname(sub->fd, (struct sockaddr *)&group, &len) == 0);
+    inet_pton(AF_INET, "239.255.42.99", &group.sin_addr);
+    assert(mcast_publisher_open(pub, &group, loopback) == 0);
+}
+
+/* Receive until the subscriber has delivered up to seq */
+static void receive_until(mcast_subscriber_t *sub, uint64_t seq, delivered_t *out) {
+    while (sub->next_seq <= seq) {
+        struct pollfd pfd = {sub->fd, POLLIN, 0};
+        assert(poll(&pfd, 1, 1000) == 1);
+        assert(mcast_receive(sub, collect, out) == 0);
+    }
+}
+
+/* Test in-order delivery, and packing of a batch into several packets */
+void test_multicast_delivery() {
+    printf("Testing multicast delivery... ");
+
+    mcast_publisher_t pub;
+    mcast_subscriber_t sub;
+    open_pair(&pub, &sub);
+    delivered_t *out = calloc(1, sizeof(*out));
+
+    uint8_t frame[64];
+    size_t len = make_frame(frame, 1);
+    assert(mcast_publish(&pub, frame, len, 0) == 0);
+    assert(pub.next_seq == 2);
+    receive_until(&sub, 1, out);
+    assert(out->packets == 1 && out->len == len && memcmp(out->data, frame, len) == 0);
+
+    /* A batch larger than a packet is split between whole frames */
+    uint8_t batch[8192];
+    size_t batch_len = 0;
+    for (int i = 0; i < 200; i++) {
+        batch_len += make_frame(batch + batch_len, i);
+    }
+    assert(mcast_publish(&pub, batch, batch_len, 0) == 0);
+    uint64_t last = pub.next_seq - 1;
+    assert(last > 2);
+    receive_until(&sub, last, out);
+    assert(out->len == len + batch_len);
+    assert(memcmp(out->data + len, batch, batch_len) == 0);
+
+    /* Frames are never split across packets */
+    size_t packet_len;
+    const uint8_t *packet = mcast_lookup(&pub, 2, &packet_len);
+    assert(packet && packet_len <= MCAST_MAX_PACKET - MCAST_HEADER_LEN);
+    assert(packet_len % len == 0);
+
+    free(out);
+    mcast_subscriber_close(&sub);
+    mcast_publisher_close(&pub);
+
+    printf("PASSED\n");
+}
+
+/* Test holding early packets, NAK ranges and repairs */
+void test_multicast_repair() {
+    printf("Testing multicast repair... ");
+
+    mcast_publisher_t pub;
+    mcast_subscriber_t sub;
+    open_pair(&pub, &sub);
+    delivered_t *out = calloc(1, sizeof(*out));
+
+    uint8_t frame[64];
+    size_t len = make_frame(frame, 7);
+
+    /* Packets 3 and 5 arrive, 1, 2 and 4 are missing */
+    assert(mcast_accept(&sub, 3, frame, len, collect, out) == 0);
+    assert(mcast_accept(&sub, 5, frame, len, collect, out) == 0);
+    assert(out->packets == 0);
+
+    uint64_t first;
+    uint32_t count;
+    assert(mcast_next_nak(&sub, 1000, &first, &count) == 1);
+    assert(first == 1 && count == 2);
+
+    /* No repeat until the retry interval has passed */
+    assert(mcast_next_nak(&sub, 1000 + MCAST_NAK_RETRY_MS - 1, &first, &count) == 0);
+    assert(mcast_next_nak(&sub, 1000 + MCAST_NAK_RETRY_MS, &first, &count) == 1);
+    assert(first == 1 && count == 2);
+
+    /* Repairs release the held packet behind them */
+    assert(mcast_accept(&sub, 2, frame, len, collect, out) == 0);
+    assert(out->packets == 0);
+    assert(mcast_accept(&sub, 1, frame, len, collect, out) == 0);
+    assert(out->packets == 3 && sub.next_seq == 4);
+
+    /* A packet reported lost is skipped */
+    assert(mcast_next_nak(&sub, 2000, &first, &count) == 1);
+    assert(first == 4 && count == 1);
+    assert(mcast_accept(&sub, 4, NULL, 0, collect, out) == 0);
+    assert(out->packets == 4 && sub.next_seq == 6);
+    assert(mcast_next_nak(&sub, 3000, &first, &count) == 0);
+
+    /* Duplicates are ignored */
+    assert(mcast_accept(&sub, 5, frame, len, collect, out) == 0);
+    assert(out->packets == 4);
+
+    free(out);
+    mcast_subscriber_close(&sub);
+    mcast_publisher_close(&pub);
+
+    printf("PASSED\n");
+}
+
+/* Test that a heartbeat reveals a lost last packet */
+void test_multicast_heartbeat() {
+    printf("Testing multicast heartbeat... ");
+
+    mcast_publisher_t pub;
+    mcast_subscriber_t sub;
+    open_pair(&pub, &sub);
+    delivered_t *out = calloc(1, sizeof(*out));
+
+    /* Packet 1 is lost, so only the heartbeat tells of it */
+    uint8_t frame[64];
+    size_t len = make_frame(frame, 3);
+    struct pollfd pfd = {sub.fd, POLLIN, 0};
+    assert(mcast_publish(&pub, frame, len, 5000) == 0);
+    assert(poll(&pfd, 1, 1000) == 1);
+    sub.drop_every = 1;
+    assert(mcast_receive(&sub, collect, out) == 0);
+    sub.drop_every = 0;
+    assert(sub.horizon == 1);
+
+    mcast_heartbeat(&pub, 5000 + MCAST_HEARTBEAT_MS - 1);
+    mcast_heartbeat(&pub, 5000 + MCAST_HEARTBEAT_MS);
+    assert(poll(&pfd, 1, 1000) == 1);
+    assert(mcast_receive(&sub, collect, out) == 0);
+    assert(sub.horizon == 2 && out->packets == 0);
+
+    uint64_t first;
+    uint32_t count;
+    assert(mcast_next_nak(&sub, 0, &first, &count) == 1);
+    assert(first == 1 && count == 1);
+
+    size_t repair_len;
+    const uint8_t *repair = mcast_lookup(&pub, first, &repair_len);
+    assert(repair && repair_len == len);
+    assert(mcast_accept(&sub, first, repair, repair_len, collect, out) == 0);
+    assert(out->packets == 1 && memcmp(out->data, frame, len) == 0);
+
+    free(out);
+    mcast_subscriber_close(&sub);
+    mcast_publisher_close(&pub);
+
+    printf("PASSED\n");
+}
+
+/* Test that only the most recent packets can be repaired */
+void test_multicast_ring() {
+    printf("Testing multicast ring... ");
+
+    mcast_publisher_t pub;
+    mcast_subscriber_t sub;
+    open_pair(&pub, &sub);
+    mcast_subscriber_close(&sub);
+
+    uint8_t frame[64];
+    size_t len = make_frame(frame, 9);
+    for (int i = 0; i < MCAST_RING_PACKETS + 10; i++) {
+        assert(mcast_publish(&pub, frame, len, 0) == 0);
+    }
+
+    size_t out_len;
+    assert(mcast_lookup(&pub, 0, &out_len) == NULL);
+    assert(mcast_lookup(&pub, 10, &out_len) == NULL);
+    assert(mcast_lookup(&pub, 11, &out_len) != NULL && out_len == len);
+    assert(mcast_lookup(&pub, pub.next_seq - 1, &out_len) != NULL);
+    assert(mcast_lookup(&pub, pub.next_seq, &out_len) == NULL);
+
+    mcast_publisher_close(&pub);
+
+    printf("PASSED\n");
+}
+
+/* Run all multicast tests */
+int test_multicast_main(void) {
+    printf("\n=== Running Multicast Tests ===\n\n");
+
+    test_multicast_delivery();
+    test_multicast_repair();
+    test_multicast_heartbeat();
+    test_multicast_ring();
+
+    printf("\n=== All Multicast Tests Passed ===\n\n");
+    return 0;
+}
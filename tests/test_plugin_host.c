@@ -0,0 +1,145 @@
+/**
+ * @file test_plugin_host.c
+ * @brief Unit tests for message plugins
+ */
+
+#include "plugin_host.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Drops messages containing "drop", rewrites "old" to "new" */
+static chat_plugin_verdict_t edit_on_message(void *state, const chat_plugin_message_t *msg,
+                                             char *rewrite, size_t *rewrite_len) {
+    (void)state;
+    if (msg->payload_len == 4 && memcmp(msg->payload, "drop", 4) == 0) {
+        return CHAT_PLUGIN_DROP;
+    }
+    if (msg->payload_len == 3 && memcmp(msg->payload, "old", 3) == 0) {
+        memcpy(rewrite, "new", 3);
+        *rewrite_len = 3;
+        return CHAT_PLUGIN_REWRITE;
+    }
+    return CHAT_PLUGIN_ACCEPT;
+}
+
+/* Appends '!' to whatever it sees, to check chaining */
+static chat_plugin_verdict_t bang_on_message(void *state, const chat_plugin_message_t *msg,
+                                             char *rewrite, size_t *rewrite_len) {
+    (void)state;
+    memcpy(rewrite, msg->payload, msg->payload_len);
+    rewrite[msg->payload_len] = '!';
+    *rewrite_len = msg->payload_len + 1;
+    return CHAT_PLUGIN_REWRITE;
+}
+
+/* Rewrites to text that cannot go out in a frame */
+static chat_plugin_verdict_t broken_on_message(void *state, const chat_plugin_message_t *msg,
+                                               char *rewrite, size_t *rewrite_len) {
+    (void)state;
+    (void)msg;
+    memcpy(rewrite, "a\nb", 3);
+    *rewrite_len = 3;
+    return CHAT_PLUGIN_REWRITE;
+}
+
+static int init_calls = 0;
+
+static int counting_init(const char *arg, void **state) {
+    init_calls++;
+    *state = (void *)arg;
+    return arg && strcmp(arg, "fail") == 0 ? -1 : 0;
+}
+
+static const chat_plugin_t edit_plugin = {CHAT_PLUGIN_ABI_VERSION, "edit", counting_init,
+                                          edit_on_message, NULL};
+static const chat_plugin_t bang_plugin = {CHAT_PLUGIN_ABI_VERSION, "bang", NULL,
+                                          bang_on_message, NULL};
+static const chat_plugin_t broken_plugin = {CHAT_PLUGIN_ABI_VERSION, "broken", NULL,
+                                            broken_on_message, NULL};
+static const chat_plugin_t future_plugin = {CHAT_PLUGIN_ABI_VERSION + 1, "future", NULL,
+                                            edit_on_message, NULL};
+
+static chat_plugin_message_t message(const char *text) {
+    chat_plugin_message_t msg = {"alice", 5, "", 0, text, strlen(text), 0, 0};
+    return msg;
+}
+
+/* Test verdicts and chaining */
+void test_plugin_chain() {
+    printf("Testing plugin chain... ");
+
+    static plugin_host_t host;
+    plugin_host_init(&host, 1000000000);
+    assert(plugin_host_add(&host, &future_plugin, NULL, NULL) == -1);
+    assert(plugin_host_add(&host, &edit_plugin, NULL, "fail") == -1);
+    assert(plugin_host_add(&host, &edit_plugin, NULL, NULL) == 0);
+    assert(plugin_host_add(&host, &bang_plugin, NULL, NULL) == 0);
+    assert(host.num_plugins == 2 && init_calls == 2);
+
+    chat_plugin_message_t msg = message("hello");
+    assert(plugin_host_run(&host, &msg) == 0);
+    assert(msg.payload_len == 6 && memcmp(msg.payload, "hello!", 6) == 0);
+
+    /* The second plugin sees the first one's rewrite */
+    msg = message("old");
+    assert(plugin_host_run(&host, &msg) == 0);
+    assert(msg.payload_len == 4 && memcmp(msg.payload, "new!", 4) == 0);
+
+    /* A drop ends the chain */
+    msg = message("drop");
+    assert(plugin_host_run(&host, &msg) == 1);
+    assert(host.plugins[0].drops == 1 && host.plugins[1].calls == 2);
+    assert(host.plugins[0].rewrites == 1 && host.plugins[1].rewrites == 2);
+
+    plugin_host_free(&host);
+
+    printf("PASSED\n");
+}
+
+/* Test that bad rewrites are ignored and slow plugins are disabled */
+void test_plugin_limits() {
+    printf("Testing plugin limits... ");
+
+    static plugin_host_t host;
+    plugin_host_init(&host, 1000000000);
+    assert(plugin_host_add(&host, &broken_plugin, NULL, NULL) == 0);
+    chat_plugin_message_t msg = message("text");
+    assert(plugin_host_run(&host, &msg) == 0);
+    assert(msg.payload_len == 4 && memcmp(msg.payload, "text", 4) == 0);
+    assert(host.plugins[0].errors == 1 && host.plugins[0].rewrites == 0);
+    plugin_host_free(&host);
+
+    /* No call fits in a zero budget */
+    plugin_host_init(&host, 0);
+    assert(plugin_host_add(&host, &bang_plugin, NULL, NULL) == 0);
+    for (int i = 0; i < PLUGIN_MAX_OVERRUNS + 2; i++) {
+        msg = message("x");
+        plugin_host_run(&host, &msg);
+    }
+    assert(host.plugins[0].disabled);
+    assert(host.plugins[0].calls == PLUGIN_MAX_OVERRUNS);
+    assert(host.plugins[0].overruns == PLUGIN_MAX_OVERRUNS);
+    assert(msg.payload_len == 1);
+
+    char out[1024];
+    int len = plugin_host_render_metrics(&host, out, sizeof(out));
+    assert(len > 0 && (size_t)len == strlen(out));
+    assert(strstr(out, "chat_plugin_overruns_total{plugin=\"bang\"} 8\n"));
+    assert(strstr(out, "chat_plugin_disabled{plugin=\"bang\"} 1\n"));
+    assert(plugin_host_render_metrics(&host, out, 32) == -1);
+    plugin_host_free(&host);
+
+    printf("PASSED\n");
+}
+
+/* Run all plugin tests */
+int test_plugin_host_main(void) {
+    printf("\n=== Running Plugin Tests ===\n\n");
+
+    test_plugin_chain();
+    test_plugin_limits();
+
+    printf("\n=== All Plugin Tests Passed ===\n\n");
+    return 0;
+}
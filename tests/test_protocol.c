@@ -32,6 +32,23 @@ void test_bytes_to_hex() {
     printf("PASSED\n");
 }
 
+/* Test hex_to_u64 function */
+void test_hex_to_u64() {
+    printf("Testing hex_to_u64... ");
+    
+    uint64_t value;
+    assert(hex_to_u64("00000000deadBEEF", 16, &value) == 0);
+    assert(value == 0xDEADBEEFULL);
+    
+    /* Invalid digit */
+    assert(hex_to_u64("12g4", 4, &value) == -1);
+    
+    /* Too long for 64 bits */
+    assert(hex_to_u64("00000000000000000", 17, &value) == -1);
+    
+    printf("PASSED\n");
+}
+
 /* Test message header initialization */
 void test_init_msg_header() {
     printf("Testing init_msg_header... ");
@@ -62,14 +79,50 @@ void test_protocol_constants() {
     printf("PASSED\n");
 }
 
-/* Run all tests */
-int main() {
+/* Test registration status values and their descriptions */
+void test_register_status() {
+    printf("Testing register_status_str... ");
+    
+    /* Status bytes must never be mistaken for the frame terminator */
+    assert(REGISTER_OK != '\n' && REGISTER_INVALID != '\n' && REGISTER_TAKEN != '\n');
+    
+    assert(strcmp(register_status_str(REGISTER_OK), "accepted") == 0);
+    assert(strcmp(register_status_str(REGISTER_TAKEN), "username already in use") == 0);
+    assert(strcmp(register_status_str(200), "rejected") == 0);
+    
+    printf("PASSED\n");
+}
+
+/* Test client HELLO encoding */
+void test_encode_client_hello() {
+    printf("Testing encode_client_hello... ");
+    
+    uint8_t buf[HELLO_CLIENT_LEN + 1];
+    int len = encode_client_hello(buf, FEATURE_ACKS | FEATURE_SENDER_IDS);
+    assert(len == HELLO_CLIENT_LEN);
+    assert(buf[0] == MSG_TYPE_HELLO);
+    assert(buf[1] == PROTOCOL_VERSION && buf[1] != '\n');
+    assert(buf[len - 1] == '\n');
+    assert(memchr(buf, '\n', len - 1) == NULL);
+    
+    uint64_t features;
+    assert(hex_to_u64((const char *)buf + 2, 8, &features) == 0);
+    assert(features == (FEATURE_ACKS | FEATURE_SENDER_IDS));
+    
+    printf("PASSED\n");
+}
+
+/* Run all protocol tests */
+int test_protocol_main(void) {
     printf("\n=== Running Protocol Tests ===\n\n");
     
     test_bytes_to_hex();
+    test_hex_to_u64();
     test_init_msg_header();
     test_protocol_constants();
+    test_register_status();
+    test_encode_client_hello();
     
-    printf("\n=== All Tests Passed ===\n\n");
+    printf("\n=== All Protocol Tests Passed ===\n\n");
     return 0;
 }
@@ -0,0 +1,199 @@
+/**
+ * @file test_qos.c
+ * @brief Unit tests for room QoS classes
+ */
+
+#include "qos.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_SLOTS 8
+#define FRAME_LEN 512
+
+/* Recording sink: busy[] marks recipients whose socket is full, broken[]
+ * those whose writes fail, got[] counts the bytes written to each per class
+ * (first byte of the frame) and last[] holds the second byte of the last
+ * frame each received */
+typedef struct {
+    int busy[NUM_SLOTS];
+    int broken[NUM_SLOTS];
+    size_t got[QOS_NUM_CLASSES][NUM_SLOTS];
+    uint8_t last[NUM_SLOTS];
+} recorder_t;
+
+static int busy(size_t recipient, void *arg) {
+    return ((recorder_t *)arg)->busy[recipient];
+}
+
+static int deliver(size_t recipient, const uint8_t *frame, size_t len, void *arg) {
+    recorder_t *rec = arg;
+    if (rec->broken[recipient]) {
+        return -1;
+    }
+    rec->got[frame[0]][recipient] += len;
+    rec->last[recipient] = frame[1];
+    return 0;
+}
+
+/* Test rules assigning rooms to classes */
+void test_qos_rules() {
+    printf("Testing QoS class rules... ");
+
+    static qos_t qos;
+    qos_init(&qos, NUM_SLOTS);
+    assert(qos_add_rule(&qos, "interactive:bots.humans") == 0);
+    assert(qos_add_rule(&qos, "bot:bots.#") == 0);
+    assert(qos_add_rule(&qos, "bulk:logs.*") == 0);
+    assert(qos_add_rule(&qos, "fast:chat") == -1);
+    assert(qos_add_rule(&qos, "bot") == -1);
+    assert(qos_add_rule(&qos, "bot:a..b") == -1);
+
+    /* First matching rule wins; anything else is interactive */
+    assert(qos_classify(&qos, "bots.ci", 7) == QOS_BOT);
+    assert(qos_classify(&qos, "bots", 4) == QOS_BOT);
+    assert(qos_classify(&qos, "bots.humans", 11) == QOS_INTERACTIVE);
+    assert(qos_classify(&qos, "logs.web", 8) == QOS_BULK);
+    assert(qos_classify(&qos, "logs.web.err", 12) == QOS_INTERACTIVE);
+    assert(strcmp(qos_class_name(QOS_BULK), "bulk") == 0);
+
+    qos_free(&qos);
+    printf("PASSED\n");
+}
+
+/* Test that the queues share each pass by their weights */
+void test_qos_shares() {
+    printf("Testing QoS deficit round robin... ");
+
+    static qos_t qos;
+    recorder_t rec;
+    memset(&rec, 0, sizeof(rec));
+    qos_sink_t sink = {busy, deliver, &rec};
+    qos_init(&qos, NUM_SLOTS);
+    slotset_t everyone;
+    slotset_init(&everyone, NUM_SLOTS);
+    for (size_t i = 0; i < 4; i++) {
+        slotset_add(&everyone, i);
+    }
+
+    uint8_t frame[QOS_NUM_CLASSES][FRAME_LEN];
+    for (int c = 0; c < QOS_NUM_CLASSES; c++) {
+        memset(frame[c], c, FRAME_LEN);
+    }
+    assert(qos_enqueue(&qos, QOS_INTERACTIVE, frame[0], FRAME_LEN, &everyone) == -1);
+    assert(!qos_pending(&qos));
+    for (int i = 0; i < 200; i++) {
+        assert(qos_enqueue(&qos, QOS_BULK, frame[QOS_BULK], FRAME_LEN, &everyone) == 0);
+        assert(qos_enqueue(&qos, QOS_BOT, frame[QOS_BOT], FRAME_LEN, &everyone) == 0);
+    }
+    assert(qos.queues[QOS_BOT].queued == 200 * FRAME_LEN);
+
+    /* Both busy: bulk gets three parts to the bots' one, within a pass */
+    size_t written = qos_flush(&qos, 64 * 1024, &sink);
+    assert(written >= 64 * 1024 && written < 64 * 1024 + QOS_QUANTUM * QOS_BULK_SHARE);
+    assert(rec.got[QOS_BULK][0] == 3 * rec.got[QOS_BOT][0]);
+    assert(rec.got[QOS_BULK][0] == rec.got[QOS_BULK][3]);
+
+    /* Once bulk is empty the bots get everything */
+    while (qos.queues[QOS_BULK].head) {
+        qos_flush(&qos, 64 * 1024, &sink);
+    }
+    size_t bot_before = rec.got[QOS_BOT][0];
+    qos_flush(&qos, 64 * 1024, &sink);
+    assert(rec.got[QOS_BOT][0] - bot_before == 64 * 1024 / 4);
+    while (qos_pending(&qos)) {
+        qos_flush(&qos, 64 * 1024, &sink);
+    }
+    assert(rec.got[QOS_BULK][1] == 200 * FRAME_LEN && rec.got[QOS_BOT][1] == 200 * FRAME_LEN);
+    assert(qos.queues[QOS_BOT].sent == 4 * 200 * FRAME_LEN);
+    assert(qos.queues[QOS_BOT].queued == 0 && qos.queues[QOS_BOT].deficit == 0);
+
+    slotset_free(&everyone);
+    qos_free(&qos);
+    printf("PASSED\n");
+}
+
+/* Test busy recipients, departed slots and the queue limit */
+void test_qos_limits() {
+    printf("Testing QoS busy recipients and limits... ");
+
+    static qos_t qos;
+    recorder_t rec;
+    memset(&rec, 0, sizeof(rec));
+    qos_sink_t sink = {busy, deliver, &rec};
+    qos_init(&qos, NUM_SLOTS);
+    slotset_t everyone;
+    slotset_init(&everyone, NUM_SLOTS);
+    for (size_t i = 0; i < 4; i++) {
+        slotset_add(&everyone, i);
+    }
+    uint8_t frame[FRAME_LEN];
+    memset(frame, QOS_BOT, sizeof(frame));
+
+    /* A recipient whose socket is full keeps the frame queued, and only
+     * the copies written are charged; one that left is no longer a
+     * recipient, and one whose write fails loses the frame */
+    rec.busy[1] = 1;
+    rec.broken[3] = 1;
+    frame[1] = 1;
+    assert(qos_enqueue(&qos, QOS_BOT, frame, FRAME_LEN, &everyone) == 0);
+    frame[1] = 2;
+    assert(qos_enqueue(&qos, QOS_BOT, frame, FRAME_LEN, &everyone) == 0);
+    qos_forget(&qos, 2);
+    assert(qos.queues[QOS_BOT].head->cost == 3 * FRAME_LEN);
+    assert(qos_flush(&qos, QOS_PASS_BYTES, &sink) == 2 * FRAME_LEN);
+    assert(rec.got[QOS_BOT][0] == 2 * FRAME_LEN && rec.last[0] == 2);
+    assert(rec.got[QOS_BOT][1] == 0 && rec.got[QOS_BOT][2] == 0);
+    assert(qos.queues[QOS_BOT].dropped == 2);
+    assert(qos_pending(&qos) && qos.queues[QOS_BOT].queued == 2 * FRAME_LEN);
+    assert(qos.queues[QOS_BOT].head->cost == FRAME_LEN);
+    assert(qos.queues[QOS_BOT].deficit == 0);
+
+    /* Nothing is written while it stays busy; once its socket drains it
+     * gets both frames, in order */
+    assert(qos_flush(&qos, QOS_PASS_BYTES, &sink) == 0);
+    rec.busy[1] = 0;
+    assert(qos.queues[QOS_BOT].head->data[1] == 1);
+    assert(qos_flush(&qos, QOS_PASS_BYTES, &sink) == 2 * FRAME_LEN);
+    assert(rec.got[QOS_BOT][1] == 2 * FRAME_LEN && rec.last[1] == 2);
+    assert(!qos_pending(&qos) && qos.queues[QOS_BOT].queued == 0);
+    assert(qos.queues[QOS_BOT].dropped == 2);
+
+    /* A full queue drops its oldest frames for the busy recipient */
+    rec.busy[1] = 1;
+    rec.broken[3] = 0;
+    for (size_t i = 0; i < QOS_MAX_QUEUED / FRAME_LEN; i++) {
+        assert(qos_enqueue(&qos, QOS_BOT, frame, FRAME_LEN, &everyone) == 0);
+    }
+    qos_flush(&qos, QOS_MAX_QUEUED * 4, &sink);
+    assert(qos.queues[QOS_BOT].queued == QOS_MAX_QUEUED);
+    assert(qos.queues[QOS_BOT].dropped == 2);
+    assert(qos_enqueue(&qos, QOS_BOT, frame, FRAME_LEN, &everyone) == 0);
+    assert(qos_enqueue(&qos, QOS_BOT, frame, FRAME_LEN, &everyone) == 0);
+    assert(qos.queues[QOS_BOT].queued == QOS_MAX_QUEUED);
+    assert(qos.queues[QOS_BOT].dropped == 2 + 2);
+    assert(qos_enqueue(&qos, QOS_BOT, frame, QOS_MAX_QUEUED + 1, &everyone) == -1);
+    assert(qos.queues[QOS_BOT].dropped == 2 + 2 + 4);
+
+    char out[1024];
+    int len = qos_render(&qos, out, sizeof(out));
+    assert(len > 0 && strstr(out, "chat_qos_dropped_total{class=\"bot\"} 8\n"));
+    assert(qos_render(&qos, out, 16) == -1);
+
+    slotset_free(&everyone);
+    qos_free(&qos);
+    assert(!qos_pending(&qos));
+    printf("PASSED\n");
+}
+
+/* Run all QoS tests */
+int test_qos_main(void) {
+    printf("\n=== Running QoS Tests ===\n\n");
+
+    test_qos_rules();
+    test_qos_shares();
+    test_qos_limits();
+
+    printf("\n=== All QoS Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file test_reactions.c
+ * @brief Unit tests for aggregated reactions
+ */
+
+#include "protocol.h"
+#include "reactions.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define S(str) str, strlen(str)
+
+static uint64_t get_u64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = v << 8 | p[i];
+    }
+    return v;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/* Test that many reactions collapse into one frame per changed counter */
+void test_reactions_batch() {
+    printf("Testing reaction batching... ");
+
+    static reactions_t reactions;
+    reactions_init(&reactions, 1024);
+    assert(reactions_next_message(&reactions) == 0);
+    assert(reactions_next_message(&reactions) == 1);
+    assert(reactions_wait_ms(&reactions, 0) == -1);
+
+    /* A thousand users click on message 1, a few on message 0 */
+    for (size_t slot = 0; slot < 1000; slot++) {
+        assert(reactions_apply(&reactions, slot, 1, 1, S("+1")) == 1);
+    }
+    assert(reactions_apply(&reactions, 7, 1, 1, S("+1")) == 0);
+    assert(reactions_apply(&reactions, 3, 0, 1, S("\xf0\x9f\x8e\x89")) == 1);
+    assert(reactions_apply(&reactions, 4, 0, 1, S("ok")) == 1);
+    assert(reactions_apply(&reactions, 4, 0, 0, S("ok")) == 1);
+    assert(reactions_apply(&reactions, 5, 0, 0, S("ok")) == 0);
+    assert(reactions.applied == 1003);
+
+    uint8_t out[512];
+    assert(reactions_wait_ms(&reactions, 1000) == 0);
+    size_t len = reactions_flush(&reactions, 1000, out, sizeof(out));
+    assert(reactions.updates == 2);
+    assert(len == 2 * REACTION_COUNT_HEADER + 4 + 2 + 2);
+
+    /* Message 0 comes first; "ok" was added and taken back, so it is not sent */
+    const uint8_t *frame = out;
+    assert(frame[0] == MSG_TYPE_REACTION_COUNT && get_u64(frame + 1) == 0);
+    assert(get_u32(frame + 9) == 1 && frame[13] == 4);
+    frame += REACTION_COUNT_HEADER + 4 + 1;
+    assert(get_u64(frame + 1) == 1 && get_u32(frame + 9) == 1000);
+    assert(memcmp(frame + 14, "+1\n", 3) == 0);
+
+    /* Nothing changed since, and the next batch waits for the interval */
+    assert(reactions_wait_ms(&reactions, 1000) == -1);
+    assert(reactions_apply(&reactions, 1000, 1, 1, S("+1")) == 1);
+    assert(reactions_wait_ms(&reactions, 1100) == REACTIONS_INTERVAL_MS - 100);
+    assert(reactions_flush(&reactions, 1100, out, sizeof(out)) == 0);
+
+    /* Counters that do not fit wait for the next batch */
+    assert(reactions_apply(&reactions, 1, 0, 1, S("ok")) == 1);
+    len = reactions_flush(&reactions, 1250, out, REACTION_COUNT_HEADER + 3);
+    assert(len == REACTION_COUNT_HEADER + 3 && get_u64(out + 1) == 0);
+    len = reactions_flush(&reactions, 1500, out, sizeof(out));
+    assert(get_u64(out + 1) == 1 && get_u32(out + 9) == 1001);
+    assert(reactions_wait_ms(&reactions, 1500) == -1);
+
+    reactions_free(&reactions);
+    printf("PASSED\n");
+}
+
+/* Test the window of recent messages and the per-message limits */
+void test_reactions_window() {
+    printf("Testing reaction window and limits... ");
+
+    static reactions_t reactions;
+    reactions_init(&reactions, 64);
+
+    /* Unknown and expired messages are rejected */
+    assert(reactions_apply(&reactions, 0, 0, 1, S("+1")) == -1);
+    for (int i = 0; i < REACTIONS_MAX_MESSAGES; i++) {
+        reactions_next_message(&reactions);
+    }
+    assert(reactions_apply(&reactions, 0, 0, 1, S("+1")) == 1);
+    reactions_next_message(&reactions);
+    assert(reactions_apply(&reactions, 0, 0, 1, S("+1")) == -1);
+
+    /* The new message in the reused slot starts from zero */
+    uint64_t seq = REACTIONS_MAX_MESSAGES;
+    assert(reactions_apply(&reactions, 0, seq, 1, S("+1")) == 1);
+    uint8_t out[256];
+    size_t len = reactions_flush(&reactions, 0, out, sizeof(out));
+    assert(len == REACTION_COUNT_HEADER + 3);
+    assert(get_u64(out + 1) == seq && get_u32(out + 9) == 1);
+
+    /* Distinct reactions per message and their length are bounded */
+    char text[2] = {'a', 0};
+    for (int k = 0; k < REACTIONS_MAX_KINDS - 1; k++) {
+        text[0] = (char)('a' + k);
+        assert(reactions_apply(&reactions, 1, seq, 1, text, 1) == 1);
+    }
+    assert(reactions_apply(&reactions, 1, seq, 1, S("z")) == -1);
+    assert(reactions_apply(&reactions, 1, seq, 1, S("+1")) == 1);
+    assert(reactions_apply(&reactions, 1, seq, 1, S("0123456789abcdefX")) == -1);
+
+    /* A new connection in a departed user's slot may react again */
+    reactions_forget(&reactions, 1);
+    assert(reactions_apply(&reactions, 1, seq, 1, S("+1")) == 1);
+    reactions_flush(&reactions, 1000, out, sizeof(out));
+    const uint8_t *frame = out;
+    while (memcmp(frame + 14, "+1", 2) != 0) {
+        frame += REACTION_COUNT_HEADER + frame[13] + 1;
+    }
+    assert(get_u32(frame + 9) == 3);
+
+    reactions_free(&reactions);
+    printf("PASSED\n");
+}
+
+/* Run all reaction tests */
+int test_reactions_main(void) {
+    printf("\n=== Running Reaction Tests ===\n\n");
+
+    test_reactions_batch();
+    test_reactions_window();
+
+    printf("\n=== All Reaction Tests Passed ===\n\n");
+    return 0;
+}
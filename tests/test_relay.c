@@ -0,0 +1,223 @@
+/**
+ * @file test_relay.c
+ * @brief Unit tests for the relay node's upstream link
+ */
+
+#include "relay.h"
+#include "common.h"
+#include "frame_parser.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Frame length seen by the counting callback */
+static size_t last_frame_len;
+
+static int count_frame(const uint8_t *frame, size_t len, void *arg) {
+    (void)frame;
+    (*(int *)arg)++;
+    last_frame_len = len;
+    return 0;
+}
+
+/* Test attach and redirect frames, including bytes equal to '\n' */
+void test_relay_frames() {
+    printf("Testing relay frames... ");
+
+    uint8_t buf[RELAY_ATTACH_LEN + RELAY_REDIRECT_LEN];
+    assert(relay_encode_attach(buf, 9401) == RELAY_ATTACH_LEN);
+    assert(memcmp(buf + 1, "24b9\n", 5) == 0);
+
+    frame_parser_t parser;
+    int frames = 0;
+    frame_parser_init(&parser, FRAME_TO_SERVER);
+    assert(frame_parser_feed(&parser, buf, RELAY_ATTACH_LEN, count_frame, &frames) == 0);
+    assert(frames == 1 && last_frame_len == RELAY_ATTACH_LEN);
+
+    /* 10.0.0.10 port 10: three bytes of the frame are '\n' */
+    int len = relay_encode_redirect(buf, htonl(0x0a00000a), htons(10));
+    assert(len == RELAY_REDIRECT_LEN);
+    frames = 0;
+    frame_parser_init(&parser, FRAME_TO_CLIENT);
+    for (int i = 0; i < len; i++) {
+        assert(frame_parser_feed(&parser, buf + i, 1, count_frame, &frames) == 0);
+    }
+    assert(frames == 1 && last_frame_len == RELAY_REDIRECT_LEN);
+
+    printf("PASSED\n");
+}
+
+/* Read what the link wrote to the parent */
+static size_t read_upstream(int fd, char *out, size_t cap) {
+    ssize_t n = read(fd, out, cap - 1);
+    assert(n > 0);
+    out[n] = '\0';
+    return (size_t)n;
+}
+
+/* Test the route lifecycle and the frames sent for it */
+void test_relay_routes() {
+    printf("Testing relay routes... ");
+
+    relay_link_t link;
+    assert(relay_link_init(&link) == 0);
+    int pair[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+    link.fd = pair[0];
+
+    char out[256];
+    uint16_t first, second;
+    relay_route_t owner = {3, 0, 0, RELAY_ROUTE_FREE};
+    assert(relay_open(&link, &owner, "alice", &first) == 0);
+    assert(read_upstream(pair[1], out, sizeof(out)) == 12);
+    assert(memcmp(out, "\x0a" "0000\x05" "alice\n", 12) == 0);
+
+    relay_route_t session_owner = {4, 0x1234, 1, RELAY_ROUTE_FREE};
+    assert(relay_open(&link, &session_owner, "bob", &second) == 0);
+    assert(second == first + 1);
+    read_upstream(pair[1], out, sizeof(out));
+
+    /* Leaving before the answer keeps the ID reserved until it arrives */
+    relay_close(&link, first);
+    assert(read_upstream(pair[1], out, sizeof(out)) == 6);
+    assert(memcmp(out, "\x0d" "0000\n", 6) == 0);
+    assert(link.routes[first].state == RELAY_ROUTE_ABANDONED);
+    relay_route_t route;
+    assert(relay_settle(&link, first, REGISTER_OK, &route) == 0);
+    assert(link.routes[first].state == RELAY_ROUTE_FREE);
+
+    /* A live answer reaches its owner */
+    assert(relay_settle(&link, second, REGISTER_OK, &route) == 1);
+    assert(route.client == 4 && route.is_session && route.session == 0x1234);
+    assert(link.routes[second].state == RELAY_ROUTE_OPEN);
+    assert(relay_settle(&link, second, REGISTER_OK, &route) == 0);
+    memset(&route, 0, sizeof(route));
+    assert(relay_route(&link, second, &route) == 1);
+    assert(route.client == 4 && route.is_session && route.session == 0x1234);
+    assert(relay_route(&link, first, &route) == 0);
+
+    assert(relay_chat(&link, second, 0xabc, "hey", 3) == 0);
+    read_upstream(pair[1], out, sizeof(out));
+    assert(strcmp(out, "\x0c" "0001" "0000000000000abc" "hey\n") == 0);
+
+    relay_close(&link, second);
+    read_upstream(pair[1], out, sizeof(out));
+    assert(link.routes[second].state == RELAY_ROUTE_FREE);
+    assert(relay_route(&link, second, &route) == 0);
+
+    /* Released IDs are not handed out again right away */
+    uint16_t third;
+    assert(relay_open(&link, &owner, "carol", &third) == 0);
+    assert(third == second + 1);
+
+    close(pair[1]);
+    relay_link_free(&link);
+
+    printf("PASSED\n");
+}
+
+/* Two fake parents: the first redirects to the second, which accepts */
+typedef struct {
+    int listeners[2];
+    uint16_t ports[2];
+} fake_tree_t;
+
+static void *serve_fake_tree(void *arg) {
+    fake_tree_t *tree = arg;
+
+    for (int i = 0; i < 2; i++) {
+        int fd = accept(tree->listeners[i], NULL, NULL);
+        assert(fd != -1);
+        uint8_t request[HELLO_CLIENT_LEN + RELAY_ATTACH_LEN];
+        assert(recv_exact(fd, request, sizeof(request)) == (ssize_t)sizeof(request));
+        assert(request[HELLO_CLIENT_LEN] == MSG_TYPE_RELAY_ATTACH);
+
+        uint8_t reply[HELLO_SERVER_LEN + RELAY_REDIRECT_LEN + PEER_FRAME_HEADER + 8];
+        uint32_t features_net = htonl(RELAY_FEATURES);
+        reply[0] = MSG_TYPE_HELLO;
+        reply[1] = PROTOCOL_VERSION;
+        memcpy(reply + 2, &features_net, 4);
+        reply[6] = '\n';
+        size_t len = HELLO_SERVER_LEN;
+        if (i == 0) {
+            len += relay_encode_redirect(reply + len, htonl(INADDR_LOOPBACK), tree->ports[1]);
+        } else {
+            /* A broadcast right behind the answer stays on the socket */
+            len += relay_encode_redirect(reply + len, 0, 0);
+            len += encode_peer_frame(reply + len, sizeof(reply) - len, MSG_TYPE_JOIN, 0, 0,
+                                     "dora", NULL, 0);
+        }
+        assert(send_exact(fd, reply, len) == (ssize_t)len);
+
+        if (i == 0) {
+            close(fd);
+        } else {
+            /* Wait for the relay to hang up */
+            char byte;
+            while (read(fd, &byte, 1) > 0) {
+            }
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+/* Test attaching through a redirect */
+void test_relay_attach() {
+    printf("Testing relay attach... ");
+
+    fake_tree_t tree;
+    struct sockaddr_in addr;
+    for (int i = 0; i < 2; i++) {
+        tree.listeners[i] = socket(AF_INET, SOCK_STREAM, 0);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        assert(bind(tree.listeners[i], (struct sockaddr *)&addr, sizeof(addr)) == 0);
+        assert(listen(tree.listeners[i], 1) == 0);
+        socklen_t addr_len = sizeof(addr);
+        getsockname(tree.listeners[i], (struct sockaddr *)&addr, &addr_len);
+        tree.ports[i] = addr.sin_port;
+    }
+
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, serve_fake_tree, &tree) == 0);
+
+    relay_link_t link;
+    assert(relay_link_init(&link) == 0);
+    addr.sin_port = tree.ports[0];
+    assert(relay_attach(&link, &addr, 9401) == 0);
+    assert(link.parent.sin_port == tree.ports[1]);
+
+    struct pollfd pfd = {link.fd, POLLIN, 0};
+    assert(poll(&pfd, 1, 1000) == 1);
+    uint8_t buf[64];
+    ssize_t n = read(link.fd, buf, sizeof(buf));
+    assert(n == PEER_FRAME_HEADER + 4 + 1 && buf[0] == MSG_TYPE_JOIN);
+
+    relay_link_free(&link);
+    pthread_join(thread, NULL);
+    close(tree.listeners[0]);
+    close(tree.listeners[1]);
+
+    printf("PASSED\n");
+}
+
+/* Run all relay tests */
+int test_relay_main(void) {
+    printf("\n=== Running Relay Tests ===\n\n");
+
+    test_relay_frames();
+    test_relay_routes();
+    test_relay_attach();
+
+    printf("\n=== All Relay Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file test_slotset.c
+ * @brief Unit tests for bitmap slot sets
+ */
+
+#include "slotset.h"
+#include <assert.h>
+#include <stdio.h>
+
+/* Test adding, removing and lazy allocation */
+void test_slotset_basic() {
+    printf("Testing slot set basics... ");
+
+    slotset_t set;
+    slotset_init(&set, 130);
+    assert(set.words == NULL && slotset_empty(&set) && slotset_count(&set) == 0);
+    assert(!slotset_contains(&set, 5));
+    slotset_remove(&set, 5);
+    assert(slotset_next(&set, 0) == -1);
+
+    assert(slotset_add(&set, 0) == 0);
+    assert(slotset_add(&set, 64) == 0);
+    assert(slotset_add(&set, 129) == 0);
+    assert(slotset_add(&set, 130) == -1);
+    assert(slotset_contains(&set, 64) && !slotset_contains(&set, 63));
+    assert(!slotset_empty(&set) && slotset_count(&set) == 3);
+
+    slotset_remove(&set, 64);
+    assert(!slotset_contains(&set, 64));
+    slotset_clear(&set);
+    assert(slotset_empty(&set));
+
+    slotset_free(&set);
+    assert(set.words == NULL && slotset_empty(&set));
+
+    printf("PASSED\n");
+}
+
+/* Test iteration across word boundaries */
+void test_slotset_next() {
+    printf("Testing slot set iteration... ");
+
+    slotset_t set;
+    slotset_init(&set, 200);
+    size_t slots[] = {1, 63, 64, 127, 128, 199};
+    for (size_t i = 0; i < sizeof(slots) / sizeof(slots[0]); i++) {
+        assert(slotset_add(&set, slots[i]) == 0);
+    }
+
+    size_t seen = 0;
+    for (long s = slotset_next(&set, 0); s != -1; s = slotset_next(&set, (size_t)s + 1)) {
+        assert((size_t)s == slots[seen]);
+        seen++;
+    }
+    assert(seen == sizeof(slots) / sizeof(slots[0]));
+    assert(slotset_next(&set, 65) == 127);
+    assert(slotset_next(&set, 200) == -1);
+
+    slotset_free(&set);
+
+    printf("PASSED\n");
+}
+
+/* Test "registered AND NOT muted" and unions */
+void test_slotset_ops() {
+    printf("Testing slot set operations... ");
+
+    slotset_t registered, muted, out;
+    slotset_init(&registered, 100);
+    slotset_init(&muted, 100);
+    slotset_init(&out, 100);
+    for (size_t i = 0; i < 100; i += 3) {
+        assert(slotset_add(&registered, i) == 0);
+    }
+
+    /* Nobody muted: everyone registered */
+    assert(slotset_andnot(&out, &registered, &muted) == 0);
+    for (size_t i = 0; i < 100; i++) {
+        assert(slotset_contains(&out, i) == (i % 3 == 0));
+    }
+
+    assert(slotset_add(&muted, 3) == 0);
+    assert(slotset_add(&muted, 4) == 0);
+    assert(slotset_add(&muted, 99) == 0);
+    assert(slotset_andnot(&out, &registered, &muted) == 0);
+    assert(!slotset_contains(&out, 3) && !slotset_contains(&out, 99));
+    assert(slotset_contains(&out, 0) && slotset_contains(&out, 6));
+    assert(!slotset_contains(&out, 4));
+
+    /* In place */
+    assert(slotset_andnot(&registered, &registered, &muted) == 0);
+    assert(!slotset_contains(&registered, 3) && slotset_contains(&registered, 96));
+
+    slotset_t all;
+    slotset_init(&all, 100);
+    assert(slotset_or(&all, &muted) == 0);
+    assert(slotset_or(&all, &registered) == 0);
+    assert(slotset_contains(&all, 4) && slotset_contains(&all, 96) && slotset_contains(&all, 99));
+
+    slotset_free(&registered);
+    slotset_free(&muted);
+    slotset_free(&out);
+    slotset_free(&all);
+
+    printf("PASSED\n");
+}
+
+/* Run all slot set tests */
+int test_slotset_main(void) {
+    printf("\n=== Running Slot Set Tests ===\n\n");
+
+    test_slotset_basic();
+    test_slotset_next();
+    test_slotset_ops();
+
+    printf("\n=== All Slot Set Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file test_sse.c
+ * @brief Unit tests for the Server-Sent Events stream
+ */
+
+#include "sse.h"
+#include "protocol.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Test request matching, including split reads and rejected paths */
+void test_sse_request() {
+    printf("Testing SSE request matching... ");
+
+    const char *request = "GET /events?room=main HTTP/1.1\r\nHost: x\r\nAccept: text/event-stream\r\n\r\n";
+    sse_viewer_t viewer;
+    memset(&viewer, 0, sizeof(viewer));
+    size_t len = strlen(request);
+    for (size_t i = 0; i + 1 < len; i++) {
+        assert(sse_request_feed(&viewer, (const uint8_t *)request + i, 1) == 0);
+    }
+    assert(sse_request_feed(&viewer, (const uint8_t *)request + len - 1, 1) == 1);
+
+    const char *bad[] = {"GET /eventsx HTTP/1.1\r\n\r\n", "POST /events HTTP/1.1\r\n\r\n",
+                         "GET / HTTP/1.1\r\n\r\n"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        memset(&viewer, 0, sizeof(viewer));
+        assert(sse_request_feed(&viewer, (const uint8_t *)bad[i], strlen(bad[i])) == -1);
+    }
+
+    printf("PASSED\n");
+}
+
+/* Test event rendering and JSON escaping */
+void test_sse_render() {
+    printf("Testing SSE event rendering... ");
+
+    uint8_t frame[BUF_SIZE];
+    char out[4096];
+    const char *text = "say \"hi\"\\\t";
+    int len = encode_peer_frame(frame, sizeof(frame), MSG_TYPE_CHAT, htonl(0x7f000001),
+                                htons(5000), "alice", text, strlen(text));
+    int n = sse_render_frame(frame, (size_t)len, out, sizeof(out));
+    assert(n > 0 && (size_t)n == strlen(out));
+    assert(strcmp(out, "event: chat\ndata: {\"user\":\"alice\",\"addr\":\"127.0.0.1:5000\","
+                       "\"text\":\"say \\\"hi\\\"\\\\\\u0009\"}\n\n") == 0);
+
+    len = encode_peer_frame(frame, sizeof(frame), MSG_TYPE_DISCONNECT, htonl(0x0a000001),
+                            htons(80), "bob", NULL, 0);
+    n = sse_render_frame(frame, (size_t)len, out, sizeof(out));
+    assert(n > 0);
+    assert(strcmp(out, "event: leave\ndata: {\"user\":\"bob\",\"addr\":\"10.0.0.1:80\"}\n\n") == 0);
+
+    /* Frames viewers do not see, and output that does not fit */
+    uint8_t ack[] = {MSG_TYPE_REGISTER_ACK, REGISTER_OK, '\n'};
+    assert(sse_render_frame(ack, sizeof(ack), out, sizeof(out)) == 0);
+    assert(sse_render_frame(frame, (size_t)len, out, 16) == -1);
+
+    printf("PASSED\n");
+}
+
+/* Test that one broadcast reaches every streaming viewer */
+void test_sse_broadcast() {
+    printf("Testing SSE broadcast... ");
+
+    sse_hub_t hub;
+    assert(sse_hub_init(&hub, 4) == 0);
+
+    int pairs[2][2];
+    for (int i = 0; i < 2; i++) {
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) == 0);
+        int slot = sse_add_viewer(&hub, pairs[i][0], 0);
+        assert(slot == i);
+        const char *request = "GET /events HTTP/1.1\r\n\r\n";
+        assert(write(pairs[i][1], request, strlen(request)) == (ssize_t)strlen(request));
+        sse_handle_input(&hub, slot);
+        assert(hub.viewers[slot].streaming);
+    }
+
+    /* Two frames in one broadcast, as after a group commit */
+    uint8_t frames[2 * BUF_SIZE];
+    int len = encode_peer_frame(frames, sizeof(frames), MSG_TYPE_JOIN, 0, 0, "carol", NULL, 0);
+    len += encode_peer_frame(frames + len, sizeof(frames) - (size_t)len, MSG_TYPE_CHAT, 0, 0,
+                             "carol", "hey", 3);
+    sse_broadcast(&hub, frames, (size_t)len);
+
+    for (int i = 0; i < 2; i++) {
+        char buf[1024];
+        ssize_t n = read(pairs[i][1], buf, sizeof(buf) - 1);
+        assert(n > 0);
+        buf[n] = '\0';
+        assert(strstr(buf, "HTTP/1.1 200 OK\r\n") == buf);
+        assert(strstr(buf, "Content-Type: text/event-stream\r\n"));
+        char *join = strstr(buf, "event: join\n");
+        char *chat = strstr(buf, "event: chat\n");
+        assert(join && chat && join < chat);
+        assert(strstr(chat, "\"text\":\"hey\"}\n\n"));
+    }
+
+    /* A viewer that hangs up is released */
+    close(pairs[0][1]);
+    sse_handle_input(&hub, 0);
+    assert(hub.viewers[0].fd == -1 && hub.num_viewers == 1);
+
+    close(pairs[1][1]);
+    sse_hub_free(&hub);
+
+    printf("PASSED\n");
+}
+
+/* Test that viewers which never finish their request give their slots up */
+void test_sse_request_timeout() {
+    printf("Testing SSE request timeout... ");
+
+    sse_hub_t hub;
+    assert(sse_hub_init(&hub, 2) == 0);
+
+    /* One viewer sends half a request, the other never gets past it */
+    int pairs[2][2];
+    for (int i = 0; i < 2; i++) {
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i]) == 0);
+        assert(sse_add_viewer(&hub, pairs[i][0], 1000 + i) == i);
+    }
+    const char *partial = "GET /events HTTP/1.1\r\n";
+    assert(write(pairs[0][1], partial, strlen(partial)) == (ssize_t)strlen(partial));
+    sse_handle_input(&hub, 0);
+    assert(hub.num_pending == 2);
+
+    /* The first finishes in time and keeps streaming; the second does not */
+    sse_sweep(&hub, 1000 + SSE_REQUEST_TIMEOUT_SEC - 1);
+    assert(hub.num_viewers == 2);
+    assert(write(pairs[0][1], "\r\n", 2) == 2);
+    sse_handle_input(&hub, 0);
+    assert(hub.viewers[0].streaming && hub.num_pending == 1);
+    sse_sweep(&hub, 1001 + SSE_REQUEST_TIMEOUT_SEC);
+    assert(hub.viewers[0].fd != -1 && hub.viewers[1].fd == -1);
+    assert(hub.num_viewers == 1 && hub.num_pending == 0);
+    char byte;
+    assert(read(pairs[1][1], &byte, 1) == 0);
+
+    /* Its slot takes a new viewer */
+    close(pairs[1][1]);
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[1]) == 0);
+    assert(sse_add_viewer(&hub, pairs[1][0], 2000) == 1);
+
+    close(pairs[0][1]);
+    close(pairs[1][1]);
+    sse_hub_free(&hub);
+
+    printf("PASSED\n");
+}
+
+/* Run all SSE tests */
+int test_sse_main(void) {
+    printf("\n=== Running SSE Tests ===\n\n");
+
+    test_sse_request();
+    test_sse_render();
+    test_sse_broadcast();
+    test_sse_request_timeout();
+
+    printf("\n=== All SSE Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file test_topic_trie.c
+ * @brief Unit tests for wildcard topic subscriptions
+ */
+
+#include "topic_trie.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define S(str) str, strlen(str)
+
+/* Subscribers of a topic as a bit mask of the first 64 slots */
+static uint64_t match_mask(topic_trie_t *trie, const char *topic) {
+    const slotset_t *set = topic_trie_match(trie, topic, strlen(topic));
+    assert(set);
+    uint64_t mask = 0;
+    for (long i = slotset_next(set, 0); i != -1; i = slotset_next(set, (size_t)i + 1)) {
+        mask |= (uint64_t)1 << i;
+    }
+    return mask;
+}
+
+/* Test topic and pattern syntax */
+void test_topic_syntax() {
+    printf("Testing topic syntax... ");
+
+    assert(topic_name_valid(S("team.backend")));
+    assert(!topic_name_valid(S("")));
+    assert(!topic_name_valid(S("team..backend")));
+    assert(!topic_name_valid(S("team.")));
+    assert(!topic_name_valid(S("team.*")));
+    assert(!topic_name_valid(S("alerts.#")));
+
+    assert(topic_pattern_valid(S("team.*")));
+    assert(topic_pattern_valid(S("alerts.#")));
+    assert(topic_pattern_valid(S("#")));
+    assert(topic_pattern_valid(S("*.backend.*")));
+    assert(!topic_pattern_valid(S("alerts.#.disk")));
+    assert(!topic_pattern_valid(S("team.back*")));
+    assert(!topic_pattern_valid(S(".team")));
+
+    assert(topic_pattern_matches(S("team.*"), S("team.backend")));
+    assert(!topic_pattern_matches(S("team.*"), S("team")));
+    assert(!topic_pattern_matches(S("team.*"), S("team.backend.deploys")));
+    assert(topic_pattern_matches(S("alerts.#"), S("alerts")));
+    assert(topic_pattern_matches(S("alerts.#"), S("alerts.disk.full")));
+    assert(!topic_pattern_matches(S("alerts.#"), S("alert")));
+    assert(topic_pattern_matches(S("a.b"), S("a.b")));
+    assert(!topic_pattern_matches(S("a.b"), S("a.b.c")));
+    assert(!topic_pattern_matches(S("a.b.c"), S("a.b")));
+
+    printf("PASSED\n");
+}
+
+/* Test matching through the trie */
+void test_topic_match() {
+    printf("Testing topic matching... ");
+
+    topic_trie_t trie;
+    assert(topic_trie_init(&trie, 64) == 0);
+    assert(topic_trie_subscribe(&trie, S("team.backend.*"), 0) == 1);
+    assert(topic_trie_subscribe(&trie, S("alerts.#"), 1) == 1);
+    assert(topic_trie_subscribe(&trie, S("#"), 2) == 1);
+    assert(topic_trie_subscribe(&trie, S("*.backend.deploys"), 3) == 1);
+    assert(topic_trie_subscribe(&trie, S("team.backend.deploys"), 4) == 1);
+    assert(topic_trie_subscribe(&trie, S("team.backend.deploys"), 4) == 0);
+
+    assert(match_mask(&trie, "team.backend.deploys") == 0x1d);
+    assert(match_mask(&trie, "team.backend") == 0x04);
+    assert(match_mask(&trie, "alerts") == 0x06);
+    assert(match_mask(&trie, "alerts.disk.full") == 0x06);
+    assert(match_mask(&trie, "ops.backend.deploys") == 0x0c);
+
+    topic_trie_free(&trie);
+
+    printf("PASSED\n");
+}
+
+/* Test that cached results follow subscription changes */
+void test_topic_cache() {
+    printf("Testing topic cache invalidation... ");
+
+    topic_trie_t trie;
+    assert(topic_trie_init(&trie, 64) == 0);
+    assert(topic_trie_subscribe(&trie, S("team.*"), 0) == 1);
+    assert(match_mask(&trie, "team.backend") == 0x1);
+    assert(match_mask(&trie, "team.backend") == 0x1);
+    assert(trie.hits == 1 && trie.misses == 1);
+
+    /* Subscribing updates the cached entry in place */
+    assert(topic_trie_subscribe(&trie, S("team.#"), 1) == 1);
+    assert(topic_trie_subscribe(&trie, S("other"), 2) == 1);
+    assert(match_mask(&trie, "team.backend") == 0x3);
+    assert(trie.hits == 2);
+
+    /* Slot 1 still matches through another pattern after unsubscribing one */
+    assert(topic_trie_subscribe(&trie, S("*.backend"), 1) == 1);
+    assert(topic_trie_unsubscribe(&trie, S("team.#"), 1) == 1);
+    assert(topic_trie_unsubscribe(&trie, S("team.#"), 1) == 0);
+    assert(match_mask(&trie, "team.backend") == 0x3);
+    assert(topic_trie_unsubscribe(&trie, S("*.backend"), 1) == 1);
+    assert(match_mask(&trie, "team.backend") == 0x1);
+
+    /* Leaving removes every subscription and prunes the trie */
+    topic_trie_remove_slot(&trie, 0);
+    assert(match_mask(&trie, "team.backend") == 0);
+    topic_trie_remove_slot(&trie, 2);
+    assert(trie.root.num_children == 0);
+
+    topic_trie_free(&trie);
+
+    printf("PASSED\n");
+}
+
+/* Run all topic tests */
+int test_topic_trie_main(void) {
+    printf("\n=== Running Topic Tests ===\n\n");
+
+    test_topic_syntax();
+    test_topic_match();
+    test_topic_cache();
+
+    printf("\n=== All Topic Tests Passed ===\n\n");
+    return 0;
+}
@@ -0,0 +1,257 @@
+/**
+ * @file test_transfer.c
+ * @brief Unit tests for file transfers
+ */
+
+#include "transfer.h"
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define FILE_SIZE (3 * TRANSFER_CHUNK + 12345)
+
+/* Clock passed to the transfer code */
+static int64_t now_ms = 0;
+
+static int parse(const char *line, uint64_t *value) {
+    return transfer_parse_request(line, strlen(line), value);
+}
+
+/* Test request line parsing */
+void test_transfer_parse() {
+    printf("Testing transfer request parsing... ");
+
+    uint64_t value;
+    assert(parse("PUT 1048576", &value) == 1 && value == 1048576);
+    assert(parse("PUT 0", &value) == 1 && value == 0);
+    assert(parse("GET 00000000000000ff", &value) == 2 && value == 0xff);
+    assert(parse("PUT ", &value) == -1);
+    assert(parse("PUT -1", &value) == -1);
+    assert(parse("PUT 99999999999999999999", &value) == -1);
+    assert(parse("GET ff", &value) == -1);
+    assert(parse("GET 00000000000000fg", &value) == -1);
+    assert(parse("DELETE 00000000000000ff", &value) == -1);
+
+    printf("PASSED\n");
+}
+
+/* Run one round of the transfer connections' events; no event may move
+ * more than one chunk */
+static void pump(transfer_t *transfer) {
+    struct pollfd fds[TRANSFER_MAX_CONNS + 1];
+    fds[0].fd = transfer->listen_fd;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        fds[i + 1].fd = transfer->conns[i].fd;
+        fds[i + 1].events = transfer_poll_events(transfer, i);
+    }
+    assert(poll(fds, TRANSFER_MAX_CONNS + 1, 10) >= 0);
+    if (fds[0].revents & POLLIN) {
+        transfer_accept(transfer, now_ms);
+    }
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        if (fds[i + 1].revents && transfer->conns[i].fd != -1) {
+            uint64_t before = transfer->bytes_in + transfer->bytes_out;
+            transfer_handle_events(transfer, i, fds[i + 1].revents, now_ms);
+            assert(transfer->bytes_in + transfer->bytes_out - before <= TRANSFER_CHUNK);
+        }
+    }
+}
+
+static int connect_to(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = port};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+/* Send out while driving the server, then collect everything it sends
+ * until it closes the connection */
+static size_t exchange(transfer_t *transfer, int fd, const char *out, size_t out_len, char *in,
+                       size_t in_cap) {
+    size_t sent = 0;
+    size_t received = 0;
+    for (;;) {
+        if (sent < out_len) {
+            ssize_t n = send(fd, out + sent, out_len - sent, MSG_NOSIGNAL);
+            assert(n > 0 || errno == EAGAIN);
+            sent += n > 0 ? (size_t)n : 0;
+        }
+        pump(transfer);
+        ssize_t n = recv(fd, in + received, in_cap - received, 0);
+        if (n == 0) {
+            return received;
+        }
+        assert(n > 0 || errno == EAGAIN);
+        received += n > 0 ? (size_t)n : 0;
+    }
+}
+
+/* Test an upload and a download over loopback */
+void test_transfer_roundtrip() {
+    printf("Testing transfer upload and download... ");
+
+    char dir[] = "/tmp/test_transfer_XXXXXX";
+    assert(mkdtemp(dir));
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    assert(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listen_fd, 4) == 0);
+    assert(getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) == 0);
+
+    static transfer_t transfer;
+    assert(transfer_init(&transfer, -1, "/nonexistent/dir") == -1);
+    assert(transfer_init(&transfer, listen_fd, dir) == 0);
+
+    /* Upload a file several chunks long right behind the request line */
+    static char request[FILE_SIZE + 32];
+    int header = snprintf(request, 32, "PUT %d\n", FILE_SIZE);
+    for (int i = 0; i < FILE_SIZE; i++) {
+        request[header + i] = (char)(i * 7);
+    }
+    char reply[64] = {0};
+    int fd = connect_to(addr.sin_port);
+    size_t len = exchange(&transfer, fd, request, (size_t)header + FILE_SIZE, reply,
+                          sizeof(reply) - 1);
+    close(fd);
+    assert(len == 3 + 16 + 1 && memcmp(reply, "OK ", 3) == 0);
+    assert(transfer.uploads == 1 && transfer.bytes_in == FILE_SIZE);
+    char id[17];
+    memcpy(id, reply + 3, 16);
+    id[16] = '\0';
+
+    /* Download it back */
+    static char got[FILE_SIZE + 64];
+    char get[32];
+    snprintf(get, sizeof(get), "GET %s\n", id);
+    fd = connect_to(addr.sin_port);
+    len = exchange(&transfer, fd, get, strlen(get), got, sizeof(got));
+    close(fd);
+    int reply_len = snprintf(reply, sizeof(reply), "OK %d\n", FILE_SIZE);
+    assert(len == (size_t)reply_len + FILE_SIZE);
+    assert(memcmp(got, reply, (size_t)reply_len) == 0);
+    assert(memcmp(got + reply_len, request + header, FILE_SIZE) == 0);
+    assert(transfer.downloads == 1 && transfer.bytes_out == FILE_SIZE);
+
+    /* Unknown files, oversized uploads and junk are refused */
+    fd = connect_to(addr.sin_port);
+    len = exchange(&transfer, fd, "GET 0000000000000001\n", 21, reply, sizeof(reply));
+    close(fd);
+    assert(len == 14 && memcmp(reply, "ERR not found\n", 14) == 0);
+    snprintf(request, 32, "PUT %llu\n", TRANSFER_MAX_SIZE + 1);
+    fd = connect_to(addr.sin_port);
+    len = exchange(&transfer, fd, request, strlen(request), reply, sizeof(reply));
+    close(fd);
+    assert(len == 14 && memcmp(reply, "ERR too large\n", 14) == 0);
+    fd = connect_to(addr.sin_port);
+    len = exchange(&transfer, fd, "HELLO\n", 6, reply, sizeof(reply));
+    close(fd);
+    assert(len == 16 && memcmp(reply, "ERR bad request\n", 16) == 0);
+
+    /* An upload cut short leaves no file behind */
+    fd = connect_to(addr.sin_port);
+    assert(send(fd, "PUT 100\nabc", 11, 0) == 11);
+    for (int i = 0; i < 5; i++) {
+        pump(&transfer);
+    }
+    close(fd);
+    for (int i = 0; i < 5; i++) {
+        pump(&transfer);
+    }
+    
+    /* Once the stored files reach the limit, uploads are refused */
+    assert(transfer.stored_bytes == FILE_SIZE);
+    transfer.max_stored = FILE_SIZE + 99;
+    fd = connect_to(addr.sin_port);
+    len = exchange(&transfer, fd, "PUT 100\n", 8, reply, sizeof(reply));
+    close(fd);
+    assert(len == 9 && memcmp(reply, "ERR full\n", 9) == 0);
+    transfer_close(&transfer);
+    
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s", dir, id);
+    assert(unlink(path) == 0);
+    assert(rmdir(dir) == 0);
+    printf("PASSED\n");
+}
+
+/* Test that stalled connections are closed and their uploads deleted */
+void test_transfer_idle() {
+    printf("Testing transfer idle timeout... ");
+    
+    char dir[] = "/tmp/test_transfer_XXXXXX";
+    assert(mkdtemp(dir));
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    assert(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listen_fd, 4) == 0);
+    assert(getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) == 0);
+    
+    /* A partial upload left by an earlier run is deleted at startup */
+    char path[64];
+    snprintf(path, sizeof(path), "%s/00000000000000aa.part", dir);
+    int part = open(path, O_WRONLY | O_CREAT, 0644);
+    assert(part != -1 && write(part, "abc", 3) == 3);
+    close(part);
+    static transfer_t transfer;
+    assert(transfer_init(&transfer, listen_fd, dir) == 0);
+    assert(access(path, F_OK) == -1 && transfer.stored_bytes == 0);
+    
+    /* One connection says nothing, another stops part way through an upload */
+    now_ms = 1000;
+    int quiet = connect_to(addr.sin_port);
+    int stalled = connect_to(addr.sin_port);
+    assert(send(stalled, "PUT 100\nabc", 11, 0) == 11);
+    for (int i = 0; i < 5; i++) {
+        pump(&transfer);
+    }
+    int open_conns = 0;
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        open_conns += transfer.conns[i].fd != -1;
+    }
+    assert(open_conns == 2);
+    
+    transfer_sweep(&transfer, now_ms + TRANSFER_IDLE_MS - 1);
+    assert(transfer.conns[0].fd != -1 && transfer.conns[1].fd != -1);
+    transfer_sweep(&transfer, now_ms + TRANSFER_IDLE_MS);
+    for (int i = 0; i < TRANSFER_MAX_CONNS; i++) {
+        assert(transfer.conns[i].fd == -1);
+    }
+    
+    /* The server closed both; the partial file is gone */
+    char byte;
+    assert(recv(quiet, &byte, 1, 0) == 0);
+    assert(recv(stalled, &byte, 1, 0) <= 0);
+    close(quiet);
+    close(stalled);
+    transfer_close(&transfer);
+    assert(rmdir(dir) == 0);
+    now_ms = 0;
+    printf("PASSED\n");
+}
+
+/* Run all file transfer tests */
+int test_transfer_main(void) {
+    printf("\n=== Running File Transfer Tests ===\n\n");
+
+    test_transfer_parse();
+    test_transfer_roundtrip();
+    test_transfer_idle();
+
+    printf("\n=== All File Transfer Tests Passed ===\n\n");
+    return 0;
+}
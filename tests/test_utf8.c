@@ -0,0 +1,115 @@
+/**
+ * @file test_utf8.c
+ * @brief Unit tests for UTF-8 validation
+ */
+
+#include "utf8.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Both implementations must agree on every input */
+static int valid(const char *data, size_t len) {
+    int result = utf8_valid_scalar(data, len);
+    assert(utf8_valid(data, len) == result);
+    return result;
+}
+
+/* Check a sequence alone and at every offset around a 16-byte block boundary */
+static int valid_everywhere(const char *seq) {
+    size_t len = strlen(seq);
+    int result = valid(seq, len);
+    char buf[64];
+    for (size_t offset = 0; offset < 20; offset++) {
+        memset(buf, 'a', sizeof(buf));
+        memcpy(buf + offset, seq, len);
+        assert(valid(buf, offset + len) == result);
+        assert(valid(buf, sizeof(buf)) == result);
+    }
+    return result;
+}
+
+/* Test well-formed and malformed sequences */
+void test_utf8_sequences() {
+    printf("Testing UTF-8 sequences... ");
+
+    assert(valid("", 0));
+    assert(valid_everywhere("plain ascii"));
+    assert(valid_everywhere("caf\xc3\xa9"));                 /* U+00E9 */
+    assert(valid_everywhere("\xe2\x82\xac"));                /* U+20AC */
+    assert(valid_everywhere("\xf0\x9f\x98\x80"));            /* U+1F600 */
+    assert(valid_everywhere("\xed\x9f\xbf"));                /* U+D7FF */
+    assert(valid_everywhere("\xee\x80\x80"));                /* U+E000 */
+    assert(valid_everywhere("\xf4\x8f\xbf\xbf"));            /* U+10FFFF */
+    assert(valid_everywhere("\xc2\x80\xdf\xbf\xe0\xa0\x80")); /* Edges of each length */
+
+    assert(!valid_everywhere("\x80"));                       /* Lone continuation */
+    assert(!valid_everywhere("\xc3"));                       /* Truncated */
+    assert(!valid_everywhere("\xe2\x82"));
+    assert(!valid_everywhere("\xf0\x9f\x98"));
+    assert(!valid_everywhere("\xc3\xa9\xa9"));               /* Extra continuation */
+    assert(!valid_everywhere("\xc0\xaf"));                   /* Overlong */
+    assert(!valid_everywhere("\xc1\xbf"));
+    assert(!valid_everywhere("\xe0\x9f\xbf"));
+    assert(!valid_everywhere("\xf0\x8f\xbf\xbf"));
+    assert(!valid_everywhere("\xed\xa0\x80"));               /* Surrogates */
+    assert(!valid_everywhere("\xed\xbf\xbf"));
+    assert(!valid_everywhere("\xf4\x90\x80\x80"));           /* Above U+10FFFF */
+    assert(!valid_everywhere("\xf5\x80\x80\x80"));
+    assert(!valid_everywhere("\xff"));
+    assert(!valid_everywhere("\xe2\x82\x41"));               /* ASCII inside a sequence */
+
+    /* A sequence cut off exactly at a block boundary */
+    char block[32];
+    memset(block, 'a', sizeof(block));
+    memcpy(block + 14, "\xe2\x82\xac", 3);
+    assert(valid(block, 17));
+    assert(!valid(block, 16));
+
+    printf("PASSED\n");
+}
+
+/* Test random mixes of valid and damaged text against the scalar validator */
+void test_utf8_random() {
+    printf("Testing UTF-8 random inputs... ");
+
+    static const char *const pieces[] = {"a", "hello ", "\xc3\xa9", "\xe2\x82\xac",
+                                         "\xf0\x9f\x98\x80", "\xed\x9f\xbf", "\n"};
+    srand(11);
+    char text[256];
+    int seen_valid = 0;
+    int seen_invalid = 0;
+    for (int round = 0; round < 5000; round++) {
+        size_t len = 0;
+        size_t target = (size_t)(rand() % 200);
+        while (len < target) {
+            const char *piece = pieces[rand() % 7];
+            memcpy(text + len, piece, strlen(piece));
+            len += strlen(piece);
+        }
+        /* Damage some of them with a random byte */
+        if (len > 0 && rand() % 2) {
+            text[rand() % (int)len] = (char)(rand() % 256);
+        }
+        if (valid(text, len)) {
+            seen_valid++;
+        } else {
+            seen_invalid++;
+        }
+    }
+    assert(seen_valid > 1000 && seen_invalid > 1000);
+
+    printf("PASSED\n");
+}
+
+/* Run all UTF-8 tests */
+int test_utf8_main(void) {
+    printf("\n=== Running UTF-8 Tests ===\n\n");
+
+    test_utf8_sequences();
+    test_utf8_random();
+
+    printf("\n=== All UTF-8 Tests Passed ===\n\n");
+    return 0;
+}
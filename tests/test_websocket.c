@@ -0,0 +1,179 @@
+/**
+ * @file test_websocket.c
+ * @brief Unit tests for the WebSocket handshake and framing
+ */
+
+#include "websocket.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_MESSAGES 8
+
+/* Messages collected by the test handler */
+typedef struct {
+    uint8_t opcode[MAX_MESSAGES];
+    uint8_t payload[MAX_MESSAGES][WS_MAX_MESSAGE];
+    size_t len[MAX_MESSAGES];
+    int count;
+} ws_collected_t;
+
+static int collect_message(uint8_t opcode, const uint8_t *payload, size_t len, void *arg) {
+    ws_collected_t *c = arg;
+    assert(c->count < MAX_MESSAGES);
+    c->opcode[c->count] = opcode;
+    memcpy(c->payload[c->count], payload, len);
+    c->len[c->count] = len;
+    c->count++;
+    return 0;
+}
+
+/* Build a masked client frame */
+static size_t client_frame(uint8_t *out, int fin, uint8_t opcode, const void *payload, size_t len) {
+    static const uint8_t mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+    size_t pos = ws_frame_header(out, opcode, len);
+    if (!fin) {
+        out[0] &= 0x7f;
+    }
+    out[1] |= 0x80;
+    memcpy(out + pos, mask, 4);
+    pos += 4;
+    for (size_t i = 0; i < len; i++) {
+        out[pos + i] = ((const uint8_t *)payload)[i] ^ mask[i & 3];
+    }
+    return pos + len;
+}
+
+/* Test the upgrade handshake, including the RFC 6455 example key */
+void test_ws_handshake() {
+    printf("Testing WebSocket handshake... ");
+
+    char accept[WS_ACCEPT_LEN + 1];
+    const char *key = "dGhlIHNhbXBsZSBub25jZQ==";
+    ws_accept_key(key, strlen(key), accept);
+    assert(strcmp(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == 0);
+
+    static ws_conn_t ws;
+    ws_conn_init(&ws);
+    const char *request = "GET /chat HTTP/1.1\r\n"
+                          "Host: example.com\r\n"
+                          "upgrade: WebSocket\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Sec-WebSocket-Key:  dGhlIHNhbXBsZSBub25jZQ== \r\n"
+                          "Sec-WebSocket-Version: 13\r\n\r\n";
+    uint8_t stream[512];
+    size_t request_len = strlen(request);
+    memcpy(stream, request, request_len);
+    stream[request_len] = 0x81; /* First frame byte in the same read */
+
+    /* Split inside the terminating blank line */
+    char response[256];
+    size_t consumed;
+    assert(ws_handshake_feed(&ws, stream, request_len - 2, &consumed, response,
+                             sizeof(response)) == 0);
+    assert(consumed == request_len - 2 && !ws.open);
+    int n = ws_handshake_feed(&ws, stream + request_len - 2, 3, &consumed, response,
+                              sizeof(response));
+    assert(n > 0 && ws.open);
+    assert(consumed == 2);
+    assert(strstr(response, "HTTP/1.1 101 ") == response);
+    assert(strstr(response, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"));
+
+    /* Plain HTTP without an upgrade is refused */
+    ws_conn_init(&ws);
+    const char *plain = "GET / HTTP/1.1\r\nHost: x\r\n\r\n";
+    assert(ws_handshake_feed(&ws, (const uint8_t *)plain, strlen(plain), &consumed, response,
+                             sizeof(response)) == -1);
+
+    printf("PASSED\n");
+}
+
+/* Test decoding of masked, fragmented and interleaved frames */
+void test_ws_decode() {
+    printf("Testing WebSocket decoding... ");
+
+    static ws_conn_t ws;
+    static ws_collected_t c;
+    ws_conn_init(&ws);
+    memset(&c, 0, sizeof(c));
+
+    /* RFC 6455 section 5.7: masked "Hello" */
+    const uint8_t hello[] = {0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58};
+    assert(ws_decode(&ws, hello, sizeof(hello), collect_message, &c) == 0);
+    assert(c.count == 1 && c.opcode[0] == WS_OPCODE_TEXT);
+    assert(c.len[0] == 5 && memcmp(c.payload[0], "Hello", 5) == 0);
+
+    /* Fragmented binary message with a ping in between, fed byte by byte */
+    uint8_t stream[1024];
+    size_t len = client_frame(stream, 0, WS_OPCODE_BINARY, "abc", 3);
+    len += client_frame(stream + len, 1, WS_OPCODE_PING, "p", 1);
+    len += client_frame(stream + len, 1, WS_OPCODE_CONTINUATION, "def", 3);
+    for (size_t i = 0; i < len; i++) {
+        assert(ws_decode(&ws, stream + i, 1, collect_message, &c) == 0);
+    }
+    assert(c.count == 3);
+    assert(c.opcode[1] == WS_OPCODE_PING && c.len[1] == 1 && c.payload[1][0] == 'p');
+    assert(c.opcode[2] == WS_OPCODE_BINARY && c.len[2] == 6);
+    assert(memcmp(c.payload[2], "abcdef", 6) == 0);
+
+    /* 16-bit extended length */
+    static uint8_t big[300];
+    memset(big, 'z', sizeof(big));
+    len = client_frame(stream, 1, WS_OPCODE_BINARY, big, sizeof(big));
+    assert(stream[1] == (0x80 | 126));
+    assert(ws_decode(&ws, stream, len, collect_message, &c) == 0);
+    assert(c.count == 4 && c.len[3] == sizeof(big));
+    assert(memcmp(c.payload[3], big, sizeof(big)) == 0);
+
+    printf("PASSED\n");
+}
+
+/* Test protocol violations and server frame headers */
+void test_ws_errors() {
+    printf("Testing WebSocket errors and headers... ");
+
+    static ws_conn_t ws;
+    static ws_collected_t c;
+    uint8_t stream[64];
+
+    /* Unmasked client frame */
+    ws_conn_init(&ws);
+    size_t len = ws_frame_header(stream, WS_OPCODE_TEXT, 1);
+    stream[len++] = 'x';
+    assert(ws_decode(&ws, stream, len, collect_message, &c) == -1);
+
+    /* Continuation without a message */
+    ws_conn_init(&ws);
+    len = client_frame(stream, 1, WS_OPCODE_CONTINUATION, "x", 1);
+    assert(ws_decode(&ws, stream, len, collect_message, &c) == -1);
+
+    /* Message larger than WS_MAX_MESSAGE */
+    ws_conn_init(&ws);
+    len = ws_frame_header(stream, WS_OPCODE_BINARY, WS_MAX_MESSAGE + 1);
+    stream[1] |= 0x80;
+    memset(stream + len, 0, 4);
+    assert(ws_decode(&ws, stream, len + 4, collect_message, &c) == -1);
+
+    /* Server headers use the shortest length encoding and no mask */
+    assert(ws_frame_header(stream, WS_OPCODE_BINARY, 125) == 2);
+    assert(stream[0] == 0x82 && stream[1] == 125);
+    assert(ws_frame_header(stream, WS_OPCODE_BINARY, 126) == 4);
+    assert(stream[1] == 126 && stream[2] == 0 && stream[3] == 126);
+    assert(ws_frame_header(stream, WS_OPCODE_BINARY, 70000) == 10);
+    assert(stream[1] == 127 && stream[7] == 0x01 && stream[8] == 0x11 && stream[9] == 0x70);
+
+    printf("PASSED\n");
+}
+
+/* Run all WebSocket tests */
+int test_websocket_main(void) {
+    printf("\n=== Running WebSocket Tests ===\n\n");
+
+    test_ws_handshake();
+    test_ws_decode();
+    test_ws_errors();
+
+    printf("\n=== All WebSocket Tests Passed ===\n\n");
+    return 0;
+}